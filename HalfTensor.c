@@ -0,0 +1,110 @@
+#include "torch/utils.h"
+#include "THCl.h"
+#include "THFile.h"
+#include "THClStorageFile.h"
+#include "luaT.h"
+
+/* torch.ClHalfStorage and torch.ClHalfTensor: as the generic files, with
+   THClHalf* mapped onto THCl* by THClHalf.h */
+
+#define real float
+#define Real ClHalf
+
+#define THFile_readRealRaw(file, data, size)                            \
+  {                                                                     \
+    float *fdata = (float*)THAlloc(sizeof(float)*size);                 \
+    THFile_readFloatRaw(file, fdata, size);                             \
+    THFree(fdata);                                                      \
+  }
+
+#define THFile_writeRealRaw(file, data, size)                           \
+  {                                                                     \
+    float *fdata = (float*)THAlloc(sizeof(float)*size);                 \
+    THFile_writeFloatRaw(file, fdata, size);                            \
+    THFree(fdata);                                                      \
+  }
+
+#define torch_Storage_(NAME) TH_CONCAT_4(torch_,Real,Storage_,NAME)
+#define torch_Storage TH_CONCAT_STRING_3(torch.,Real,Storage)
+#define torch_Tensor_(NAME) TH_CONCAT_4(torch_,Real,Tensor_,NAME)
+#define torch_Tensor TH_CONCAT_STRING_3(torch.,Real,Tensor)
+
+#define TH_GENERIC_FILE "generic/Storage.c"
+#include "generic/Storage.c"
+#undef TH_GENERIC_FILE
+
+#define TH_GENERIC_FILE "generic/Tensor.c"
+#include "generic/Tensor.c"
+#undef TH_GENERIC_FILE
+
+#undef real
+#undef Real
+
+/* copy also takes a ClTensor, converting on the device */
+static int cltorch_ClHalfTensor_copy(lua_State *L)
+{
+  THClState *state = cltorch_getstate(L);
+  THClHalfTensor *tensor = luaT_checkudata(L, 1, "torch.ClHalfTensor");
+  void *src;
+  if( (src = luaT_toudata(L, 2, "torch.ClHalfTensor")) )
+    THClTensor_copy(state, tensor, src);
+  else if( (src = luaT_toudata(L, 2, "torch.ClTensor")) )
+    THClTensor_copy(state, tensor, src);
+  else if( (src = luaT_toudata(L, 2, "torch.ClByteTensor")) )
+    THClTensor_copy(state, tensor, src);
+  else if( (src = luaT_toudata(L, 2, "torch.ByteTensor")) )
+    THClTensor_copyByte(state, tensor, src);
+  else if( (src = luaT_toudata(L, 2, "torch.CharTensor")) )
+    THClTensor_copyChar(state, tensor, src);
+  else if( (src = luaT_toudata(L, 2, "torch.ShortTensor")) )
+    THClTensor_copyShort(state, tensor, src);
+  else if( (src = luaT_toudata(L, 2, "torch.IntTensor")) )
+    THClTensor_copyInt(state, tensor, src);
+  else if( (src = luaT_toudata(L, 2, "torch.LongTensor")) )
+    THClTensor_copyLong(state, tensor, src);
+  else if( (src = luaT_toudata(L, 2, "torch.FloatTensor")) )
+    THClTensor_copyFloat(state, tensor, src);
+  else if( (src = luaT_toudata(L, 2, "torch.DoubleTensor")) )
+    THClTensor_copyDouble(state, tensor, src);
+  else
+    luaL_typerror(L, 2, "torch.*Tensor");
+
+  lua_settop(L, 1);
+  return 1;
+}
+
+/* saved as floats, like a ClStorage */
+static int cltorch_ClHalfStorage_write(lua_State *L)
+{
+  THClHalfStorage *storage = luaT_checkudata(L, 1, "torch.ClHalfStorage");
+  THFile *file = luaT_checkudata(L, 2, "torch.File");
+  THClStorage_write(cltorch_getstate(L), storage, file);
+  return 0;
+}
+
+static int cltorch_ClHalfStorage_read(lua_State *L)
+{
+  THClHalfStorage *storage = luaT_checkudata(L, 1, "torch.ClHalfStorage");
+  THFile *file = luaT_checkudata(L, 2, "torch.File");
+  THClStorage_read(cltorch_getstate(L), storage, file);
+  return 0;
+}
+
+void cltorch_ClHalfTensor_init(lua_State* L)
+{
+  /* the standard stuff */
+  torch_ClHalfStorage_init(L);
+  torch_ClHalfTensor_init(L);
+
+  luaT_pushmetatable(L, "torch.ClHalfTensor");
+  lua_pushcfunction(L, cltorch_ClHalfTensor_copy);
+  lua_setfield(L, -2, "copy");
+  lua_pop(L, 1);
+
+  luaT_pushmetatable(L, "torch.ClHalfStorage");
+  lua_pushcfunction(L, cltorch_ClHalfStorage_write);
+  lua_setfield(L, -2, "write");
+  lua_pushcfunction(L, cltorch_ClHalfStorage_read);
+  lua_setfield(L, -2, "read");
+  lua_pop(L, 1);
+}
@@ -0,0 +1,61 @@
+-- cltorch.precompile(spec) builds kernels on a background thread, so that
+-- the first call of each op doesn't stall on OpenCL compilation.  spec is
+-- either the filename of a trace written by cltorch.saveKernelTrace() in an
+-- earlier run, or a list of signatures, eg
+--
+--   cltorch.precompile({
+--      {op='exp', ntensors=2, dims=3},
+--      {op='add', ntensors=2, dims=2, args={1}, layouts={'contiguous'}},
+--   })
+--
+-- For a signature, op is called on small tensors of `dims` dimensions, in
+-- each of `layouts` ('contiguous' and 'transposed' by default), with
+-- kernel launches switched off, which queues the kernels that call would
+-- use.  args are appended after the tensors.  Launches that need a kernel
+-- still being built wait for it.
+
+local unpack = unpack or table.unpack
+
+local function newPrecompileTensor(dims, layout)
+   local sizes = {}
+   for d=1,dims do
+      sizes[d] = 4
+   end
+   if layout == 'contiguous' then
+      return torch.ClTensor(torch.LongStorage(sizes)):fill(1)
+   elseif layout == 'transposed' then
+      if dims == 1 then
+         return torch.ClTensor(4, 2):fill(1):select(2, 1)
+      end
+      return torch.ClTensor(torch.LongStorage(sizes)):fill(1):transpose(1, dims)
+   end
+   error('cltorch.precompile: unknown layout ' .. tostring(layout))
+end
+
+function cltorch.precompile(spec)
+   if type(spec) == 'string' then
+      cltorch._precompileTrace(spec)
+      return
+   end
+   for _, signature in ipairs(spec) do
+      local fn = torch.ClTensor[signature.op]
+      if fn == nil then
+         error('cltorch.precompile: unknown op ' .. tostring(signature.op))
+      end
+      for _, layout in ipairs(signature.layouts or {'contiguous', 'transposed'}) do
+         local args = {}
+         for i=1,signature.ntensors or 1 do
+            args[i] = newPrecompileTensor(signature.dims or 1, layout)
+         end
+         for _, arg in ipairs(signature.args or {}) do
+            args[#args + 1] = arg
+         end
+         cltorch._setCompileOnly(true)
+         local ok, err = pcall(fn, unpack(args))
+         cltorch._setCompileOnly(false)
+         if not ok then
+            error('cltorch.precompile: ' .. signature.op .. ': ' .. tostring(err))
+         end
+      end
+   end
+end
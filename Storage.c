@@ -1,6 +1,7 @@
 #include "torch/utils.h"
 #include "THCl.h"
-//#include "THFile.h"
+#include "THFile.h"
+#include "THClStorageFile.h"
 #include "luaT.h"
 
 /* everything is as the generic Storage.c, except few things (see below) */
@@ -67,6 +68,24 @@ static int cltorch_ClStorage_copy(lua_State *L)
   return 1;
 }
 
+/* write and read stream the device buffer through pinned memory, in the
+   same format as a FloatStorage */
+static int cltorch_ClStorage_write(lua_State *L)
+{
+  THClStorage *storage = luaT_checkudata(L, 1, "torch.ClStorage");
+  THFile *file = luaT_checkudata(L, 2, "torch.File");
+  THClStorage_write(cltorch_getstate(L), storage, file);
+  return 0;
+}
+
+static int cltorch_ClStorage_read(lua_State *L)
+{
+  THClStorage *storage = luaT_checkudata(L, 1, "torch.ClStorage");
+  THFile *file = luaT_checkudata(L, 2, "torch.File");
+  THClStorage_read(cltorch_getstate(L), storage, file);
+  return 0;
+}
+
 #define CL_IMPLEMENT_STORAGE_COPY(TYPEC)                              \
   static int cltorch_##TYPEC##Storage_copy(lua_State *L)                \
   {                                                                     \
@@ -140,4 +159,11 @@ void cltorch_ClStorage_init(lua_State* L)
       lua_pop(L, 1);
     }
   }
+
+  luaT_pushmetatable(L, "torch.ClStorage");
+  lua_pushcfunction(L, cltorch_ClStorage_write);
+  lua_setfield(L, -2, "write");
+  lua_pushcfunction(L, cltorch_ClStorage_read);
+  lua_setfield(L, -2, "read");
+  lua_pop(L, 1);
 }
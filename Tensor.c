@@ -44,6 +44,10 @@ static int cltorch_ClTensor_copy(lua_State *L)
     THClTensor_copyDouble(state, storage, src);
   else if( (src = luaT_toudata(L, 2, "torch.ClTensor")) )
     THClTensor_copyCl(state, storage, src);
+  else if( (src = luaT_toudata(L, 2, "torch.ClHalfTensor")) )
+    THClTensor_copy(state, storage, src);
+  else if( (src = luaT_toudata(L, 2, "torch.ClByteTensor")) )
+    THClTensor_copy(state, storage, src);
   else
     luaL_typerror(L, 2, "torch.*Tensor");
 
@@ -74,6 +78,10 @@ static int cltorch_ClTensor_copy(lua_State *L)
       TH##TYPEC##Tensor_copyDouble(storage, src);                       \
     else if( (src = luaT_toudata(L, 2, "torch.ClTensor")) )           \
       TH##TYPEC##Tensor_copyCl(cltorch_getstate(L), storage, src);    \
+    else if( (src = luaT_toudata(L, 2, "torch.ClHalfTensor")) )       \
+      TH##TYPEC##Tensor_copyCl(cltorch_getstate(L), storage, src);    \
+    else if( (src = luaT_toudata(L, 2, "torch.ClByteTensor")) )       \
+      TH##TYPEC##Tensor_copyCl(cltorch_getstate(L), storage, src);    \
     else                                                                \
       luaL_typerror(L, 2, "torch.*Tensor");                             \
                                                                         \
@@ -4,6 +4,39 @@ function torch.ClTensor.apply(self, func)
    self:copy(x)
    return self
 end
+torch.ClHalfTensor.apply = torch.ClTensor.apply
+torch.ClByteTensor.apply = torch.ClTensor.apply
+
+-- map, map2 and map3 run an OpenCL C operation on the device, eg
+-- a:map2(b, '*out = *in1 > 0 ? *in1 : val1 * *in1', 0.1); extra arguments
+-- are the scalars val1, val2, ...
+function torch.ClTensor.map(self, operation, ...)
+   cltorch._map(self, nil, nil, operation, {...})
+   return self
+end
+function torch.ClTensor.map2(self, src, operation, ...)
+   cltorch._map(self, src, nil, operation, {...})
+   return self
+end
+function torch.ClTensor.map3(self, src1, src2, operation, ...)
+   cltorch._map(self, src1, src2, operation, {...})
+   return self
+end
+for _,name in ipairs({'map', 'map2', 'map3'}) do
+   torch.ClHalfTensor[name] = torch.ClTensor[name]
+   torch.ClByteTensor[name] = torch.ClTensor[name]
+end
+
+-- streamMap2 and streamMap3 are map2 and map3 for FloatTensors too big for
+-- the device: the tensors go through it a tile at a time
+function cltorch.streamMap2(self, src, operation, ...)
+   cltorch._streamMap(self, src, nil, operation, {...})
+   return self
+end
+function cltorch.streamMap3(self, src1, src2, operation, ...)
+   cltorch._streamMap(self, src1, src2, operation, {...})
+   return self
+end
 
 local function Tensor__type(self,type)
    local current = torch.typename(self)
@@ -24,6 +57,12 @@ end
 local function Tensor__cl(self)
    return self:type('torch.ClTensor')
 end
+local function Tensor__clhalf(self)
+   return self:type('torch.ClHalfTensor')
+end
+local function Tensor__clbyte(self)
+   return self:type('torch.ClByteTensor')
+end
 local function Tensor__double(self)
    return self:type('torch.DoubleTensor')
 end
@@ -59,6 +98,26 @@ rawset(torch.getmetatable('torch.IntTensor'), 'cl', Tensor__cl)
 rawset(torch.getmetatable('torch.ShortTensor'), 'cl', Tensor__cl)
 rawset(torch.getmetatable('torch.LongTensor'), 'cl', Tensor__cl)
 rawset(torch.getmetatable('torch.ClTensor'), 'cl', Tensor__cl)
+rawset(torch.getmetatable('torch.ClHalfTensor'), 'cl', Tensor__cl)
+rawset(torch.getmetatable('torch.ClByteTensor'), 'cl', Tensor__cl)
+
+for _,name in ipairs{'torch.DoubleTensor', 'torch.FloatTensor', 'torch.ClTensor', 'torch.ClHalfTensor'} do
+   rawset(torch.getmetatable(name), 'clhalf', Tensor__clhalf)
+end
+for _,name in ipairs{'torch.ByteTensor', 'torch.FloatTensor', 'torch.ClTensor', 'torch.ClHalfTensor'} do
+   rawset(torch.getmetatable(name), 'clbyte', Tensor__clbyte)
+end
+
+rawset(torch.getmetatable('torch.ClHalfTensor'), 'type', Tensor__type)
+rawset(torch.getmetatable('torch.ClHalfTensor'), 'typeAs', Tensor__typeAs)
+rawset(torch.getmetatable('torch.ClHalfTensor'), 'double', Tensor__double)
+rawset(torch.getmetatable('torch.ClHalfTensor'), 'float', Tensor__float)
+
+rawset(torch.getmetatable('torch.ClByteTensor'), 'type', Tensor__type)
+rawset(torch.getmetatable('torch.ClByteTensor'), 'typeAs', Tensor__typeAs)
+rawset(torch.getmetatable('torch.ClByteTensor'), 'double', Tensor__double)
+rawset(torch.getmetatable('torch.ClByteTensor'), 'float', Tensor__float)
+rawset(torch.getmetatable('torch.ClByteTensor'), 'byte', Tensor__byte)
 
 rawset(torch.getmetatable('torch.ClTensor'), 'type', Tensor__type)
 rawset(torch.getmetatable('torch.ClTensor'), 'typeAs', Tensor__typeAs)
@@ -11,101 +11,103 @@ interface:print('#include "torch/utils.h"')
 interface:print('')
 interface:print('')
 
--- specific to CL
-local typename = 'ClTensor'
-
 -- Lua 5.2 compatibility
 local unpack = unpack or table.unpack
 
--- cut and paste from wrap/types.lua
-wrap.types.ClTensor = {
-
-   helpname = function(arg)
-      if arg.dim then
-         return string.format('%s~%dD', typename, arg.dim)
-      else
-         return typename
-      end
-   end,
-
-   declare = function(arg)
-      local txt = {}
-      table.insert(txt, string.format("TH%s *arg%d = NULL;", typename, arg.i))
-      if arg.returned then
-         table.insert(txt, string.format("int arg%d_idx = 0;", arg.i));
-      end
-      return table.concat(txt, '\n')
-   end,
-
-   check = function(arg, idx)
-      if arg.dim then
-         return string.format('(arg%d = luaT_toudata(L, %d, "torch.%s")) && (arg%d->nDimension == %d)', arg.i, idx, typename, arg.i, arg.dim)
-      else
-         return string.format('(arg%d = luaT_toudata(L, %d, "torch.%s"))', arg.i, idx, typename)
-      end
-   end,
-
-   read = function(arg, idx)
-      if arg.returned then
-         return string.format("arg%d_idx = %d;", arg.i, idx)
-      end
-   end,
-
-   init = function(arg)
-      if type(arg.default) == 'boolean' then
-         return string.format('arg%d = TH%s_new(cltorch_getstate(L));', arg.i, typename)
-      elseif type(arg.default) == 'number' then
-         return string.format('arg%d = %s;', arg.i, arg.args[arg.default]:carg())
-      else
-         error('unknown default tensor type value')
-      end
-   end,
-
-   carg = function(arg)
-      return string.format('arg%d', arg.i)
-   end,
+-- cut and paste from wrap/types.lua; specific to CL, and shared by
+-- ClTensor and ClByteTensor, which are both THClTensors
+local function clTensorType(typename)
+   return {
+      helpname = function(arg)
+         if arg.dim then
+            return string.format('%s~%dD', typename, arg.dim)
+         else
+            return typename
+         end
+      end,
 
-   creturn = function(arg)
-      return string.format('arg%d', arg.i)
-   end,
+      declare = function(arg)
+         local txt = {}
+         table.insert(txt, string.format("TH%s *arg%d = NULL;", typename, arg.i))
+         if arg.returned then
+            table.insert(txt, string.format("int arg%d_idx = 0;", arg.i));
+         end
+         return table.concat(txt, '\n')
+      end,
+
+      check = function(arg, idx)
+         if arg.dim then
+            return string.format('(arg%d = luaT_toudata(L, %d, "torch.%s")) && (arg%d->nDimension == %d)', arg.i, idx, typename, arg.i, arg.dim)
+         else
+            return string.format('(arg%d = luaT_toudata(L, %d, "torch.%s"))', arg.i, idx, typename)
+         end
+      end,
 
-   precall = function(arg)
-      local txt = {}
-      if arg.default and arg.returned then
-         table.insert(txt, string.format('if(arg%d_idx)', arg.i)) -- means it was passed as arg
-         table.insert(txt, string.format('lua_pushvalue(L, arg%d_idx);', arg.i))
-         table.insert(txt, string.format('else'))
-         if type(arg.default) == 'boolean' then -- boolean: we did a new()
-            table.insert(txt, string.format('luaT_pushudata(L, arg%d, "torch.%s");', arg.i, typename))
-         else  -- otherwise: point on default tensor --> retain
-            table.insert(txt, string.format('{'))
-            table.insert(txt, string.format('TH%s_retain(arg%d);', typename, arg.i)) -- so we need a retain
-            table.insert(txt, string.format('luaT_pushudata(L, arg%d, "torch.%s");', arg.i, typename))
-            table.insert(txt, string.format('}'))
+      read = function(arg, idx)
+         if arg.returned then
+            return string.format("arg%d_idx = %d;", arg.i, idx)
          end
-      elseif arg.default then
-         -- we would have to deallocate the beast later if we did a new
-         -- unlikely anyways, so i do not support it for now
+      end,
+
+      init = function(arg)
          if type(arg.default) == 'boolean' then
-            error('a tensor cannot be optional if not returned')
+            return string.format('arg%d = TH%s_new(cltorch_getstate(L));', arg.i, typename)
+         elseif type(arg.default) == 'number' then
+            return string.format('arg%d = %s;', arg.i, arg.args[arg.default]:carg())
+         else
+            error('unknown default tensor type value')
+         end
+      end,
+
+      carg = function(arg)
+         return string.format('arg%d', arg.i)
+      end,
+
+      creturn = function(arg)
+         return string.format('arg%d', arg.i)
+      end,
+
+      precall = function(arg)
+         local txt = {}
+         if arg.default and arg.returned then
+            table.insert(txt, string.format('if(arg%d_idx)', arg.i)) -- means it was passed as arg
+            table.insert(txt, string.format('lua_pushvalue(L, arg%d_idx);', arg.i))
+            table.insert(txt, string.format('else'))
+            if type(arg.default) == 'boolean' then -- boolean: we did a new()
+               table.insert(txt, string.format('luaT_pushudata(L, arg%d, "torch.%s");', arg.i, typename))
+            else  -- otherwise: point on default tensor --> retain
+               table.insert(txt, string.format('{'))
+               table.insert(txt, string.format('TH%s_retain(arg%d);', typename, arg.i)) -- so we need a retain
+               table.insert(txt, string.format('luaT_pushudata(L, arg%d, "torch.%s");', arg.i, typename))
+               table.insert(txt, string.format('}'))
+            end
+         elseif arg.default then
+            -- we would have to deallocate the beast later if we did a new
+            -- unlikely anyways, so i do not support it for now
+            if type(arg.default) == 'boolean' then
+               error('a tensor cannot be optional if not returned')
+            end
+         elseif arg.returned then
+            table.insert(txt, string.format('lua_pushvalue(L, arg%d_idx);', arg.i))
+         end
+         return table.concat(txt, '\n')
+      end,
+
+      postcall = function(arg)
+         local txt = {}
+         if arg.creturned then
+            -- if a tensor is returned by a wrapped C function, the refcount semantics
+            -- are ambiguous (transfer ownership vs. shared ownership).
+            -- We never actually do this, so lets just not allow it.
+            error('a tensor cannot be creturned')
          end
-      elseif arg.returned then
-         table.insert(txt, string.format('lua_pushvalue(L, arg%d_idx);', arg.i))
+         return table.concat(txt, '\n')
       end
-      return table.concat(txt, '\n')
-   end,
+   }
+end
 
-   postcall = function(arg)
-      local txt = {}
-      if arg.creturned then
-         -- if a tensor is returned by a wrapped C function, the refcount semantics
-         -- are ambiguous (transfer ownership vs. shared ownership).
-         -- We never actually do this, so lets just not allow it.
-         error('a tensor cannot be creturned')
-      end
-      return table.concat(txt, '\n')
-   end
-}
+wrap.types.ClTensor = clTensorType('ClTensor')
+wrap.types.ClByteTensor = clTensorType('ClByteTensor')
 
 wrap.types.LongArg = {
 
@@ -293,31 +295,75 @@ wrap("addcdiv",
         {name=Tensor},
         {name=Tensor}})
 
+-- the mask can be a ClByteTensor, as the comparisons return, a ClTensor,
+-- or a ByteTensor on the host
 wrap("maskedFill",
      cname("maskedFill"),
+     {{name=Tensor, returned=true, method={default='nil'}},
+      {name="ClByteTensor"},
+      {name=real}},
+     cname("maskedFill"),
      {{name=Tensor, returned=true, method={default='nil'}},
       {name=Tensor},
+      {name=real}},
+     cname("maskedFillByte"),
+     {{name=Tensor, returned=true, method={default='nil'}},
+      {name="ByteTensor"},
       {name=real}})
 
 wrap("maskedCopy",
      cname("maskedCopy"),
+     {{name=Tensor, returned=true, method={default='nil'}},
+	{name="ClByteTensor"},
+	{name=Tensor}},
+     cname("maskedCopy"),
      {{name=Tensor, returned=true, method={default='nil'}},
 	{name=Tensor},
+	{name=Tensor}},
+     cname("maskedCopyByte"),
+     {{name=Tensor, returned=true, method={default='nil'}},
+	{name="ByteTensor"},
 	{name=Tensor}})
 
 wrap("maskedSelect",
      cname("maskedSelect"),
      {{name=Tensor, returned=true, default=true},
       {name=Tensor},
-      {name=Tensor}})
+      {name="ClByteTensor"}},
+     cname("maskedSelect"),
+     {{name=Tensor, returned=true, default=true},
+      {name=Tensor},
+      {name=Tensor}},
+     cname("maskedSelectByte"),
+     {{name=Tensor, returned=true, default=true},
+      {name=Tensor},
+      {name="ByteTensor"}})
+
+wrap("sort",
+     cname("sort"),
+     {{name=Tensor, default=true, returned=true},
+        {name=Tensor, default=true, returned=true, noreadadd=true},
+        {name=Tensor},
+        {name="index", default=lastdim(3)},
+        {name="boolean", default=0}})
 
---wrap("sort",
---     cname("sort"),
---     {{name=Tensor, default=true, returned=true},
---        {name=Tensor, default=true, returned=true, noreadadd=true},
---        {name=Tensor},
---        {name="index", default=lastdim(3)},
---        {name="boolean", default=0}})
+wrap("topk",
+     cname("topk"),
+     {{name=Tensor, default=true, returned=true},
+        {name=Tensor, default=true, returned=true, noreadadd=true},
+        {name=Tensor},
+        {name="long", default=1},
+        {name="index", default=lastdim(3)},
+        {name="boolean", default=0},
+        {name="boolean", default=0}})
+
+wrap("kthvalue",
+     cname("kthvalue"),
+     {{name=Tensor, default=true, returned=true},
+        {name=Tensor, default=true, returned=true, noreadadd=true},
+        {name=Tensor},
+        {name="long"},
+        {name="index", default=lastdim(3)}})
 
 
 do
@@ -549,14 +595,24 @@ wrap("clamp",
       {name=real},
       {name=real}})
 
+-- a new result is a ClByteTensor, as torch gives a ByteTensor; a ClTensor
+-- result can still be passed in
 for _,name in pairs({'lt','gt','le','ge','eq','ne'}) do
    wrap(name,
         cname(name .. 'Value'),
-        {{name=Tensor, default=true, returned=true},
+        {{name="ClByteTensor", default=true, returned=true},
+         {name=Tensor},
+         {name=real}},
+        cname(name .. 'Value'),
+        {{name=Tensor, returned=true},
          {name=Tensor},
          {name=real}},
         cname(name .. 'Tensor'),
-        {{name=Tensor, default=true, returned=true},
+        {{name="ClByteTensor", default=true, returned=true},
+         {name=Tensor},
+         {name=Tensor}},
+        cname(name .. 'Tensor'),
+        {{name=Tensor, returned=true},
          {name=Tensor},
          {name=Tensor}})
 end
@@ -645,6 +701,18 @@ wrap("dist",
       {name=real, default=2},
       {name=real, creturned=true}})
 
+for _,name in ipairs({"softmax", "logSoftmax"}) do
+   wrap(name,
+        cname(name),
+        {{name=Tensor, default=true, returned=true},
+         {name=Tensor}})
+   wrap(name .. "Backward",
+        cname(name .. "Backward"),
+        {{name=Tensor, default=true, returned=true},
+         {name=Tensor},
+         {name=Tensor}})
+end
+
 wrap("squeeze",
      cname("squeeze"),
      {{name=Tensor, default=true, returned=true, postcall=function(arg)
@@ -680,6 +748,28 @@ interface:print(method:tostring())
 method:clearhistory()
 interface:register("cltorch_ClTensorMath__")
 
+-- the few methods a ClByteTensor mask needs: counting and testing it
+Tensor = "ClByteTensor"
+function method.luaname2wrapname(self, name)
+   return string.format('cltorch_ClByteTensor_%s', name)
+end
+
+method:wrap("sum",
+     cname("sumall"),
+     {{name=Tensor},
+      {name=real, creturned=true}})
+
+for _,name in pairs({'all', 'any'}) do
+  method:wrap(name,
+       cname('logical' .. name),
+       {{name=Tensor},
+        {name="boolean", creturned=true}})
+end
+
+method:register("m_cltorch_ClByteTensorMath__")
+interface:print(method:tostring())
+method:clearhistory()
+
 interface:print([[
 void cltorch_ClTensorMath_init(lua_State *L)
 {
@@ -694,6 +784,10 @@ void cltorch_ClTensorMath_init(lua_State *L)
   luaL_setfuncs(L, cltorch_ClTensorMath__, 0);
   lua_rawset(L, -3);
   lua_pop(L, 1);
+
+  luaT_pushmetatable(L, "torch.ClByteTensor");
+  luaL_setfuncs(L, m_cltorch_ClByteTensorMath__, 0);
+  lua_pop(L, 1);
 }
 ]])
 
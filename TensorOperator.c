@@ -17,24 +17,13 @@ static int cltorch_ClTensorOperator___add__(lua_State *L)
     r = THClTensor_new(state);
     luaT_pushudata(L, r, "torch.ClTensor");
 
+    /* each case is one kernel, writing straight into r */
     if(!tensor1 && tensor2)
-    {
-      THClTensor_resizeAs(state, r, tensor2);
-      THClTensor_copy(state, r, tensor2);
-      THClTensor_add(state, r, r, luaL_checknumber(L, 1));
-    }
+      THClTensor_add(state, r, tensor2, luaL_checknumber(L, 1));
     else if(tensor1 && !tensor2)
-    {
-      THClTensor_resizeAs(state, r, tensor1);
-      THClTensor_copy(state, r, tensor1);
-      THClTensor_add(state, r, r, luaL_checknumber(L, 2));
-    }
+      THClTensor_add(state, r, tensor1, luaL_checknumber(L, 2));
     else
-    {
-      THClTensor_resizeAs(state, r, tensor1);
-      THClTensor_copy(state, r, tensor1);
-      THClTensor_cadd(state, r, r, 1, tensor2);
-    }
+      THClTensor_cadd(state, r, tensor1, 1, tensor2);
   }
   return 1;
 }
@@ -55,23 +44,11 @@ static int cltorch_ClTensorOperator___sub__(lua_State *L)
     luaT_pushudata(L, r, "torch.ClTensor");
 
     if(!tensor1 && tensor2)
-    {
-      THClTensor_resizeAs(state, r, tensor2);
-      THClTensor_fill(state, r, luaL_checknumber(L, 1));
-      THClTensor_cadd(state, r, r, -1, tensor2);
-    }
+      THClTensor_rsub(state, r, tensor2, luaL_checknumber(L, 1));
     else if(tensor1 && !tensor2)
-    {
-      THClTensor_resizeAs(state, r, tensor1);
-      THClTensor_copy(state, r, tensor1);
-      THClTensor_add(state, r, r, -luaL_checknumber(L, 2));
-    }
+      THClTensor_add(state, r, tensor1, -luaL_checknumber(L, 2));
     else
-    {
-      THClTensor_resizeAs(state, r, tensor1);
-      THClTensor_copy(state, r, tensor1);
-      THClTensor_cadd(state, r, r, -1, tensor2);
-    }
+      THClTensor_cadd(state, r, tensor1, -1, tensor2);
   }
   return 1;
 }
@@ -85,9 +62,7 @@ static int cltorch_ClTensorOperator___unm__(lua_State *L)
 
   r = THClTensor_new(state);
   luaT_pushudata(L, r, "torch.ClTensor");
-  THClTensor_resizeAs(state, r, tensor);
-  THClTensor_copy(state, r, tensor);
-  THClTensor_mul(state, r, r, -1);
+  THClTensor_mul(state, r, tensor, -1);
 
   return 1;
 }
@@ -108,17 +83,9 @@ static int cltorch_ClTensorOperator___mul__(lua_State *L)
     luaT_pushudata(L, r, "torch.ClTensor");
 
     if(!tensor1 && tensor2)
-    {
-      THClTensor_resizeAs(state, r, tensor2);
-      THClTensor_copy(state, r, tensor2);
-      THClTensor_mul(state, r, r, luaL_checknumber(L, 1));
-    }
+      THClTensor_mul(state, r, tensor2, luaL_checknumber(L, 1));
     else if(tensor1 && !tensor2)
-    {
-      THClTensor_resizeAs(state, r, tensor1);
-      THClTensor_copy(state, r, tensor1);
-      THClTensor_mul(state, r, r, luaL_checknumber(L, 2));
-    }
+      THClTensor_mul(state, r, tensor1, luaL_checknumber(L, 2));
     else
     {
       int dimt = tensor1->nDimension;
@@ -157,9 +124,7 @@ static int cltorch_ClTensorOperator___div__(lua_State *L)
   r = THClTensor_new(state);
   luaT_pushudata(L, r, "torch.ClTensor");
 
-  THClTensor_resizeAs(state, r, tensor);
-  THClTensor_copy(state, r, tensor);
-  THClTensor_mul(state, r, r, 1/lua_tonumber(L, 2));
+  THClTensor_mul(state, r, tensor, 1/lua_tonumber(L, 2));
 
   return 1;
 }
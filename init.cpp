@@ -12,11 +12,22 @@ extern "C" {
   int luaopen_libcltorch( lua_State *L );
   extern void cltorch_ClStorage_init(lua_State* L);
   extern void cltorch_ClTensor_init(lua_State* L);
+  extern void cltorch_ClHalfTensor_init(lua_State* L);
+  extern void cltorch_ClByteTensor_init(lua_State* L);
   extern void cltorch_ClTensorMath_init(lua_State* L);
   extern void cltorch_ClTensorOperator_init(lua_State* L);
 }
 
 #include "THClGeneral.h"
+#include "THClTensor.h"
+#include "THClTensorMath.h"
+#include "THClDeviceCopy.h"
+#include "THClProfiler.h"
+#include "THClMemory.h"
+#include "THClPrecompile.h"
+#include "THClGraph.h"
+#include "THClMapping.h"
+#include "THClStream.h"
 
 namespace cltorch {
   void setProperty(lua_State *L, string name, int value)
@@ -29,12 +40,382 @@ namespace cltorch {
     lua_pushstring(L, value.c_str());
     lua_setfield(L, -2, name.c_str());
   }
+  // for values that can pass 2^31, eg byte counts
+  void setNumberProperty(lua_State *L, string name, double value)
+  {
+    lua_pushnumber(L, value);
+    lua_setfield(L, -2, name.c_str());
+  }
   static int cltorch_getDeviceCount(lua_State *L)
   {
     int count = easycl::DevicesInfo::getNumDevices();
     lua_pushnumber(L, count);
     return 1;
   }
+  static int cltorch_setDevice(lua_State *L)
+  {
+    THClState *state = cltorch_getstate(L);
+    int device = (int)luaL_checknumber(L, 1)-1;
+    luaL_argcheck(L, device >= 0 && device < THClState_getNumDevices(state), 1, "invalid device");
+    THClState_setDevice(state, device);
+    return 0;
+  }
+  static int cltorch_getDevice(lua_State *L)
+  {
+    THClState *state = cltorch_getstate(L);
+    lua_pushnumber(L, THClState_getDevice(state) + 1);
+    return 1;
+  }
+  // cltorch.allReduce({t1, t2, ...}): sums the tensors in place, across their devices
+  static int cltorch_allReduce(lua_State *L)
+  {
+    THClState *state = cltorch_getstate(L);
+    luaL_checktype(L, 1, LUA_TTABLE);
+    int numTensors = (int)lua_objlen(L, 1);
+    THClTensor **tensors = new THClTensor *[numTensors];
+    for(int i = 0; i < numTensors; i++) {
+      lua_rawgeti(L, 1, i + 1);
+      tensors[i] = (THClTensor *)luaT_toudata(L, -1, "torch.ClTensor");
+      lua_pop(L, 1);
+      if(tensors[i] == 0) {
+        delete[] tensors;
+        luaL_argerror(L, 1, "expected a table of torch.ClTensor");
+      }
+    }
+    THClTensor_allReduce(state, tensors, numTensors);
+    delete[] tensors;
+    lua_settop(L, 1);
+    return 1;
+  }
+  static int cltorch_profilerStart(lua_State *L)
+  {
+    THClProfiler_start(cltorch_getstate(L));
+    return 0;
+  }
+  static int cltorch_profilerStop(lua_State *L)
+  {
+    THClProfiler_stop(cltorch_getstate(L));
+    return 0;
+  }
+  // cltorch.profiler.report(): prints, and returns, one entry per op, longest total time first
+  static int cltorch_profilerReport(lua_State *L)
+  {
+    THClState *state = cltorch_getstate(L);
+    vector<THClProfileSummary> summaries = THClProfiler_summarize(state);
+    lua_newtable(L);
+    for(size_t i = 0; i < summaries.size(); i++) {
+      THClProfileSummary &summary = summaries[i];
+      double gbPerSecond = summary.milliseconds > 0 ? summary.bytes / summary.milliseconds / 1000000.0 : 0;
+      cout << summary.name << " calls=" << summary.calls << " time=" << summary.milliseconds << "ms"
+        << " GB/s=" << gbPerSecond << endl;
+      lua_newtable(L);
+      setProperty(L, "name", summary.name);
+      setProperty(L, "calls", summary.calls);
+      lua_pushnumber(L, summary.milliseconds);
+      lua_setfield(L, -2, "milliseconds");
+      lua_pushnumber(L, summary.bytes);
+      lua_setfield(L, -2, "bytes");
+      lua_pushnumber(L, gbPerSecond);
+      lua_setfield(L, -2, "gbPerSecond");
+      lua_rawseti(L, -2, (int)i + 1);
+    }
+    return 1;
+  }
+  // cltorch.profiler.writeTrace(filename): for chrome://tracing
+  static int cltorch_profilerWriteTrace(lua_State *L)
+  {
+    THClProfiler_writeTrace(cltorch_getstate(L), luaL_checkstring(L, 1));
+    return 0;
+  }
+  // cltorch.getMemoryUsage(): live storage counts and bytes, peaks, and the
+  // allocation rate since the previous call
+  static int cltorch_getMemoryUsage(lua_State *L)
+  {
+    THClState *state = cltorch_getstate(L);
+    THClMemoryUsage usage = THClMemory_getUsage(state);
+    lua_newtable(L);
+    setNumberProperty(L, "storages", usage.storages);
+    setNumberProperty(L, "deviceBytes", usage.deviceBytes);
+    setNumberProperty(L, "hostBytes", usage.hostBytes);
+    setNumberProperty(L, "peakDeviceBytes", usage.peakDeviceBytes);
+    setNumberProperty(L, "peakHostBytes", usage.peakHostBytes);
+    setNumberProperty(L, "allocations", usage.allocations);
+    setNumberProperty(L, "frees", usage.frees);
+    setNumberProperty(L, "allocationsPerSecond", usage.allocationsPerSecond);
+    setNumberProperty(L, "pooledBytes", usage.pooledBytes);
+    setNumberProperty(L, "poolHits", usage.poolHits);
+    lua_newtable(L);
+    for(int i = 0; i < (int)usage.deviceBytesPerDevice.size(); i++) {
+      lua_pushnumber(L, usage.deviceBytesPerDevice[i]);
+      lua_rawseti(L, -2, i + 1);
+    }
+    lua_setfield(L, -2, "deviceBytesPerDevice");
+    return 1;
+  }
+  // allocation sites are recorded as Lua tracebacks
+  static string cltorch_luaTraceback(void *context)
+  {
+    lua_State *L = (lua_State *)context;
+    lua_getglobal(L, "debug");
+    lua_getfield(L, -1, "traceback");
+    lua_remove(L, -2);
+    string traceback = "(no traceback)";
+    if(lua_pcall(L, 0, 1, 0) == 0 && lua_isstring(L, -1)) {
+      traceback = lua_tostring(L, -1);
+    }
+    lua_pop(L, 1);
+    return traceback;
+  }
+  // cltorch.setMemoryTracking(bool): record where each new storage is allocated
+  static int cltorch_setMemoryTracking(lua_State *L)
+  {
+    THClState *state = cltorch_getstate(L);
+    THClMemory_setSiteHook(state, cltorch_luaTraceback, L);
+    THClMemory_setTracking(state, lua_toboolean(L, 1));
+    return 0;
+  }
+  // cltorch.dumpMemory([filename]): totals, and live storages by allocation site
+  static int cltorch_dumpMemory(lua_State *L)
+  {
+    THClState *state = cltorch_getstate(L);
+    FILE *out = stdout;
+    if(lua_gettop(L) >= 1) {
+      out = fopen(luaL_checkstring(L, 1), "w");
+      if(out == 0) {
+        luaL_error(L, "couldn't open %s for writing", lua_tostring(L, 1));
+      }
+    }
+    THClMemory_dump(state, out);
+    if(out != stdout) {
+      fclose(out);
+    }
+    return 0;
+  }
+  // cltorch.setStoragePoolLimit(bytes): how much freed storage memory to keep
+  // for reuse; 0 turns the pool off
+  static int cltorch_setStoragePoolLimit(lua_State *L)
+  {
+    THClMemory_setPoolLimit(cltorch_getstate(L), (long)luaL_checknumber(L, 1));
+    return 0;
+  }
+  static int cltorch_emptyStoragePool(lua_State *L)
+  {
+    THClMemory_emptyPool(cltorch_getstate(L));
+    return 0;
+  }
+  // cltorch.newLazyStorage(filename[, shared[, size]]): as torch.ClStorage(filename, ...),
+  // but each chunk of the file is uploaded the first time a kernel uses it
+  static int cltorch_newLazyStorage(lua_State *L)
+  {
+    THClState *state = cltorch_getstate(L);
+    const char *fileName = luaL_checkstring(L, 1);
+    int isShared = lua_toboolean(L, 2);
+    long size = (long)luaL_optnumber(L, 3, 0);
+    THClStorage *storage = THClStorage_newWithLazyMapping(state, fileName, size, isShared);
+    luaT_pushudata(L, storage, "torch.ClStorage");
+    return 1;
+  }
+  // cltorch.getMappingResidency(storage): chunks on the device, and chunks in all
+  static int cltorch_getMappingResidency(lua_State *L)
+  {
+    THClState *state = cltorch_getstate(L);
+    THClStorage *storage = (THClStorage *)luaT_checkudata(L, 1, "torch.ClStorage");
+    long residentChunks, numChunks;
+    THClMapping_getResidency(state, storage, &residentChunks, &numChunks);
+    lua_pushnumber(L, residentChunks);
+    lua_pushnumber(L, numChunks);
+    return 2;
+  }
+  // a ClTensor, ClHalfTensor or ClByteTensor, which are all THClTensors
+  static THClTensor *cltorch_checkAnyClTensor(lua_State *L, int index)
+  {
+    void *tensor = luaT_toudata(L, index, "torch.ClTensor");
+    if(tensor == 0) {
+      tensor = luaT_toudata(L, index, "torch.ClHalfTensor");
+    }
+    if(tensor == 0) {
+      tensor = luaT_toudata(L, index, "torch.ClByteTensor");
+    }
+    if(tensor == 0) {
+      luaL_typerror(L, index, "torch.ClTensor, ClHalfTensor or ClByteTensor");
+    }
+    return (THClTensor *)tensor;
+  }
+  // used by ClTensor:map, map2 and map3: (self, src1 or nil, src2 or nil,
+  // operation, {scalars})
+  static int cltorch_map(lua_State *L)
+  {
+    THClState *state = cltorch_getstate(L);
+    THClTensor *self = cltorch_checkAnyClTensor(L, 1);
+    THClTensor *src1 = lua_isnoneornil(L, 2) ? 0 : cltorch_checkAnyClTensor(L, 2);
+    THClTensor *src2 = lua_isnoneornil(L, 3) ? 0 : cltorch_checkAnyClTensor(L, 3);
+    luaL_argcheck(L, src1 != 0 || src2 == 0, 2, "map3 needs both sources");
+    const char *operation = luaL_checkstring(L, 4);
+    luaL_checktype(L, 5, LUA_TTABLE);
+    int numScalars = (int)lua_objlen(L, 5);
+    vector<float> scalars(numScalars);
+    for(int i = 0; i < numScalars; i++) {
+      lua_rawgeti(L, 5, i + 1);
+      scalars[i] = (float)luaL_checknumber(L, -1);
+      lua_pop(L, 1);
+    }
+    const float *scalarData = numScalars > 0 ? &scalars[0] : 0;
+    if(src2 != 0) {
+      THClTensor_map3(state, self, src1, src2, operation, numScalars, scalarData);
+    } else if(src1 != 0) {
+      THClTensor_map2(state, self, src1, operation, numScalars, scalarData);
+    } else {
+      THClTensor_map(state, self, operation, numScalars, scalarData);
+    }
+    return 0;
+  }
+  // used by cltorch.streamMap2 and streamMap3: (self, src1, src2 or nil,
+  // operation, {scalars}), all FloatTensors
+  static int cltorch_streamMap(lua_State *L)
+  {
+    THClState *state = cltorch_getstate(L);
+    THFloatTensor *self = (THFloatTensor *)luaT_checkudata(L, 1, "torch.FloatTensor");
+    THFloatTensor *src1 = (THFloatTensor *)luaT_checkudata(L, 2, "torch.FloatTensor");
+    THFloatTensor *src2 = lua_isnoneornil(L, 3) ? 0 : (THFloatTensor *)luaT_checkudata(L, 3, "torch.FloatTensor");
+    const char *operation = luaL_checkstring(L, 4);
+    luaL_checktype(L, 5, LUA_TTABLE);
+    int numScalars = (int)lua_objlen(L, 5);
+    vector<float> scalars(numScalars);
+    for(int i = 0; i < numScalars; i++) {
+      lua_rawgeti(L, 5, i + 1);
+      scalars[i] = (float)luaL_checknumber(L, -1);
+      lua_pop(L, 1);
+    }
+    THClStream_map(state, self, src1, src2, operation, numScalars, numScalars > 0 ? &scalars[0] : 0);
+    return 0;
+  }
+  // cltorch.streamAddmm(r, beta, t, alpha, m1, m2): r = beta * t + alpha * m1 * m2
+  // for FloatTensors, with m1 and r going through the device a tile at a time
+  static int cltorch_streamAddmm(lua_State *L)
+  {
+    THClState *state = cltorch_getstate(L);
+    THFloatTensor *self = (THFloatTensor *)luaT_checkudata(L, 1, "torch.FloatTensor");
+    float beta = (float)luaL_checknumber(L, 2);
+    THFloatTensor *t = (THFloatTensor *)luaT_checkudata(L, 3, "torch.FloatTensor");
+    float alpha = (float)luaL_checknumber(L, 4);
+    THFloatTensor *mat1 = (THFloatTensor *)luaT_checkudata(L, 5, "torch.FloatTensor");
+    THFloatTensor *mat2 = (THFloatTensor *)luaT_checkudata(L, 6, "torch.FloatTensor");
+    THClStream_addmm(state, self, beta, t, alpha, mat1, mat2);
+    lua_settop(L, 1);
+    return 1;
+  }
+  // cltorch.setStreamTileSize(floats): per tensor, per tile; 0 sizes tiles
+  // from the device's memory
+  static int cltorch_setStreamTileSize(lua_State *L)
+  {
+    THClStream_setTileElements(cltorch_getstate(L), (long)luaL_checknumber(L, 1));
+    return 0;
+  }
+  // used by cltorch.precompile: while on, ops queue their kernels for the
+  // background thread, and don't run
+  static int cltorch_setCompileOnly(lua_State *L)
+  {
+    THClPrecompile_setCompileOnly(cltorch_getstate(L), lua_toboolean(L, 1));
+    return 0;
+  }
+  static int cltorch_precompileTrace(lua_State *L)
+  {
+    THClPrecompile_loadTrace(cltorch_getstate(L), luaL_checkstring(L, 1));
+    return 0;
+  }
+  // cltorch.saveKernelTrace(filename): every kernel built so far, for cltorch.precompile
+  static int cltorch_saveKernelTrace(lua_State *L)
+  {
+    THClPrecompile_saveTrace(cltorch_getstate(L), luaL_checkstring(L, 1));
+    return 0;
+  }
+  // cltorch.finishPrecompile(): waits for the background builds; returns how many there were
+  static int cltorch_finishPrecompile(lua_State *L)
+  {
+    THClState *state = cltorch_getstate(L);
+    int pending = THClPrecompile_pending(state);
+    THClPrecompile_wait(state);
+    lua_pushnumber(L, pending);
+    return 1;
+  }
+  // graphs are userdata of this type; they keep the state they were captured on
+  struct GraphHandle {
+    THClState *state;
+    THClGraph *graph;
+  };
+  static GraphHandle *checkGraph(lua_State *L, int index)
+  {
+    GraphHandle *handle = (GraphHandle *)luaL_checkudata(L, index, "cltorch.Graph");
+    luaL_argcheck(L, handle->graph != 0, index, "graph has been freed");
+    return handle;
+  }
+  // cltorch.beginGraphCapture(): launches from here on are recorded, as well as run
+  static int cltorch_beginGraphCapture(lua_State *L)
+  {
+    THClGraph_beginCapture(cltorch_getstate(L));
+    return 0;
+  }
+  // cltorch.endGraphCapture(): returns the graph, with :replay(), :setScalar(i, value),
+  // :getScalar(i), :numScalars(), :numNodes() and :updateTensor(old, new)
+  static int cltorch_endGraphCapture(lua_State *L)
+  {
+    THClState *state = cltorch_getstate(L);
+    GraphHandle *handle = (GraphHandle *)lua_newuserdata(L, sizeof(GraphHandle));
+    handle->state = state;
+    handle->graph = THClGraph_endCapture(state);
+    luaL_getmetatable(L, "cltorch.Graph");
+    lua_setmetatable(L, -2);
+    return 1;
+  }
+  static int cltorch_graphReplay(lua_State *L)
+  {
+    GraphHandle *handle = checkGraph(L, 1);
+    THClGraph_replay(handle->state, handle->graph);
+    lua_settop(L, 1);
+    return 1;
+  }
+  static int cltorch_graphNumNodes(lua_State *L)
+  {
+    lua_pushnumber(L, THClGraph_numNodes(checkGraph(L, 1)->graph));
+    return 1;
+  }
+  static int cltorch_graphNumScalars(lua_State *L)
+  {
+    lua_pushnumber(L, THClGraph_numScalars(checkGraph(L, 1)->graph));
+    return 1;
+  }
+  // scalars are numbered from 1, in launch order
+  static int cltorch_graphGetScalar(lua_State *L)
+  {
+    GraphHandle *handle = checkGraph(L, 1);
+    lua_pushnumber(L, THClGraph_getScalar(handle->graph, (int)luaL_checknumber(L, 2) - 1));
+    return 1;
+  }
+  static int cltorch_graphSetScalar(lua_State *L)
+  {
+    GraphHandle *handle = checkGraph(L, 1);
+    THClGraph_setScalar(handle->graph, (int)luaL_checknumber(L, 2) - 1, (float)luaL_checknumber(L, 3));
+    lua_settop(L, 1);
+    return 1;
+  }
+  static int cltorch_graphUpdateTensor(lua_State *L)
+  {
+    GraphHandle *handle = checkGraph(L, 1);
+    THClTensor *oldTensor = (THClTensor *)luaT_checkudata(L, 2, "torch.ClTensor");
+    THClTensor *newTensor = (THClTensor *)luaT_checkudata(L, 3, "torch.ClTensor");
+    THClGraph_updateTensor(handle->state, handle->graph, oldTensor, newTensor);
+    lua_settop(L, 1);
+    return 1;
+  }
+  static int cltorch_graphFree(lua_State *L)
+  {
+    GraphHandle *handle = (GraphHandle *)luaL_checkudata(L, 1, "cltorch.Graph");
+    if(handle->graph != 0) {
+      THClGraph_free(handle->state, handle->graph);
+      handle->graph = 0;
+    }
+    return 0;
+  }
   static int cltorch_getDeviceProperties(lua_State *L)
   {
     cout << "cltorch_getDeviceProperties" << endl;
@@ -83,6 +464,45 @@ namespace cltorch {
   static const struct luaL_Reg cltorch_stuff__ [] = {
     {"getDeviceCount", cltorch_getDeviceCount},
     {"getDeviceProperties", cltorch_getDeviceProperties},
+    {"setDevice", cltorch_setDevice},
+    {"getDevice", cltorch_getDevice},
+    {"allReduce", cltorch_allReduce},
+    {"getMemoryUsage", cltorch_getMemoryUsage},
+    {"setMemoryTracking", cltorch_setMemoryTracking},
+    {"dumpMemory", cltorch_dumpMemory},
+    {"setStoragePoolLimit", cltorch_setStoragePoolLimit},
+    {"_map", cltorch_map},
+    {"newLazyStorage", cltorch_newLazyStorage},
+    {"getMappingResidency", cltorch_getMappingResidency},
+    {"_streamMap", cltorch_streamMap},
+    {"streamAddmm", cltorch_streamAddmm},
+    {"setStreamTileSize", cltorch_setStreamTileSize},
+    {"emptyStoragePool", cltorch_emptyStoragePool},
+    {"_setCompileOnly", cltorch_setCompileOnly},
+    {"_precompileTrace", cltorch_precompileTrace},
+    {"saveKernelTrace", cltorch_saveKernelTrace},
+    {"finishPrecompile", cltorch_finishPrecompile},
+    {"beginGraphCapture", cltorch_beginGraphCapture},
+    {"endGraphCapture", cltorch_endGraphCapture},
+    {NULL, NULL}
+  };
+
+  static const struct luaL_Reg cltorch_profiler__ [] = {
+    {"start", cltorch_profilerStart},
+    {"stop", cltorch_profilerStop},
+    {"report", cltorch_profilerReport},
+    {"writeTrace", cltorch_profilerWriteTrace},
+    {NULL, NULL}
+  };
+
+  static const struct luaL_Reg cltorch_graph__ [] = {
+    {"replay", cltorch_graphReplay},
+    {"numNodes", cltorch_graphNumNodes},
+    {"numScalars", cltorch_graphNumScalars},
+    {"getScalar", cltorch_graphGetScalar},
+    {"setScalar", cltorch_graphSetScalar},
+    {"updateTensor", cltorch_graphUpdateTensor},
+    {"free", cltorch_graphFree},
     {NULL, NULL}
   };
 }
@@ -94,6 +514,17 @@ int luaopen_libcltorch( lua_State *L ) {
   lua_newtable(L);
 
   luaL_setfuncs(L, cltorch::cltorch_stuff__, 0);
+  lua_newtable(L);
+  luaL_setfuncs(L, cltorch::cltorch_profiler__, 0);
+  lua_setfield(L, -2, "profiler");
+
+  luaL_newmetatable(L, "cltorch.Graph");
+  lua_newtable(L);
+  luaL_setfuncs(L, cltorch::cltorch_graph__, 0);
+  lua_setfield(L, -2, "__index");
+  lua_pushcfunction(L, cltorch::cltorch_graphFree);
+  lua_setfield(L, -2, "__gc");
+  lua_pop(L, 1);
   cout << "setfuncs done" << endl;
 
   THClState* state = (THClState*)malloc(sizeof(THClState));
@@ -103,6 +534,8 @@ int luaopen_libcltorch( lua_State *L ) {
 
   cltorch_ClStorage_init(L);
   cltorch_ClTensor_init(L);
+  cltorch_ClHalfTensor_init(L);
+  cltorch_ClByteTensor_init(L);
   cltorch_ClTensorMath_init(L);
   cltorch_ClTensorOperator_init(L);
 
@@ -3,8 +3,13 @@ cltorch = paths.require("libcltorch")
 
 torch.ClStorage.__tostring__ = torch.FloatStorage.__tostring__
 torch.ClTensor.__tostring__ = torch.FloatTensor.__tostring__
+torch.ClHalfStorage.__tostring__ = torch.FloatStorage.__tostring__
+torch.ClHalfTensor.__tostring__ = torch.FloatTensor.__tostring__
+torch.ClByteStorage.__tostring__ = torch.ByteStorage.__tostring__
+torch.ClByteTensor.__tostring__ = torch.ByteTensor.__tostring__
 
 include('Tensor.lua')
+include('Precompile.lua')
 --include('FFI.lua')
 --include('test.lua')
 
@@ -8,9 +8,11 @@
 #include "THClStorageCopy.h"
 #include "THClTensor.h"
 #include "THClTensorCopy.h"
+#include "THClHalf.h"
+#include "THClByte.h"
 //#include "THClTensorRandom.h"
 #include "THClTensorMath.h"
 //#include "THClTensorConv.h"
-//#include "THClTensorSort.h"
+#include "THClTensorSort.h"
 
 #endif
@@ -27,6 +27,9 @@ std::string getApplyDv2_template() {
     "// ... dimD\n" 
     "// num_input_tensors\n" 
     "// include_scalar_input\n" 
+    "// has_narrow: 1 if any tensor is stored as half or byte\n" 
+    "// half_tensors: per tensor, 1 if it is stored as half\n" 
+    "// byte_tensors: per tensor, 1 if it is stored as byte\n" 
     "//\n" 
     "// maybe should add:\n" 
     "// IndexType (hardcoded to int for now)\n" 
@@ -68,9 +71,10 @@ std::string getApplyDv2_template() {
     "   end\n" 
     " %}\n" 
     "\n" 
-    "void op( global float *out\n" 
+    "// with half or byte tensors, values are loaded into private floats, and op works on those\n" 
+    "void op( {{pointer_space}} float *out\n" 
     "  {% for i=1,(num_tensors-1) do %}\n" 
-    "  , global float *in{{i}}\n" 
+    "  , {{pointer_space}} float *in{{i}}\n" 
     "  {% end %}\n" 
     "  {% for i=1,(num_scalars) do %}\n" 
     "  , float val{{i}}\n" 
@@ -100,6 +104,16 @@ std::string getApplyDv2_template() {
     "}\n" 
     "{% end %}\n" 
     "\n" 
+    "// broadcast over the outer dimension: a row, repeated\n" 
+    "int IndexToOffset_996_get(int linearId, const TensorInfoCl info) {\n" 
+    "  return (linearId % info.sizes[1]) * info.strides[1];\n" 
+    "}\n" 
+    "\n" 
+    "// broadcast over the inner dimension: each element repeated sizes[1] times\n" 
+    "int IndexToOffset_997_get(int linearId, const TensorInfoCl info) {\n" 
+    "  return (linearId / info.sizes[1]) * info.strides[0];\n" 
+    "}\n" 
+    "\n" 
     "int IndexToOffset_998_get(int linearId, const TensorInfoCl info) {\n" 
     "    return linearId;\n" 
     "}\n" 
@@ -123,7 +137,7 @@ std::string getApplyDv2_template() {
     "THClTensor_pointwiseApplyD(\n" 
     "   {% for input_idx=1,num_tensors do %}\n" 
     "    global TensorInfoCl *info_{{input_idx}},\n" 
-    "    global float*data_{{input_idx}},\n" 
+    "    global {% if half_tensors[input_idx] == 1 then %}half{% elseif byte_tensors[input_idx] == 1 then %}uchar{% else %}float{% end %}*data_{{input_idx}},\n" 
     "   {% end %}\n" 
     "   {% for i=1,num_scalars do %}\n" 
     "   float val{{i}},\n" 
@@ -138,6 +152,33 @@ std::string getApplyDv2_template() {
     "      IndexToOffset_{{1000+loadstring('return dim' .. input_idx)()}}_get(linearIndex, info_{{input_idx}}[0]);\n" 
     "    {% end %}\n" 
     "\n" 
+    "    {% if has_narrow == 1 then %}\n" 
+    "    {% for input_idx=1,num_tensors do %}\n" 
+    "    const int index{{input_idx}} = offset{{input_idx}} + info_{{input_idx}}->offset;\n" 
+    "    {% if half_tensors[input_idx] == 1 then %}\n" 
+    "    float value{{input_idx}} = vload_half(index{{input_idx}}, data_{{input_idx}});\n" 
+    "    {% elseif byte_tensors[input_idx] == 1 then %}\n" 
+    "    float value{{input_idx}} = (float)data_{{input_idx}}[index{{input_idx}}];\n" 
+    "    {% else %}\n" 
+    "    float value{{input_idx}} = data_{{input_idx}}[index{{input_idx}}];\n" 
+    "    {% end %}\n" 
+    "    {% end %}\n" 
+    "    op( &value1\n" 
+    "      {% for input_idx=2,num_tensors do %}\n" 
+    "      , &value{{input_idx}}\n" 
+    "      {% end %}\n" 
+    "      {% for i=1,num_scalars do %}\n" 
+    "      , val{{i}}\n" 
+    "      {% end %}\n" 
+    "    );\n" 
+    "    {% if half_tensors[1] == 1 then %}\n" 
+    "    vstore_half(value1, index1, data_1);\n" 
+    "    {% elseif byte_tensors[1] == 1 then %}\n" 
+    "    data_1[index1] = (uchar)value1;\n" 
+    "    {% else %}\n" 
+    "    data_1[index1] = value1;\n" 
+    "    {% end %}\n" 
+    "    {% else %}\n" 
     "    op(\n" 
     "      {% for input_idx=1,num_tensors do %}\n" 
     "         {% if input_idx > 1 then %} , {% end %}\n" 
@@ -147,6 +188,7 @@ std::string getApplyDv2_template() {
     "      , val{{i}}\n" 
     "      {% end %}\n" 
     "    );\n" 
+    "    {% end %}\n" 
     "  }\n" 
     "}\n" 
     "\n" 
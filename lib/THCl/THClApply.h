@@ -3,6 +3,9 @@
 
 #include "THClTensorCopy.h"
 #include "THClReduceApplyUtils.h"
+#include "THClProfiler.h"
+#include "THClPrecompile.h"
+#include "THClGraph.h"
 #include "templates/TemplatedKernel.h"
 #include "util/easycl_stringhelper.h"
 #include "EasyCL.h"
@@ -61,8 +64,34 @@ typedef struct TensorInfoCl {
   int dims;
 } TensorInfoCl;
 
+// tells the template which tensors are stored as half or byte; returns a
+// suffix to keep the unique kernel names apart
+inline std::string setApplyDataTypes(TemplatedKernel &kernelBuilder, int numTensors, const int *dataTypes) {
+  std::vector<int> halfTensors;
+  std::vector<int> byteTensors;
+  bool hasNarrow = false;
+  std::string suffix = "";
+  for( int i = 0; i < numTensors; i++ ) {
+    halfTensors.push_back(dataTypes[i] == THCL_HALF ? 1 : 0);
+    byteTensors.push_back(dataTypes[i] == THCL_BYTE ? 1 : 0);
+    hasNarrow = hasNarrow || dataTypes[i] != THCL_FLOAT;
+  }
+  kernelBuilder.set("half_tensors", halfTensors);
+  kernelBuilder.set("byte_tensors", byteTensors);
+  kernelBuilder.set("has_narrow", hasNarrow ? 1 : 0);
+  kernelBuilder.set("pointer_space", std::string(hasNarrow ? "private" : "global"));
+  if( hasNarrow ) {
+    suffix = "_t";
+    for( int i = 0; i < numTensors; i++ ) {
+      suffix += easycl::toString(dataTypes[i]);
+    }
+  }
+  return suffix;
+}
+
 template< typename IndexType >
 void kernelLaunch_pointwiseApply1( THClState *state, dim3 grid, dim3 block, int A, TensorInfo<IndexType> aInfo, IndexType totalElements, HasOperator1 const * op ) {
+  THClProfileSpan buildSpan(state, "buildKernel");
   TemplatedKernel kernelBuilder( state->cl );
   kernelBuilder.set("dim1", A);
   std::vector<int> dims;
@@ -82,8 +111,15 @@ void kernelLaunch_pointwiseApply1( THClState *state, dim3 grid, dim3 block, int
   kernelBuilder.set("num_tensor_inputs", numTensors);
   kernelBuilder.set("MAX_CLTORCH_DIMS", MAX_CLTORCH_DIMS);
   kernelBuilder.set("operation", operation);
-  std::string uniqueName = "applyDv2_1t" + easycl::toString(numScalars) + "s_" + easycl::toString(A) + "_" + op->operator1();
-  CLKernel *kernel = kernelBuilder.buildKernel( uniqueName, "THClApplyDv2.cl", getApplyDv2_template(), "THClTensor_pointwiseApplyD" );
+  int dataTypes[] = { aInfo.dataType };
+  std::string uniqueName = "applyDv2_1t" + easycl::toString(numScalars) + "s_" + easycl::toString(A) + "_" + op->operator1()
+    + setApplyDataTypes(kernelBuilder, numTensors, dataTypes);
+  CLKernel *kernel = THClKernel_build( state, kernelBuilder, uniqueName, "THClApplyDv2.cl", getApplyDv2_template(), "THClTensor_pointwiseApplyD" );
+  if( kernel == 0 ) { // compile-only
+    return;
+  }
+  buildSpan.end();
+  THClProfileSpan argsSpan(state, "setArgs");
   // calculate workgroup sizes and stuff
   dim3 global_ws;
   for( int i = 0; i < 3; i++ ) {
@@ -112,23 +148,33 @@ void kernelLaunch_pointwiseApply1( THClState *state, dim3 grid, dim3 block, int
     aInfo.wrapper->createOnDevice();
   }
 
-  kernel->in(1, &aInfoCl);
-  kernel->inout( aInfo.wrapper );
+  THClLaunch launch(state, kernel, uniqueName);
+  launch.in(1, &aInfoCl);
+  launch.range(aInfo.wrapper, aInfo.firstFloat(), aInfo.numFloats());
+  launch.inout( aInfo.wrapper );
 
   for( int i = 0; i < numScalars; i++ ) {
-    kernel->in(hasScalars->getScalar(i));
+    launch.scalar(hasScalars->getScalar(i));
   }
 
   if( totalElements > ( 1l << 30 )) {
     throw std::runtime_error("Error: out of bounds for totalelements=" + easycl::toString(totalElements));
   }
-  kernel->in( (int)totalElements );
-  kernel->run(3, global_ws.vec, block.vec);
+  launch.in( (int)totalElements );
+  argsSpan.end();
+  cl_event profileBegin = THClProfiler_begin(state);
+  THClProfileSpan enqueueSpan(state, "enqueue");
+  launch.run(3, global_ws.vec, block.vec);
+  enqueueSpan.end();
+  THClProfiler_end(state, profileBegin, uniqueName, THClProfiler_shapeClass(aInfo.dims, totalElements),
+    (long)totalElements * THClStorage_elementSize(aInfo.dataType));
+  THClProfileSpan finishSpan(state, "finish");
   state->cl->finish();
 }
 
 template< typename IndexType >
 void kernelLaunch_pointwiseApply2( THClState *state, dim3 grid, dim3 block, int A, int B, TensorInfo<IndexType> aInfo, TensorInfo<IndexType> bInfo, IndexType totalElements, HasOperator2 const*op ) {
+  THClProfileSpan buildSpan(state, "buildKernel");
   TemplatedKernel kernelBuilder( state->cl );
   kernelBuilder.set("dim1", A);
   kernelBuilder.set("dim2", B);
@@ -151,14 +197,21 @@ void kernelLaunch_pointwiseApply2( THClState *state, dim3 grid, dim3 block, int
   kernelBuilder.set("dims", dims);
   kernelBuilder.set("MAX_CLTORCH_DIMS", MAX_CLTORCH_DIMS);
   kernelBuilder.set("operation", operation);
-  std::string uniqueName = "applyDv2_" + easycl::toString(numTensors) + "t" + easycl::toString(numScalars) + "s_" + easycl::toString(A) + "_" + easycl::toString(B) + "_" + op->operator2();
+  int dataTypes[] = { aInfo.dataType, bInfo.dataType };
+  std::string uniqueName = "applyDv2_" + easycl::toString(numTensors) + "t" + easycl::toString(numScalars) + "s_" + easycl::toString(A) + "_" + easycl::toString(B) + "_" + op->operator2()
+    + setApplyDataTypes(kernelBuilder, numTensors, dataTypes);
   CLKernel *kernel = 0;
   try {
-    kernel = kernelBuilder.buildKernel( uniqueName, "THClApplyDv2.cl", getApplyDv2_template(), "THClTensor_pointwiseApplyD" );
+    kernel = THClKernel_build( state, kernelBuilder, uniqueName, "THClApplyDv2.cl", getApplyDv2_template(), "THClTensor_pointwiseApplyD" );
   } catch( std::runtime_error &e ) {
     std::cout << "Error building kernel in apply2 " << __FILE__ << ":" << easycl::toString( __LINE__ ) << ": " << e.what() << std::endl;
     throw e;
   }
+  if( kernel == 0 ) { // compile-only
+    return;
+  }
+  buildSpan.end();
+  THClProfileSpan argsSpan(state, "setArgs");
   // calculate workgroup sizes and stuff
   dim3 global_ws;
   for( int i = 0; i < 3; i++ ) {
@@ -192,26 +245,37 @@ void kernelLaunch_pointwiseApply2( THClState *state, dim3 grid, dim3 block, int
     aInfo.wrapper->createOnDevice();
   }
 
-  kernel->in(1, &aInfoCl);
-  kernel->inout( aInfo.wrapper );
+  THClLaunch launch(state, kernel, uniqueName);
+  launch.in(1, &aInfoCl);
+  launch.range(aInfo.wrapper, aInfo.firstFloat(), aInfo.numFloats());
+  launch.inout( aInfo.wrapper );
 
-  kernel->in(1, &bInfoCl);
-  kernel->inout( bInfo.wrapper );
+  launch.in(1, &bInfoCl);
+  launch.range(bInfo.wrapper, bInfo.firstFloat(), bInfo.numFloats());
+  launch.inout( bInfo.wrapper );
 
   for( int i = 0; i < numScalars; i++ ) {
-    kernel->in(hasScalars->getScalar(i));
+    launch.scalar(hasScalars->getScalar(i));
   }
 
   if( totalElements > ( 1l << 30 )) {
     throw std::runtime_error("Error: out of bounds for totalelements=" + easycl::toString(totalElements));
   }
-  kernel->in( (int)totalElements );
-  kernel->run(3, global_ws.vec, block.vec);
+  launch.in( (int)totalElements );
+  argsSpan.end();
+  cl_event profileBegin = THClProfiler_begin(state);
+  THClProfileSpan enqueueSpan(state, "enqueue");
+  launch.run(3, global_ws.vec, block.vec);
+  enqueueSpan.end();
+  THClProfiler_end(state, profileBegin, uniqueName, THClProfiler_shapeClass(aInfo.dims, totalElements),
+    (long)totalElements * (THClStorage_elementSize(aInfo.dataType) + THClStorage_elementSize(bInfo.dataType)));
+  THClProfileSpan finishSpan(state, "finish");
   state->cl->finish();
 }
 
 template< typename IndexType >
 void kernelLaunch_pointwiseApply3( THClState *state, dim3 grid, dim3 block, int A, int B, int C, TensorInfo<IndexType> aInfo, TensorInfo<IndexType> bInfo, TensorInfo<IndexType> cInfo, IndexType totalElements, HasOperator3 const*op ) {
+  THClProfileSpan buildSpan(state, "buildKernel");
   TemplatedKernel kernelBuilder( state->cl );
   kernelBuilder.set("dim1", A);
   kernelBuilder.set("dim2", B);
@@ -238,8 +302,15 @@ void kernelLaunch_pointwiseApply3( THClState *state, dim3 grid, dim3 block, int
   kernelBuilder.set("dims", dims);
   kernelBuilder.set("MAX_CLTORCH_DIMS", MAX_CLTORCH_DIMS);
   kernelBuilder.set("operation", operation);
-  std::string uniqueName = "applyDv2_3t" + easycl::toString(numScalars) + "s_" + easycl::toString(A) + "_" + easycl::toString(B) + "_" + easycl::toString(C) + "_" + op->operator3();
-  CLKernel *kernel = kernelBuilder.buildKernel( uniqueName, "THClApplyDv2.cl", getApplyDv2_template(), "THClTensor_pointwiseApplyD" );
+  int dataTypes[] = { aInfo.dataType, bInfo.dataType, cInfo.dataType };
+  std::string uniqueName = "applyDv2_3t" + easycl::toString(numScalars) + "s_" + easycl::toString(A) + "_" + easycl::toString(B) + "_" + easycl::toString(C) + "_" + op->operator3()
+    + setApplyDataTypes(kernelBuilder, numTensors, dataTypes);
+  CLKernel *kernel = THClKernel_build( state, kernelBuilder, uniqueName, "THClApplyDv2.cl", getApplyDv2_template(), "THClTensor_pointwiseApplyD" );
+  if( kernel == 0 ) { // compile-only
+    return;
+  }
+  buildSpan.end();
+  THClProfileSpan argsSpan(state, "setArgs");
   // calculate workgroup sizes and stuff
   dim3 global_ws;
   for( int i = 0; i < 3; i++ ) {
@@ -273,24 +344,36 @@ void kernelLaunch_pointwiseApply3( THClState *state, dim3 grid, dim3 block, int
   if( !aInfo.wrapper->isOnDevice() ) {
     aInfo.wrapper->createOnDevice();
   }
-  kernel->in(1, &aInfoCl);
-  kernel->inout( aInfo.wrapper );
+  THClLaunch launch(state, kernel, uniqueName);
+  launch.in(1, &aInfoCl);
+  launch.range(aInfo.wrapper, aInfo.firstFloat(), aInfo.numFloats());
+  launch.inout( aInfo.wrapper );
 
-  kernel->in(1, &bInfoCl);
-  kernel->inout( bInfo.wrapper );
+  launch.in(1, &bInfoCl);
+  launch.range(bInfo.wrapper, bInfo.firstFloat(), bInfo.numFloats());
+  launch.inout( bInfo.wrapper );
 
-  kernel->in(1, &cInfoCl);
-  kernel->inout( cInfo.wrapper );
+  launch.in(1, &cInfoCl);
+  launch.range(cInfo.wrapper, cInfo.firstFloat(), cInfo.numFloats());
+  launch.inout( cInfo.wrapper );
 
   for( int i = 0; i < numScalars; i++ ) {
-    kernel->in(hasScalars->getScalar(i));
+    launch.scalar(hasScalars->getScalar(i));
   }
 
   if( totalElements > ( 1l << 30 )) {
     throw std::runtime_error("Error: out of bounds for totalelements=" + easycl::toString(totalElements));
   }
-  kernel->in( (int)totalElements );
-  kernel->run(3, global_ws.vec, block.vec);
+  launch.in( (int)totalElements );
+  argsSpan.end();
+  cl_event profileBegin = THClProfiler_begin(state);
+  THClProfileSpan enqueueSpan(state, "enqueue");
+  launch.run(3, global_ws.vec, block.vec);
+  enqueueSpan.end();
+  THClProfiler_end(state, profileBegin, uniqueName, THClProfiler_shapeClass(aInfo.dims, totalElements),
+    (long)totalElements * (THClStorage_elementSize(aInfo.dataType) + THClStorage_elementSize(bInfo.dataType)
+      + THClStorage_elementSize(cInfo.dataType)));
+  THClProfileSpan finishSpan(state, "finish");
   state->cl->finish();
 }
 
@@ -327,6 +410,7 @@ bool THClTensor_pointwiseApply1(THClState* state,
                                   THClTensor* a,
                                   const Op& op,
                                   TensorArgType aType = ReadWrite) {
+  THClProfileSpan setupSpan(state, "tensorInfo");
   long totalElements = THClTensor_nElement(state, a);
 
   if (THClTensor_nDimension(state, a) > MAX_CLTORCH_DIMS) {
@@ -371,6 +455,7 @@ bool THClTensor_pointwiseApply1(THClState* state,
   // dimension, and the loop to translate the linear index to the array
   // index can be similarly collapsed. That is what this unrolling is for.
 #define HANDLE_CASE(TYPE, A)                                   \
+   setupSpan.end(); \
    kernelLaunch_pointwiseApply1<TYPE>(state, grid, block, A, aInfo, (TYPE) totalElements, &op ); \
   /*THClTensor_pointwiseApply1<Op, TYPE, A>                    \
     <<<grid, block, 0, THClState_getCurrentStream(state)>>>(    \
@@ -446,9 +531,12 @@ bool THClTensor_pointwiseApply2(THClState* state,
                                   const Op& op,
                                   TensorArgType aType = ReadWrite,
                                   TensorArgType bType = ReadOnly) {
+  THClProfileSpan setupSpan(state, "tensorInfo");
   long totalElements = THClTensor_nElement(state, a);
 
-  if (totalElements != THClTensor_nElement(state, b)) {
+  // a read-only b with fewer elements is broadcast to a's size
+  bool broadcastB = totalElements != THClTensor_nElement(state, b);
+  if (broadcastB && (bType != ReadOnly || !THClTensor_canExpandAs(state, b, a))) {
     return false;
   }
 
@@ -469,6 +557,12 @@ bool THClTensor_pointwiseApply2(THClState* state,
     return false;
   }
 
+  // broadcasting reads b through a zero-stride view; being read-only, its
+  // overlapping indices don't matter
+  if (broadcastB) {
+    b = THClTensor_newExpandAs(state, b, a);
+  }
+
   // If tensor args have overlapping indices and are read/write, then
   // we must expand the tensor to a contiguous form first, since
   // otherwise there are conflicting writes. Upon copying back to the
@@ -501,6 +595,7 @@ bool THClTensor_pointwiseApply2(THClState* state,
   // dimension, and the loop to translate the linear index to the array
   // index can be similarly collapsed. That is what this unrolling is for.
 #define HANDLE_CASE(TYPE, A, B)                                \
+   setupSpan.end(); \
    kernelLaunch_pointwiseApply2< TYPE>(state, grid, block, A, B, aInfo, bInfo, (TYPE) totalElements, &op ); \
   /* THClTensor_pointwiseApply2<Op, TYPE, A, B>                 \
     <<<grid, block, 0, THClState_getCurrentStream(state)>>>(    \
@@ -510,6 +605,10 @@ bool THClTensor_pointwiseApply2(THClState* state,
   {                                                 \
     if (bInfo.isContiguous()) {                     \
       HANDLE_CASE(TYPE, A, -2);                     \
+    } else if (bInfo.isOuterBroadcast()) {          \
+      HANDLE_CASE(TYPE, A, -4);                     \
+    } else if (bInfo.isInnerBroadcast()) {          \
+      HANDLE_CASE(TYPE, A, -3);                     \
     } else {                                        \
       switch (B) {                                  \
         case 1:                                     \
@@ -579,6 +678,10 @@ bool THClTensor_pointwiseApply2(THClState* state,
 #undef HANDLE_B_CASE
 #undef HANDLE_A_CASE
 
+  if (broadcastB) {
+    THClTensor_free(state, b);
+  }
+
   if (oldA) {
     // Ignore overlaps when copying back; if we use THClTensor_copy
     // instead, it will recursively try and invoke ourselves to make
@@ -610,10 +713,16 @@ bool THClTensor_pointwiseApply3(THClState* state,
                                   TensorArgType aType = ReadWrite,
                                   TensorArgType bType = ReadOnly,
                                   TensorArgType cType = ReadOnly) {
+  THClProfileSpan setupSpan(state, "tensorInfo");
   long totalElements = THClTensor_nElement(state, a);
 
-  if (totalElements != THClTensor_nElement(state, b) ||
-      totalElements != THClTensor_nElement(state, c)) {
+  // read-only b and c with fewer elements are broadcast to a's size
+  bool broadcastB = totalElements != THClTensor_nElement(state, b);
+  bool broadcastC = totalElements != THClTensor_nElement(state, c);
+  if (broadcastB && (bType != ReadOnly || !THClTensor_canExpandAs(state, b, a))) {
+    return false;
+  }
+  if (broadcastC && (cType != ReadOnly || !THClTensor_canExpandAs(state, c, a))) {
     return false;
   }
 
@@ -635,6 +744,15 @@ bool THClTensor_pointwiseApply3(THClState* state,
     return false;
   }
 
+  // broadcasting reads b and c through zero-stride views; being read-only,
+  // their overlapping indices don't matter
+  if (broadcastB) {
+    b = THClTensor_newExpandAs(state, b, a);
+  }
+  if (broadcastC) {
+    c = THClTensor_newExpandAs(state, c, a);
+  }
+
   // If tensor args have overlapping indices and are read/write, then
   // we must expand the tensor to a contiguous form first, since
   // otherwise there are conflicting writes. Upon copying back to the
@@ -668,6 +786,7 @@ bool THClTensor_pointwiseApply3(THClState* state,
 
 #define HANDLE_CASE(TYPE, A, B, C)                                      \
     /* kernel launch ... */ \
+   setupSpan.end(); \
    kernelLaunch_pointwiseApply3<TYPE>(state, grid, block, A, B, C, aInfo, bInfo, cInfo, (TYPE) totalElements, &op ); \
   /* THClTensor_pointwiseApply3<Op, TYPE, A, B, C> */                      \
     /* <<<grid, block, 0, THClState_getCurrentStream(state)>>>(             \
@@ -677,6 +796,10 @@ bool THClTensor_pointwiseApply3(THClState* state,
   {                                              \
     if (cInfo.isContiguous()) {                  \
       HANDLE_CASE(TYPE, A, B, -2);               \
+    } else if (cInfo.isOuterBroadcast()) {       \
+      HANDLE_CASE(TYPE, A, B, -4);               \
+    } else if (cInfo.isInnerBroadcast()) {       \
+      HANDLE_CASE(TYPE, A, B, -3);               \
     } else {                                     \
       switch (C) {                               \
         case 1:                                  \
@@ -699,6 +822,10 @@ bool THClTensor_pointwiseApply3(THClState* state,
   {                                                  \
     if (bInfo.isContiguous()) {                      \
       HANDLE_C_CASE(TYPE, A, -2, C);                 \
+    } else if (bInfo.isOuterBroadcast()) {           \
+      HANDLE_C_CASE(TYPE, A, -4, C);                 \
+    } else if (bInfo.isInnerBroadcast()) {           \
+      HANDLE_C_CASE(TYPE, A, -3, C);                 \
     } else {                                         \
       switch (B) {                                   \
         case 1:                                      \
@@ -772,6 +899,13 @@ bool THClTensor_pointwiseApply3(THClState* state,
 #undef HANDLE_B_CASE
 #undef HANDLE_A_CASE
 
+  if (broadcastB) {
+    THClTensor_free(state, b);
+  }
+  if (broadcastC) {
+    THClTensor_free(state, c);
+  }
+
   if (oldA) {
     // Ignore overlaps when copying back; if we use THClTensor_copy
     // instead, it will recursively try and invoke ourselves to make
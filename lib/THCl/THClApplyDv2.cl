@@ -9,6 +9,9 @@
 // ... dimD
 // num_input_tensors
 // include_scalar_input
+// has_narrow: 1 if any tensor is stored as half or byte
+// half_tensors: per tensor, 1 if it is stored as half
+// byte_tensors: per tensor, 1 if it is stored as byte
 //
 // maybe should add:
 // IndexType (hardcoded to int for now)
@@ -50,9 +53,10 @@ bool TensorInfo_isContiguous( TensorInfoCl tensorInfo ) {
    end
  %}
 
-void op( global float *out
+// with half or byte tensors, values are loaded into private floats, and op works on those
+void op( {{pointer_space}} float *out
   {% for i=1,(num_tensors-1) do %}
-  , global float *in{{i}}
+  , {{pointer_space}} float *in{{i}}
   {% end %}
   {% for i=1,(num_scalars) do %}
   , float val{{i}}
@@ -82,6 +86,16 @@ int IndexToOffset_{{1000 + dim}}_get( int linearId, TensorInfoCl info) {
 }
 {% end %}
 
+// broadcast over the outer dimension: a row, repeated
+int IndexToOffset_996_get(int linearId, const TensorInfoCl info) {
+  return (linearId % info.sizes[1]) * info.strides[1];
+}
+
+// broadcast over the inner dimension: each element repeated sizes[1] times
+int IndexToOffset_997_get(int linearId, const TensorInfoCl info) {
+  return (linearId / info.sizes[1]) * info.strides[0];
+}
+
 int IndexToOffset_998_get(int linearId, const TensorInfoCl info) {
     return linearId;
 }
@@ -105,7 +119,7 @@ kernel void
 THClTensor_pointwiseApplyD(
    {% for input_idx=1,num_tensors do %}
     global TensorInfoCl *info_{{input_idx}},
-    global float*data_{{input_idx}},
+    global {% if half_tensors[input_idx] == 1 then %}half{% elseif byte_tensors[input_idx] == 1 then %}uchar{% else %}float{% end %}*data_{{input_idx}},
    {% end %}
    {% for i=1,num_scalars do %}
    float val{{i}},
@@ -120,6 +134,33 @@ THClTensor_pointwiseApplyD(
       IndexToOffset_{{1000+loadstring('return dim' .. input_idx)()}}_get(linearIndex, info_{{input_idx}}[0]);
     {% end %}
 
+    {% if has_narrow == 1 then %}
+    {% for input_idx=1,num_tensors do %}
+    const int index{{input_idx}} = offset{{input_idx}} + info_{{input_idx}}->offset;
+    {% if half_tensors[input_idx] == 1 then %}
+    float value{{input_idx}} = vload_half(index{{input_idx}}, data_{{input_idx}});
+    {% elseif byte_tensors[input_idx] == 1 then %}
+    float value{{input_idx}} = (float)data_{{input_idx}}[index{{input_idx}}];
+    {% else %}
+    float value{{input_idx}} = data_{{input_idx}}[index{{input_idx}}];
+    {% end %}
+    {% end %}
+    op( &value1
+      {% for input_idx=2,num_tensors do %}
+      , &value{{input_idx}}
+      {% end %}
+      {% for i=1,num_scalars do %}
+      , val{{i}}
+      {% end %}
+    );
+    {% if half_tensors[1] == 1 then %}
+    vstore_half(value1, index1, data_1);
+    {% elseif byte_tensors[1] == 1 then %}
+    data_1[index1] = (uchar)value1;
+    {% else %}
+    data_1[index1] = value1;
+    {% end %}
+    {% else %}
     op( 
       {% for input_idx=1,num_tensors do %}
          {% if input_idx > 1 then %} , {% end %}
@@ -129,6 +170,7 @@ THClTensor_pointwiseApplyD(
       , val{{i}}
       {% end %}
     );
+    {% end %}
   }
 }
 
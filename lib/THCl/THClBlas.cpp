@@ -2,6 +2,9 @@
 
 #include "THClBlas.h"
 #include "THClGeneral.h"
+#include "THClProfiler.h"
+#include "THClGraph.h"
+#include "THClMapping.h"
 
 #include "util/easycl_stringhelper.h"
 #include "EasyCL.h"
@@ -148,6 +151,9 @@ float THClBlas_dot(THClState *state, long n,
     CLWrapper *xwrapper, long xoffset, long incx, 
     CLWrapper *ywrapper, long yoffset, long incy)
 {
+  // clBLAS buffers are used whole, as far as lazy mappings go
+  THClMapping_touchAll(state, xwrapper);
+  THClMapping_touchAll(state, ywrapper);
   if(n == 1)
   {
     incx = 1;
@@ -174,6 +180,7 @@ float THClBlas_dot(THClState *state, long n,
     scratchWrapper->createOnDevice();
     resultWrapper->createOnDevice();
 
+    cl_event profileBegin = THClProfiler_begin(state);
     cl_event event = NULL;
     err = clblasSdot( i_n, resultWrapper->getBuffer(), 0, 
           xwrapper->getBuffer(), xoffset, i_incx, 
@@ -189,6 +196,7 @@ float THClBlas_dot(THClState *state, long n,
         /* Wait for calculations to be finished. */
         err = clWaitForEvents(1, &event);
     }
+    THClProfiler_end(state, profileBegin, "clblasSdot", THClProfiler_shapeClass(1, n), 2 * n * sizeof(float));
     resultWrapper->copyToHost();
 
     /* Finalize work with clblas. */
@@ -212,6 +220,9 @@ void THClBlas_gemv(THClState *state, char trans, long m, long n, float alpha, CL
     float beta,
      CLWrapper *ywrapper, long yoffset, long incy)
 {
+  THClMapping_touchAll(state, awrapper);
+  THClMapping_touchAll(state, xwrapper);
+  THClMapping_touchAll(state, ywrapper);
   if(n == 1)
     lda = m;
 
@@ -235,6 +246,7 @@ void THClBlas_gemv(THClState *state, char trans, long m, long n, float alpha, CL
         THError("clblasSetup() failed with %d", err);
     }
 
+    cl_event profileBegin = THClProfiler_begin(state);
     cl_event event = NULL;
     err = clblasSgemv(clblasColumnMajor, op, i_m, i_n, alpha,
           awrapper->getBuffer(), aoffset, i_lda, 
@@ -250,6 +262,8 @@ void THClBlas_gemv(THClState *state, char trans, long m, long n, float alpha, CL
         /* Wait for calculations to be finished. */
         err = clWaitForEvents(1, &event);
     }
+    THClProfiler_end(state, profileBegin, "clblasSgemv",
+      easycl::toString(m) + "x" + easycl::toString(n), (m * n + m + 2 * n) * sizeof(float));
 
     /* Finalize work with clblas. */
     clblasTeardown();
@@ -317,6 +331,13 @@ void adjustLd(char transa, char transb, long m, long n, long k, long *lda, long
 /* Level 3 */
 void THClBlas_gemm(THClState *state, char transa, char transb, long m, long n, long k, float alpha, CLWrapper *aWrapper, long offseta, long lda, CLWrapper *bWrapper, long offsetb, long ldb, float beta, CLWrapper *cWrapper, long offsetc, long ldc)
 {
+  if(THClGraph_isCapturing(state)) {
+    THClGraph_recordGemm(state, transa, transb, m, n, k, alpha, aWrapper, offseta, lda,
+      bWrapper, offsetb, ldb, beta, cWrapper, offsetc, ldc);
+  }
+  THClMapping_touchAll(state, aWrapper);
+  THClMapping_touchAll(state, bWrapper);
+  THClMapping_touchAll(state, cWrapper);
   adjustLd(transa, transb, m, n, k, &lda, &ldb, &ldc);
   clblasTranspose opa = convertTransToClblasOperation(transa);
   clblasTranspose opb = convertTransToClblasOperation(transb);
@@ -347,6 +368,7 @@ void THClBlas_gemm(THClState *state, char transa, char transb, long m, long n, l
       cWrapper->createOnDevice();
     }
 
+    cl_event profileBegin = THClProfiler_begin(state);
     cl_event event = NULL;
     err = clblasSgemm(clblasColumnMajor, opa, opb, i_m, i_n, i_k,
                          alpha, aWrapper->getBuffer(), offseta, i_lda,
@@ -358,8 +380,12 @@ void THClBlas_gemm(THClState *state, char transa, char transb, long m, long n, l
     }
     else {
         /* Wait for calculations to be finished. */
+        THClProfileSpan waitSpan(state, "clblasSgemm wait");
         err = clWaitForEvents(1, &event);
     }
+    THClProfiler_end(state, profileBegin, "clblasSgemm",
+      easycl::toString(m) + "x" + easycl::toString(n) + "x" + easycl::toString(k),
+      (m * k + k * n + 2 * m * n) * sizeof(float));
 
     /* Finalize work with clblas. */
     clblasTeardown();
@@ -0,0 +1,36 @@
+#include "THClByte.h"
+
+THClByteStorage* THClByteStorage_new(THClState *state)
+{
+  return THClStorage_newOfType(state, THCL_BYTE);
+}
+
+THClByteStorage* THClByteStorage_newWithSize(THClState *state, long size)
+{
+  return THClStorage_newWithSizeOfType(state, size, THCL_BYTE);
+}
+
+THClByteTensor* THClByteTensor_new(THClState *state)
+{
+  THClByteStorage *storage = THClByteStorage_new(state);
+  THClByteTensor *self = THClTensor_newWithStorage(state, storage, 0, NULL, NULL);
+  THClStorage_free(state, storage);
+  return self;
+}
+
+THClByteTensor* THClByteTensor_newWithSize(THClState *state, THLongStorage *size, THLongStorage *stride)
+{
+  return THClByteTensor_newWithStorage(state, NULL, 0, size, stride);
+}
+
+THClByteTensor* THClByteTensor_newWithStorage(THClState *state, THClByteStorage *storage, long storageOffset, THLongStorage *size, THLongStorage *stride)
+{
+  if(storage)
+    return THClTensor_newWithStorage(state, storage, storageOffset, size, stride);
+
+  // no storage given: start from an empty byte one, which the resize grows
+  storage = THClByteStorage_new(state);
+  THClByteTensor *self = THClTensor_newWithStorage(state, storage, storageOffset, size, stride);
+  THClStorage_free(state, storage);
+  return self;
+}
@@ -0,0 +1,78 @@
+#ifndef THCL_BYTE_INC
+#define THCL_BYTE_INC
+
+#include "THClGeneral.h"
+#include "THClStorage.h"
+#include "THClTensor.h"
+
+/* A ClByteTensor is a ClTensor whose storage holds unsigned bytes, as the
+   comparison ops return, and the masked ops take.  Like ClHalfTensor, kernels
+   load it into floats and store it back as uchar, so only the constructors
+   differ from ClTensor; the rest of the THClByte* api is the THCl one. */
+typedef THClStorage THClByteStorage;
+typedef THClTensor THClByteTensor;
+
+THCL_API THClByteStorage* THClByteStorage_new(THClState *state);
+THCL_API THClByteStorage* THClByteStorage_newWithSize(THClState *state, long size);
+
+THCL_API THClByteTensor* THClByteTensor_new(THClState *state);
+THCL_API THClByteTensor* THClByteTensor_newWithSize(THClState *state, THLongStorage *size, THLongStorage *stride);
+THCL_API THClByteTensor* THClByteTensor_newWithStorage(THClState *state, THClByteStorage *storage, long storageOffset, THLongStorage *size, THLongStorage *stride);
+
+#define THClByteStorage_newWithData THClStorage_newWithData
+#define THClByteStorage_newWithMapping THClStorage_newWithMapping
+#define THClByteStorage_retain THClStorage_retain
+#define THClByteStorage_free THClStorage_free
+#define THClByteStorage_resize THClStorage_resize
+#define THClByteStorage_fill THClStorage_fill
+#define THClByteStorage_get THClStorage_get
+#define THClByteStorage_set THClStorage_set
+#define THClByteStorage_copy THClStorage_copy
+#define THClByteStorage_copyByte THClStorage_copyByte
+#define THClByteStorage_copyChar THClStorage_copyChar
+#define THClByteStorage_copyShort THClStorage_copyShort
+#define THClByteStorage_copyInt THClStorage_copyInt
+#define THClByteStorage_copyLong THClStorage_copyLong
+#define THClByteStorage_copyFloat THClStorage_copyFloat
+#define THClByteStorage_copyDouble THClStorage_copyDouble
+
+#define THClByteTensor_retain THClTensor_retain
+#define THClByteTensor_newWithTensor THClTensor_newWithTensor
+#define THClByteTensor_newClone THClTensor_newClone
+#define THClByteTensor_newContiguous THClTensor_newContiguous
+#define THClByteTensor_newSizeOf THClTensor_newSizeOf
+#define THClByteTensor_newStrideOf THClTensor_newStrideOf
+#define THClByteTensor_storage THClTensor_storage
+#define THClByteTensor_storageOffset THClTensor_storageOffset
+#define THClByteTensor_nElement THClTensor_nElement
+#define THClByteTensor_isContiguous THClTensor_isContiguous
+#define THClByteTensor_isSameSizeAs THClTensor_isSameSizeAs
+#define THClByteTensor_setStorage THClTensor_setStorage
+#define THClByteTensor_resize THClTensor_resize
+#define THClByteTensor_resizeAs THClTensor_resizeAs
+#define THClByteTensor_narrow THClTensor_narrow
+#define THClByteTensor_select THClTensor_select
+#define THClByteTensor_transpose THClTensor_transpose
+#define THClByteTensor_unfold THClTensor_unfold
+#define THClByteTensor_free THClTensor_free
+#define THClByteTensor_fill THClTensor_fill
+#define THClByteTensor_get1d THClTensor_get1d
+#define THClByteTensor_indexCopy THClTensor_indexCopy
+#define THClByteTensor_indexFill THClTensor_indexFill
+#define THClByteTensor_indexSelect THClTensor_indexSelect
+#define THClByteTensor_maskedCopy THClTensor_maskedCopy
+#define THClByteTensor_maskedCopyByte THClTensor_maskedCopyByte
+#define THClByteTensor_maskedFill THClTensor_maskedFill
+#define THClByteTensor_maskedFillByte THClTensor_maskedFillByte
+#define THClByteTensor_maskedSelect THClTensor_maskedSelect
+#define THClByteTensor_maskedSelectByte THClTensor_maskedSelectByte
+#define THClByteTensor_copy THClTensor_copy
+#define THClByteTensor_copyByte THClTensor_copyByte
+#define THClByteTensor_copyChar THClTensor_copyChar
+#define THClByteTensor_copyShort THClTensor_copyShort
+#define THClByteTensor_copyInt THClTensor_copyInt
+#define THClByteTensor_copyLong THClTensor_copyLong
+#define THClByteTensor_copyFloat THClTensor_copyFloat
+#define THClByteTensor_copyDouble THClTensor_copyDouble
+
+#endif
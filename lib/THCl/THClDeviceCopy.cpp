@@ -0,0 +1,240 @@
+#include "THClDeviceCopy.h"
+#include "THClTensorMath.h"
+#include "THClReduceApplyUtils.h"
+#include "THGeneral.h"
+#include "THClMapping.h"
+
+#include "EasyCL.h"
+
+static void THClDeviceCopy_check(cl_int err, const char *what)
+{
+  if(err != CL_SUCCESS) {
+    THError("%s failed, OpenCL error %d", what, err);
+  }
+}
+
+static void THClDeviceCopy_waitAndRelease(cl_event *event)
+{
+  if(*event != 0) {
+    THClDeviceCopy_check(clWaitForEvents(1, event), "clWaitForEvents");
+    clReleaseEvent(*event);
+    *event = 0;
+  }
+}
+
+THClStagingRing::THClStagingRing(THClState *state, int srcDevice, int dstDevice, long chunkElements) :
+    chunkElements(chunkElements), nextFetch(0), nextDeliver(0), numInFlight(0) {
+  srcCl = THClState_getClForDevice(state, srcDevice);
+  dstCl = THClState_getClForDevice(state, dstDevice);
+  size_t bytes = chunkElements * sizeof(float);
+  for(int i = 0; i < THCL_DEVICE_COPY_SLOTS; i++) {
+    Slot *slot = &slots[i];
+    cl_int err;
+    // CL_MEM_ALLOC_HOST_PTR gets us page-locked memory on most drivers, which the
+    // dma engines can read and write directly
+    slot->pinned = clCreateBuffer(*srcCl->context, CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR, bytes, 0, &err);
+    THClDeviceCopy_check(err, "clCreateBuffer");
+    slot->host = (float *)clEnqueueMapBuffer(*srcCl->queue, slot->pinned, CL_TRUE,
+      CL_MAP_READ | CL_MAP_WRITE, 0, bytes, 0, 0, 0, &err);
+    THClDeviceCopy_check(err, "clEnqueueMapBuffer");
+    slot->readDone = 0;
+    slot->writeDone = 0;
+    slot->dst = 0;
+    slot->dstOffset = 0;
+    slot->count = 0;
+  }
+}
+
+THClStagingRing::~THClStagingRing() {
+  finish();
+  for(int i = 0; i < THCL_DEVICE_COPY_SLOTS; i++) {
+    clEnqueueUnmapMemObject(*srcCl->queue, slots[i].pinned, slots[i].host, 0, 0, 0);
+  }
+  clFinish(*srcCl->queue);
+  for(int i = 0; i < THCL_DEVICE_COPY_SLOTS; i++) {
+    clReleaseMemObject(slots[i].pinned);
+  }
+}
+
+void THClStagingRing::fetch(CLWrapper *src, long srcOffset, CLWrapper *dst, long dstOffset, long count) {
+  THAssert(count <= chunkElements);
+  if(numInFlight == THCL_DEVICE_COPY_SLOTS) {
+    deliver();
+  }
+  Slot *slot = &slots[nextFetch];
+  // the slot might still be feeding an earlier write
+  THClDeviceCopy_waitAndRelease(&slot->writeDone);
+  THClDeviceCopy_check(clEnqueueReadBuffer(*srcCl->queue, src->getBuffer(), CL_FALSE,
+    srcOffset * sizeof(float), count * sizeof(float), slot->host, 0, 0, &slot->readDone),
+    "clEnqueueReadBuffer");
+  clFlush(*srcCl->queue);
+  slot->dst = dst;
+  slot->dstOffset = dstOffset;
+  slot->count = count;
+  nextFetch = (nextFetch + 1) % THCL_DEVICE_COPY_SLOTS;
+  numInFlight++;
+}
+
+void THClStagingRing::deliver() {
+  if(numInFlight == 0) {
+    return;
+  }
+  Slot *slot = &slots[nextDeliver];
+  THClDeviceCopy_waitAndRelease(&slot->readDone);
+  THClDeviceCopy_check(clEnqueueWriteBuffer(*dstCl->queue, slot->dst->getBuffer(), CL_FALSE,
+    slot->dstOffset * sizeof(float), slot->count * sizeof(float), slot->host, 0, 0, &slot->writeDone),
+    "clEnqueueWriteBuffer");
+  clFlush(*dstCl->queue);
+  slot->dst->markDeviceDirty();
+  nextDeliver = (nextDeliver + 1) % THCL_DEVICE_COPY_SLOTS;
+  numInFlight--;
+}
+
+void THClStagingRing::finish() {
+  while(numInFlight > 0) {
+    deliver();
+  }
+  for(int i = 0; i < THCL_DEVICE_COPY_SLOTS; i++) {
+    THClDeviceCopy_waitAndRelease(&slots[i].writeDone);
+  }
+}
+
+void THClDeviceCopy_copy(THClState *state,
+    int dstDevice, CLWrapper *dst, long dstOffset,
+    int srcDevice, CLWrapper *src, long srcOffset, long count) {
+  if(count == 0) {
+    return;
+  }
+  EasyCL *srcCl = THClState_getClForDevice(state, srcDevice);
+  EasyCL *dstCl = THClState_getClForDevice(state, dstDevice);
+  if(!dst->isOnDevice()) {
+    dst->createOnDevice();
+  }
+  THClMapping_touchAll(state, src);
+  THClMapping_touchAll(state, dst);
+  // anything still queued against src has to land before we read it
+  srcCl->finish();
+
+  if(*srcCl->context == *dstCl->context) {
+    // same context: let the runtime move the buffer, then copy device-side
+    cl_mem srcBuffer = src->getBuffer();
+    THClDeviceCopy_check(clEnqueueMigrateMemObjects(*dstCl->queue, 1, &srcBuffer, 0, 0, 0, 0),
+      "clEnqueueMigrateMemObjects");
+    THClDeviceCopy_check(clEnqueueCopyBuffer(*dstCl->queue, srcBuffer, dst->getBuffer(),
+      srcOffset * sizeof(float), dstOffset * sizeof(float), count * sizeof(float), 0, 0, 0),
+      "clEnqueueCopyBuffer");
+    dstCl->finish();
+  } else {
+    long chunk = count < THCL_DEVICE_COPY_CHUNK ? count : THCL_DEVICE_COPY_CHUNK;
+    THClStagingRing ring(state, srcDevice, dstDevice, chunk);
+    for(long done = 0; done < count; done += chunk) {
+      long thisChunk = count - done < chunk ? count - done : chunk;
+      ring.fetch(src, srcOffset + done, dst, dstOffset + done, thisChunk);
+    }
+    ring.finish();
+  }
+  dst->markDeviceDirty();
+}
+
+// dst[start..start+len) += src[start..start+len), or = if !accumulate.
+// When accumulating, chunks land in recv first, and are added in on dst's device
+static void THClTensor_allReduceSegment(THClState *state, THClStagingRing *ring,
+    THClTensor *dst, int dstDev, THClTensor *src, THClTensor *recv,
+    long start, long len, bool accumulate) {
+  long chunk = ring->getChunkElements();
+  long numChunks = DIVUP(len, chunk);
+  for(long c = 0; c <= numChunks; c++) {
+    if(c < numChunks) {
+      long thisChunk = len - c * chunk < chunk ? len - c * chunk : chunk;
+      if(accumulate) {
+        ring->fetch(src->storage->wrapper, src->storageOffset + start + c * chunk,
+          recv->storage->wrapper, recv->storageOffset + c * chunk, thisChunk);
+      } else {
+        ring->fetch(src->storage->wrapper, src->storageOffset + start + c * chunk,
+          dst->storage->wrapper, dst->storageOffset + start + c * chunk, thisChunk);
+      }
+    }
+    if(c > 0) {
+      ring->deliver();
+      if(accumulate) {
+        // the write was enqueued on dst's queue, so the kernel runs after it
+        long prevChunk = len - (c - 1) * chunk < chunk ? len - (c - 1) * chunk : chunk;
+        THClState_setDevice(state, dstDev);
+        THClTensor *local = THClTensor_newWithStorage1d(state, dst->storage,
+          dst->storageOffset + start + (c - 1) * chunk, prevChunk, 1);
+        THClTensor *incoming = THClTensor_newWithStorage1d(state, recv->storage,
+          recv->storageOffset + (c - 1) * chunk, prevChunk, 1);
+        THClTensor_cadd(state, local, local, 1.0f, incoming);
+        THClTensor_free(state, incoming);
+        THClTensor_free(state, local);
+      }
+    }
+  }
+  ring->finish();
+}
+
+void THClTensor_allReduce(THClState *state, THClTensor **tensors, int numTensors) {
+  THArgCheck(numTensors >= 1, 3, "need at least one tensor");
+  long numElements = THClTensor_nElement(state, tensors[0]);
+  for(int i = 0; i < numTensors; i++) {
+    THArgCheck(THClTensor_nElement(state, tensors[i]) == numElements, 2, "sizes do not match");
+    THArgCheck(THClTensor_isContiguous(state, tensors[i]), 2, "tensors must be contiguous");
+  }
+  if(numTensors == 1 || numElements == 0) {
+    return;
+  }
+
+  int oldDev = THClState_getDevice(state);
+  long segment = DIVUP(numElements, numTensors);
+  long chunk = segment < THCL_DEVICE_COPY_CHUNK ? segment : THCL_DEVICE_COPY_CHUNK;
+  int *devices = new int[numTensors];
+  THClTensor **recv = new THClTensor *[numTensors];
+  THClStagingRing **rings = new THClStagingRing *[numTensors];
+  for(int i = 0; i < numTensors; i++) {
+    devices[i] = THClTensor_getDevice(state, tensors[i]);
+  }
+  for(int i = 0; i < numTensors; i++) {
+    THClState_setDevice(state, devices[i]);
+    THClState_getClForDevice(state, devices[i])->finish();
+    recv[i] = THClTensor_newWithSize1d(state, segment);
+    // rings[i] carries data from tensor i to tensor i+1
+    rings[i] = new THClStagingRing(state, devices[i], devices[(i + 1) % numTensors], chunk);
+  }
+
+  // reduce-scatter: after step s, tensor i holds the sum of s+2 tensors'
+  // worth of segment i-s-1; at the end it has the full sum of segment i+1
+  for(int step = 0; step < numTensors - 1; step++) {
+    for(int i = 0; i < numTensors; i++) {
+      int next = (i + 1) % numTensors;
+      long start = ((i - step + numTensors) % numTensors) * segment;
+      long len = numElements - start < segment ? numElements - start : segment;
+      if(len > 0) {
+        THClTensor_allReduceSegment(state, rings[i], tensors[next], devices[next],
+          tensors[i], recv[next], start, len, true);
+      }
+    }
+  }
+  // all-gather: pass each finished segment on round the ring
+  for(int step = 0; step < numTensors - 1; step++) {
+    for(int i = 0; i < numTensors; i++) {
+      int next = (i + 1) % numTensors;
+      long start = ((i + 1 - step + numTensors) % numTensors) * segment;
+      long len = numElements - start < segment ? numElements - start : segment;
+      if(len > 0) {
+        THClTensor_allReduceSegment(state, rings[i], tensors[next], devices[next],
+          tensors[i], recv[next], start, len, false);
+      }
+    }
+  }
+
+  for(int i = 0; i < numTensors; i++) {
+    delete rings[i];
+    THClState_setDevice(state, devices[i]);
+    THClTensor_free(state, recv[i]);
+  }
+  delete[] rings;
+  delete[] recv;
+  delete[] devices;
+  THClState_setDevice(state, oldDev);
+}
+
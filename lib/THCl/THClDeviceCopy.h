@@ -0,0 +1,62 @@
+#ifndef THCL_DEVICE_COPY_INC
+#define THCL_DEVICE_COPY_INC
+
+#include "THClGeneral.h"
+#include "THClTensor.h"
+#include "EasyCL.h"
+
+// number of floats moved per chunk when copying between devices
+#define THCL_DEVICE_COPY_CHUNK (1024 * 1024)
+// number of pinned staging buffers in the ring
+#define THCL_DEVICE_COPY_SLOTS 2
+
+// Moves chunks of one device's buffers into another device's buffers, via
+// pinned host memory.  fetch() enqueues a non-blocking read of a chunk into
+// the next free slot; deliver() waits for the oldest outstanding read and
+// enqueues the non-blocking write out to the destination device.  So calling
+// fetch(k) before deliver() for chunk k-1 overlaps the read of chunk k with
+// the write of chunk k-1.
+class THClStagingRing {
+public:
+  THClStagingRing(THClState *state, int srcDevice, int dstDevice, long chunkElements);
+  ~THClStagingRing();
+  long getChunkElements() { return chunkElements; }
+  int getNumInFlight() { return numInFlight; }
+  void fetch(CLWrapper *src, long srcOffset, CLWrapper *dst, long dstOffset, long count);
+  void deliver();
+  // delivers anything still outstanding, and waits for all writes to land
+  void finish();
+
+private:
+  struct Slot {
+    cl_mem pinned;
+    float *host;
+    cl_event readDone;
+    cl_event writeDone;
+    CLWrapper *dst;
+    long dstOffset;
+    long count;
+  };
+  EasyCL *srcCl;
+  EasyCL *dstCl;
+  long chunkElements;
+  Slot slots[THCL_DEVICE_COPY_SLOTS];
+  int nextFetch;
+  int nextDeliver;
+  int numInFlight;
+};
+
+// copies count floats from src (on srcDevice) to dst (on dstDevice), chunked
+// through a THClStagingRing, or directly when both devices share a context
+THCL_API void THClDeviceCopy_copy(THClState *state,
+  int dstDevice, CLWrapper *dst, long dstOffset,
+  int srcDevice, CLWrapper *src, long srcOffset, long count);
+
+// sums numTensors same-sized contiguous tensors, one per device, leaving
+// the total in every one of them.  Runs as a ring: a reduce-scatter then
+// an all-gather, each numTensors-1 steps, with each step streaming one
+// segment from device i to device i+1 in chunks.  While chunk c is in
+// flight, chunk c-1 is added into the receiver's tensor with cadd.
+THCL_API void THClTensor_allReduce(THClState *state, THClTensor **tensors, int numTensors);
+
+#endif
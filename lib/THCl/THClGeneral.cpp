@@ -1,4 +1,11 @@
 #include "THClGeneral.h"
+#include "THClProfiler.h"
+#include "THClMemory.h"
+#include "THClPrecompile.h"
+#include "THClGraph.h"
+#include "THClStorageFile.h"
+#include "THClMapping.h"
+#include "THClStream.h"
 #include "TH.h"
 
 #include <stdio.h>
@@ -13,15 +20,76 @@ void THClInit(THClState* state)
     printf("*******************************************\n");
     printf("THClInit()\n");
   state->cl = EasyCL::createForFirstGpuOtherwiseCpu(); // obviously this should change...
+  state->allocatedDevices = easycl::DevicesInfo::getNumDevices();
+  state->deviceCls = (EasyCL **)THAlloc(sizeof(EasyCL *) * state->allocatedDevices);
+  state->currentDevice = 0;
+  state->profiler = 0;
+  state->memory = 0;
+  state->precompiler = 0;
+  state->capture = 0;
+  state->fileStaging = 0;
+  state->mappings = 0;
+  state->stream = 0;
+  for(int i = 0; i < state->allocatedDevices; i++) {
+    state->deviceCls[i] = 0;
+    cl_platform_id platformId;
+    cl_device_id deviceId;
+    easycl::DevicesInfo::getIdForIndexedDevice(i, &platformId, &deviceId);
+    if(deviceId == state->cl->device) {
+      state->currentDevice = i;
+    }
+  }
+  state->deviceCls[state->currentDevice] = state->cl;
 }
 
 void THClShutdown(THClState* state)
 {
-  delete state->cl;
+  if(state->capture != 0) {
+    THClGraph_free(state, THClGraph_endCapture(state));
+  }
+  THClPrecompile_free(state);
+  THClProfiler_free(state);
+  THClStorageFile_free(state);
+  THClMapping_free(state);
+  THClStream_free(state);
+  THClMemory_free(state);
+  for(int i = 0; i < state->allocatedDevices; i++) {
+    delete state->deviceCls[i];
+  }
+  THFree(state->deviceCls);
     printf("THClShutdown()\n");
     printf("*******************************************\n");
 }
 
+int THClState_getNumDevices(THClState* state)
+{
+  return state->allocatedDevices;
+}
+
+EasyCL *THClState_getClForDevice(THClState* state, int device)
+{
+  THArgCheck(device >= 0 && device < state->allocatedDevices, 2, "invalid device");
+  if(state->deviceCls[device] == 0) {
+    state->deviceCls[device] = EasyCL::createForIndexedDevice(device);
+    THClProfiler_attachDevice(state, device);
+  }
+  return state->deviceCls[device];
+}
+
+void THClState_setDevice(THClState* state, int device)
+{
+  if(device == state->currentDevice) {
+    return;
+  }
+  state->cl = THClState_getClForDevice(state, device);
+  state->currentDevice = device;
+}
+
+int THClState_getDevice(THClState* state)
+{
+  return state->currentDevice;
+}
+
 std::ostream &operator<<( std::ostream &os, const dim3 &obj ) {
     os << "dim3{" << obj.vec[0] << ", " << obj.vec[1] << ", " << obj.vec[2] << "}";
     return os;
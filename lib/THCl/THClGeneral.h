@@ -25,6 +25,10 @@
 //THCL_API void __THClCheck(clError_t err, const char *file, const int line);
 
 struct EasyCL;
+struct THClProfiler;
+struct THClMemoryStats;
+struct THClPrecompiler;
+struct THClGraph;
 
 #ifdef __cplusplus
 #include <iostream>
@@ -33,12 +37,28 @@ struct EasyCL;
 /* Global state to be held in the cutorch table. */
 typedef struct THClState
 {
-  struct EasyCL *cl;
+  struct EasyCL *cl; // EasyCL for the current device
+  int currentDevice;
+  int allocatedDevices;
+  struct EasyCL **deviceCls; // one per device, created the first time the device is used
+  struct THClProfiler *profiler; // created by the first THClProfiler_start
+  struct THClMemoryStats *memory; // created by the first storage allocation
+  struct THClPrecompiler *precompiler; // created by the first kernel build
+  struct THClGraph *capture; // the graph being captured, or 0
+  struct THClFileStaging *fileStaging; // created by the first storage read or write
+  struct THClMappings *mappings; // created by the first file-backed storage
+  struct THClStream *stream; // created by the first streamed op
 } THClState;
 
 THCL_API void THClInit(THClState* state);
 THCL_API void THClShutdown(THClState* state);
 
+/* devices are 0-based here; the lua side adds 1 */
+THCL_API int THClState_getNumDevices(THClState* state);
+THCL_API void THClState_setDevice(THClState* state, int device);
+THCL_API int THClState_getDevice(THClState* state);
+THCL_API struct EasyCL *THClState_getClForDevice(THClState* state, int device);
+
 
 typedef unsigned long ulong;
 
@@ -0,0 +1,376 @@
+#include "THClGraph.h"
+#include "THClStorage.h"
+#include "THClTensor.h"
+#include "THClMemory.h"
+#include "THClProfiler.h"
+#include "THClBlas.h"
+#include "THClMapping.h"
+
+#include <cstring>
+
+using namespace std;
+
+void THClGraph_beginCapture(THClState *state)
+{
+  THArgCheck(state->capture == 0, 1, "already capturing a graph");
+  THClGraph *graph = new THClGraph();
+  graph->device = THClState_getDevice(state);
+  state->capture = graph;
+}
+
+static void THClGraph_indexScalars(THClGraph *graph)
+{
+  graph->scalars.clear();
+  for(size_t i = 0; i < graph->nodes.size(); i++) {
+    vector<THClGraphArg> &args = graph->nodes[i].args;
+    for(size_t j = 0; j < args.size(); j++) {
+      if(args[j].kind == THCL_GRAPH_SCALAR) {
+        graph->scalars.push_back(&args[j]);
+      }
+    }
+  }
+}
+
+THClGraph *THClGraph_endCapture(THClState *state)
+{
+  THArgCheck(state->capture != 0, 1, "not capturing a graph");
+  THClGraph *graph = state->capture;
+  state->capture = 0;
+  THClGraph_indexScalars(graph);
+  return graph;
+}
+
+int THClGraph_isCapturing(THClState *state)
+{
+  return state->capture != 0;
+}
+
+// the graph holds a reference to each storage it launches on
+static THClStorage *THClGraph_retain(THClState *state, CLWrapper *wrapper)
+{
+  THClStorage *storage = THClMemory_storageForWrapper(state, wrapper);
+  if(storage == 0) {
+    THError("graph capture: a launch uses a buffer that isn't a ClStorage, so it can't be replayed");
+  }
+  THClStorage_retain(state, storage);
+  return storage;
+}
+
+static THClGraphArg THClGraph_newArg(int kind)
+{
+  THClGraphArg arg;
+  arg.kind = kind;
+  arg.storage = 0;
+  arg.wrapper = 0;
+  arg.structData = 0;
+  arg.intValue = 0;
+  arg.floatValue = 0;
+  return arg;
+}
+
+void THClGraph_recordGemm(THClState *state, char transa, char transb, long m, long n, long k,
+    float alpha, CLWrapper *aWrapper, long offseta, long lda, CLWrapper *bWrapper, long offsetb,
+    long ldb, float beta, CLWrapper *cWrapper, long offsetc, long ldc)
+{
+  THClGraphNode node;
+  node.name = "clblasSgemm";
+  node.kernel = 0;
+  node.dims = 0;
+  node.transa = transa;
+  node.transb = transb;
+  node.m = m;
+  node.n = n;
+  node.k = k;
+  node.offseta = offseta;
+  node.lda = lda;
+  node.offsetb = offsetb;
+  node.ldb = ldb;
+  node.offsetc = offsetc;
+  node.ldc = ldc;
+  THClGraphArg alphaArg = THClGraph_newArg(THCL_GRAPH_SCALAR);
+  alphaArg.floatValue = alpha;
+  THClGraphArg betaArg = THClGraph_newArg(THCL_GRAPH_SCALAR);
+  betaArg.floatValue = beta;
+  THClGraphArg a = THClGraph_newArg(THCL_GRAPH_IN);
+  a.storage = THClGraph_retain(state, aWrapper);
+  THClGraphArg b = THClGraph_newArg(THCL_GRAPH_IN);
+  b.storage = THClGraph_retain(state, bWrapper);
+  THClGraphArg c = THClGraph_newArg(THCL_GRAPH_INOUT);
+  c.storage = THClGraph_retain(state, cWrapper);
+  node.args.push_back(alphaArg);
+  node.args.push_back(betaArg);
+  node.args.push_back(a);
+  node.args.push_back(b);
+  node.args.push_back(c);
+  state->capture->nodes.push_back(node);
+}
+
+THClLaunch::THClLaunch(THClState *state, CLKernel *kernel, string name) :
+    state(state), kernel(kernel), recording(state->capture != 0) {
+  node.name = name;
+  node.kernel = kernel;
+  node.dims = 0;
+}
+
+void THClLaunch::recordBuffer(int kind, CLWrapper *wrapper)
+{
+  THClGraphArg arg = THClGraph_newArg(kind);
+  arg.storage = THClGraph_retain(state, wrapper);
+  node.args.push_back(arg);
+}
+
+// copied into a buffer of the graph's own, that stays on the device
+void THClLaunch::recordStruct(const void *data, size_t bytes)
+{
+  THClGraphArg arg = THClGraph_newArg(THCL_GRAPH_STRUCT);
+  int numFloats = (int)((bytes + sizeof(float) - 1) / sizeof(float));
+  arg.structData = new float[numFloats];
+  memcpy(arg.structData, data, bytes);
+  arg.wrapper = state->cl->wrap(numFloats, arg.structData);
+  arg.wrapper->copyToDevice();
+  node.args.push_back(arg);
+}
+
+THClLaunch &THClLaunch::range(CLWrapper *wrapper, long first, long count)
+{
+  if(THClMapping_any(state)) {
+    Range range;
+    range.wrapper = wrapper;
+    range.first = first;
+    range.count = count;
+    ranges.push_back(range);
+  }
+  return *this;
+}
+
+void THClLaunch::touch(CLWrapper *wrapper)
+{
+  for(size_t i = 0; i < ranges.size(); i++) {
+    if(ranges[i].wrapper == wrapper) {
+      THClMapping_touch(state, wrapper, ranges[i].first, ranges[i].count);
+      return;
+    }
+  }
+  THClMapping_touchAll(state, wrapper);
+}
+
+THClLaunch &THClLaunch::in(CLWrapper *wrapper)
+{
+  if(THClMapping_any(state)) {
+    touch(wrapper);
+  }
+  kernel->in(wrapper);
+  if(recording) {
+    recordBuffer(THCL_GRAPH_IN, wrapper);
+  }
+  return *this;
+}
+
+THClLaunch &THClLaunch::out(CLWrapper *wrapper)
+{
+  if(THClMapping_any(state)) {
+    touch(wrapper);
+  }
+  kernel->out(wrapper);
+  if(recording) {
+    recordBuffer(THCL_GRAPH_OUT, wrapper);
+  }
+  return *this;
+}
+
+THClLaunch &THClLaunch::inout(CLWrapper *wrapper)
+{
+  if(THClMapping_any(state)) {
+    touch(wrapper);
+  }
+  kernel->inout(wrapper);
+  if(recording) {
+    recordBuffer(THCL_GRAPH_INOUT, wrapper);
+  }
+  return *this;
+}
+
+THClLaunch &THClLaunch::in(int value)
+{
+  kernel->in(value);
+  if(recording) {
+    THClGraphArg arg = THClGraph_newArg(THCL_GRAPH_INT);
+    arg.intValue = value;
+    node.args.push_back(arg);
+  }
+  return *this;
+}
+
+THClLaunch &THClLaunch::in(float value)
+{
+  kernel->in(value);
+  if(recording) {
+    THClGraphArg arg = THClGraph_newArg(THCL_GRAPH_FLOAT);
+    arg.floatValue = value;
+    node.args.push_back(arg);
+  }
+  return *this;
+}
+
+THClLaunch &THClLaunch::scalar(float value)
+{
+  kernel->in(value);
+  if(recording) {
+    THClGraphArg arg = THClGraph_newArg(THCL_GRAPH_SCALAR);
+    arg.floatValue = value;
+    node.args.push_back(arg);
+  }
+  return *this;
+}
+
+THClLaunch &THClLaunch::localFloats(int count)
+{
+  kernel->localFloats(count);
+  if(recording) {
+    THClGraphArg arg = THClGraph_newArg(THCL_GRAPH_LOCAL);
+    arg.intValue = count;
+    node.args.push_back(arg);
+  }
+  return *this;
+}
+
+void THClLaunch::run(int dims, const size_t *global, const size_t *local)
+{
+  kernel->run(dims, global, local);
+  if(recording) {
+    node.dims = dims;
+    for(int i = 0; i < dims; i++) {
+      node.global[i] = global[i];
+      node.local[i] = local[i];
+    }
+    state->capture->nodes.push_back(node);
+  }
+}
+
+void THClLaunch::run_1d(int global, int local)
+{
+  size_t global_ws = global;
+  size_t local_ws = local;
+  run(1, &global_ws, &local_ws);
+}
+
+static void THClGraph_replayKernel(THClGraphNode &node)
+{
+  CLKernel *kernel = node.kernel;
+  for(size_t i = 0; i < node.args.size(); i++) {
+    THClGraphArg &arg = node.args[i];
+    switch(arg.kind) {
+      case THCL_GRAPH_IN:
+        kernel->in(arg.storage->wrapper);
+        break;
+      case THCL_GRAPH_OUT:
+        kernel->out(arg.storage->wrapper);
+        break;
+      case THCL_GRAPH_INOUT:
+        kernel->inout(arg.storage->wrapper);
+        break;
+      case THCL_GRAPH_INT:
+        kernel->in(arg.intValue);
+        break;
+      case THCL_GRAPH_FLOAT:
+      case THCL_GRAPH_SCALAR:
+        kernel->in(arg.floatValue);
+        break;
+      case THCL_GRAPH_STRUCT:
+        kernel->in(arg.wrapper);
+        break;
+      case THCL_GRAPH_LOCAL:
+        kernel->localFloats(arg.intValue);
+        break;
+    }
+  }
+  kernel->run(node.dims, node.global, node.local);
+}
+
+void THClGraph_replay(THClState *state, THClGraph *graph)
+{
+  THArgCheck(state->capture == 0, 1, "can't replay a graph while capturing one");
+  int oldDevice = THClState_getDevice(state);
+  THClState_setDevice(state, graph->device);
+  for(size_t i = 0; i < graph->nodes.size(); i++) {
+    THClGraphNode &node = graph->nodes[i];
+    cl_event profileBegin = THClProfiler_begin(state);
+    if(node.kernel != 0) {
+      THClGraph_replayKernel(node);
+    } else {
+      vector<THClGraphArg> &args = node.args;
+      THClBlas_gemm(state, node.transa, node.transb, node.m, node.n, node.k,
+        args[0].floatValue, args[2].storage->wrapper, node.offseta, node.lda,
+        args[3].storage->wrapper, node.offsetb, node.ldb,
+        args[1].floatValue, args[4].storage->wrapper, node.offsetc, node.ldc);
+    }
+    THClProfiler_end(state, profileBegin, "replay " + node.name, "", 0);
+  }
+  state->cl->finish();
+  THClState_setDevice(state, oldDevice);
+}
+
+int THClGraph_numNodes(THClGraph *graph)
+{
+  return (int)graph->nodes.size();
+}
+
+int THClGraph_numScalars(THClGraph *graph)
+{
+  return (int)graph->scalars.size();
+}
+
+float THClGraph_getScalar(THClGraph *graph, int index)
+{
+  THArgCheck(index >= 0 && index < (int)graph->scalars.size(), 2, "scalar index out of range");
+  return graph->scalars[index]->floatValue;
+}
+
+void THClGraph_setScalar(THClGraph *graph, int index, float value)
+{
+  THArgCheck(index >= 0 && index < (int)graph->scalars.size(), 2, "scalar index out of range");
+  graph->scalars[index]->floatValue = value;
+}
+
+void THClGraph_updateTensor(THClState *state, THClGraph *graph, THClTensor *oldTensor, THClTensor *newTensor)
+{
+  THArgCheck(THClTensor_isSameSizeAs(state, oldTensor, newTensor), 4, "sizes don't match");
+  THArgCheck(oldTensor->storageOffset == newTensor->storageOffset, 4, "storage offsets don't match");
+  for(int d = 0; d < oldTensor->nDimension; d++) {
+    THArgCheck(oldTensor->stride[d] == newTensor->stride[d], 4, "strides don't match");
+  }
+  THArgCheck(newTensor->storage != 0 && newTensor->storage->dataType == oldTensor->storage->dataType,
+    4, "storage types don't match");
+  THClStorage *oldStorage = oldTensor->storage;
+  THClStorage *newStorage = newTensor->storage;
+  if(oldStorage == newStorage) {
+    return;
+  }
+  for(size_t i = 0; i < graph->nodes.size(); i++) {
+    vector<THClGraphArg> &args = graph->nodes[i].args;
+    for(size_t j = 0; j < args.size(); j++) {
+      if(args[j].storage == oldStorage) {
+        THClStorage_retain(state, newStorage);
+        THClStorage_free(state, oldStorage);
+        args[j].storage = newStorage;
+      }
+    }
+  }
+}
+
+void THClGraph_free(THClState *state, THClGraph *graph)
+{
+  for(size_t i = 0; i < graph->nodes.size(); i++) {
+    vector<THClGraphArg> &args = graph->nodes[i].args;
+    for(size_t j = 0; j < args.size(); j++) {
+      if(args[j].storage != 0) {
+        THClStorage_free(state, args[j].storage);
+      }
+      if(args[j].wrapper != 0) {
+        delete args[j].wrapper;
+        delete[] args[j].structData;
+      }
+    }
+  }
+  delete graph;
+}
@@ -0,0 +1,130 @@
+#ifndef THCL_GRAPH_INC
+#define THCL_GRAPH_INC
+
+#include "THClGeneral.h"
+
+struct THClStorage;
+struct THClTensor;
+
+// Capture and replay of kernel launch sequences.
+//
+// Between THClGraph_beginCapture and THClGraph_endCapture, ops run as
+// usual, and each kernel launch made through THClLaunch, and each gemm, is
+// also recorded with its buffers and arguments.  Replaying the graph
+// enqueues the same launches again, skipping TensorInfo, kernel lookup and
+// argument marshalling.  Host transfers, and values read back to the host,
+// are not recorded.
+//
+// The graph keeps a reference to every storage it launches on, so
+// temporaries the ops allocated stay valid.  Op scalars (eg the value in
+// add(value)), and gemm's alpha and beta, are slots that can be changed
+// between replays; a storage can be swapped for another tensor of the same
+// layout.
+
+typedef struct THClGraph THClGraph;
+
+THCL_API void THClGraph_beginCapture(THClState *state);
+THCL_API THClGraph *THClGraph_endCapture(THClState *state);
+THCL_API int THClGraph_isCapturing(THClState *state);
+THCL_API void THClGraph_replay(THClState *state, THClGraph *graph);
+THCL_API int THClGraph_numNodes(THClGraph *graph);
+THCL_API int THClGraph_numScalars(THClGraph *graph);
+THCL_API float THClGraph_getScalar(THClGraph *graph, int index);
+THCL_API void THClGraph_setScalar(THClGraph *graph, int index, float value);
+// rebinds every launch on oldTensor's storage to newTensor's, which must have
+// the same sizes, strides and storage offset
+THCL_API void THClGraph_updateTensor(THClState *state, THClGraph *graph, struct THClTensor *oldTensor,
+  struct THClTensor *newTensor);
+THCL_API void THClGraph_free(THClState *state, THClGraph *graph);
+
+// called by THClBlas_gemm while capturing
+THCL_API void THClGraph_recordGemm(THClState *state, char transa, char transb, long m, long n, long k,
+  float alpha, struct CLWrapper *aWrapper, long offseta, long lda, struct CLWrapper *bWrapper, long offsetb,
+  long ldb, float beta, struct CLWrapper *cWrapper, long offsetc, long ldc);
+
+#ifdef __cplusplus
+#include <string>
+#include <vector>
+#include "EasyCL.h"
+
+#define THCL_GRAPH_IN 0
+#define THCL_GRAPH_OUT 1
+#define THCL_GRAPH_INOUT 2
+#define THCL_GRAPH_INT 3
+#define THCL_GRAPH_FLOAT 4
+#define THCL_GRAPH_SCALAR 5 // a float that can be changed between replays
+#define THCL_GRAPH_STRUCT 6 // bytes passed by pointer, eg a TensorInfoCl
+#define THCL_GRAPH_LOCAL 7
+
+struct THClGraphArg {
+  int kind;
+  struct THClStorage *storage; // IN, OUT, INOUT
+  CLWrapper *wrapper;          // STRUCT: owned by the graph
+  float *structData;
+  int intValue;                // INT, and LOCAL's float count
+  float floatValue;            // FLOAT, SCALAR
+};
+
+struct THClGraphNode {
+  std::string name;
+  CLKernel *kernel; // 0 for gemm
+  std::vector<THClGraphArg> args; // gemm: alpha, beta, a, b, c
+  int dims;
+  size_t global[3];
+  size_t local[3];
+  char transa; // gemm only, from here on
+  char transb;
+  long m, n, k;
+  long offseta, lda, offsetb, ldb, offsetc, ldc;
+};
+
+struct THClGraph {
+  int device;
+  std::vector<THClGraphNode> nodes;
+  std::vector<THClGraphArg *> scalars; // refreshed after nodes stops growing
+};
+
+// Stands in for a CLKernel while setting arguments and running it, so the
+// launch is recorded when a capture is on.  Scalars that belong to the op,
+// rather than to the tensor layout, go through scalar().
+class THClLaunch {
+public:
+  THClLaunch(THClState *state, CLKernel *kernel, std::string name);
+  THClLaunch &in(CLWrapper *wrapper);
+  THClLaunch &out(CLWrapper *wrapper);
+  THClLaunch &inout(CLWrapper *wrapper);
+  THClLaunch &in(int value);
+  THClLaunch &in(float value);
+  THClLaunch &scalar(float value);
+  THClLaunch &localFloats(int count);
+  // the floats of wrapper the kernel uses; call before passing wrapper.  Only
+  // matters for lazily mapped storages, which otherwise upload all of wrapper
+  THClLaunch &range(CLWrapper *wrapper, long first, long count);
+  template< typename T >
+  THClLaunch &in(int N, const T *data) {
+    kernel->in(N, data);
+    if(recording) {
+      recordStruct(data, N * sizeof(T));
+    }
+    return *this;
+  }
+  void run(int dims, const size_t *global, const size_t *local);
+  void run_1d(int global, int local);
+private:
+  void recordBuffer(int kind, CLWrapper *wrapper);
+  void touch(CLWrapper *wrapper);
+  void recordStruct(const void *data, size_t bytes);
+  THClState *state;
+  CLKernel *kernel;
+  bool recording;
+  THClGraphNode node;
+  struct Range {
+    CLWrapper *wrapper;
+    long first;
+    long count;
+  };
+  std::vector<Range> ranges;
+};
+#endif // __cplusplus
+
+#endif
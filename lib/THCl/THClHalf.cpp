@@ -0,0 +1,36 @@
+#include "THClHalf.h"
+
+THClHalfStorage* THClHalfStorage_new(THClState *state)
+{
+  return THClStorage_newOfType(state, THCL_HALF);
+}
+
+THClHalfStorage* THClHalfStorage_newWithSize(THClState *state, long size)
+{
+  return THClStorage_newWithSizeOfType(state, size, THCL_HALF);
+}
+
+THClHalfTensor* THClHalfTensor_new(THClState *state)
+{
+  THClHalfStorage *storage = THClHalfStorage_new(state);
+  THClHalfTensor *self = THClTensor_newWithStorage(state, storage, 0, NULL, NULL);
+  THClStorage_free(state, storage);
+  return self;
+}
+
+THClHalfTensor* THClHalfTensor_newWithSize(THClState *state, THLongStorage *size, THLongStorage *stride)
+{
+  return THClHalfTensor_newWithStorage(state, NULL, 0, size, stride);
+}
+
+THClHalfTensor* THClHalfTensor_newWithStorage(THClState *state, THClHalfStorage *storage, long storageOffset, THLongStorage *size, THLongStorage *stride)
+{
+  if(storage)
+    return THClTensor_newWithStorage(state, storage, storageOffset, size, stride);
+
+  // no storage given: start from an empty half one, which the resize grows
+  storage = THClHalfStorage_new(state);
+  THClHalfTensor *self = THClTensor_newWithStorage(state, storage, storageOffset, size, stride);
+  THClStorage_free(state, storage);
+  return self;
+}
@@ -0,0 +1,78 @@
+#ifndef THCL_HALF_INC
+#define THCL_HALF_INC
+
+#include "THClGeneral.h"
+#include "THClStorage.h"
+#include "THClTensor.h"
+
+/* A ClHalfTensor is a ClTensor whose storage holds 16-bit floats.  Kernels
+   load and store it with vload_half/vstore_half and compute in float, and
+   the copies convert to and from float as needed, all keyed off
+   storage->dataType.  So only the constructors differ from ClTensor; the
+   rest of the THClHalf* api is the THCl one. */
+typedef THClStorage THClHalfStorage;
+typedef THClTensor THClHalfTensor;
+
+THCL_API THClHalfStorage* THClHalfStorage_new(THClState *state);
+THCL_API THClHalfStorage* THClHalfStorage_newWithSize(THClState *state, long size);
+
+THCL_API THClHalfTensor* THClHalfTensor_new(THClState *state);
+THCL_API THClHalfTensor* THClHalfTensor_newWithSize(THClState *state, THLongStorage *size, THLongStorage *stride);
+THCL_API THClHalfTensor* THClHalfTensor_newWithStorage(THClState *state, THClHalfStorage *storage, long storageOffset, THLongStorage *size, THLongStorage *stride);
+
+#define THClHalfStorage_newWithData THClStorage_newWithData
+#define THClHalfStorage_newWithMapping THClStorage_newWithMapping
+#define THClHalfStorage_retain THClStorage_retain
+#define THClHalfStorage_free THClStorage_free
+#define THClHalfStorage_resize THClStorage_resize
+#define THClHalfStorage_fill THClStorage_fill
+#define THClHalfStorage_get THClStorage_get
+#define THClHalfStorage_set THClStorage_set
+#define THClHalfStorage_copy THClStorage_copy
+#define THClHalfStorage_copyByte THClStorage_copyByte
+#define THClHalfStorage_copyChar THClStorage_copyChar
+#define THClHalfStorage_copyShort THClStorage_copyShort
+#define THClHalfStorage_copyInt THClStorage_copyInt
+#define THClHalfStorage_copyLong THClStorage_copyLong
+#define THClHalfStorage_copyFloat THClStorage_copyFloat
+#define THClHalfStorage_copyDouble THClStorage_copyDouble
+
+#define THClHalfTensor_newWithTensor THClTensor_newWithTensor
+#define THClHalfTensor_newClone THClTensor_newClone
+#define THClHalfTensor_newContiguous THClTensor_newContiguous
+#define THClHalfTensor_newSizeOf THClTensor_newSizeOf
+#define THClHalfTensor_newStrideOf THClTensor_newStrideOf
+#define THClHalfTensor_storage THClTensor_storage
+#define THClHalfTensor_storageOffset THClTensor_storageOffset
+#define THClHalfTensor_nElement THClTensor_nElement
+#define THClHalfTensor_isContiguous THClTensor_isContiguous
+#define THClHalfTensor_isSameSizeAs THClTensor_isSameSizeAs
+#define THClHalfTensor_setStorage THClTensor_setStorage
+#define THClHalfTensor_resize THClTensor_resize
+#define THClHalfTensor_resizeAs THClTensor_resizeAs
+#define THClHalfTensor_narrow THClTensor_narrow
+#define THClHalfTensor_select THClTensor_select
+#define THClHalfTensor_transpose THClTensor_transpose
+#define THClHalfTensor_unfold THClTensor_unfold
+#define THClHalfTensor_free THClTensor_free
+#define THClHalfTensor_fill THClTensor_fill
+#define THClHalfTensor_get1d THClTensor_get1d
+#define THClHalfTensor_indexCopy THClTensor_indexCopy
+#define THClHalfTensor_indexFill THClTensor_indexFill
+#define THClHalfTensor_indexSelect THClTensor_indexSelect
+#define THClHalfTensor_maskedCopy THClTensor_maskedCopy
+#define THClHalfTensor_maskedCopyByte THClTensor_maskedCopyByte
+#define THClHalfTensor_maskedFill THClTensor_maskedFill
+#define THClHalfTensor_maskedFillByte THClTensor_maskedFillByte
+#define THClHalfTensor_maskedSelect THClTensor_maskedSelect
+#define THClHalfTensor_maskedSelectByte THClTensor_maskedSelectByte
+#define THClHalfTensor_copy THClTensor_copy
+#define THClHalfTensor_copyByte THClTensor_copyByte
+#define THClHalfTensor_copyChar THClTensor_copyChar
+#define THClHalfTensor_copyShort THClTensor_copyShort
+#define THClHalfTensor_copyInt THClTensor_copyInt
+#define THClHalfTensor_copyLong THClTensor_copyLong
+#define THClHalfTensor_copyFloat THClTensor_copyFloat
+#define THClHalfTensor_copyDouble THClTensor_copyDouble
+
+#endif
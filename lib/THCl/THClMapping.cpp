@@ -0,0 +1,198 @@
+#include "THClMapping.h"
+#include "THClStorage.h"
+#include "THClMemory.h"
+#include "THClProfiler.h"
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+static THClMappings *THClMapping_get(THClState *state)
+{
+  if(state->mappings == 0) {
+    state->mappings = new THClMappings();
+  }
+  return state->mappings;
+}
+
+static THClMappedFile *THClMapping_find(THClState *state, const CLWrapper *wrapper)
+{
+  if(state->mappings == 0) {
+    return 0;
+  }
+  map<const CLWrapper *, THClMappedFile *>::iterator it = state->mappings->byWrapper.find(wrapper);
+  return it == state->mappings->byWrapper.end() ? 0 : it->second;
+}
+
+static long THClMapping_numChunks(long numFloats)
+{
+  return (numFloats + THCL_MAPPING_CHUNK - 1) / THCL_MAPPING_CHUNK;
+}
+
+// enqueues the chunk's write straight from the mapping, and returns its
+// bytes; the queue is in order, so kernels enqueued after it see the data
+static long THClMapping_upload(THClState *state, CLWrapper *wrapper, THClMappedFile *mapped, long chunk)
+{
+  EasyCL *cl = THClState_getClForDevice(state, mapped->device);
+  long first = chunk * THCL_MAPPING_CHUNK;
+  long count = mapped->numFloats - first < THCL_MAPPING_CHUNK ? mapped->numFloats - first : THCL_MAPPING_CHUNK;
+  cl_int err = clEnqueueWriteBuffer(*cl->queue, wrapper->getBuffer(), CL_FALSE,
+    first * sizeof(float), count * sizeof(float), (float *)mapped->base + first, 0, 0, 0);
+  if(err != CL_SUCCESS) {
+    THError("clEnqueueWriteBuffer failed, OpenCL error %d", err);
+  }
+  mapped->resident[chunk] = true;
+  mapped->residentChunks++;
+  return count * sizeof(float);
+}
+
+static void THClMapping_uploadRange(THClState *state, CLWrapper *wrapper, THClMappedFile *mapped,
+    long firstChunk, long lastChunk)
+{
+  cl_event profileBegin = THClProfiler_begin(state);
+  long bytes = 0;
+  for(long chunk = firstChunk; chunk <= lastChunk; chunk++) {
+    if(!mapped->resident[chunk]) {
+      bytes += THClMapping_upload(state, wrapper, mapped, chunk);
+    }
+  }
+  if(bytes > 0) {
+    clFlush(*THClState_getClForDevice(state, mapped->device)->queue);
+    THClProfiler_end(state, profileBegin, "mapping upload", "", bytes);
+  }
+}
+
+THClStorage *THClMapping_newStorage(THClState *state, const char *fileName, long size, int isShared, int lazy)
+{
+#ifdef _WIN32
+  THError("file-backed ClStorages need mmap, which isn't available on this platform");
+  return 0;
+#else
+  int fd = open(fileName, isShared ? O_RDWR : O_RDONLY);
+  if(fd < 0) {
+    THError("couldn't open %s", fileName);
+  }
+  struct stat fileStat;
+  if(fstat(fd, &fileStat) != 0) {
+    close(fd);
+    THError("couldn't stat %s", fileName);
+  }
+  long fileFloats = (long)(fileStat.st_size / sizeof(float));
+  if(size == 0) {
+    size = fileFloats;
+  }
+  if(size <= 0 || size > fileFloats) {
+    close(fd);
+    THError("%s holds %ld floats, can't map %ld", fileName, fileFloats, size);
+  }
+  size_t length = size * sizeof(float);
+  // a private mapping can still be written: copyToHost lands there, in
+  // copy-on-write pages, without touching the file
+  void *base = mmap(0, length, PROT_READ | PROT_WRITE, isShared ? MAP_SHARED : MAP_PRIVATE, fd, 0);
+  close(fd);
+  if(base == MAP_FAILED) {
+    THError("couldn't map %s", fileName);
+  }
+
+  THClMappedFile *mapped = new THClMappedFile();
+  mapped->base = base;
+  mapped->length = length;
+  mapped->shared = isShared != 0;
+  mapped->device = THClState_getDevice(state);
+  mapped->numFloats = size;
+  mapped->resident.resize(THClMapping_numChunks(size), false);
+  mapped->residentChunks = 0;
+
+  THClStorage *storage = (THClStorage*)THAlloc(sizeof(THClStorage));
+  storage->data = (float *)base;
+  storage->size = size;
+  storage->refcount = 1;
+  storage->flag = TH_STORAGE_REFCOUNTED | TH_STORAGE_RESIZABLE | TH_STORAGE_FREEMEM;
+  storage->device = mapped->device;
+  storage->dataType = THCL_FLOAT;
+  storage->wrapper = state->cl->wrap(size, storage->data);
+  storage->wrapper->createOnDevice();
+  THClMapping_get(state)->byWrapper[storage->wrapper] = mapped;
+  THClMemory_allocated(state, storage);
+  if(!lazy) {
+    THClMapping_uploadRange(state, storage->wrapper, mapped, 0, (long)mapped->resident.size() - 1);
+  }
+  return storage;
+#endif
+}
+
+int THClMapping_isMapped(THClState *state, const THClStorage *storage)
+{
+  return storage->wrapper != 0 && THClMapping_find(state, storage->wrapper) != 0;
+}
+
+void THClMapping_release(THClState *state, THClStorage *storage)
+{
+#ifndef _WIN32
+  CLWrapper *wrapper = storage->wrapper;
+  THClMappedFile *mapped = THClMapping_find(state, wrapper);
+  THAssert(mapped != 0);
+  EasyCL *cl = THClState_getClForDevice(state, mapped->device);
+  if(mapped->shared && wrapper->isDeviceDirty()) {
+    THClMapping_touchAll(state, wrapper);
+    THClProfiler_copyToHost(state, wrapper);
+    msync(mapped->base, mapped->length, MS_SYNC);
+  }
+  // uploads still queued read from the mapping
+  cl->finish();
+  state->mappings->byWrapper.erase(wrapper);
+  delete wrapper;
+  munmap(mapped->base, mapped->length);
+  delete mapped;
+  storage->wrapper = 0;
+  storage->data = 0;
+#endif
+}
+
+void THClMapping_getResidency(THClState *state, const THClStorage *storage, long *residentChunks, long *numChunks)
+{
+  THClMappedFile *mapped = storage->wrapper != 0 ? THClMapping_find(state, storage->wrapper) : 0;
+  THArgCheck(mapped != 0, 2, "storage isn't file-backed");
+  *residentChunks = mapped->residentChunks;
+  *numChunks = (long)mapped->resident.size();
+}
+
+void THClMapping_touch(THClState *state, CLWrapper *wrapper, long first, long count)
+{
+  THClMappedFile *mapped = THClMapping_find(state, wrapper);
+  if(mapped == 0 || mapped->residentChunks == (long)mapped->resident.size() || count <= 0) {
+    return;
+  }
+  long last = first + count - 1 < mapped->numFloats - 1 ? first + count - 1 : mapped->numFloats - 1;
+  THClMapping_uploadRange(state, wrapper, mapped, first / THCL_MAPPING_CHUNK, last / THCL_MAPPING_CHUNK);
+}
+
+void THClMapping_touchAll(THClState *state, CLWrapper *wrapper)
+{
+  THClMappedFile *mapped = THClMapping_find(state, wrapper);
+  if(mapped == 0 || mapped->residentChunks == (long)mapped->resident.size()) {
+    return;
+  }
+  THClMapping_uploadRange(state, wrapper, mapped, 0, (long)mapped->resident.size() - 1);
+}
+
+void THClMapping_markResident(THClState *state, CLWrapper *wrapper)
+{
+  THClMappedFile *mapped = THClMapping_find(state, wrapper);
+  if(mapped == 0) {
+    return;
+  }
+  mapped->resident.assign(mapped->resident.size(), true);
+  mapped->residentChunks = (long)mapped->resident.size();
+}
+
+void THClMapping_free(THClState *state)
+{
+  delete state->mappings;
+  state->mappings = 0;
+}
@@ -0,0 +1,64 @@
+#ifndef THCL_MAPPING_INC
+#define THCL_MAPPING_INC
+
+#include "THClGeneral.h"
+
+struct THClStorage;
+
+// ClStorages backed by a memory-mapped file, for THClStorage_newWithMapping.
+//
+// storage->data is the mapping itself, so there is no host copy of the
+// file: it goes to the device in chunks, straight from the page cache.  A
+// lazy mapping uploads each chunk the first time a kernel touches it.
+// Launches give the range of each buffer they use with THClLaunch::range;
+// a buffer launched without one, a gemm, and any read back to the host,
+// make the whole storage resident.
+//
+// The mapping is private unless shared is set.  A shared mapping writes the
+// device contents back to the file when the storage is freed, if a kernel
+// has written to it.
+
+// floats per chunk
+#define THCL_MAPPING_CHUNK (1024 * 1024)
+
+// size 0 maps the whole file
+THCL_API struct THClStorage *THClMapping_newStorage(THClState *state, const char *fileName, long size,
+  int isShared, int lazy);
+THCL_API int THClMapping_isMapped(THClState *state, const struct THClStorage *storage);
+// called by THClStorage_free and THClStorage_resize, instead of freeing storage->data
+THCL_API void THClMapping_release(THClState *state, struct THClStorage *storage);
+THCL_API void THClMapping_getResidency(THClState *state, const struct THClStorage *storage,
+  long *residentChunks, long *numChunks);
+THCL_API void THClMapping_free(THClState *state);
+
+#ifdef __cplusplus
+#include <map>
+#include <vector>
+#include "EasyCL.h"
+
+struct THClMappedFile {
+  void *base;
+  size_t length; // bytes mapped
+  bool shared;
+  int device;
+  long numFloats;
+  std::vector<bool> resident; // per chunk
+  long residentChunks;
+};
+
+typedef struct THClMappings {
+  std::map<const CLWrapper *, THClMappedFile *> byWrapper;
+} THClMappings;
+
+// make [first, first + count) floats of wrapper resident, if it's lazily mapped
+void THClMapping_touch(THClState *state, CLWrapper *wrapper, long first, long count);
+void THClMapping_touchAll(THClState *state, CLWrapper *wrapper);
+// after wrapper->copyToDevice, which uploads the whole mapping
+void THClMapping_markResident(THClState *state, CLWrapper *wrapper);
+
+inline bool THClMapping_any(THClState *state) {
+  return state->mappings != 0 && !state->mappings->byWrapper.empty();
+}
+#endif // __cplusplus
+
+#endif
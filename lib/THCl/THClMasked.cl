@@ -0,0 +1,28 @@
+// OpenCL kernels....
+
+// expected templated values:
+// MaskType: OpenCL type of the mask, uchar or float
+//
+// positions comes from THClScan_exclusiveSum over the mask; it travels in
+// a float wrapper on the host side, so it's just reinterpreted as int here
+
+// dst[positions[i]] = src[i], where mask[i] is set
+kernel void THClMasked_compact(int n, global const {{MaskType}} *mask, int maskOffset,
+    global const int *positions, global const float *src, int srcOffset,
+    global float *dst, int dstOffset) {
+  const int linearIndex = get_global_id(0);
+  if(linearIndex < n && mask[maskOffset + linearIndex] != 0) {
+    dst[dstOffset + positions[linearIndex]] = src[srcOffset + linearIndex];
+  }
+}
+
+// dst[i] = src[positions[i]], where mask[i] is set
+kernel void THClMasked_expand(int n, global const {{MaskType}} *mask, int maskOffset,
+    global const int *positions, global const float *src, int srcOffset,
+    global float *dst, int dstOffset) {
+  const int linearIndex = get_global_id(0);
+  if(linearIndex < n && mask[maskOffset + linearIndex] != 0) {
+    dst[dstOffset + linearIndex] = src[srcOffset + positions[linearIndex]];
+  }
+}
+
@@ -0,0 +1,271 @@
+#include "THClMemory.h"
+#include "THClStorage.h"
+#include "THClProfiler.h"
+
+#include <algorithm>
+#ifndef _WIN32
+#include <execinfo.h>
+#endif
+
+using namespace std;
+
+static THClMemoryStats *THClMemory_get(THClState *state)
+{
+  if(state->memory == 0) {
+    THClMemoryStats *stats = new THClMemoryStats();
+    stats->storages = 0;
+    stats->deviceBytes = 0;
+    stats->hostBytes = 0;
+    stats->peakDeviceBytes = 0;
+    stats->peakHostBytes = 0;
+    stats->allocations = 0;
+    stats->frees = 0;
+    stats->allocationsAtLastQuery = 0;
+    stats->lastQuery = THClProfiler_hostNow();
+    stats->tracking = false;
+    stats->siteHook = 0;
+    stats->siteHookContext = 0;
+    stats->pooledBytes = 0;
+    stats->poolLimit = THCL_DEFAULT_POOL_LIMIT;
+    stats->poolHits = 0;
+    state->memory = stats;
+  }
+  THClMemoryStats *stats = state->memory;
+  if((int)stats->deviceBytesPerDevice.size() < state->allocatedDevices) {
+    stats->deviceBytesPerDevice.resize(state->allocatedDevices, 0);
+  }
+  return stats;
+}
+
+// the device buffer and the host mirror are the same size
+static long THClMemory_storageBytes(const THClStorage *storage)
+{
+  return (long)storage->wrapper->size() * storage->wrapper->getElementSize();
+}
+
+static string THClMemory_nativeBacktrace()
+{
+#ifdef _WIN32
+  return "(no backtrace on this platform)";
+#else
+  void *frames[32];
+  int numFrames = backtrace(frames, 32);
+  char **symbols = backtrace_symbols(frames, numFrames);
+  string site = "";
+  // skip ourselves, and THClMemory_allocated
+  for(int i = 2; i < numFrames; i++) {
+    site += string("  ") + (symbols != 0 ? symbols[i] : "?") + "\n";
+  }
+  free(symbols);
+  return site;
+#endif
+}
+
+void THClMemory_allocated(THClState *state, THClStorage *storage)
+{
+  if(storage->wrapper == 0) {
+    return;
+  }
+  THClMemoryStats *stats = THClMemory_get(state);
+  long bytes = THClMemory_storageBytes(storage);
+  stats->storages++;
+  stats->allocations++;
+  stats->deviceBytes += bytes;
+  stats->hostBytes += bytes;
+  stats->deviceBytesPerDevice[storage->device] += bytes;
+  stats->peakDeviceBytes = std::max(stats->peakDeviceBytes, stats->deviceBytes);
+  stats->peakHostBytes = std::max(stats->peakHostBytes, stats->hostBytes);
+  stats->storagesByWrapper[storage->wrapper] = storage;
+  if(stats->tracking) {
+    THClAllocationSite site;
+    site.bytes = bytes;
+    site.device = storage->device;
+    site.site = stats->siteHook != 0 ? stats->siteHook(stats->siteHookContext) : THClMemory_nativeBacktrace();
+    stats->live[storage] = site;
+  }
+}
+
+void THClMemory_freed(THClState *state, THClStorage *storage)
+{
+  if(storage->wrapper == 0) {
+    return;
+  }
+  THClMemoryStats *stats = THClMemory_get(state);
+  long bytes = THClMemory_storageBytes(storage);
+  stats->storages--;
+  stats->frees++;
+  stats->deviceBytes -= bytes;
+  stats->hostBytes -= bytes;
+  stats->deviceBytesPerDevice[storage->device] -= bytes;
+  stats->live.erase(storage);
+  stats->storagesByWrapper.erase(storage->wrapper);
+}
+
+THClStorage *THClMemory_storageForWrapper(THClState *state, const CLWrapper *wrapper)
+{
+  THClMemoryStats *stats = THClMemory_get(state);
+  map<const CLWrapper *, THClStorage *>::iterator it = stats->storagesByWrapper.find(wrapper);
+  return it == stats->storagesByWrapper.end() ? 0 : it->second;
+}
+
+void THClMemory_setTracking(THClState *state, int tracking)
+{
+  THClMemory_get(state)->tracking = tracking != 0;
+}
+
+int THClMemory_isTracking(THClState *state)
+{
+  return state->memory != 0 && state->memory->tracking;
+}
+
+void THClMemory_setSiteHook(THClState *state, THClAllocationSiteHook hook, void *context)
+{
+  THClMemoryStats *stats = THClMemory_get(state);
+  stats->siteHook = hook;
+  stats->siteHookContext = context;
+}
+
+THClMemoryUsage THClMemory_getUsage(THClState *state)
+{
+  THClMemoryStats *stats = THClMemory_get(state);
+  THClMemoryUsage usage;
+  usage.storages = stats->storages;
+  usage.deviceBytes = stats->deviceBytes;
+  usage.hostBytes = stats->hostBytes;
+  usage.peakDeviceBytes = stats->peakDeviceBytes;
+  usage.peakHostBytes = stats->peakHostBytes;
+  usage.allocations = stats->allocations;
+  usage.frees = stats->frees;
+  usage.deviceBytesPerDevice = stats->deviceBytesPerDevice;
+  usage.pooledBytes = stats->pooledBytes;
+  usage.poolHits = stats->poolHits;
+
+  cl_ulong now = THClProfiler_hostNow();
+  double seconds = (now - stats->lastQuery) / 1e9;
+  usage.allocationsPerSecond = seconds > 0 ? (stats->allocations - stats->allocationsAtLastQuery) / seconds : 0;
+  stats->lastQuery = now;
+  stats->allocationsAtLastQuery = stats->allocations;
+  return usage;
+}
+
+struct THClSiteTotal {
+  string site;
+  long bytes;
+  long storages;
+};
+
+static bool THClMemory_largerSite(const THClSiteTotal &a, const THClSiteTotal &b)
+{
+  return a.bytes > b.bytes;
+}
+
+void THClMemory_dump(THClState *state, FILE *out)
+{
+  THClMemoryStats *stats = THClMemory_get(state);
+  fprintf(out, "cltorch memory: %ld storages, %ld device bytes (peak %ld), %ld host bytes (peak %ld), %ld bytes pooled\n",
+    stats->storages, stats->deviceBytes, stats->peakDeviceBytes, stats->hostBytes, stats->peakHostBytes,
+    stats->pooledBytes);
+  for(int i = 0; i < (int)stats->deviceBytesPerDevice.size(); i++) {
+    if(stats->deviceBytesPerDevice[i] != 0) {
+      fprintf(out, "  device %d: %ld bytes\n", i + 1, stats->deviceBytesPerDevice[i]);
+    }
+  }
+  if(!stats->tracking && stats->live.size() == 0) {
+    fprintf(out, "allocation sites aren't tracked; turn tracking on to see them\n");
+    return;
+  }
+
+  map<string, THClSiteTotal> bySite;
+  long trackedBytes = 0;
+  long trackedStorages = 0;
+  for(map<const THClStorage *, THClAllocationSite>::iterator it = stats->live.begin(); it != stats->live.end(); it++) {
+    THClSiteTotal &total = bySite[it->second.site];
+    total.site = it->second.site;
+    total.bytes += it->second.bytes;
+    total.storages++;
+    trackedBytes += it->second.bytes;
+    trackedStorages++;
+  }
+  vector<THClSiteTotal> sites;
+  for(map<string, THClSiteTotal>::iterator it = bySite.begin(); it != bySite.end(); it++) {
+    sites.push_back(it->second);
+  }
+  sort(sites.begin(), sites.end(), THClMemory_largerSite);
+  for(size_t i = 0; i < sites.size(); i++) {
+    fprintf(out, "%ld bytes in %ld storages, allocated at:\n%s\n",
+      sites[i].bytes, sites[i].storages, sites[i].site.c_str());
+  }
+  if(trackedStorages < stats->storages) {
+    fprintf(out, "%ld storages, %ld device bytes, were allocated before tracking was turned on\n",
+      stats->storages - trackedStorages, stats->deviceBytes - trackedBytes);
+  }
+}
+
+bool THClMemory_takeFromPool(THClState *state, int device, long numFloats, float **data, CLWrapper **wrapper)
+{
+  THClMemoryStats *stats = THClMemory_get(state);
+  multimap<pair<int, long>, THClPooledBuffer>::iterator it = stats->pool.find(make_pair(device, numFloats));
+  if(it == stats->pool.end()) {
+    return false;
+  }
+  *data = it->second.data;
+  *wrapper = it->second.wrapper;
+  stats->pool.erase(it);
+  stats->pooledBytes -= numFloats * sizeof(float);
+  stats->poolHits++;
+  return true;
+}
+
+bool THClMemory_returnToPool(THClState *state, int device, long numFloats, float *data, CLWrapper *wrapper)
+{
+  THClMemoryStats *stats = THClMemory_get(state);
+  long bytes = numFloats * sizeof(float);
+  if(stats->pooledBytes + bytes > stats->poolLimit) {
+    return false;
+  }
+  THClPooledBuffer buffer;
+  buffer.data = data;
+  buffer.wrapper = wrapper;
+  stats->pool.insert(make_pair(make_pair(device, numFloats), buffer));
+  stats->pooledBytes += bytes;
+  return true;
+}
+
+// deletes pooled buffers, largest first, until at most limit bytes are left
+static void THClMemory_trimPool(THClMemoryStats *stats, long limit)
+{
+  while(stats->pooledBytes > limit && !stats->pool.empty()) {
+    multimap<pair<int, long>, THClPooledBuffer>::iterator largest = stats->pool.begin();
+    for(multimap<pair<int, long>, THClPooledBuffer>::iterator it = stats->pool.begin(); it != stats->pool.end(); it++) {
+      if(it->first.second > largest->first.second) {
+        largest = it;
+      }
+    }
+    stats->pooledBytes -= largest->first.second * sizeof(float);
+    delete largest->second.wrapper;
+    delete[] largest->second.data;
+    stats->pool.erase(largest);
+  }
+}
+
+void THClMemory_setPoolLimit(THClState *state, long bytes)
+{
+  THClMemoryStats *stats = THClMemory_get(state);
+  stats->poolLimit = bytes;
+  THClMemory_trimPool(stats, bytes);
+}
+
+void THClMemory_emptyPool(THClState *state)
+{
+  THClMemory_trimPool(THClMemory_get(state), 0);
+}
+
+void THClMemory_free(THClState *state)
+{
+  if(state->memory == 0) {
+    return;
+  }
+  THClMemory_emptyPool(state);
+  delete state->memory;
+  state->memory = 0;
+}
@@ -0,0 +1,104 @@
+#ifndef THCL_MEMORY_INC
+#define THCL_MEMORY_INC
+
+#include "THClGeneral.h"
+
+struct THClStorage;
+
+// Accounting for ClStorage allocations.
+//
+// Counters are always kept: live storages, device bytes, bytes of the host
+// mirror (storage->data), peaks, and allocation / free counts.  With
+// tracking on, each storage allocated from then on also remembers where it
+// was allocated, so THClMemory_dump can show which call sites are holding
+// on to memory.
+//
+// Buffers of freed storages go into a pool, up to a limit in bytes, and are
+// handed out again to new storages of exactly the same size on the same
+// device, so the temporaries of a loop don't go back to the driver every
+// iteration.  Pooled buffers aren't counted in deviceBytes; they are in
+// pooledBytes.
+
+// called by THClStorage whenever it creates or deletes a wrapper
+THCL_API void THClMemory_allocated(THClState *state, struct THClStorage *storage);
+THCL_API void THClMemory_freed(THClState *state, struct THClStorage *storage);
+
+THCL_API void THClMemory_setTracking(THClState *state, int tracking);
+THCL_API int THClMemory_isTracking(THClState *state);
+// totals, then the live storages grouped by allocation site, largest first
+THCL_API void THClMemory_dump(THClState *state, FILE *out);
+THCL_API void THClMemory_free(THClState *state);
+
+#define THCL_DEFAULT_POOL_LIMIT (256l << 20)
+// 0 turns pooling off; the pool is trimmed to the new limit
+THCL_API void THClMemory_setPoolLimit(THClState *state, long bytes);
+THCL_API void THClMemory_emptyPool(THClState *state);
+
+#ifdef __cplusplus
+#include <string>
+#include <vector>
+#include <map>
+#include "EasyCL.h"
+
+struct THClMemoryUsage {
+  long storages;
+  long deviceBytes;
+  long hostBytes;
+  long peakDeviceBytes;
+  long peakHostBytes;
+  long allocations; // since THClInit
+  long frees;
+  double allocationsPerSecond; // since the previous THClMemory_getUsage
+  long pooledBytes;
+  long poolHits; // allocations served from the pool
+  std::vector<long> deviceBytesPerDevice;
+};
+
+struct THClAllocationSite {
+  long bytes;
+  int device;
+  std::string site;
+};
+
+struct THClPooledBuffer {
+  float *data;
+  CLWrapper *wrapper;
+};
+
+// returns the allocation site as text, eg a Lua traceback
+typedef std::string (*THClAllocationSiteHook)(void *context);
+
+typedef struct THClMemoryStats {
+  long storages;
+  long deviceBytes;
+  long hostBytes;
+  long peakDeviceBytes;
+  long peakHostBytes;
+  long allocations;
+  long frees;
+  std::vector<long> deviceBytesPerDevice;
+  long allocationsAtLastQuery;
+  cl_ulong lastQuery;
+  bool tracking;
+  std::map<const struct THClStorage *, THClAllocationSite> live;
+  std::map<const CLWrapper *, struct THClStorage *> storagesByWrapper;
+  THClAllocationSiteHook siteHook; // 0: use a native backtrace
+  void *siteHookContext;
+  // keyed by device and size in floats
+  std::multimap<std::pair<int, long>, THClPooledBuffer> pool;
+  long pooledBytes;
+  long poolLimit;
+  long poolHits;
+} THClMemoryStats;
+
+THClMemoryUsage THClMemory_getUsage(THClState *state);
+// the live storage that owns wrapper, or 0
+struct THClStorage *THClMemory_storageForWrapper(THClState *state, const CLWrapper *wrapper);
+void THClMemory_setSiteHook(THClState *state, THClAllocationSiteHook hook, void *context);
+// a pooled buffer of numFloats floats on device, if there is one
+bool THClMemory_takeFromPool(THClState *state, int device, long numFloats, float **data, CLWrapper **wrapper);
+// false if the pool is full, in which case the caller deletes the buffer
+bool THClMemory_returnToPool(THClState *state, int device, long numFloats, float *data, CLWrapper *wrapper);
+#endif // __cplusplus
+
+#endif
@@ -0,0 +1,112 @@
+// Norm kernels, for renorm and dist
+
+// expected templated values:
+// MAX_CLTORCH_DIMS
+//
+// pCase picks the norm: 0 counts the nonzero elements, 1 sums |x|, 2 sums
+// x^2, 3 takes the largest |x|, and 4 sums |x|^p
+
+// kernel argument that defines tensor layout
+typedef struct TensorInfoCl {
+  int sizes[{{MAX_CLTORCH_DIMS}}];
+  int strides[{{MAX_CLTORCH_DIMS}}];
+  int offset;
+  int dims;
+} TensorInfoCl;
+
+// where element linearId is, from the start of the storage
+int IndexToOffset_999_get(int linearId, global const TensorInfoCl *info) {
+  int offset = info->offset;
+  for (int i = info->dims - 1; i >= 0; --i) {
+    int curDimIndex = linearId % info->sizes[i];
+    offset += curDimIndex * info->strides[i];
+    linearId /= info->sizes[i];
+  }
+  return offset;
+}
+
+// fmax, except that NaNs win, as in TensorMaxReduceOp
+float normMax(float a, float b) {
+  return isnan(a) ? a : (isnan(b) ? b : fmax(a, b));
+}
+
+float normAccumulate(float acc, float x, float p, int pCase) {
+  switch(pCase) {
+    case 0: return acc + (x != 0 ? 1 : 0);
+    case 1: return acc + fabs(x);
+    case 2: return acc + x * x;
+    case 3: return normMax(acc, fabs(x));
+    default: return acc + pow(fabs(x), p);
+  }
+}
+
+float normCombine(float acc1, float acc2, int pCase) {
+  return pCase == 3 ? normMax(acc1, acc2) : acc1 + acc2;
+}
+
+float normFinish(float acc, float p, int pCase) {
+  switch(pCase) {
+    case 2: return sqrt(acc);
+    case 4: return pow(acc, 1 / p);
+    default: return acc;
+  }
+}
+
+// Folds smem[0..get_local_size(0)) into smem[0]
+void normReduceLocal(local float *smem, int pCase) {
+  const int tid = get_local_id(0);
+  const int size = get_local_size(0);
+  barrier(CLK_LOCAL_MEM_FENCE);
+  for (int s = 1; s < size; s <<= 1) {
+    if ((tid % (s << 1)) == 0 && tid + s < size) {
+      smem[tid] = normCombine(smem[tid], smem[tid + s], pCase);
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+  }
+}
+
+// A work group per slice: it finds the slice's norm, and if that's over
+// maxnorm, scales the slice down to it, as the CPU does.  info lays out the
+// elements of slice 0; slice i is sliceStride * i further on
+kernel void THClNorm_renorm(global const TensorInfoCl *info, global float *data,
+    int sliceStride, int sliceSize, int numSlices,
+    float p, int pCase, float maxnorm, local float *smem) {
+  const int tid = get_local_id(0);
+  const int size = get_local_size(0);
+  for (int slice = get_group_id(0); slice < numSlices; slice += get_num_groups(0)) {
+    const int base = slice * sliceStride;
+    float acc = 0;
+    for (int j = tid; j < sliceSize; j += size) {
+      acc = normAccumulate(acc, data[base + IndexToOffset_999_get(j, info)], p, pCase);
+    }
+    smem[tid] = acc;
+    normReduceLocal(smem, pCase);
+    const float norm = normFinish(smem[0], p, pCase);
+    if (norm > maxnorm) {
+      const float scale = maxnorm / (norm + 1e-7f);
+      for (int j = tid; j < sliceSize; j += size) {
+        data[base + IndexToOffset_999_get(j, info)] *= scale;
+      }
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+  }
+}
+
+// Each block folds the norm terms of a - b, over a strided share of their
+// elements, into partials[block]; they're folded together on the host side
+// with THClTensor_reduceAll
+kernel void THClNorm_distPartials(global const TensorInfoCl *aInfo, global const float *aData,
+    global const TensorInfoCl *bInfo, global const float *bData,
+    int totalElements, float p, int pCase, global float *partials, local float *smem) {
+  float acc = 0;
+  for (int i = get_global_id(0); i < totalElements; i += get_global_size(0)) {
+    const float diff = aData[IndexToOffset_999_get(i, aInfo)] - bData[IndexToOffset_999_get(i, bInfo)];
+    acc = normAccumulate(acc, diff, p, pCase);
+  }
+  smem[get_local_id(0)] = acc;
+  normReduceLocal(smem, pCase);
+  if (get_local_id(0) == 0) {
+    partials[get_group_id(0)] = smem[0];
+  }
+}
+
@@ -0,0 +1,231 @@
+#include "THClPrecompile.h"
+
+#include <iostream>
+#include <fstream>
+#include <stdexcept>
+
+using namespace std;
+
+static THClPrecompiler *THClPrecompile_get(THClState *state)
+{
+  if(state->precompiler == 0) {
+    THClPrecompiler *precompiler = new THClPrecompiler();
+    precompiler->compileOnly = false;
+    precompiler->stopping = false;
+    precompiler->worker = 0;
+    state->precompiler = precompiler;
+  }
+  return state->precompiler;
+}
+
+// caller holds the lock
+static void THClPrecompile_record(THClPrecompiler *precompiler, const THClKernelRecipe &recipe)
+{
+  if(precompiler->recorded.count(recipe.uniqueName) == 0) {
+    precompiler->recorded.insert(recipe.uniqueName);
+    precompiler->recipes.push_back(recipe);
+  }
+}
+
+static void THClPrecompile_work(THClPrecompiler *precompiler)
+{
+  unique_lock<mutex> lock(precompiler->mutex);
+  while(true) {
+    while(!precompiler->stopping && precompiler->queue.empty()) {
+      precompiler->changed.wait(lock);
+    }
+    if(precompiler->stopping) {
+      return;
+    }
+    THClPrecompileJob job = precompiler->queue.front();
+    precompiler->queue.pop_front();
+    lock.unlock();
+
+    // OpenCL allows building programs on one thread while another enqueues
+    // kernels on the same context
+    CLKernel *kernel = 0;
+    try {
+      kernel = job.cl->buildKernelFromString(job.recipe.source, job.recipe.kernelName, "", job.recipe.filename);
+    } catch(runtime_error &e) {
+      // left for the foreground, which will build it again and report the error
+      cout << "precompile of " << job.recipe.kernelName << " failed: " << e.what() << endl;
+    }
+
+    lock.lock();
+    if(kernel != 0) {
+      job.cl->storeKernel(job.recipe.uniqueName, kernel, true);
+    }
+    precompiler->inFlight.erase(make_pair(job.cl, job.recipe.uniqueName));
+    precompiler->changed.notify_all();
+  }
+}
+
+// caller holds the lock, and has put the job in inFlight
+static void THClPrecompile_enqueue(THClPrecompiler *precompiler, EasyCL *cl, const THClKernelRecipe &recipe)
+{
+  THClPrecompileJob job;
+  job.cl = cl;
+  job.recipe = recipe;
+  precompiler->queue.push_back(job);
+  if(precompiler->worker == 0) {
+    precompiler->worker = new thread(THClPrecompile_work, precompiler);
+  }
+  precompiler->changed.notify_all();
+}
+
+CLKernel *THClKernel_build(THClState *state, TemplatedKernel &kernelBuilder, string uniqueName,
+    string filename, string templateSource, string kernelName)
+{
+  THClPrecompiler *precompiler = THClPrecompile_get(state);
+  EasyCL *cl = state->cl;
+  pair<EasyCL *, string> key = make_pair(cl, uniqueName);
+  {
+    unique_lock<mutex> lock(precompiler->mutex);
+    if(precompiler->inFlight.count(key) != 0 && precompiler->compileOnly) {
+      return 0;
+    }
+    while(precompiler->inFlight.count(key) != 0) {
+      precompiler->changed.wait(lock);
+    }
+    if(cl->kernelExists(uniqueName)) {
+      return precompiler->compileOnly ? 0 : cl->getKernel(uniqueName);
+    }
+    precompiler->inFlight.insert(key);
+  }
+
+  THClKernelRecipe recipe;
+  recipe.uniqueName = uniqueName;
+  recipe.kernelName = kernelName;
+  recipe.filename = filename;
+  CLKernel *kernel = 0;
+  try {
+    recipe.source = kernelBuilder.getRenderedKernel(templateSource);
+    if(!precompiler->compileOnly) {
+      kernel = cl->buildKernelFromString(recipe.source, kernelName, "", filename);
+    }
+  } catch(runtime_error &e) {
+    lock_guard<mutex> lock(precompiler->mutex);
+    precompiler->inFlight.erase(key);
+    precompiler->changed.notify_all();
+    throw;
+  }
+
+  lock_guard<mutex> lock(precompiler->mutex);
+  THClPrecompile_record(precompiler, recipe);
+  if(kernel == 0) {
+    THClPrecompile_enqueue(precompiler, cl, recipe);
+    return 0;
+  }
+  cl->storeKernel(uniqueName, kernel, true);
+  precompiler->inFlight.erase(key);
+  precompiler->changed.notify_all();
+  return kernel;
+}
+
+void THClPrecompile_setCompileOnly(THClState *state, int compileOnly)
+{
+  THClPrecompiler *precompiler = THClPrecompile_get(state);
+  lock_guard<mutex> lock(precompiler->mutex);
+  precompiler->compileOnly = compileOnly != 0;
+}
+
+int THClPrecompile_isCompileOnly(THClState *state)
+{
+  return state->precompiler != 0 && state->precompiler->compileOnly;
+}
+
+// one header line per kernel, "<uniqueName length> <kernelName> <filename>
+// <source length>", followed by the name and the source
+void THClPrecompile_saveTrace(THClState *state, const char *filename)
+{
+  THClPrecompiler *precompiler = THClPrecompile_get(state);
+  ofstream out(filename, ios::binary);
+  if(!out) {
+    THError("couldn't open %s for writing", filename);
+  }
+  lock_guard<mutex> lock(precompiler->mutex);
+  out << "cltorch-kernel-trace 1" << "\n";
+  for(size_t i = 0; i < precompiler->recipes.size(); i++) {
+    const THClKernelRecipe &recipe = precompiler->recipes[i];
+    out << recipe.uniqueName.size() << " " << recipe.kernelName << " " << recipe.filename << " "
+      << recipe.source.size() << "\n" << recipe.uniqueName << recipe.source << "\n";
+  }
+}
+
+static string THClPrecompile_readBytes(ifstream &in, size_t length)
+{
+  string bytes(length, ' ');
+  if(length > 0) {
+    in.read(&bytes[0], length);
+  }
+  return bytes;
+}
+
+void THClPrecompile_loadTrace(THClState *state, const char *filename)
+{
+  THClPrecompiler *precompiler = THClPrecompile_get(state);
+  ifstream in(filename, ios::binary);
+  if(!in) {
+    THError("couldn't open %s", filename);
+  }
+  string magic;
+  int version = 0;
+  in >> magic >> version;
+  if(magic != "cltorch-kernel-trace" || version != 1) {
+    THError("%s is not a cltorch kernel trace", filename);
+  }
+  EasyCL *cl = state->cl;
+  size_t nameLength, sourceLength;
+  THClKernelRecipe recipe;
+  while(in >> nameLength >> recipe.kernelName >> recipe.filename >> sourceLength) {
+    in.get(); // the newline after the header line
+    recipe.uniqueName = THClPrecompile_readBytes(in, nameLength);
+    recipe.source = THClPrecompile_readBytes(in, sourceLength);
+    if(!in) {
+      THError("%s is truncated", filename);
+    }
+    lock_guard<mutex> lock(precompiler->mutex);
+    THClPrecompile_record(precompiler, recipe);
+    pair<EasyCL *, string> key = make_pair(cl, recipe.uniqueName);
+    if(precompiler->inFlight.count(key) != 0 || cl->kernelExists(recipe.uniqueName)) {
+      continue;
+    }
+    precompiler->inFlight.insert(key);
+    THClPrecompile_enqueue(precompiler, cl, recipe);
+  }
+}
+
+int THClPrecompile_pending(THClState *state)
+{
+  THClPrecompiler *precompiler = THClPrecompile_get(state);
+  lock_guard<mutex> lock(precompiler->mutex);
+  return (int)precompiler->inFlight.size();
+}
+
+void THClPrecompile_wait(THClState *state)
+{
+  THClPrecompiler *precompiler = THClPrecompile_get(state);
+  unique_lock<mutex> lock(precompiler->mutex);
+  while(!precompiler->inFlight.empty()) {
+    precompiler->changed.wait(lock);
+  }
+}
+
+void THClPrecompile_free(THClState *state)
+{
+  THClPrecompiler *precompiler = state->precompiler;
+  if(precompiler == 0) {
+    return;
+  }
+  {
+    lock_guard<mutex> lock(precompiler->mutex);
+    precompiler->stopping = true;
+    precompiler->changed.notify_all();
+  }
+  if(precompiler->worker != 0) {
+    precompiler->worker->join();
+    delete precompiler->worker;
+  }
+  delete precompiler;
+  state->precompiler = 0;
+}
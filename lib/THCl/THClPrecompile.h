@@ -0,0 +1,70 @@
+#ifndef THCL_PRECOMPILE_INC
+#define THCL_PRECOMPILE_INC
+
+#include "THClGeneral.h"
+
+// Building kernels ahead of time, on a background thread.
+//
+// Every templated kernel is built through THClKernel_build, which keeps
+// a recipe (name and rendered source) for it, so the set of kernels a run
+// used can be saved as a trace and queued for building at the start of
+// the next run.  While compile-only mode is on, THClKernel_build queues
+// the kernel it was asked for and returns 0, and the launchers return
+// without running anything: calling an op on small tensors queues the
+// kernels it needs.  A launch that needs a kernel the background thread is
+// still building waits for it, rather than building it a second time.
+
+THCL_API void THClPrecompile_setCompileOnly(THClState *state, int compileOnly);
+THCL_API int THClPrecompile_isCompileOnly(THClState *state);
+THCL_API void THClPrecompile_saveTrace(THClState *state, const char *filename);
+// queues every kernel in the trace that isn't built yet, for the current device
+THCL_API void THClPrecompile_loadTrace(THClState *state, const char *filename);
+// number of kernels queued or being built
+THCL_API int THClPrecompile_pending(THClState *state);
+// blocks until the queue is empty
+THCL_API void THClPrecompile_wait(THClState *state);
+// stops the background thread; queued kernels are dropped
+THCL_API void THClPrecompile_free(THClState *state);
+
+#ifdef __cplusplus
+#include <string>
+#include <vector>
+#include <set>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include "EasyCL.h"
+#include "templates/TemplatedKernel.h"
+
+struct THClKernelRecipe {
+  std::string uniqueName;
+  std::string kernelName;
+  std::string filename;
+  std::string source;
+};
+
+struct THClPrecompileJob {
+  EasyCL *cl;
+  THClKernelRecipe recipe;
+};
+
+typedef struct THClPrecompiler {
+  std::mutex mutex;
+  std::condition_variable changed; // a build finished, or a job was queued
+  std::deque<THClPrecompileJob> queue;
+  std::set<std::pair<EasyCL *, std::string> > inFlight; // queued, or being built
+  std::vector<THClKernelRecipe> recipes; // every kernel built, in order
+  std::set<std::string> recorded;
+  bool compileOnly;
+  bool stopping;
+  std::thread *worker; // started by the first queued job
+} THClPrecompiler;
+
+// the kernel uniqueName for state->cl: from the kernel store, from the
+// background thread, or built here.  Returns 0 in compile-only mode.
+CLKernel *THClKernel_build(THClState *state, TemplatedKernel &kernelBuilder, std::string uniqueName,
+  std::string filename, std::string templateSource, std::string kernelName);
+#endif // __cplusplus
+
+#endif
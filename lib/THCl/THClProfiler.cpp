@@ -0,0 +1,404 @@
+#include "THClProfiler.h"
+#include "THClMapping.h"
+#include "TH.h"
+
+#include <map>
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include "EasyCL.h"
+#include "util/easycl_stringhelper.h"
+
+using namespace std;
+
+// unresolved records, beyond which THClProfiler_end resolves the ones done
+#define THCL_PROFILER_PENDING_LIMIT 1024
+// resolved records kept for the trace
+#define THCL_PROFILER_MAX_RECORDS 100000
+
+static void THClProfiler_check(cl_int err, const char *what)
+{
+  if(err != CL_SUCCESS) {
+    THError("%s failed, OpenCL error %d", what, err);
+  }
+}
+
+static cl_ulong THClProfiler_timestamp(cl_event event, cl_profiling_info which)
+{
+  cl_ulong value = 0;
+  THClProfiler_check(clGetEventProfilingInfo(event, which, sizeof(value), &value, 0),
+    "clGetEventProfilingInfo");
+  return value;
+}
+
+cl_ulong THClProfiler_hostNow()
+{
+  return (cl_ulong)chrono::duration_cast<chrono::nanoseconds>(
+    chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static THClProfiler *THClProfiler_get(THClState *state)
+{
+  if(state->profiler == 0) {
+    state->profiler = new THClProfiler();
+    state->profiler->enabled = false;
+    state->profiler->firstPending = 0;
+  }
+  THClProfiler *profiler = state->profiler;
+  if((int)profiler->savedQueues.size() < state->allocatedDevices) {
+    profiler->savedQueues.resize(state->allocatedDevices, 0);
+    profiler->clockOffsets.resize(state->allocatedDevices, 0);
+  }
+  return profiler;
+}
+
+void THClProfiler_attachDevice(THClState *state, int device)
+{
+  THClProfiler *profiler = state->profiler;
+  if(profiler == 0 || !profiler->enabled || profiler->savedQueues[device] != 0) {
+    return;
+  }
+  EasyCL *cl = state->deviceCls[device];
+  if(cl == 0) {
+    return;
+  }
+  cl->finish();
+  cl_int err;
+  cl_command_queue queue = clCreateCommandQueue(*cl->context, cl->device, CL_QUEUE_PROFILING_ENABLE, &err);
+  THClProfiler_check(err, "clCreateCommandQueue");
+  profiler->savedQueues[device] = *cl->queue;
+  *cl->queue = queue;
+
+  // line the device clock up with the host one: a marker on an idle queue
+  // completes just before clWaitForEvents returns
+  cl_event marker;
+  THClProfiler_check(clEnqueueMarkerWithWaitList(queue, 0, 0, &marker), "clEnqueueMarkerWithWaitList");
+  THClProfiler_check(clWaitForEvents(1, &marker), "clWaitForEvents");
+  cl_ulong hostNow = THClProfiler_hostNow();
+  profiler->clockOffsets[device] = (long long)hostNow
+    - (long long)THClProfiler_timestamp(marker, CL_PROFILING_COMMAND_END);
+  clReleaseEvent(marker);
+}
+
+static void THClProfiler_detachDevice(THClState *state, int device)
+{
+  THClProfiler *profiler = state->profiler;
+  if(profiler->savedQueues[device] == 0) {
+    return;
+  }
+  EasyCL *cl = state->deviceCls[device];
+  cl->finish();
+  clReleaseCommandQueue(*cl->queue);
+  *cl->queue = profiler->savedQueues[device];
+  profiler->savedQueues[device] = 0;
+}
+
+void THClProfiler_start(THClState *state)
+{
+  THClProfiler *profiler = THClProfiler_get(state);
+  if(profiler->enabled) {
+    return;
+  }
+  THClProfiler_resolve(state);
+  profiler->records.clear();
+  profiler->firstPending = 0;
+  profiler->totals.clear();
+  profiler->totalIndex.clear();
+  profiler->hostSpans.clear();
+  profiler->enabled = true;
+  for(int i = 0; i < state->allocatedDevices; i++) {
+    THClProfiler_attachDevice(state, i);
+  }
+}
+
+void THClProfiler_stop(THClState *state)
+{
+  THClProfiler *profiler = THClProfiler_get(state);
+  if(!profiler->enabled) {
+    return;
+  }
+  // the markers live on the profiling queues, so resolve before swapping back
+  THClProfiler_resolve(state);
+  for(int i = 0; i < state->allocatedDevices; i++) {
+    THClProfiler_detachDevice(state, i);
+  }
+  profiler->enabled = false;
+}
+
+int THClProfiler_isEnabled(THClState *state)
+{
+  return state->profiler != 0 && state->profiler->enabled;
+}
+
+void THClProfiler_free(THClState *state)
+{
+  if(state->profiler == 0) {
+    return;
+  }
+  THClProfiler_stop(state);
+  delete state->profiler;
+  state->profiler = 0;
+}
+
+static bool THClProfiler_isComplete(cl_event event)
+{
+  cl_int status = CL_COMPLETE;
+  THClProfiler_check(clGetEventInfo(event, CL_EVENT_COMMAND_EXECUTION_STATUS, sizeof(status), &status, 0),
+    "clGetEventInfo");
+  return status <= CL_COMPLETE; // negative on failure, which clWaitForEvents reports
+}
+
+// fills in the record's timestamps, releases its markers, and adds it to the
+// totals.  queued and submit are the begin marker's: EasyCL doesn't give us
+// the kernel's own event
+static void THClProfiler_resolveRecord(THClProfiler *profiler, THClProfileRecord &record)
+{
+  THClProfiler_check(clWaitForEvents(1, &record.end), "clWaitForEvents");
+  record.queued = THClProfiler_timestamp(record.begin, CL_PROFILING_COMMAND_QUEUED);
+  record.submit = THClProfiler_timestamp(record.begin, CL_PROFILING_COMMAND_SUBMIT);
+  record.start = THClProfiler_timestamp(record.begin, CL_PROFILING_COMMAND_END);
+  record.finish = THClProfiler_timestamp(record.end, CL_PROFILING_COMMAND_END);
+  clReleaseEvent(record.begin);
+  clReleaseEvent(record.end);
+  record.begin = 0;
+  record.end = 0;
+
+  map<string, int>::iterator it = profiler->totalIndex.find(record.name);
+  if(it == profiler->totalIndex.end()) {
+    it = profiler->totalIndex.insert(make_pair(record.name, (int)profiler->totals.size())).first;
+    THClProfileSummary summary;
+    summary.name = record.name;
+    summary.calls = 0;
+    summary.milliseconds = 0;
+    summary.bytes = 0;
+    profiler->totals.push_back(summary);
+  }
+  THClProfileSummary &summary = profiler->totals[it->second];
+  summary.calls++;
+  summary.milliseconds += (record.finish - record.start) / 1000000.0;
+  summary.bytes += record.bytes;
+}
+
+// resolves records in order: all the ones already complete, and then,
+// waiting if need be, until at most maxPending are left.  Then drops the
+// oldest resolved records past THCL_PROFILER_MAX_RECORDS
+static void THClProfiler_resolveSome(THClProfiler *profiler, size_t maxPending)
+{
+  deque<THClProfileRecord> &records = profiler->records;
+  while(profiler->firstPending < records.size()) {
+    THClProfileRecord &record = records[profiler->firstPending];
+    if(records.size() - profiler->firstPending <= maxPending && !THClProfiler_isComplete(record.end)) {
+      break;
+    }
+    THClProfiler_resolveRecord(profiler, record);
+    profiler->firstPending++;
+  }
+  while(records.size() > THCL_PROFILER_MAX_RECORDS && profiler->firstPending > 0) {
+    records.pop_front();
+    profiler->firstPending--;
+  }
+}
+
+cl_event THClProfiler_begin(THClState *state)
+{
+  if(!THClProfiler_isEnabled(state)) {
+    return 0;
+  }
+  cl_event event = 0;
+  THClProfiler_check(clEnqueueMarkerWithWaitList(*state->cl->queue, 0, 0, &event),
+    "clEnqueueMarkerWithWaitList");
+  return event;
+}
+
+void THClProfiler_end(THClState *state, cl_event begin, string name, string shapeClass, long bytes)
+{
+  if(begin == 0) {
+    return;
+  }
+  THClProfileRecord record;
+  record.name = name;
+  record.shapeClass = shapeClass;
+  record.bytes = bytes;
+  record.device = state->currentDevice;
+  record.begin = begin;
+  record.end = 0;
+  record.queued = record.submit = record.start = record.finish = 0;
+  THClProfiler_check(clEnqueueMarkerWithWaitList(*state->cl->queue, 0, 0, &record.end),
+    "clEnqueueMarkerWithWaitList");
+  THClProfiler *profiler = state->profiler;
+  profiler->records.push_back(record);
+  if(profiler->records.size() - profiler->firstPending > THCL_PROFILER_PENDING_LIMIT) {
+    THClProfiler_resolveSome(profiler, THCL_PROFILER_PENDING_LIMIT / 2);
+  }
+}
+
+THClProfileSpan::THClProfileSpan(THClState *state, const char *name) :
+    state(state), name(name), start(0), open(false) {
+  if(THClProfiler_isEnabled(state)) {
+    start = THClProfiler_hostNow();
+    open = true;
+  }
+}
+
+THClProfileSpan::~THClProfileSpan() {
+  end();
+}
+
+void THClProfileSpan::end() {
+  if(!open) {
+    return;
+  }
+  open = false;
+  if(!THClProfiler_isEnabled(state)) {
+    return;
+  }
+  THClHostSpanRecord span;
+  span.name = name;
+  span.start = start;
+  span.finish = THClProfiler_hostNow();
+  state->profiler->hostSpans.push_back(span);
+}
+
+string THClProfiler_shapeClass(int dims, long elements)
+{
+  int k = 0;
+  while((1l << k) < elements) {
+    k++;
+  }
+  return easycl::toString(dims) + "d_2^" + easycl::toString(k);
+}
+
+void THClProfiler_resolve(THClState *state)
+{
+  if(state->profiler == 0) {
+    return;
+  }
+  THClProfiler_resolveSome(state->profiler, 0);
+}
+
+static bool THClProfiler_longerFirst(const THClProfileSummary &a, const THClProfileSummary &b)
+{
+  return a.milliseconds > b.milliseconds;
+}
+
+vector<THClProfileSummary> THClProfiler_summarize(THClState *state)
+{
+  vector<THClProfileSummary> summaries;
+  if(state->profiler == 0) {
+    return summaries;
+  }
+  THClProfiler_resolve(state);
+  summaries = state->profiler->totals;
+  sort(summaries.begin(), summaries.end(), THClProfiler_longerFirst);
+  return summaries;
+}
+
+void THClProfiler_copyToDevice(THClState *state, CLWrapper *wrapper)
+{
+  cl_event begin = THClProfiler_begin(state);
+  wrapper->copyToDevice();
+  THClMapping_markResident(state, wrapper);
+  THClProfiler_end(state, begin, "copyToDevice", THClProfiler_shapeClass(1, wrapper->size()),
+    (long)wrapper->size() * wrapper->getElementSize());
+}
+
+void THClProfiler_copyToHost(THClState *state, CLWrapper *wrapper)
+{
+  THClMapping_touchAll(state, wrapper);
+  cl_event begin = THClProfiler_begin(state);
+  wrapper->copyToHost();
+  THClProfiler_end(state, begin, "copyToHost", THClProfiler_shapeClass(1, wrapper->size()),
+    (long)wrapper->size() * wrapper->getElementSize());
+}
+
+static string THClProfiler_jsonString(const string &value)
+{
+  string result = "\"";
+  for(size_t i = 0; i < value.size(); i++) {
+    char c = value[i];
+    if(c == '"' || c == '\\') {
+      result += '\\';
+    }
+    if(c == '\n') {
+      result += "\\n";
+      continue;
+    }
+    result += c;
+  }
+  return result + "\"";
+}
+
+static void THClProfiler_writeEvent(ofstream &out, bool &first, const string &name, const char *category,
+    int tid, double startUs, double durationUs, const string &args)
+{
+  out << (first ? "\n" : ",\n");
+  first = false;
+  out << "{\"name\":" << THClProfiler_jsonString(name) << ",\"cat\":\"" << category << "\""
+    << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << tid
+    << ",\"ts\":" << startUs << ",\"dur\":" << durationUs;
+  if(args != "") {
+    out << ",\"args\":{" << args << "}";
+  }
+  out << "}";
+}
+
+static void THClProfiler_writeThreadName(ofstream &out, bool &first, int tid, const string &name)
+{
+  out << (first ? "\n" : ",\n");
+  first = false;
+  out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << tid
+    << ",\"args\":{\"name\":" << THClProfiler_jsonString(name) << "}}";
+}
+
+void THClProfiler_writeTrace(THClState *state, const char *filename)
+{
+  THClProfiler *profiler = THClProfiler_get(state);
+  THClProfiler_resolve(state);
+  ofstream out(filename);
+  if(!out) {
+    THError("couldn't open %s for writing", filename);
+  }
+  out.precision(15);
+  // timestamps are relative to the earliest event, so they stay readable
+  cl_ulong origin = 0;
+  bool haveOrigin = false;
+  for(size_t i = 0; i < profiler->hostSpans.size(); i++) {
+    if(!haveOrigin || profiler->hostSpans[i].start < origin) {
+      origin = profiler->hostSpans[i].start;
+      haveOrigin = true;
+    }
+  }
+  for(size_t i = 0; i < profiler->records.size(); i++) {
+    THClProfileRecord &record = profiler->records[i];
+    cl_ulong queued = record.queued + profiler->clockOffsets[record.device];
+    if(!haveOrigin || queued < origin) {
+      origin = queued;
+      haveOrigin = true;
+    }
+  }
+
+  bool first = true;
+  out << "{\"traceEvents\":[";
+  THClProfiler_writeThreadName(out, first, 0, "host");
+  for(int device = 0; device < state->allocatedDevices; device++) {
+    if(state->deviceCls[device] != 0) {
+      THClProfiler_writeThreadName(out, first, device + 1, "device " + easycl::toString(device + 1) + " queue");
+    }
+  }
+  for(size_t i = 0; i < profiler->hostSpans.size(); i++) {
+    THClHostSpanRecord &span = profiler->hostSpans[i];
+    THClProfiler_writeEvent(out, first, span.name, "host", 0,
+      (span.start - origin) / 1000.0, (span.finish - span.start) / 1000.0, "");
+  }
+  for(size_t i = 0; i < profiler->records.size(); i++) {
+    THClProfileRecord &record = profiler->records[i];
+    long long offset = profiler->clockOffsets[record.device];
+    double startUs = ((long long)record.start + offset - (long long)origin) / 1000.0;
+    string args = "\"shape\":" + THClProfiler_jsonString(record.shapeClass)
+      + ",\"bytes\":" + easycl::toString(record.bytes)
+      + ",\"queuedToStartUs\":" + easycl::toString((record.start - record.queued) / 1000.0);
+    THClProfiler_writeEvent(out, first, record.name, "device", record.device + 1,
+      startUs, (record.finish - record.start) / 1000.0, args);
+  }
+  out << "\n],\"displayTimeUnit\":\"ms\"}\n";
+}
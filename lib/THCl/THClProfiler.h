@@ -0,0 +1,109 @@
+#ifndef THCL_PROFILER_INC
+#define THCL_PROFILER_INC
+
+#include "THClGeneral.h"
+
+// Opt-in profiling of kernels, BLAS calls and host transfers.
+//
+// While started, every device queue is swapped for one created with
+// CL_QUEUE_PROFILING_ENABLE.  Each profiled call is bracketed by two marker
+// events on the current queue: the queued and submit times come from the
+// first marker, the start time is when the first marker completes (ie the
+// queue has drained up to the call), and the end time is when the second
+// marker completes.  EasyCL doesn't hand back the events from CLKernel::run,
+// so markers are the only way to time our own kernels; queued and submit are
+// the marker's, not the call's own.
+//
+// Records are resolved, and their events released, as they complete, once
+// more than THCL_PROFILER_PENDING_LIMIT are outstanding.  The summaries
+// cover every call; the trace keeps the last THCL_PROFILER_MAX_RECORDS.
+
+THCL_API void THClProfiler_start(THClState *state);
+THCL_API void THClProfiler_stop(THClState *state);
+THCL_API int THClProfiler_isEnabled(THClState *state);
+// writes a chrome://tracing JSON file: host spans on one track, and the
+// device records on one track per command queue, shifted onto the host clock
+THCL_API void THClProfiler_writeTrace(THClState *state, const char *filename);
+// called by THClState_getClForDevice, so devices first used mid-profile get
+// a profiling queue too
+THCL_API void THClProfiler_attachDevice(THClState *state, int device);
+THCL_API void THClProfiler_free(THClState *state);
+
+#ifdef __cplusplus
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include "EasyCL.h"
+
+struct THClProfileRecord {
+  std::string name;       // kernel unique name, or the BLAS / transfer name
+  std::string shapeClass; // eg "2d_2^20"; groups calls of a similar size
+  long bytes;             // bytes read and written by the call
+  int device;
+  cl_event begin;         // released once the record is resolved
+  cl_event end;
+  cl_ulong queued;        // nanoseconds, device clock; queued and submit
+  cl_ulong submit;        // are the begin marker's
+  cl_ulong start;
+  cl_ulong finish;
+};
+
+struct THClHostSpanRecord {
+  std::string name;
+  cl_ulong start;         // nanoseconds, host steady clock
+  cl_ulong finish;
+};
+
+struct THClProfileSummary {
+  std::string name;
+  int calls;
+  double milliseconds;
+  double bytes;
+};
+
+typedef struct THClProfiler {
+  bool enabled;
+  std::deque<THClProfileRecord> records;
+  size_t firstPending; // records before this one are resolved
+  std::vector<THClProfileSummary> totals; // per name, as records resolve
+  std::map<std::string, int> totalIndex;
+  std::vector<cl_command_queue> savedQueues; // one per device, 0 if not swapped
+  std::vector<THClHostSpanRecord> hostSpans;
+  std::vector<long long> clockOffsets; // per device: host clock minus device clock, ns
+} THClProfiler;
+
+// Times a stretch of host code, for the trace.  Closes when it goes out of
+// scope, or earlier with end().  Does nothing when profiling is off.
+class THClProfileSpan {
+public:
+  THClProfileSpan(THClState *state, const char *name);
+  ~THClProfileSpan();
+  void end();
+private:
+  THClState *state;
+  const char *name;
+  cl_ulong start;
+  bool open;
+};
+
+// returns 0 when profiling is off, so the matching end() is a no-op
+cl_event THClProfiler_begin(THClState *state);
+void THClProfiler_end(THClState *state, cl_event begin, std::string name, std::string shapeClass, long bytes);
+// "<dims>d_2^<k>", with k the number of elements rounded up to a power of two
+std::string THClProfiler_shapeClass(int dims, long elements);
+
+// waits for outstanding records, and fills in their timestamps
+void THClProfiler_resolve(THClState *state);
+// per op name, sorted by total time, longest first
+std::vector<THClProfileSummary> THClProfiler_summarize(THClState *state);
+
+// nanoseconds on the host steady clock
+cl_ulong THClProfiler_hostNow();
+
+// wrapper->copyToDevice() / copyToHost(), recorded as transfers
+void THClProfiler_copyToDevice(THClState *state, CLWrapper *wrapper);
+void THClProfiler_copyToHost(THClState *state, CLWrapper *wrapper);
+#endif // __cplusplus
+
+#endif
@@ -1,9 +1,70 @@
-// Threads per thread block
-#define THCL_NONCONTIG_REDUCE_BLOCK_SIZE 32 * 16
+// Reduction kernels
+// (Ported from cutorch's THCReduce.cuh and THCReduceAll.cuh)
 
-{{index_type}} getReduceNoncontigDimSliceIndex() {
-  // Each thread handles one slice
-  return getLinearBlockId<{{index_type}}>() * THCL_NONCONTIG_REDUCE_BLOCK_SIZE + threadIdx.x;
+// expected templated values:
+// dims (vector of unique dimension values)
+// dim1: dims of the output (reduceDim only)
+// dim2: dims of the input
+// modify_operation: applied to each input value, eg "*out = *in1"
+// reduce_operation: folds two values, eg "*out = *in1 + *in2"; for the
+//   index reductions, compares them instead, eg "*out = *in1 > *in2"
+// in_half: 1 if the input is stored as half
+// out_half: 1 if the output is stored as half
+// in_byte, out_byte: likewise, for bytes
+// MAX_CLTORCH_DIMS
+
+// kernel argument that defines tensor layout
+typedef struct TensorInfoCl {
+  int sizes[{{MAX_CLTORCH_DIMS}}];
+  int strides[{{MAX_CLTORCH_DIMS}}];
+  int offset;
+  int dims;
+} TensorInfoCl;
+
+// Translate a linear index for the reduction to a float* offset;
+// specialized on `Dims` to reduce compilation time
+{% for _,dim in ipairs(dims) do %}
+int IndexToOffset_{{1000 + dim}}_get( int linearId, TensorInfoCl info) {
+  int offset = 0;
+
+  // Use static dims
+  for (int i = {{dim}} - 1; i >= 0; --i) {
+    int curDimIndex = linearId % info.sizes[i];
+    int curDimOffset = curDimIndex * info.strides[i];
+    offset += curDimOffset;
+
+    if (i > 0) {
+      linearId /= info.sizes[i];
+    }
+  }
+
+  return offset;
+}
+{% end %}
+
+int IndexToOffset_998_get(int linearId, const TensorInfoCl info) {
+    return linearId;
+}
+
+int IndexToOffset_999_get(int linearId, const TensorInfoCl info) {
+  int offset = 0;
+
+  // Use dynamic dims
+  for (int i = info.dims - 1; i >= 0; --i) {
+    int curDimIndex = linearId % info.sizes[i];
+    int curDimOffset = curDimIndex * info.strides[i];
+    offset += curDimOffset;
+
+    linearId /= info.sizes[i];
+  }
+
+  return offset;
+}
+
+int getLinearBlockId() {
+  return get_group_id(2) * get_num_groups(1) * get_num_groups(0) +
+    get_group_id(1) * get_num_groups(0) +
+    get_group_id(0);
 }
 
 float modifyOp(float _in1) {
@@ -24,107 +85,441 @@ float reduceOp(float _in1, float _in2) {
   return _out;
 }
 
+{% if in_half == 1 then %}
+#define IN_TYPE half
+#define LOAD_IN(data, index) vload_half(index, data)
+{% elseif in_byte == 1 then %}
+#define IN_TYPE uchar
+#define LOAD_IN(data, index) ((float)data[index])
+{% else %}
+#define IN_TYPE float
+#define LOAD_IN(data, index) data[index]
+{% end %}
+{% if out_half == 1 then %}
+#define OUT_TYPE half
+#define STORE_OUT(data, index, value) vstore_half(value, index, data)
+{% elseif out_byte == 1 then %}
+#define OUT_TYPE uchar
+#define STORE_OUT(data, index, value) data[index] = (uchar)(value)
+{% else %}
+#define OUT_TYPE float
+#define STORE_OUT(data, index, value) data[index] = value
+{% end %}
+
+// Folds smem[0..get_local_size(0)) into smem[0].  Works for any work group
+// size, not just powers of two
+void reduceLocal(local float *smem) {
+  const int tid = get_local_id(0);
+  const int size = get_local_size(0);
+  barrier(CLK_LOCAL_MEM_FENCE);
+  for (int s = 1; s < size; s <<= 1) {
+    if ((tid % (s << 1)) == 0 && tid + s < size) {
+      smem[tid] = reduceOp(smem[tid], smem[tid + s]);
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+  }
+}
+
 // Kernel that handles an entire reduction of a slice of a tensor per each thread
 kernel void
-THClTensor_reduceNoncontigDim(TensorInfoCl<{{index_type}}> out,
-                              global float *out_data,
-                              TensorInfoCl<{{index_type}}> in,
-                              global float *in_data,
-                              {{index_type}} reductionStride,
-                              {{index_type}} reductionSize,
-                              {{index_type}} totalSlices) {
-  const {{index_type}} sliceIndex = getReduceNoncontigDimSliceIndex<{{index_type}}>();
-
+THClTensor_reduceNoncontigDim(global TensorInfoCl *out_info,
+                              global OUT_TYPE *out_data,
+                              global TensorInfoCl *in_info,
+                              global IN_TYPE *in_data,
+                              int reductionStride,
+                              int reductionSize,
+                              int totalSlices,
+                              float init) {
+  // Each thread handles one slice
+  const int sliceIndex = getLinearBlockId() * get_local_size(0) + get_local_id(0);
   if (sliceIndex >= totalSlices) {
     return;
   }
 
   // Each thread picks a point in `out` and `in` for which it is
   // producing the reduction
-  const {{index_type}} outOffset =
-    IndexToOffset<{{index_type}}, {{dims1}}>::get(sliceIndex, out);
-  const {{index_type}} inBaseOffset =
-    IndexToOffset<{{index_type}}, {{dims2}}>::get(sliceIndex, in);
+  const int outOffset =
+    IndexToOffset_{{1000 + dim1}}_get(sliceIndex, out_info[0]) + out_info->offset;
+  int inOffset =
+    IndexToOffset_{{1000 + dim2}}_get(sliceIndex, in_info[0]) + in_info->offset;
 
   // For each point in reductionSize, reduce into `r`
-  {{index_type}} inOffset = inBaseOffset;
-
-  float r = modifyOp(in_data[0]);
-  inOffset += reductionStride;
-
-  for ({{index_type}} i = 1; i < reductionSize; ++i) {
-    r = reduceOp(r, modifyOp(in_data[inOffset]));
+  float r = init;
+  for (int i = 0; i < reductionSize; ++i) {
+    r = reduceOp(r, modifyOp(LOAD_IN(in_data, inOffset)));
     inOffset += reductionStride;
   }
 
   // Write out reduced value
-  out.data[outOffset] = r;
-}
-
-{{index_type}} getReduceContigDimSliceIndex() {
-  // Each block handles one slice
-  return getLinearBlockId<{{index_type}}>();
+  STORE_OUT(out_data, outOffset, r);
 }
 
 // Kernel that handles an entire reduction of a slice of a tensor per
 // each block
 kernel void
-THClTensor_reduceContigDim(TensorInfoCl<{{index_type}}> out,
-                           global float *out_data,
-                           TensorInfoCl<{{index_type}}> in,
-                           global float *in_data,
-                           {{index_type}} reductionSize,
-                           {{index_type}} totalSlices) {
-  const {{index_type}} sliceIndex = getReduceContigDimSliceIndex<{{index_type}}>();
-
+THClTensor_reduceContigDim(global TensorInfoCl *out_info,
+                           global OUT_TYPE *out_data,
+                           global TensorInfoCl *in_info,
+                           global IN_TYPE *in_data,
+                           int reductionSize,
+                           int totalSlices,
+                           float init,
+                           local float *smem) {
+  // Each block handles one slice
+  const int sliceIndex = getLinearBlockId();
   if (sliceIndex >= totalSlices) {
     return;
   }
 
   // Get the offset in `out` for the reduction
-  const {{index_type}} outOffset =
-    IndexToOffset<{{index_type}}, {{dims1}}>::get(sliceIndex, out);
+  const int outOffset =
+    IndexToOffset_{{1000 + dim1}}_get(sliceIndex, out_info[0]) + out_info->offset;
 
   // Get the base offset in `in` for this block's reduction
-  const {{index_type}} inBaseOffset =
-    IndexToOffset<{{index_type}}, {{dims2}}>::get(sliceIndex, in);
+  const int inBaseOffset =
+    IndexToOffset_{{1000 + dim2}}_get(sliceIndex, in_info[0]) + in_info->offset;
 
   // Each thread in the block will reduce some subset of elements in
   // the slice. The elements are guaranteed contiguous starting at
   // `inBaseOffset`.
-  float r = modifyOp(in_data[inBaseOffset]);
-  for ({{index_type}} i = threadIdx.x + 1; i < reductionSize; i += blockDim.x) {
-    r = reduceOp(r, modifyOp(in_data[inBaseOffset + i]));
+  float r = init;
+  for (int i = get_local_id(0); i < reductionSize; i += get_local_size(0)) {
+    r = reduceOp(r, modifyOp(LOAD_IN(in_data, inBaseOffset + i)));
   }
 
   // Reduce within the block
-  extern __shared__ float smem[];
-  smem[threadIdx.x] = r;
-
-  // First warp will perform reductions across warps
-  __syncthreads();
-  if ((threadIdx.x / 32) == 0) {
-    r = smem[i + threadIdx.x];
-    for (int i = 1; i < blockDim.x; i += 32) {
-      r = reduceOp(r, smem[i + threadIdx.x]);
+  smem[get_local_id(0)] = r;
+  reduceLocal(smem);
+
+  if (get_local_id(0) == 0) {
+    // Write out reduced value
+    STORE_OUT(out_data, outOffset, smem[0]);
+  }
+}
+
+// For the index reductions, whether (value1, index1) beats (value2,
+// index2), where reduceOp is nonzero if value1 beats value2.  As on the CPU,
+// NaNs beat everything else, and of equal values the lower index wins.  An
+// index of -1 marks an empty pair, which everything beats
+bool pairBeats(float value1, int index1, float value2, int index2) {
+  if (index2 < 0 || index1 < 0) {
+    return index2 < 0 && index1 >= 0;
+  }
+  const bool nan1 = isnan(value1);
+  const bool nan2 = isnan(value2);
+  if (nan1 || nan2) {
+    return nan1 && (!nan2 || index1 < index2);
+  }
+  if (reduceOp(value1, value2) != 0) {
+    return true;
+  }
+  return value1 == value2 && index1 < index2;
+}
+
+// Folds the pairs in values and indices [0..get_local_size(0)) into their
+// first elements, like reduceLocal
+void reduceLocalPairs(local float *values, local int *indices) {
+  const int tid = get_local_id(0);
+  const int size = get_local_size(0);
+  barrier(CLK_LOCAL_MEM_FENCE);
+  for (int s = 1; s < size; s <<= 1) {
+    if ((tid % (s << 1)) == 0 && tid + s < size
+        && pairBeats(values[tid + s], indices[tid + s], values[tid], indices[tid])) {
+      values[tid] = values[tid + s];
+      indices[tid] = indices[tid + s];
     }
+    barrier(CLK_LOCAL_MEM_FENCE);
+  }
+}
 
-    // Each lane participating writes out a value
-    smem[threadIdx.x] = r;
+// Like THClTensor_reduceNoncontigDim, but finding the winning element of
+// each slice, and writing its index along the slice, from 1, to indices
+kernel void
+THClTensor_reduceNoncontigDimIndex(global TensorInfoCl *out_info,
+                                   global OUT_TYPE *out_data,
+                                   global TensorInfoCl *indices_info,
+                                   global float *indices_data,
+                                   global TensorInfoCl *in_info,
+                                   global IN_TYPE *in_data,
+                                   int reductionStride,
+                                   int reductionSize,
+                                   int totalSlices) {
+  const int sliceIndex = getLinearBlockId() * get_local_size(0) + get_local_id(0);
+  if (sliceIndex >= totalSlices) {
+    return;
   }
 
-  // First thread will perform reductions across the block
-  __syncthreads();
-  if (threadIdx.x == 0) {
-    r = smem[0];
-    #pragma unroll
-    {% for i=1,32 do %}
-      r = reduceOp(r, smem[i]);
-    {% end %}
+  const int outOffset =
+    IndexToOffset_{{1000 + dim1}}_get(sliceIndex, out_info[0]) + out_info->offset;
+  const int indicesOffset =
+    IndexToOffset_999_get(sliceIndex, indices_info[0]) + indices_info->offset;
+  int inOffset =
+    IndexToOffset_{{1000 + dim2}}_get(sliceIndex, in_info[0]) + in_info->offset;
 
-    // Write out reduced value
-    out_data[outOffset] = r;
+  float r = 0;
+  int rIndex = -1;
+  for (int i = 0; i < reductionSize; ++i) {
+    const float value = modifyOp(LOAD_IN(in_data, inOffset));
+    if (pairBeats(value, i, r, rIndex)) {
+      r = value;
+      rIndex = i;
+    }
+    inOffset += reductionStride;
   }
+
+  STORE_OUT(out_data, outOffset, r);
+  indices_data[indicesOffset] = rIndex + 1;
 }
 
+// Like THClTensor_reduceContigDim, but finding the winning element of each
+// slice, and writing its index along the slice, from 1, to indices
+kernel void
+THClTensor_reduceContigDimIndex(global TensorInfoCl *out_info,
+                                global OUT_TYPE *out_data,
+                                global TensorInfoCl *indices_info,
+                                global float *indices_data,
+                                global TensorInfoCl *in_info,
+                                global IN_TYPE *in_data,
+                                int reductionSize,
+                                int totalSlices,
+                                local float *smem,
+                                local float *smemIndexSpace) {
+  local int *smemIndices = (local int *)smemIndexSpace;
+  const int sliceIndex = getLinearBlockId();
+  if (sliceIndex >= totalSlices) {
+    return;
+  }
+
+  const int outOffset =
+    IndexToOffset_{{1000 + dim1}}_get(sliceIndex, out_info[0]) + out_info->offset;
+  const int indicesOffset =
+    IndexToOffset_999_get(sliceIndex, indices_info[0]) + indices_info->offset;
+  const int inBaseOffset =
+    IndexToOffset_{{1000 + dim2}}_get(sliceIndex, in_info[0]) + in_info->offset;
+
+  float r = 0;
+  int rIndex = -1;
+  for (int i = get_local_id(0); i < reductionSize; i += get_local_size(0)) {
+    const float value = modifyOp(LOAD_IN(in_data, inBaseOffset + i));
+    if (pairBeats(value, i, r, rIndex)) {
+      r = value;
+      rIndex = i;
+    }
+  }
+
+  smem[get_local_id(0)] = r;
+  smemIndices[get_local_id(0)] = rIndex;
+  reduceLocalPairs(smem, smemIndices);
+
+  if (get_local_id(0) == 0) {
+    STORE_OUT(out_data, outOffset, smem[0]);
+    indices_data[indicesOffset] = smemIndices[0] + 1;
+  }
+}
+
+// Each block folds a strided share of all the elements of `in` into
+// out_data[block]; running it again over those partials, with a single
+// block, gives the total
+kernel void
+THClTensor_reduceAll(global TensorInfoCl *in_info,
+                     global IN_TYPE *in_data,
+                     int totalElements,
+                     float init,
+                     global OUT_TYPE *out_data,
+                     local float *smem) {
+  float r = init;
+  for (int i = get_global_id(0); i < totalElements; i += get_global_size(0)) {
+    const int inOffset = IndexToOffset_{{1000 + dim2}}_get(i, in_info[0]) + in_info->offset;
+    r = reduceOp(r, modifyOp(LOAD_IN(in_data, inOffset)));
+  }
+
+  smem[get_local_id(0)] = r;
+  reduceLocal(smem);
+
+  if (get_local_id(0) == 0) {
+    STORE_OUT(out_data, get_group_id(0), smem[0]);
+  }
+}
+
+// Moments, for var and std: each thread folds its elements into a count,
+// mean and M2, the sum of squared deviations from the mean, with Welford's
+// update, and the threads' and groups' moments merge pairwise (Chan et al).
+// So the data is read once, and there's no cancellation between a sum of
+// squares and a squared sum.  Counts are uints, since a float stops
+// counting at 2^24, and one thread can take a whole slice
+void welfordAdd(float value, uint *n, float *mean, float *m2) {
+  *n += 1;
+  const float delta = value - *mean;
+  *mean += delta / (float)*n;
+  *m2 += delta * (value - *mean);
+}
+
+void welfordMerge(uint nB, float meanB, float m2B, uint *n, float *mean, float *m2) {
+  if (nB == 0) {
+    return;
+  }
+  const uint total = *n + nB;
+  const float delta = meanB - *mean;
+  const float ratio = (float)nB / (float)total;
+  *mean += delta * ratio;
+  *m2 += m2B + delta * delta * (float)*n * ratio;
+  *n = total;
+}
+
+// the variance, divided by n if biased, otherwise by n - 1; or its square root
+float welfordFinish(uint n, float m2, int biased, int applySqrt) {
+  const float count = (float)n;
+  const float var = m2 / (biased ? count : count - 1);
+  return applySqrt ? sqrt(var) : var;
+}
+
+// Folds the moments in n, mean and m2 [0..get_local_size(0)) into their
+// first elements, like reduceLocal
+void reduceLocalMoments(local uint *n, local float *mean, local float *m2) {
+  const int tid = get_local_id(0);
+  const int size = get_local_size(0);
+  barrier(CLK_LOCAL_MEM_FENCE);
+  for (int s = 1; s < size; s <<= 1) {
+    if ((tid % (s << 1)) == 0 && tid + s < size) {
+      uint nA = n[tid];
+      float meanA = mean[tid];
+      float m2A = m2[tid];
+      welfordMerge(n[tid + s], mean[tid + s], m2[tid + s], &nA, &meanA, &m2A);
+      n[tid] = nA;
+      mean[tid] = meanA;
+      m2[tid] = m2A;
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+  }
+}
+
+// Variance of each slice, a thread per slice, as THClTensor_reduceNoncontigDim
+kernel void
+THClTensor_reduceNoncontigDimMoments(global TensorInfoCl *out_info,
+                                     global OUT_TYPE *out_data,
+                                     global TensorInfoCl *in_info,
+                                     global IN_TYPE *in_data,
+                                     int reductionStride,
+                                     int reductionSize,
+                                     int totalSlices,
+                                     int biased,
+                                     int applySqrt) {
+  const int sliceIndex = getLinearBlockId() * get_local_size(0) + get_local_id(0);
+  if (sliceIndex >= totalSlices) {
+    return;
+  }
+
+  const int outOffset =
+    IndexToOffset_{{1000 + dim1}}_get(sliceIndex, out_info[0]) + out_info->offset;
+  int inOffset =
+    IndexToOffset_{{1000 + dim2}}_get(sliceIndex, in_info[0]) + in_info->offset;
+
+  uint n = 0;
+  float mean = 0;
+  float m2 = 0;
+  for (int i = 0; i < reductionSize; ++i) {
+    welfordAdd(modifyOp(LOAD_IN(in_data, inOffset)), &n, &mean, &m2);
+    inOffset += reductionStride;
+  }
+
+  STORE_OUT(out_data, outOffset, welfordFinish(n, m2, biased, applySqrt));
+}
+
+// Variance of each slice, a work group per slice, as THClTensor_reduceContigDim
+kernel void
+THClTensor_reduceContigDimMoments(global TensorInfoCl *out_info,
+                                  global OUT_TYPE *out_data,
+                                  global TensorInfoCl *in_info,
+                                  global IN_TYPE *in_data,
+                                  int reductionSize,
+                                  int totalSlices,
+                                  int biased,
+                                  int applySqrt,
+                                  local uint *smemN,
+                                  local float *smemMean,
+                                  local float *smemM2) {
+  const int sliceIndex = getLinearBlockId();
+  if (sliceIndex >= totalSlices) {
+    return;
+  }
+
+  const int outOffset =
+    IndexToOffset_{{1000 + dim1}}_get(sliceIndex, out_info[0]) + out_info->offset;
+  const int inBaseOffset =
+    IndexToOffset_{{1000 + dim2}}_get(sliceIndex, in_info[0]) + in_info->offset;
+
+  uint n = 0;
+  float mean = 0;
+  float m2 = 0;
+  for (int i = get_local_id(0); i < reductionSize; i += get_local_size(0)) {
+    welfordAdd(modifyOp(LOAD_IN(in_data, inBaseOffset + i)), &n, &mean, &m2);
+  }
+
+  smemN[get_local_id(0)] = n;
+  smemMean[get_local_id(0)] = mean;
+  smemM2[get_local_id(0)] = m2;
+  reduceLocalMoments(smemN, smemMean, smemM2);
+
+  if (get_local_id(0) == 0) {
+    STORE_OUT(out_data, outOffset, welfordFinish(smemN[0], smemM2[0], biased, applySqrt));
+  }
+}
+
+// Each block folds a strided share of all the elements of `in` into moments,
+// which go to partials[3 * block] on, as n (its bits, as a float), mean and M2
+kernel void
+THClTensor_reduceAllMoments(global TensorInfoCl *in_info,
+                            global IN_TYPE *in_data,
+                            int totalElements,
+                            global float *partials,
+                            local uint *smemN,
+                            local float *smemMean,
+                            local float *smemM2) {
+  uint n = 0;
+  float mean = 0;
+  float m2 = 0;
+  for (int i = get_global_id(0); i < totalElements; i += get_global_size(0)) {
+    const int inOffset = IndexToOffset_{{1000 + dim2}}_get(i, in_info[0]) + in_info->offset;
+    welfordAdd(modifyOp(LOAD_IN(in_data, inOffset)), &n, &mean, &m2);
+  }
+
+  smemN[get_local_id(0)] = n;
+  smemMean[get_local_id(0)] = mean;
+  smemM2[get_local_id(0)] = m2;
+  reduceLocalMoments(smemN, smemMean, smemM2);
+
+  if (get_local_id(0) == 0) {
+    partials[3 * get_group_id(0)] = as_float(smemN[0]);
+    partials[3 * get_group_id(0) + 1] = smemMean[0];
+    partials[3 * get_group_id(0) + 2] = smemM2[0];
+  }
+}
+
+// A single block merges numPartials moments from THClTensor_reduceAllMoments
+// into the variance, in out[0]
+kernel void
+THClTensor_mergeMoments(int numPartials,
+                        global const float *partials,
+                        global float *out,
+                        int biased,
+                        int applySqrt,
+                        local uint *smemN,
+                        local float *smemMean,
+                        local float *smemM2) {
+  uint n = 0;
+  float mean = 0;
+  float m2 = 0;
+  for (int i = get_local_id(0); i < numPartials; i += get_local_size(0)) {
+    welfordMerge(as_uint(partials[3 * i]), partials[3 * i + 1], partials[3 * i + 2], &n, &mean, &m2);
+  }
+
+  smemN[get_local_id(0)] = n;
+  smemMean[get_local_id(0)] = mean;
+  smemM2[get_local_id(0)] = m2;
+  reduceLocalMoments(smemN, smemMean, smemM2);
+
+  if (get_local_id(0) == 0) {
+    out[0] = welfordFinish(smemN[0], smemM2[0], biased, applySqrt);
+  }
+}
 
@@ -1,20 +1,163 @@
 #include <iostream>
 
 #include "THClReduce.h"
+#include "THClApply.h"
+#include "THClPrecompile.h"
+#include "THClGraph.h"
 
 using namespace std;
 
 #define THCL_NONCONTIG_REDUCE_BLOCK_SIZE 32 * 16
+// number of work groups in the first pass of reduceAll
+#define THCL_REDUCE_ALL_GROUPS 64
 
 // since this is no longer a template, so move to .cpp
 
+static CLKernel *THClTensor_buildReduceKernel(THClState *state, int outDims, int inDims,
+    int outType, int inType, const HasOperator2 *modifyOp, const HasOperator3 *reduceOp,
+    string kernelName) {
+  TemplatedKernel kernelBuilder(state->cl);
+  std::vector<int> dims;
+  if( outDims >= 0 ) {
+    dims.push_back(outDims);
+  }
+  if( inDims >= 0 && inDims != outDims ) {
+    dims.push_back(inDims);
+  }
+  kernelBuilder.set("dims", dims);
+  kernelBuilder.set("dim1", outDims);
+  kernelBuilder.set("dim2", inDims);
+  kernelBuilder.set("modify_operation", modifyOp->operator2());
+  kernelBuilder.set("reduce_operation", reduceOp->operator3());
+  kernelBuilder.set("in_half", inType == THCL_HALF ? 1 : 0);
+  kernelBuilder.set("out_half", outType == THCL_HALF ? 1 : 0);
+  kernelBuilder.set("in_byte", inType == THCL_BYTE ? 1 : 0);
+  kernelBuilder.set("out_byte", outType == THCL_BYTE ? 1 : 0);
+  kernelBuilder.set("MAX_CLTORCH_DIMS", MAX_CLTORCH_DIMS);
+  string uniqueName = kernelName + "_" + easycl::toString(outDims) + "_" + easycl::toString(inDims)
+    + "_" + easycl::toString(outType) + easycl::toString(inType)
+    + "_" + modifyOp->operator2() + "_" + reduceOp->operator3();
+  return THClKernel_build(state, kernelBuilder, uniqueName, "THClReduce.cl", getReduce_template(), kernelName);
+}
+
+// work group sizes are capped at what the device allows
+static dim3 THClTensor_capReduceBlock(THClState *state, dim3 block) {
+  ulong maxWorkgroupSize = state->cl->getMaxWorkgroupSize();
+  if( block.vec[0] > maxWorkgroupSize ) {
+    block.vec[0] = maxWorkgroupSize;
+  }
+  return block;
+}
+
+template< typename IndexType >
+static void kernelLaunch_THClTensor_reduceNoncontigDim(
+  THClState *state,
+  dim3 grid,
+  dim3 block,
+  int ADims,
+  int BDims,
+  TensorInfo<IndexType> out,
+  TensorInfo<IndexType> in,
+  IndexType reductionStride,
+  IndexType reductionSize,
+  IndexType totalSlices,
+  float init,
+  const HasOperator2 *modifyOp,
+  const HasOperator3 *reduceOp) {
+  CLKernel *kernel = THClTensor_buildReduceKernel(state, ADims, BDims, out.dataType, in.dataType,
+    modifyOp, reduceOp, "THClTensor_reduceNoncontigDim");
+  if( kernel == 0 ) { // compile-only
+    return;
+  }
+
+  dim3 global_ws;
+  for( int i = 0; i < 3; i++ ) {
+    global_ws.vec[i] = grid.vec[i] * block.vec[i];
+  }
+  TensorInfoCl outCl(out);
+  TensorInfoCl inCl(in);
+
+  if( !out.wrapper->isOnDevice() ) {
+    out.wrapper->createOnDevice();
+  }
+  THClLaunch launch(state, kernel, "THClTensor_reduceNoncontigDim");
+  launch.in(1, &outCl);
+  launch.range(out.wrapper, out.firstFloat(), out.numFloats());
+  launch.out(out.wrapper);
+  launch.in(1, &inCl);
+  launch.range(in.wrapper, in.firstFloat(), in.numFloats());
+  launch.in(in.wrapper);
+  launch.in((int)reductionStride);
+  launch.in((int)reductionSize);
+  launch.in((int)totalSlices);
+  launch.in(init);
+
+  cl_event profileBegin = THClProfiler_begin(state);
+  launch.run(3, global_ws.vec, block.vec);
+  THClProfiler_end(state, profileBegin, "THClTensor_reduceNoncontigDim",
+    THClProfiler_shapeClass(in.dims, (long)totalSlices * reductionSize),
+    (long)totalSlices * reductionSize * THClStorage_elementSize(in.dataType));
+  state->cl->finish();
+}
+
+template< typename IndexType >
+static void kernelLaunch_THClTensor_reduceContigDim(
+  THClState *state,
+  dim3 grid,
+  dim3 block,
+  int ADims,
+  int BDims,
+  TensorInfo<IndexType> out,
+  TensorInfo<IndexType> in,
+  IndexType reductionSize,
+  IndexType totalSlices,
+  float init,
+  const HasOperator2 *modifyOp,
+  const HasOperator3 *reduceOp) {
+  CLKernel *kernel = THClTensor_buildReduceKernel(state, ADims, BDims, out.dataType, in.dataType,
+    modifyOp, reduceOp, "THClTensor_reduceContigDim");
+  if( kernel == 0 ) { // compile-only
+    return;
+  }
+
+  dim3 global_ws;
+  for( int i = 0; i < 3; i++ ) {
+    global_ws.vec[i] = grid.vec[i] * block.vec[i];
+  }
+  TensorInfoCl outCl(out);
+  TensorInfoCl inCl(in);
+
+  if( !out.wrapper->isOnDevice() ) {
+    out.wrapper->createOnDevice();
+  }
+  THClLaunch launch(state, kernel, "THClTensor_reduceContigDim");
+  launch.in(1, &outCl);
+  launch.range(out.wrapper, out.firstFloat(), out.numFloats());
+  launch.out(out.wrapper);
+  launch.in(1, &inCl);
+  launch.range(in.wrapper, in.firstFloat(), in.numFloats());
+  launch.in(in.wrapper);
+  launch.in((int)reductionSize);
+  launch.in((int)totalSlices);
+  launch.in(init);
+  launch.localFloats(block.vec[0]);
+
+  cl_event profileBegin = THClProfiler_begin(state);
+  launch.run(3, global_ws.vec, block.vec);
+  THClProfiler_end(state, profileBegin, "THClTensor_reduceContigDim",
+    THClProfiler_shapeClass(in.dims, (long)totalSlices * reductionSize),
+    (long)totalSlices * reductionSize * THClStorage_elementSize(in.dataType));
+  state->cl->finish();
+}
+
 // Performs a reduction out[..., 0, ...] = reduce_i(modify(in[..., i, ...])) for
 // all in where i and the out's 0 are indexed at dimension `dim`
 bool THClTensor_reduceDim(THClState* state,
                             THClTensor* out,
                             THClTensor* in,
-                            const HasOperator2 *modifyOp,
-                            const HasOperator3 *reduceOp,
+                            const HasOperator2 &modifyOp,
+                            const HasOperator3 &reduceOp,
+                            float init,
                             int dim) {
   long inElements = THClTensor_nElement(state, in);
 
@@ -38,20 +181,17 @@ bool THClTensor_reduceDim(THClState* state,
 
   dim3 block;
   dim3 grid;
-  int smemSize = 0; // contiguous reduction uses smem
   if (contigReduction) {
     if (!getContigReduceGrid(outElements, grid)) {
       return false;
     }
 
-    block = getContigReduceBlock(outElements, reductionSize);
-    smemSize = sizeof(float) * block.x();
+    block = THClTensor_capReduceBlock(state, getContigReduceBlock(outElements, reductionSize));
   } else {
-    if (!getNoncontigReduceGrid(outElements, grid)) {
+    block = THClTensor_capReduceBlock(state, getNoncontigReduceBlock());
+    if (!THCL_getGridFromTiles(DIVUP(outElements, (long)block.vec[0]), grid)) {
       return false;
     }
-
-    block = getNoncontigReduceBlock();
   }
 
   // Resize out to correspond to the reduced size
@@ -70,23 +210,15 @@ bool THClTensor_reduceDim(THClState* state,
   // index can be similarly collapsed. That is what this unrolling is for.
 #define HANDLE_CASE(TYPE, OUT, IN)                                      \
   if (contigReduction) {                                                \
-    kernelLaunch_THClTensor_reduceContigDim<TYPE, OUT, IN> (    \
-        outInfo, inInfo, (TYPE) reductionSize,                                 \
-        (TYPE) outElements, modifyOp, reduceOp);                  \
-    /* THClTensor_reduceContigDim<ModifyOp, ReduceOp, TYPE, OUT, IN>     \
-      <<<grid, block, smemSize, THClState_getCurrentStream(state)>>>(    \
-        outInfo, inInfo, (TYPE) reductionSize,                                 \
-        (TYPE) outElements, init, modifyOp, reduceOp);  */                \
-          THError("Not implemented");  \
+    kernelLaunch_THClTensor_reduceContigDim<TYPE> (                     \
+        state, grid, block, OUT, IN,                                    \
+        outInfo, inInfo, (TYPE) reductionSize,                          \
+        (TYPE) outElements, init, &modifyOp, &reduceOp);                  \
   } else {                                                              \
-     kernelLaunch_THClTensor_reduceNoncontigDim<TYPE, OUT, IN> (  \
-        outInfo, inInfo, (TYPE) reductionStride, (TYPE) reductionSize,                \
-        (TYPE) outElements, modifyOp, reduceOp);                   \
-    /* THClTensor_reduceNoncontigDim<ModifyOp, ReduceOp, TYPE, OUT, IN>  \
-      <<<grid, block, 0, THClState_getCurrentStream(state)>>>(           \
-        outInfo, inInfo, (TYPE) reductionStride, (TYPE) reductionSize,                \
-        (TYPE) outElements, init, modifyOp, reduceOp);  */                 \
-      THError("Not implemented");   \
+    kernelLaunch_THClTensor_reduceNoncontigDim<TYPE> (                  \
+        state, grid, block, OUT, IN,                                    \
+        outInfo, inInfo, (TYPE) reductionStride, (TYPE) reductionSize,  \
+        (TYPE) outElements, init, &modifyOp, &reduceOp);                  \
   }                                                                     \
 
 #define HANDLE_IN_CASE(TYPE, OUT, IN)                   \
@@ -153,9 +285,956 @@ bool THClTensor_reduceDim(THClState* state,
     }
   }
 #undef HANDLE_CASE
-#undef HANDLE_B_CASE
-#undef HANDLE_A_CASE
+#undef HANDLE_IN_CASE
+#undef HANDLE_OUT_CASE
+
+  return true;
+}
+
+// THClTensor_reduceContigDimIndex or THClTensor_reduceNoncontigDimIndex
+static void kernelLaunch_THClTensor_reduceDimIndex(
+  THClState *state,
+  bool contigReduction,
+  dim3 grid,
+  dim3 block,
+  int ADims,
+  int BDims,
+  TensorInfo<unsigned int> out,
+  TensorInfo<unsigned int> indices,
+  TensorInfo<unsigned int> in,
+  unsigned int reductionStride,
+  unsigned int reductionSize,
+  unsigned int totalSlices,
+  const HasOperator2 *modifyOp,
+  const HasOperator3 *compareOp) {
+  string kernelName = contigReduction ? "THClTensor_reduceContigDimIndex" : "THClTensor_reduceNoncontigDimIndex";
+  CLKernel *kernel = THClTensor_buildReduceKernel(state, ADims, BDims, out.dataType, in.dataType,
+    modifyOp, compareOp, kernelName);
+  if( kernel == 0 ) { // compile-only
+    return;
+  }
+
+  dim3 global_ws;
+  for( int i = 0; i < 3; i++ ) {
+    global_ws.vec[i] = grid.vec[i] * block.vec[i];
+  }
+  TensorInfoCl outCl(out);
+  TensorInfoCl indicesCl(indices);
+  TensorInfoCl inCl(in);
+
+  if( !out.wrapper->isOnDevice() ) {
+    out.wrapper->createOnDevice();
+  }
+  if( !indices.wrapper->isOnDevice() ) {
+    indices.wrapper->createOnDevice();
+  }
+  THClLaunch launch(state, kernel, kernelName);
+  launch.in(1, &outCl);
+  launch.range(out.wrapper, out.firstFloat(), out.numFloats());
+  launch.out(out.wrapper);
+  launch.in(1, &indicesCl);
+  launch.range(indices.wrapper, indices.firstFloat(), indices.numFloats());
+  launch.out(indices.wrapper);
+  launch.in(1, &inCl);
+  launch.range(in.wrapper, in.firstFloat(), in.numFloats());
+  launch.in(in.wrapper);
+  if( !contigReduction ) {
+    launch.in((int)reductionStride);
+  }
+  launch.in((int)reductionSize);
+  launch.in((int)totalSlices);
+  if( contigReduction ) {
+    launch.localFloats(block.vec[0]);
+    launch.localFloats(block.vec[0]);
+  }
+
+  cl_event profileBegin = THClProfiler_begin(state);
+  launch.run(3, global_ws.vec, block.vec);
+  THClProfiler_end(state, profileBegin, kernelName,
+    THClProfiler_shapeClass(in.dims, (long)totalSlices * reductionSize),
+    (long)totalSlices * reductionSize * THClStorage_elementSize(in.dataType));
+  state->cl->finish();
+}
+
+// the dims case the kernels are specialized on: -2 for contiguous, 1 to 3,
+// or -1 for any other
+static int THClTensor_reduceDimsCase(const TensorInfo<unsigned int> &info) {
+  if (info.isContiguous()) {
+    return -2;
+  }
+  return info.dims <= 3 ? info.dims : -1;
+}
+
+bool THClTensor_reduceDimIndex(THClState* state,
+                               THClTensor* out,
+                               THClTensor* indices,
+                               THClTensor* in,
+                               const HasOperator2 &modifyOp,
+                               const HasOperator3 &compareOp,
+                               int dim) {
+  long inElements = THClTensor_nElement(state, in);
+
+  if (THClTensor_nDimension(state, out) > MAX_CLTORCH_DIMS ||
+      THClTensor_nDimension(state, indices) > MAX_CLTORCH_DIMS ||
+      THClTensor_nDimension(state, in) > MAX_CLTORCH_DIMS) {
+    return false;
+  }
+
+  if (THClTensor_nDimension(state, in) == 0) {
+    return true;
+  }
+
+  long reductionSize = THClTensor_size(state, in, dim);
+  long reductionStride = THClTensor_stride(state, in, dim);
+  long outElements = inElements / reductionSize;
+  bool contigReduction = (reductionStride == 1);
+
+  dim3 block;
+  dim3 grid;
+  if (contigReduction) {
+    if (!getContigReduceGrid(outElements, grid)) {
+      return false;
+    }
+    block = THClTensor_capReduceBlock(state, getContigReduceBlock(outElements, reductionSize));
+  } else {
+    block = THClTensor_capReduceBlock(state, getNoncontigReduceBlock());
+    if (!THCL_getGridFromTiles(DIVUP(outElements, (long)block.vec[0]), grid)) {
+      return false;
+    }
+  }
 
+  THLongStorage* sizes = THClTensor_newSizeOf(state, in);
+  THLongStorage_set(sizes, dim, 1);
+  THClTensor_resize(state, out, sizes, NULL);
+  THClTensor_resize(state, indices, sizes, NULL);
+  THLongStorage_free(sizes);
+
+  // only 32-bit index math: indices are floats, so slices can't be long
+  // enough to need more anyway
+  if (!THCL_canUse32BitIndexMath(state, out) ||
+      !THCL_canUse32BitIndexMath(state, indices) ||
+      !THCL_canUse32BitIndexMath(state, in)) {
+    return false;
+  }
+  TensorInfo<unsigned int> outInfo(state, out);
+  TensorInfo<unsigned int> indicesInfo(state, indices);
+  TensorInfo<unsigned int> inInfo(state, in, dim);
+
+  kernelLaunch_THClTensor_reduceDimIndex(state, contigReduction, grid, block,
+    THClTensor_reduceDimsCase(outInfo), THClTensor_reduceDimsCase(inInfo),
+    outInfo, indicesInfo, inInfo, (unsigned int)reductionStride, (unsigned int)reductionSize,
+    (unsigned int)outElements, &modifyOp, &compareOp);
   return true;
 }
 
+// one pass of reduceAll: each of numGroups work groups writes one value of out
+template< typename IndexType >
+static void kernelLaunch_THClTensor_reduceAll(
+  THClState *state,
+  int numGroups,
+  int BDims,
+  TensorInfo<IndexType> in,
+  IndexType totalElements,
+  float init,
+  CLWrapper *out,
+  const HasOperator2 *modifyOp,
+  const HasOperator3 *reduceOp) {
+  CLKernel *kernel = THClTensor_buildReduceKernel(state, -2, BDims, THCL_FLOAT, in.dataType,
+    modifyOp, reduceOp, "THClTensor_reduceAll");
+  if( kernel == 0 ) { // compile-only
+    return;
+  }
+  int blockSize = THClTensor_capReduceBlock(state, dim3(THCL_NONCONTIG_REDUCE_BLOCK_SIZE)).vec[0];
+  TensorInfoCl inCl(in);
+
+  if( !out->isOnDevice() ) {
+    out->createOnDevice();
+  }
+  THClLaunch launch(state, kernel, "THClTensor_reduceAll");
+  launch.in(1, &inCl);
+  launch.range(in.wrapper, in.firstFloat(), in.numFloats());
+  launch.in(in.wrapper);
+  launch.in((int)totalElements);
+  launch.in(init);
+  launch.out(out);
+  launch.localFloats(blockSize);
+
+  cl_event profileBegin = THClProfiler_begin(state);
+  launch.run_1d(numGroups * blockSize, blockSize);
+  THClProfiler_end(state, profileBegin, "THClTensor_reduceAll",
+    THClProfiler_shapeClass(in.dims, (long)totalElements),
+    (long)totalElements * THClStorage_elementSize(in.dataType));
+  state->cl->finish();
+}
+
+bool THClTensor_reduceAll(THClState* state,
+                          THClTensor* in,
+                          const HasOperator2 &modifyOp,
+                          const HasOperator3 &reduceOp,
+                          float init,
+                          float *result) {
+  long inElements = THClTensor_nElement(state, in);
+  if (THClTensor_nDimension(state, in) > MAX_CLTORCH_DIMS) {
+    return false;
+  }
+  if (THClTensor_nDimension(state, in) == 0) {
+    *result = init;
+    return true;
+  }
+  if (!THCL_canUse32BitIndexMath(state, in)) {
+    return false;
+  }
+
+  int blockSize = THClTensor_capReduceBlock(state, dim3(THCL_NONCONTIG_REDUCE_BLOCK_SIZE)).vec[0];
+  long numGroups = DIVUP(inElements, (long)blockSize);
+  if (numGroups > THCL_REDUCE_ALL_GROUPS) {
+    numGroups = THCL_REDUCE_ALL_GROUPS;
+  }
+  THClTensor *partials = THClTensor_newWithSize1d(state, numGroups);
+  THClTensor *total = THClTensor_newWithSize1d(state, 1);
+
+  TensorInfo<unsigned int> inInfo(state, in);
+  int inDims = inInfo.isContiguous() ? -2 : inInfo.dims;
+  if (inDims > 3) {
+    inDims = -1;
+  }
+  kernelLaunch_THClTensor_reduceAll<unsigned int>(state, (int)numGroups, inDims, inInfo,
+    (unsigned int)inElements, init, THClTensor_wrapper(state, partials), &modifyOp, &reduceOp);
+
+  // the partials are already modified, so the second pass only folds them
+  TensorInfo<unsigned int> partialsInfo(state, partials);
+  CopyOp identity;
+  kernelLaunch_THClTensor_reduceAll<unsigned int>(state, 1, -2, partialsInfo,
+    (unsigned int)numGroups, init, THClTensor_wrapper(state, total), &identity, &reduceOp);
+
+  *result = THClStorage_get(state, total->storage, total->storageOffset);
+  THClTensor_free(state, partials);
+  THClTensor_free(state, total);
+  return true;
+}
+
+// THClTensor_reduceContigDimMoments or THClTensor_reduceNoncontigDimMoments
+static void kernelLaunch_THClTensor_reduceDimMoments(
+  THClState *state,
+  bool contigReduction,
+  dim3 grid,
+  dim3 block,
+  int ADims,
+  int BDims,
+  TensorInfo<unsigned int> out,
+  TensorInfo<unsigned int> in,
+  unsigned int reductionStride,
+  unsigned int reductionSize,
+  unsigned int totalSlices,
+  int biased,
+  int applySqrt) {
+  string kernelName = contigReduction ? "THClTensor_reduceContigDimMoments" : "THClTensor_reduceNoncontigDimMoments";
+  CopyOp modifyOp;
+  TensorAddReduceOp reduceOp;
+  CLKernel *kernel = THClTensor_buildReduceKernel(state, ADims, BDims, out.dataType, in.dataType,
+    &modifyOp, &reduceOp, kernelName);
+  if( kernel == 0 ) { // compile-only
+    return;
+  }
+
+  dim3 global_ws;
+  for( int i = 0; i < 3; i++ ) {
+    global_ws.vec[i] = grid.vec[i] * block.vec[i];
+  }
+  TensorInfoCl outCl(out);
+  TensorInfoCl inCl(in);
+
+  if( !out.wrapper->isOnDevice() ) {
+    out.wrapper->createOnDevice();
+  }
+  THClLaunch launch(state, kernel, kernelName);
+  launch.in(1, &outCl);
+  launch.range(out.wrapper, out.firstFloat(), out.numFloats());
+  launch.out(out.wrapper);
+  launch.in(1, &inCl);
+  launch.range(in.wrapper, in.firstFloat(), in.numFloats());
+  launch.in(in.wrapper);
+  if( !contigReduction ) {
+    launch.in((int)reductionStride);
+  }
+  launch.in((int)reductionSize);
+  launch.in((int)totalSlices);
+  launch.in(biased);
+  launch.in(applySqrt);
+  if( contigReduction ) {
+    launch.localFloats(block.vec[0]);
+    launch.localFloats(block.vec[0]);
+    launch.localFloats(block.vec[0]);
+  }
+
+  cl_event profileBegin = THClProfiler_begin(state);
+  launch.run(3, global_ws.vec, block.vec);
+  THClProfiler_end(state, profileBegin, kernelName,
+    THClProfiler_shapeClass(in.dims, (long)totalSlices * reductionSize),
+    (long)totalSlices * reductionSize * THClStorage_elementSize(in.dataType));
+  state->cl->finish();
+}
+
+bool THClTensor_reduceDimMoments(THClState* state,
+                                 THClTensor* out,
+                                 THClTensor* in,
+                                 int dim,
+                                 int biased,
+                                 int applySqrt) {
+  long inElements = THClTensor_nElement(state, in);
+
+  if (THClTensor_nDimension(state, out) > MAX_CLTORCH_DIMS ||
+      THClTensor_nDimension(state, in) > MAX_CLTORCH_DIMS) {
+    return false;
+  }
+
+  if (THClTensor_nDimension(state, in) == 0) {
+    return true;
+  }
+
+  long reductionSize = THClTensor_size(state, in, dim);
+  long reductionStride = THClTensor_stride(state, in, dim);
+  long outElements = inElements / reductionSize;
+  bool contigReduction = (reductionStride == 1);
+
+  dim3 block;
+  dim3 grid;
+  if (contigReduction) {
+    if (!getContigReduceGrid(outElements, grid)) {
+      return false;
+    }
+    block = THClTensor_capReduceBlock(state, getContigReduceBlock(outElements, reductionSize));
+  } else {
+    block = THClTensor_capReduceBlock(state, getNoncontigReduceBlock());
+    if (!THCL_getGridFromTiles(DIVUP(outElements, (long)block.vec[0]), grid)) {
+      return false;
+    }
+  }
+
+  THLongStorage* sizes = THClTensor_newSizeOf(state, in);
+  THLongStorage_set(sizes, dim, 1);
+  THClTensor_resize(state, out, sizes, NULL);
+  THLongStorage_free(sizes);
+
+  if (!THCL_canUse32BitIndexMath(state, out) || !THCL_canUse32BitIndexMath(state, in)) {
+    return false;
+  }
+  TensorInfo<unsigned int> outInfo(state, out);
+  TensorInfo<unsigned int> inInfo(state, in, dim);
+
+  kernelLaunch_THClTensor_reduceDimMoments(state, contigReduction, grid, block,
+    THClTensor_reduceDimsCase(outInfo), THClTensor_reduceDimsCase(inInfo),
+    outInfo, inInfo, (unsigned int)reductionStride, (unsigned int)reductionSize,
+    (unsigned int)outElements, biased, applySqrt);
+  return true;
+}
+
+bool THClTensor_reduceAllMoments(THClState* state,
+                                 THClTensor* in,
+                                 int biased,
+                                 int applySqrt,
+                                 float *result) {
+  long inElements = THClTensor_nElement(state, in);
+  if (THClTensor_nDimension(state, in) > MAX_CLTORCH_DIMS) {
+    return false;
+  }
+  if (THClTensor_nDimension(state, in) == 0) {
+    *result = 0;
+    return true;
+  }
+  if (!THCL_canUse32BitIndexMath(state, in)) {
+    return false;
+  }
+
+  int blockSize = THClTensor_capReduceBlock(state, dim3(THCL_NONCONTIG_REDUCE_BLOCK_SIZE)).vec[0];
+  long numGroups = DIVUP(inElements, (long)blockSize);
+  if (numGroups > THCL_REDUCE_ALL_GROUPS) {
+    numGroups = THCL_REDUCE_ALL_GROUPS;
+  }
+  THClTensor *partials = THClTensor_newWithSize1d(state, 3 * numGroups);
+  THClTensor *total = THClTensor_newWithSize1d(state, 1);
+
+  TensorInfo<unsigned int> inInfo(state, in);
+  int inDims = THClTensor_reduceDimsCase(inInfo);
+  CopyOp modifyOp;
+  TensorAddReduceOp reduceOp;
+  CLKernel *kernel = THClTensor_buildReduceKernel(state, -2, inDims, THCL_FLOAT, inInfo.dataType,
+    &modifyOp, &reduceOp, "THClTensor_reduceAllMoments");
+  CLKernel *mergeKernel = THClTensor_buildReduceKernel(state, -2, -2, THCL_FLOAT, THCL_FLOAT,
+    &modifyOp, &reduceOp, "THClTensor_mergeMoments");
+  if (kernel == 0 || mergeKernel == 0) { // compile-only
+    *result = 0;
+    THClTensor_free(state, partials);
+    THClTensor_free(state, total);
+    return true;
+  }
+  TensorInfoCl inCl(inInfo);
+
+  THClLaunch launch(state, kernel, "THClTensor_reduceAllMoments");
+  launch.in(1, &inCl);
+  launch.range(inInfo.wrapper, inInfo.firstFloat(), inInfo.numFloats());
+  launch.in(inInfo.wrapper);
+  launch.in((int)inElements);
+  launch.out(THClTensor_wrapper(state, partials));
+  launch.localFloats(blockSize);
+  launch.localFloats(blockSize);
+  launch.localFloats(blockSize);
+  cl_event profileBegin = THClProfiler_begin(state);
+  launch.run_1d(numGroups * blockSize, blockSize);
+  THClProfiler_end(state, profileBegin, "THClTensor_reduceAllMoments",
+    THClProfiler_shapeClass(inInfo.dims, inElements),
+    inElements * THClStorage_elementSize(inInfo.dataType));
+
+  THClLaunch merge(state, mergeKernel, "THClTensor_mergeMoments");
+  merge.in((int)numGroups);
+  merge.in(THClTensor_wrapper(state, partials));
+  merge.out(THClTensor_wrapper(state, total));
+  merge.in(biased);
+  merge.in(applySqrt);
+  merge.localFloats(blockSize);
+  merge.localFloats(blockSize);
+  merge.localFloats(blockSize);
+  merge.run_1d(blockSize, blockSize);
+
+  *result = THClStorage_get(state, total->storage, total->storageOffset);
+  THClTensor_free(state, partials);
+  THClTensor_free(state, total);
+  return true;
+}
+
+std::string getReduce_template() {
+    // [[[cog
+    // import stringify
+    // stringify.write_kernel( "kernel", "THClReduce.cl" )
+    // ]]]
+    // generated using cog, from THClReduce.cl:
+    const char * kernelSource =  
+    "// Reduction kernels\n" 
+    "// (Ported from cutorch's THCReduce.cuh and THCReduceAll.cuh)\n" 
+    "\n" 
+    "// expected templated values:\n" 
+    "// dims (vector of unique dimension values)\n" 
+    "// dim1: dims of the output (reduceDim only)\n" 
+    "// dim2: dims of the input\n" 
+    "// modify_operation: applied to each input value, eg \"*out = *in1\"\n" 
+    "// reduce_operation: folds two values, eg \"*out = *in1 + *in2\"; for the\n" 
+    "//   index reductions, compares them instead, eg \"*out = *in1 > *in2\"\n" 
+    "// in_half: 1 if the input is stored as half\n" 
+    "// out_half: 1 if the output is stored as half\n" 
+    "// in_byte, out_byte: likewise, for bytes\n" 
+    "// MAX_CLTORCH_DIMS\n" 
+    "\n" 
+    "// kernel argument that defines tensor layout\n" 
+    "typedef struct TensorInfoCl {\n" 
+    "  int sizes[{{MAX_CLTORCH_DIMS}}];\n" 
+    "  int strides[{{MAX_CLTORCH_DIMS}}];\n" 
+    "  int offset;\n" 
+    "  int dims;\n" 
+    "} TensorInfoCl;\n" 
+    "\n" 
+    "// Translate a linear index for the reduction to a float* offset;\n" 
+    "// specialized on `Dims` to reduce compilation time\n" 
+    "{% for _,dim in ipairs(dims) do %}\n" 
+    "int IndexToOffset_{{1000 + dim}}_get( int linearId, TensorInfoCl info) {\n" 
+    "  int offset = 0;\n" 
+    "\n" 
+    "  // Use static dims\n" 
+    "  for (int i = {{dim}} - 1; i >= 0; --i) {\n" 
+    "    int curDimIndex = linearId % info.sizes[i];\n" 
+    "    int curDimOffset = curDimIndex * info.strides[i];\n" 
+    "    offset += curDimOffset;\n" 
+    "\n" 
+    "    if (i > 0) {\n" 
+    "      linearId /= info.sizes[i];\n" 
+    "    }\n" 
+    "  }\n" 
+    "\n" 
+    "  return offset;\n" 
+    "}\n" 
+    "{% end %}\n" 
+    "\n" 
+    "int IndexToOffset_998_get(int linearId, const TensorInfoCl info) {\n" 
+    "    return linearId;\n" 
+    "}\n" 
+    "\n" 
+    "int IndexToOffset_999_get(int linearId, const TensorInfoCl info) {\n" 
+    "  int offset = 0;\n" 
+    "\n" 
+    "  // Use dynamic dims\n" 
+    "  for (int i = info.dims - 1; i >= 0; --i) {\n" 
+    "    int curDimIndex = linearId % info.sizes[i];\n" 
+    "    int curDimOffset = curDimIndex * info.strides[i];\n" 
+    "    offset += curDimOffset;\n" 
+    "\n" 
+    "    linearId /= info.sizes[i];\n" 
+    "  }\n" 
+    "\n" 
+    "  return offset;\n" 
+    "}\n" 
+    "\n" 
+    "int getLinearBlockId() {\n" 
+    "  return get_group_id(2) * get_num_groups(1) * get_num_groups(0) +\n" 
+    "    get_group_id(1) * get_num_groups(0) +\n" 
+    "    get_group_id(0);\n" 
+    "}\n" 
+    "\n" 
+    "float modifyOp(float _in1) {\n" 
+    "  float _out;\n" 
+    "  float *in1 = &_in1;\n" 
+    "  float *out = &_out;\n" 
+    "  {{modify_operation}};\n" 
+    "  return _out;\n" 
+    "}\n" 
+    "\n" 
+    "float reduceOp(float _in1, float _in2) {\n" 
+    "  // I guess the compiler can sort this stuff out :-P\n" 
+    "  float _out;\n" 
+    "  float *in1 = &_in1;\n" 
+    "  float *in2 = &_in2;\n" 
+    "  float *out = &_out;\n" 
+    "  {{reduce_operation}};\n" 
+    "  return _out;\n" 
+    "}\n" 
+    "\n" 
+    "{% if in_half == 1 then %}\n" 
+    "#define IN_TYPE half\n" 
+    "#define LOAD_IN(data, index) vload_half(index, data)\n" 
+    "{% elseif in_byte == 1 then %}\n" 
+    "#define IN_TYPE uchar\n" 
+    "#define LOAD_IN(data, index) ((float)data[index])\n" 
+    "{% else %}\n" 
+    "#define IN_TYPE float\n" 
+    "#define LOAD_IN(data, index) data[index]\n" 
+    "{% end %}\n" 
+    "{% if out_half == 1 then %}\n" 
+    "#define OUT_TYPE half\n" 
+    "#define STORE_OUT(data, index, value) vstore_half(value, index, data)\n" 
+    "{% elseif out_byte == 1 then %}\n" 
+    "#define OUT_TYPE uchar\n" 
+    "#define STORE_OUT(data, index, value) data[index] = (uchar)(value)\n" 
+    "{% else %}\n" 
+    "#define OUT_TYPE float\n" 
+    "#define STORE_OUT(data, index, value) data[index] = value\n" 
+    "{% end %}\n" 
+    "\n" 
+    "// Folds smem[0..get_local_size(0)) into smem[0].  Works for any work group\n" 
+    "// size, not just powers of two\n" 
+    "void reduceLocal(local float *smem) {\n" 
+    "  const int tid = get_local_id(0);\n" 
+    "  const int size = get_local_size(0);\n" 
+    "  barrier(CLK_LOCAL_MEM_FENCE);\n" 
+    "  for (int s = 1; s < size; s <<= 1) {\n" 
+    "    if ((tid % (s << 1)) == 0 && tid + s < size) {\n" 
+    "      smem[tid] = reduceOp(smem[tid], smem[tid + s]);\n" 
+    "    }\n" 
+    "    barrier(CLK_LOCAL_MEM_FENCE);\n" 
+    "  }\n" 
+    "}\n" 
+    "\n" 
+    "// Kernel that handles an entire reduction of a slice of a tensor per each thread\n" 
+    "kernel void\n" 
+    "THClTensor_reduceNoncontigDim(global TensorInfoCl *out_info,\n" 
+    "                              global OUT_TYPE *out_data,\n" 
+    "                              global TensorInfoCl *in_info,\n" 
+    "                              global IN_TYPE *in_data,\n" 
+    "                              int reductionStride,\n" 
+    "                              int reductionSize,\n" 
+    "                              int totalSlices,\n" 
+    "                              float init) {\n" 
+    "  // Each thread handles one slice\n" 
+    "  const int sliceIndex = getLinearBlockId() * get_local_size(0) + get_local_id(0);\n" 
+    "  if (sliceIndex >= totalSlices) {\n" 
+    "    return;\n" 
+    "  }\n" 
+    "\n" 
+    "  // Each thread picks a point in `out` and `in` for which it is\n" 
+    "  // producing the reduction\n" 
+    "  const int outOffset =\n" 
+    "    IndexToOffset_{{1000 + dim1}}_get(sliceIndex, out_info[0]) + out_info->offset;\n" 
+    "  int inOffset =\n" 
+    "    IndexToOffset_{{1000 + dim2}}_get(sliceIndex, in_info[0]) + in_info->offset;\n" 
+    "\n" 
+    "  // For each point in reductionSize, reduce into `r`\n" 
+    "  float r = init;\n" 
+    "  for (int i = 0; i < reductionSize; ++i) {\n" 
+    "    r = reduceOp(r, modifyOp(LOAD_IN(in_data, inOffset)));\n" 
+    "    inOffset += reductionStride;\n" 
+    "  }\n" 
+    "\n" 
+    "  // Write out reduced value\n" 
+    "  STORE_OUT(out_data, outOffset, r);\n" 
+    "}\n" 
+    "\n" 
+    "// Kernel that handles an entire reduction of a slice of a tensor per\n" 
+    "// each block\n" 
+    "kernel void\n" 
+    "THClTensor_reduceContigDim(global TensorInfoCl *out_info,\n" 
+    "                           global OUT_TYPE *out_data,\n" 
+    "                           global TensorInfoCl *in_info,\n" 
+    "                           global IN_TYPE *in_data,\n" 
+    "                           int reductionSize,\n" 
+    "                           int totalSlices,\n" 
+    "                           float init,\n" 
+    "                           local float *smem) {\n" 
+    "  // Each block handles one slice\n" 
+    "  const int sliceIndex = getLinearBlockId();\n" 
+    "  if (sliceIndex >= totalSlices) {\n" 
+    "    return;\n" 
+    "  }\n" 
+    "\n" 
+    "  // Get the offset in `out` for the reduction\n" 
+    "  const int outOffset =\n" 
+    "    IndexToOffset_{{1000 + dim1}}_get(sliceIndex, out_info[0]) + out_info->offset;\n" 
+    "\n" 
+    "  // Get the base offset in `in` for this block's reduction\n" 
+    "  const int inBaseOffset =\n" 
+    "    IndexToOffset_{{1000 + dim2}}_get(sliceIndex, in_info[0]) + in_info->offset;\n" 
+    "\n" 
+    "  // Each thread in the block will reduce some subset of elements in\n" 
+    "  // the slice. The elements are guaranteed contiguous starting at\n" 
+    "  // `inBaseOffset`.\n" 
+    "  float r = init;\n" 
+    "  for (int i = get_local_id(0); i < reductionSize; i += get_local_size(0)) {\n" 
+    "    r = reduceOp(r, modifyOp(LOAD_IN(in_data, inBaseOffset + i)));\n" 
+    "  }\n" 
+    "\n" 
+    "  // Reduce within the block\n" 
+    "  smem[get_local_id(0)] = r;\n" 
+    "  reduceLocal(smem);\n" 
+    "\n" 
+    "  if (get_local_id(0) == 0) {\n" 
+    "    // Write out reduced value\n" 
+    "    STORE_OUT(out_data, outOffset, smem[0]);\n" 
+    "  }\n" 
+    "}\n" 
+    "\n" 
+    "// For the index reductions, whether (value1, index1) beats (value2,\n" 
+    "// index2), where reduceOp is nonzero if value1 beats value2.  As on the CPU,\n" 
+    "// NaNs beat everything else, and of equal values the lower index wins.  An\n" 
+    "// index of -1 marks an empty pair, which everything beats\n" 
+    "bool pairBeats(float value1, int index1, float value2, int index2) {\n" 
+    "  if (index2 < 0 || index1 < 0) {\n" 
+    "    return index2 < 0 && index1 >= 0;\n" 
+    "  }\n" 
+    "  const bool nan1 = isnan(value1);\n" 
+    "  const bool nan2 = isnan(value2);\n" 
+    "  if (nan1 || nan2) {\n" 
+    "    return nan1 && (!nan2 || index1 < index2);\n" 
+    "  }\n" 
+    "  if (reduceOp(value1, value2) != 0) {\n" 
+    "    return true;\n" 
+    "  }\n" 
+    "  return value1 == value2 && index1 < index2;\n" 
+    "}\n" 
+    "\n" 
+    "// Folds the pairs in values and indices [0..get_local_size(0)) into their\n" 
+    "// first elements, like reduceLocal\n" 
+    "void reduceLocalPairs(local float *values, local int *indices) {\n" 
+    "  const int tid = get_local_id(0);\n" 
+    "  const int size = get_local_size(0);\n" 
+    "  barrier(CLK_LOCAL_MEM_FENCE);\n" 
+    "  for (int s = 1; s < size; s <<= 1) {\n" 
+    "    if ((tid % (s << 1)) == 0 && tid + s < size\n" 
+    "        && pairBeats(values[tid + s], indices[tid + s], values[tid], indices[tid])) {\n" 
+    "      values[tid] = values[tid + s];\n" 
+    "      indices[tid] = indices[tid + s];\n" 
+    "    }\n" 
+    "    barrier(CLK_LOCAL_MEM_FENCE);\n" 
+    "  }\n" 
+    "}\n" 
+    "\n" 
+    "// Like THClTensor_reduceNoncontigDim, but finding the winning element of\n" 
+    "// each slice, and writing its index along the slice, from 1, to indices\n" 
+    "kernel void\n" 
+    "THClTensor_reduceNoncontigDimIndex(global TensorInfoCl *out_info,\n" 
+    "                                   global OUT_TYPE *out_data,\n" 
+    "                                   global TensorInfoCl *indices_info,\n" 
+    "                                   global float *indices_data,\n" 
+    "                                   global TensorInfoCl *in_info,\n" 
+    "                                   global IN_TYPE *in_data,\n" 
+    "                                   int reductionStride,\n" 
+    "                                   int reductionSize,\n" 
+    "                                   int totalSlices) {\n" 
+    "  const int sliceIndex = getLinearBlockId() * get_local_size(0) + get_local_id(0);\n" 
+    "  if (sliceIndex >= totalSlices) {\n" 
+    "    return;\n" 
+    "  }\n" 
+    "\n" 
+    "  const int outOffset =\n" 
+    "    IndexToOffset_{{1000 + dim1}}_get(sliceIndex, out_info[0]) + out_info->offset;\n" 
+    "  const int indicesOffset =\n" 
+    "    IndexToOffset_999_get(sliceIndex, indices_info[0]) + indices_info->offset;\n" 
+    "  int inOffset =\n" 
+    "    IndexToOffset_{{1000 + dim2}}_get(sliceIndex, in_info[0]) + in_info->offset;\n" 
+    "\n" 
+    "  float r = 0;\n" 
+    "  int rIndex = -1;\n" 
+    "  for (int i = 0; i < reductionSize; ++i) {\n" 
+    "    const float value = modifyOp(LOAD_IN(in_data, inOffset));\n" 
+    "    if (pairBeats(value, i, r, rIndex)) {\n" 
+    "      r = value;\n" 
+    "      rIndex = i;\n" 
+    "    }\n" 
+    "    inOffset += reductionStride;\n" 
+    "  }\n" 
+    "\n" 
+    "  STORE_OUT(out_data, outOffset, r);\n" 
+    "  indices_data[indicesOffset] = rIndex + 1;\n" 
+    "}\n" 
+    "\n" 
+    "// Like THClTensor_reduceContigDim, but finding the winning element of each\n" 
+    "// slice, and writing its index along the slice, from 1, to indices\n" 
+    "kernel void\n" 
+    "THClTensor_reduceContigDimIndex(global TensorInfoCl *out_info,\n" 
+    "                                global OUT_TYPE *out_data,\n" 
+    "                                global TensorInfoCl *indices_info,\n" 
+    "                                global float *indices_data,\n" 
+    "                                global TensorInfoCl *in_info,\n" 
+    "                                global IN_TYPE *in_data,\n" 
+    "                                int reductionSize,\n" 
+    "                                int totalSlices,\n" 
+    "                                local float *smem,\n" 
+    "                                local float *smemIndexSpace) {\n" 
+    "  local int *smemIndices = (local int *)smemIndexSpace;\n" 
+    "  const int sliceIndex = getLinearBlockId();\n" 
+    "  if (sliceIndex >= totalSlices) {\n" 
+    "    return;\n" 
+    "  }\n" 
+    "\n" 
+    "  const int outOffset =\n" 
+    "    IndexToOffset_{{1000 + dim1}}_get(sliceIndex, out_info[0]) + out_info->offset;\n" 
+    "  const int indicesOffset =\n" 
+    "    IndexToOffset_999_get(sliceIndex, indices_info[0]) + indices_info->offset;\n" 
+    "  const int inBaseOffset =\n" 
+    "    IndexToOffset_{{1000 + dim2}}_get(sliceIndex, in_info[0]) + in_info->offset;\n" 
+    "\n" 
+    "  float r = 0;\n" 
+    "  int rIndex = -1;\n" 
+    "  for (int i = get_local_id(0); i < reductionSize; i += get_local_size(0)) {\n" 
+    "    const float value = modifyOp(LOAD_IN(in_data, inBaseOffset + i));\n" 
+    "    if (pairBeats(value, i, r, rIndex)) {\n" 
+    "      r = value;\n" 
+    "      rIndex = i;\n" 
+    "    }\n" 
+    "  }\n" 
+    "\n" 
+    "  smem[get_local_id(0)] = r;\n" 
+    "  smemIndices[get_local_id(0)] = rIndex;\n" 
+    "  reduceLocalPairs(smem, smemIndices);\n" 
+    "\n" 
+    "  if (get_local_id(0) == 0) {\n" 
+    "    STORE_OUT(out_data, outOffset, smem[0]);\n" 
+    "    indices_data[indicesOffset] = smemIndices[0] + 1;\n" 
+    "  }\n" 
+    "}\n" 
+    "\n" 
+    "// Each block folds a strided share of all the elements of `in` into\n" 
+    "// out_data[block]; running it again over those partials, with a single\n" 
+    "// block, gives the total\n" 
+    "kernel void\n" 
+    "THClTensor_reduceAll(global TensorInfoCl *in_info,\n" 
+    "                     global IN_TYPE *in_data,\n" 
+    "                     int totalElements,\n" 
+    "                     float init,\n" 
+    "                     global OUT_TYPE *out_data,\n" 
+    "                     local float *smem) {\n" 
+    "  float r = init;\n" 
+    "  for (int i = get_global_id(0); i < totalElements; i += get_global_size(0)) {\n" 
+    "    const int inOffset = IndexToOffset_{{1000 + dim2}}_get(i, in_info[0]) + in_info->offset;\n" 
+    "    r = reduceOp(r, modifyOp(LOAD_IN(in_data, inOffset)));\n" 
+    "  }\n" 
+    "\n" 
+    "  smem[get_local_id(0)] = r;\n" 
+    "  reduceLocal(smem);\n" 
+    "\n" 
+    "  if (get_local_id(0) == 0) {\n" 
+    "    STORE_OUT(out_data, get_group_id(0), smem[0]);\n" 
+    "  }\n" 
+    "}\n" 
+    "\n" 
+    "// Moments, for var and std: each thread folds its elements into a count,\n" 
+    "// mean and M2, the sum of squared deviations from the mean, with Welford's\n" 
+    "// update, and the threads' and groups' moments merge pairwise (Chan et al).\n" 
+    "// So the data is read once, and there's no cancellation between a sum of\n" 
+    "// squares and a squared sum.  Counts are uints, since a float stops\n" 
+    "// counting at 2^24, and one thread can take a whole slice\n" 
+    "void welfordAdd(float value, uint *n, float *mean, float *m2) {\n" 
+    "  *n += 1;\n" 
+    "  const float delta = value - *mean;\n" 
+    "  *mean += delta / (float)*n;\n" 
+    "  *m2 += delta * (value - *mean);\n" 
+    "}\n" 
+    "\n" 
+    "void welfordMerge(uint nB, float meanB, float m2B, uint *n, float *mean, float *m2) {\n" 
+    "  if (nB == 0) {\n" 
+    "    return;\n" 
+    "  }\n" 
+    "  const uint total = *n + nB;\n" 
+    "  const float delta = meanB - *mean;\n" 
+    "  const float ratio = (float)nB / (float)total;\n" 
+    "  *mean += delta * ratio;\n" 
+    "  *m2 += m2B + delta * delta * (float)*n * ratio;\n" 
+    "  *n = total;\n" 
+    "}\n" 
+    "\n" 
+    "// the variance, divided by n if biased, otherwise by n - 1; or its square root\n" 
+    "float welfordFinish(uint n, float m2, int biased, int applySqrt) {\n" 
+    "  const float count = (float)n;\n" 
+    "  const float var = m2 / (biased ? count : count - 1);\n" 
+    "  return applySqrt ? sqrt(var) : var;\n" 
+    "}\n" 
+    "\n" 
+    "// Folds the moments in n, mean and m2 [0..get_local_size(0)) into their\n" 
+    "// first elements, like reduceLocal\n" 
+    "void reduceLocalMoments(local uint *n, local float *mean, local float *m2) {\n" 
+    "  const int tid = get_local_id(0);\n" 
+    "  const int size = get_local_size(0);\n" 
+    "  barrier(CLK_LOCAL_MEM_FENCE);\n" 
+    "  for (int s = 1; s < size; s <<= 1) {\n" 
+    "    if ((tid % (s << 1)) == 0 && tid + s < size) {\n" 
+    "      uint nA = n[tid];\n" 
+    "      float meanA = mean[tid];\n" 
+    "      float m2A = m2[tid];\n" 
+    "      welfordMerge(n[tid + s], mean[tid + s], m2[tid + s], &nA, &meanA, &m2A);\n" 
+    "      n[tid] = nA;\n" 
+    "      mean[tid] = meanA;\n" 
+    "      m2[tid] = m2A;\n" 
+    "    }\n" 
+    "    barrier(CLK_LOCAL_MEM_FENCE);\n" 
+    "  }\n" 
+    "}\n" 
+    "\n" 
+    "// Variance of each slice, a thread per slice, as THClTensor_reduceNoncontigDim\n" 
+    "kernel void\n" 
+    "THClTensor_reduceNoncontigDimMoments(global TensorInfoCl *out_info,\n" 
+    "                                     global OUT_TYPE *out_data,\n" 
+    "                                     global TensorInfoCl *in_info,\n" 
+    "                                     global IN_TYPE *in_data,\n" 
+    "                                     int reductionStride,\n" 
+    "                                     int reductionSize,\n" 
+    "                                     int totalSlices,\n" 
+    "                                     int biased,\n" 
+    "                                     int applySqrt) {\n" 
+    "  const int sliceIndex = getLinearBlockId() * get_local_size(0) + get_local_id(0);\n" 
+    "  if (sliceIndex >= totalSlices) {\n" 
+    "    return;\n" 
+    "  }\n" 
+    "\n" 
+    "  const int outOffset =\n" 
+    "    IndexToOffset_{{1000 + dim1}}_get(sliceIndex, out_info[0]) + out_info->offset;\n" 
+    "  int inOffset =\n" 
+    "    IndexToOffset_{{1000 + dim2}}_get(sliceIndex, in_info[0]) + in_info->offset;\n" 
+    "\n" 
+    "  uint n = 0;\n" 
+    "  float mean = 0;\n" 
+    "  float m2 = 0;\n" 
+    "  for (int i = 0; i < reductionSize; ++i) {\n" 
+    "    welfordAdd(modifyOp(LOAD_IN(in_data, inOffset)), &n, &mean, &m2);\n" 
+    "    inOffset += reductionStride;\n" 
+    "  }\n" 
+    "\n" 
+    "  STORE_OUT(out_data, outOffset, welfordFinish(n, m2, biased, applySqrt));\n" 
+    "}\n" 
+    "\n" 
+    "// Variance of each slice, a work group per slice, as THClTensor_reduceContigDim\n" 
+    "kernel void\n" 
+    "THClTensor_reduceContigDimMoments(global TensorInfoCl *out_info,\n" 
+    "                                  global OUT_TYPE *out_data,\n" 
+    "                                  global TensorInfoCl *in_info,\n" 
+    "                                  global IN_TYPE *in_data,\n" 
+    "                                  int reductionSize,\n" 
+    "                                  int totalSlices,\n" 
+    "                                  int biased,\n" 
+    "                                  int applySqrt,\n" 
+    "                                  local uint *smemN,\n" 
+    "                                  local float *smemMean,\n" 
+    "                                  local float *smemM2) {\n" 
+    "  const int sliceIndex = getLinearBlockId();\n" 
+    "  if (sliceIndex >= totalSlices) {\n" 
+    "    return;\n" 
+    "  }\n" 
+    "\n" 
+    "  const int outOffset =\n" 
+    "    IndexToOffset_{{1000 + dim1}}_get(sliceIndex, out_info[0]) + out_info->offset;\n" 
+    "  const int inBaseOffset =\n" 
+    "    IndexToOffset_{{1000 + dim2}}_get(sliceIndex, in_info[0]) + in_info->offset;\n" 
+    "\n" 
+    "  uint n = 0;\n" 
+    "  float mean = 0;\n" 
+    "  float m2 = 0;\n" 
+    "  for (int i = get_local_id(0); i < reductionSize; i += get_local_size(0)) {\n" 
+    "    welfordAdd(modifyOp(LOAD_IN(in_data, inBaseOffset + i)), &n, &mean, &m2);\n" 
+    "  }\n" 
+    "\n" 
+    "  smemN[get_local_id(0)] = n;\n" 
+    "  smemMean[get_local_id(0)] = mean;\n" 
+    "  smemM2[get_local_id(0)] = m2;\n" 
+    "  reduceLocalMoments(smemN, smemMean, smemM2);\n" 
+    "\n" 
+    "  if (get_local_id(0) == 0) {\n" 
+    "    STORE_OUT(out_data, outOffset, welfordFinish(smemN[0], smemM2[0], biased, applySqrt));\n" 
+    "  }\n" 
+    "}\n" 
+    "\n" 
+    "// Each block folds a strided share of all the elements of `in` into moments,\n" 
+    "// which go to partials[3 * block] on, as n (its bits, as a float), mean and M2\n" 
+    "kernel void\n" 
+    "THClTensor_reduceAllMoments(global TensorInfoCl *in_info,\n" 
+    "                            global IN_TYPE *in_data,\n" 
+    "                            int totalElements,\n" 
+    "                            global float *partials,\n" 
+    "                            local uint *smemN,\n" 
+    "                            local float *smemMean,\n" 
+    "                            local float *smemM2) {\n" 
+    "  uint n = 0;\n" 
+    "  float mean = 0;\n" 
+    "  float m2 = 0;\n" 
+    "  for (int i = get_global_id(0); i < totalElements; i += get_global_size(0)) {\n" 
+    "    const int inOffset = IndexToOffset_{{1000 + dim2}}_get(i, in_info[0]) + in_info->offset;\n" 
+    "    welfordAdd(modifyOp(LOAD_IN(in_data, inOffset)), &n, &mean, &m2);\n" 
+    "  }\n" 
+    "\n" 
+    "  smemN[get_local_id(0)] = n;\n" 
+    "  smemMean[get_local_id(0)] = mean;\n" 
+    "  smemM2[get_local_id(0)] = m2;\n" 
+    "  reduceLocalMoments(smemN, smemMean, smemM2);\n" 
+    "\n" 
+    "  if (get_local_id(0) == 0) {\n" 
+    "    partials[3 * get_group_id(0)] = as_float(smemN[0]);\n" 
+    "    partials[3 * get_group_id(0) + 1] = smemMean[0];\n" 
+    "    partials[3 * get_group_id(0) + 2] = smemM2[0];\n" 
+    "  }\n" 
+    "}\n" 
+    "\n" 
+    "// A single block merges numPartials moments from THClTensor_reduceAllMoments\n" 
+    "// into the variance, in out[0]\n" 
+    "kernel void\n" 
+    "THClTensor_mergeMoments(int numPartials,\n" 
+    "                        global const float *partials,\n" 
+    "                        global float *out,\n" 
+    "                        int biased,\n" 
+    "                        int applySqrt,\n" 
+    "                        local uint *smemN,\n" 
+    "                        local float *smemMean,\n" 
+    "                        local float *smemM2) {\n" 
+    "  uint n = 0;\n" 
+    "  float mean = 0;\n" 
+    "  float m2 = 0;\n" 
+    "  for (int i = get_local_id(0); i < numPartials; i += get_local_size(0)) {\n" 
+    "    welfordMerge(as_uint(partials[3 * i]), partials[3 * i + 1], partials[3 * i + 2], &n, &mean, &m2);\n" 
+    "  }\n" 
+    "\n" 
+    "  smemN[get_local_id(0)] = n;\n" 
+    "  smemMean[get_local_id(0)] = mean;\n" 
+    "  smemM2[get_local_id(0)] = m2;\n" 
+    "  reduceLocalMoments(smemN, smemMean, smemM2);\n" 
+    "\n" 
+    "  if (get_local_id(0) == 0) {\n" 
+    "    out[0] = welfordFinish(smemN[0], smemM2[0], biased, applySqrt);\n" 
+    "  }\n" 
+    "}\n" 
+    "\n" 
+    "";
+    // [[[end]]]
+    return kernelSource;
+}
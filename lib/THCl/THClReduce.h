@@ -10,6 +10,8 @@
 
 #include "THClReduceApplyUtils.h"
 
+std::string getReduce_template();
+
 #define THCL_NONCONTIG_REDUCE_BLOCK_SIZE 32 * 16
 
 inline dim3 getNoncontigReduceBlock() {
@@ -17,35 +19,6 @@ inline dim3 getNoncontigReduceBlock() {
 }
 
 
-template<typename IndexType, int ADims, int BDims>
-void kernelLaunch_THClTensor_reduceNoncontigDim(
-  TensorInfo<IndexType> out,
-  TensorInfo<IndexType> in,
-  IndexType reductionStride,
-  IndexType reductionSize,
-  IndexType totalSlices,
-  HasOperator2 const*modifyOp,
-  HasOperator3 const*reduceOp) {
-
-  // launch kernel here....
-
-  THError("Not implemented");
-}
-
-template<typename IndexType, int ADims, int BDims>
-void kernelLaunch_THClTensor_reduceContigDim(
-  TensorInfo<IndexType> out,
-  TensorInfo<IndexType> in,
-  IndexType reductionSize,
-  IndexType totalSlices,
-  HasOperator2 const*modifyOp,
-  HasOperator3 const*reduceOp) {
-
-  // launch kernel here....
-
-  THError("Not implemented");
-}
-
 inline dim3 getContigReduceBlock(long numSlices, long reductionSize) {
   // If the number of slices is low but the reduction dimension size
   // is high, then we should increase block size for greater parallelism.
@@ -80,13 +53,105 @@ inline bool getContigReduceGrid(long elements, dim3& grid) {
   return THCL_getGridFromTiles(elements, grid);
 }
 
+// Performs a reduction out[..., 0, ...] = reduce_i(modify(in[..., i, ...])) for
+// all in where i and the out's 0 are indexed at dimension `dim`.  init is the
+// identity value of reduceOp
 bool THClTensor_reduceDim(THClState* state,
                           THClTensor* out,
                           THClTensor* in,
-                          const HasOperator1 *modifyOp,
-                          const HasOperator2 *reduceOp,
+                          const HasOperator2 &modifyOp,
+                          const HasOperator3 &reduceOp,
+                          float init,
                           int dim);
 
+// Like reduceDim, but finds the element of each slice that wins by
+// compareOp, whose operator3 sets *out nonzero when *in1 beats *in2, eg
+// "*out = *in1 > *in2".  out gets its value, and indices, which has to be
+// float, its index along dim, from 1.  As on the CPU, NaNs win, and of
+// equal values the first does
+bool THClTensor_reduceDimIndex(THClState* state,
+                               THClTensor* out,
+                               THClTensor* indices,
+                               THClTensor* in,
+                               const HasOperator2 &modifyOp,
+                               const HasOperator3 &compareOp,
+                               int dim);
+
+// Reduces every element of `in` into *result.  Runs in two passes: each
+// work group folds a strided share of the elements into a partial result,
+// then a single work group folds the partials.
+bool THClTensor_reduceAll(THClState* state,
+                          THClTensor* in,
+                          const HasOperator2 &modifyOp,
+                          const HasOperator3 &reduceOp,
+                          float init,
+                          float *result);
+
+// The variance of each slice of `in` along dim, into out, in a single pass
+// of Welford updates and pairwise merges: divided by the slice's size if
+// biased, otherwise by one less; or its square root, with applySqrt
+bool THClTensor_reduceDimMoments(THClState* state,
+                                 THClTensor* out,
+                                 THClTensor* in,
+                                 int dim,
+                                 int biased,
+                                 int applySqrt);
+
+// The variance of all of `in`, as reduceDimMoments, into *result.  Each
+// work group's moments are merged on the device, so only the result comes
+// back
+bool THClTensor_reduceAllMoments(THClState* state,
+                                 THClTensor* in,
+                                 int biased,
+                                 int applySqrt,
+                                 float *result);
+
+// Reduction operators, for reduceOp
+class TensorAddReduceOp : public HasOperator3 {
+public:
+  std::string operator3() const {
+    return "*out = *in1 + *in2";
+  }
+};
+
+class TensorMulReduceOp : public HasOperator3 {
+public:
+  std::string operator3() const {
+    return "*out = *in1 * *in2";
+  }
+};
+
+// NaNs win, as on the CPU, and as in reduceDimIndex; fmin and fmax alone
+// would drop them
+class TensorMinReduceOp : public HasOperator3 {
+public:
+  std::string operator3() const {
+    return "*out = isnan(*in1) ? *in1 : (isnan(*in2) ? *in2 : fmin(*in1, *in2))";
+  }
+};
+
+class TensorMaxReduceOp : public HasOperator3 {
+public:
+  std::string operator3() const {
+    return "*out = isnan(*in1) ? *in1 : (isnan(*in2) ? *in2 : fmax(*in1, *in2))";
+  }
+};
+
+// Comparisons, for reduceDimIndex
+class TensorMinIndexOp : public HasOperator3 {
+public:
+  std::string operator3() const {
+    return "*out = *in1 < *in2";
+  }
+};
+
+class TensorMaxIndexOp : public HasOperator3 {
+public:
+  std::string operator3() const {
+    return "*out = *in1 > *in2";
+  }
+};
+
 #undef THCL_NONCONTIG_REDUCE_BLOCK_SIZE
 
 #endif // THCL_REDUCE_INC
@@ -62,7 +62,7 @@ public:
 class CopyOp : public HasOperator2 {
 public:
     std::string operator2() const {
-        return "*out += *in1";
+        return "*out = *in1";
     }
 };
 
@@ -85,8 +85,37 @@ struct TensorInfo {
     return (dims == 1 && strides[0] == 1);
   }
 
+  // Broadcast views, as the apply makes for smaller read-only operands,
+  // collapse to two dimensions with one of stride 0: over the outer one for
+  // a row repeated down a matrix, over the inner one for a column repeated
+  // across it
+  inline bool isOuterBroadcast() const {
+    return (dims == 2 && strides[0] == 0);
+  }
+  inline bool isInnerBroadcast() const {
+    return (dims == 2 && strides[1] == 0);
+  }
+
+  // the floats of wrapper this tensor spans, for THClLaunch::range
+  inline long firstFloat() const {
+    return offset * THClStorage_elementSize(dataType) / (long)sizeof(float);
+  }
+  inline long numFloats() const {
+    long last = 0;
+    for(int i = 0; i < dims; i++) {
+      if(sizes[i] == 0) {
+        return 0;
+      }
+      last += (long)(sizes[i] - 1) * strides[i];
+    }
+    int elementSize = THClStorage_elementSize(dataType);
+    long bytes = (last + 1) * elementSize + (offset * elementSize) % (long)sizeof(float);
+    return (bytes + sizeof(float) - 1) / sizeof(float);
+  }
+
   CLWrapper *wrapper;
   long offset;
+  int dataType; // THCL_FLOAT, THCL_HALF or THCL_BYTE
 //  float* data;
   IndexType sizes[MAX_CLTORCH_DIMS];
   IndexType strides[MAX_CLTORCH_DIMS];
@@ -97,13 +126,16 @@ template <typename IndexType>
 TensorInfo<IndexType>::TensorInfo(THClState* state,
                                   THClTensor* t,
                                   int reduceDim)
-    : wrapper(NULL), offset(0), dims(0) {
+    : wrapper(NULL), offset(0), dataType(THCL_FLOAT), dims(0) {
   int origDims = THClTensor_nDimension(state, t);
   assert(origDims <= MAX_CLTORCH_DIMS);
   assert(reduceDim < origDims);
 
   offset = THClTensor_storageOffset(state, t);
   wrapper = THClTensor_wrapper(state, t);
+  if(t->storage) {
+    dataType = t->storage->dataType;
+  }
 
   // Count the number of successive dimensions that can be collapsed, from
   // innermost to outermost.
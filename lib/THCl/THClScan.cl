@@ -0,0 +1,160 @@
+// Scan (prefix sum) kernels
+
+// expected templated values:
+// scan_operation: folds two values, eg "*out = *in1 + *in2"
+// MAX_CLTORCH_DIMS
+// InType: OpenCL type of the input to THClScan_tiles, uchar, float or int
+// flags: 1 if THClScan_tiles counts the nonzero elements of its input,
+//   rather than summing them
+//
+// the int buffers travel in float wrappers on the host side, so they're
+// just reinterpreted as int here
+
+// kernel argument that defines tensor layout
+typedef struct TensorInfoCl {
+  int sizes[{{MAX_CLTORCH_DIMS}}];
+  int strides[{{MAX_CLTORCH_DIMS}}];
+  int offset;
+  int dims;
+} TensorInfoCl;
+
+// where line linearId starts; the lines are the tensor with the scan
+// dimension's size taken as 1
+int IndexToOffset_999_get(int linearId, global const TensorInfoCl *info) {
+  int offset = info->offset;
+  for (int i = info->dims - 1; i >= 0; --i) {
+    int curDimIndex = linearId % info->sizes[i];
+    offset += curDimIndex * info->strides[i];
+    linearId /= info->sizes[i];
+  }
+  return offset;
+}
+
+float scanOp(float _in1, float _in2) {
+  float _out;
+  float *in1 = &_in1;
+  float *in2 = &_in2;
+  float *out = &_out;
+  {{scan_operation}};
+  return _out;
+}
+
+// A thread per line, each scanning its n elements in turn; neighbouring
+// threads take neighbouring lines, so for a scan over an outer dimension
+// their loads coalesce
+kernel void THClScan_lineThreads(global const TensorInfoCl *outInfo, global float *outData, int outStride,
+    global const TensorInfoCl *inInfo, global const float *inData, int inStride,
+    int n, int numLines, float init) {
+  const int line = get_global_id(0);
+  if(line >= numLines) {
+    return;
+  }
+  const int outBase = IndexToOffset_999_get(line, outInfo);
+  const int inBase = IndexToOffset_999_get(line, inInfo);
+  float value = init;
+  for(int i = 0; i < n; i++) {
+    value = scanOp(value, inData[inBase + i * inStride]);
+    outData[outBase + i * outStride] = value;
+  }
+}
+
+// A work group per line: tiles of twice the group size go through a
+// work-efficient (Blelloch) scan in local memory, and a carry takes each
+// tile's total on to the next.  The group size has to be a power of two
+kernel void THClScan_lineGroups(global const TensorInfoCl *outInfo, global float *outData, int outStride,
+    global const TensorInfoCl *inInfo, global const float *inData, int inStride,
+    int n, int numLines, float init, local float *tile) {
+  const int tid = get_local_id(0);
+  const int size = get_local_size(0);
+  const int tileSize = 2 * size;
+  for(int line = get_group_id(0); line < numLines; line += get_num_groups(0)) {
+    const int outBase = IndexToOffset_999_get(line, outInfo);
+    const int inBase = IndexToOffset_999_get(line, inInfo);
+    float carry = init;
+    for(int start = 0; start < n; start += tileSize) {
+      const int a = start + tid;
+      const int b = start + tid + size;
+      const float valueA = a < n ? inData[inBase + a * inStride] : init;
+      const float valueB = b < n ? inData[inBase + b * inStride] : init;
+      tile[tid] = valueA;
+      tile[tid + size] = valueB;
+
+      // up-sweep: each node ends up holding the fold of its subtree
+      for(int d = 1; d < tileSize; d <<= 1) {
+        barrier(CLK_LOCAL_MEM_FENCE);
+        const int i = (tid + 1) * 2 * d - 1;
+        if(i < tileSize) {
+          tile[i] = scanOp(tile[i - d], tile[i]);
+        }
+      }
+      barrier(CLK_LOCAL_MEM_FENCE);
+      const float total = tile[tileSize - 1];
+      barrier(CLK_LOCAL_MEM_FENCE);
+      if(tid == 0) {
+        tile[tileSize - 1] = init;
+      }
+      // down-sweep: each node gets the fold of everything before it
+      for(int d = size; d >= 1; d >>= 1) {
+        barrier(CLK_LOCAL_MEM_FENCE);
+        const int i = (tid + 1) * 2 * d - 1;
+        if(i < tileSize) {
+          const float left = tile[i - d];
+          tile[i - d] = tile[i];
+          tile[i] = scanOp(tile[i], left);
+        }
+      }
+      barrier(CLK_LOCAL_MEM_FENCE);
+      if(a < n) {
+        outData[outBase + a * outStride] = scanOp(carry, scanOp(tile[tid], valueA));
+      }
+      if(b < n) {
+        outData[outBase + b * outStride] = scanOp(carry, scanOp(tile[tid + size], valueB));
+      }
+      carry = scanOp(carry, total);
+      barrier(CLK_LOCAL_MEM_FENCE);
+    }
+  }
+}
+
+// Exclusive prefix sum of each work group's tile of in, into out, which can
+// be in.  The sum of the whole tile goes to tileSums[group]
+kernel void THClScan_tiles(int n, global const {{InType}} *in, int inOffset,
+    global int *out, global int *tileSums, local float *scratchSpace) {
+  local int *scratch = (local int *)scratchSpace;
+  const int tid = get_local_id(0);
+  const int size = get_local_size(0);
+  const int linearIndex = get_global_id(0);
+  int value = 0;
+  if(linearIndex < n) {
+    {% if flags == 1 then %}
+    value = in[inOffset + linearIndex] != 0 ? 1 : 0;
+    {% else %}
+    value = (int)in[inOffset + linearIndex];
+    {% end %}
+  }
+  scratch[tid] = value;
+  barrier(CLK_LOCAL_MEM_FENCE);
+  // Hillis-Steele: after the pass for offset, scratch[tid] sums the
+  // 2 * offset values up to tid
+  for(int offset = 1; offset < size; offset <<= 1) {
+    int other = tid >= offset ? scratch[tid - offset] : 0;
+    barrier(CLK_LOCAL_MEM_FENCE);
+    scratch[tid] += other;
+    barrier(CLK_LOCAL_MEM_FENCE);
+  }
+  if(linearIndex < n) {
+    out[linearIndex] = scratch[tid] - value;
+  }
+  if(tid == size - 1) {
+    tileSums[get_group_id(0)] = scratch[tid];
+  }
+}
+
+// Adds the scanned tile sums onto each tile of a scan
+kernel void THClScan_addTileOffsets(int n, global int *positions, global const int *tileOffsets) {
+  const int linearIndex = get_global_id(0);
+  if(linearIndex < n) {
+    positions[linearIndex] += tileOffsets[get_group_id(0)];
+  }
+}
+
@@ -0,0 +1,330 @@
+#include <string>
+#include "THClScan.h"
+#include "THClTensorCopy.h"
+#include "THClApply.h"
+#include "THClGraph.h"
+#include "THClProfiler.h"
+#include "THClPrecompile.h"
+#include "EasyCL.h"
+#include "templates/TemplatedKernel.h"
+
+using namespace std;
+
+#ifndef DIVUP
+#define DIVUP(x, y) (((x) + (y) - 1) / (y))
+#endif
+
+// lines shorter than this get a thread each, rather than a work group
+#define THCL_SCAN_GROUP_MIN_LENGTH 256
+// fewer lines than this always get a work group each, whatever their layout
+#define THCL_SCAN_GROUP_MAX_LINES 1024
+
+static CLKernel *THClScan_getKernel(THClState *state, string scanOperation, const char *inType, int flags,
+    const char *kernelName)
+{
+  TemplatedKernel kernelBuilder(state->cl);
+  kernelBuilder.set("scan_operation", scanOperation);
+  kernelBuilder.set("MAX_CLTORCH_DIMS", MAX_CLTORCH_DIMS);
+  kernelBuilder.set("InType", inType);
+  kernelBuilder.set("flags", flags);
+  string uniqueName = string(kernelName) + "_" + inType + "_" + easycl::toString(flags) + "_" + scanOperation;
+  return THClKernel_build(state, kernelBuilder, uniqueName, "THClScan.cl", getScan_template(), kernelName);
+}
+
+// the largest power of two up to max that the device takes as a work group
+static int THClScan_groupSize(THClState *state, int max)
+{
+  int maxWorkgroupSize = (int)state->cl->getMaxWorkgroupSize();
+  int groupSize = max;
+  while(groupSize > maxWorkgroupSize) {
+    groupSize >>= 1;
+  }
+  return groupSize;
+}
+
+// the kernels work in float, so other types go through float temporaries
+static bool THClScan_narrowDim(THClState *state, THClTensor *self, THClTensor *src, long dim,
+    const HasOperator3 &scanOp, float init)
+{
+  THClTensor *srcf = THClTensor_new(state);
+  THClTensor_resizeAs(state, srcf, src);
+  THClTensor_copy(state, srcf, src);
+  bool ok = THClTensor_scanDim(state, srcf, srcf, dim, scanOp, init);
+  if(ok) {
+    THClTensor_copy(state, self, srcf);
+  }
+  THClTensor_free(state, srcf);
+  return ok;
+}
+
+bool THClTensor_scanDim(THClState *state, THClTensor *self, THClTensor *src, long dim,
+    const HasOperator3 &scanOp, float init)
+{
+  THArgCheck(dim >= 0 && dim < THClTensor_nDimension(state, src), 4, "dimension out of range");
+  if(self != src) {
+    THClTensor_resizeAs(state, self, src);
+  }
+  long totalElements = THClTensor_nElement(state, src);
+  if(totalElements == 0) {
+    return true;
+  }
+  if(THClTensor_nDimension(state, src) > MAX_CLTORCH_DIMS
+      || !THCL_canUse32BitIndexMath(state, src) || !THCL_canUse32BitIndexMath(state, self)) {
+    return false;
+  }
+  if(self->storage->dataType != THCL_FLOAT || src->storage->dataType != THCL_FLOAT) {
+    return THClScan_narrowDim(state, self, src, dim, scanOp, init);
+  }
+
+  long n = THClTensor_size(state, src, dim);
+  long numLines = totalElements / n;
+  int outStride = (int)THClTensor_stride(state, self, dim);
+  int inStride = (int)THClTensor_stride(state, src, dim);
+  TensorInfo<unsigned int> outInfo(state, self, dim);
+  TensorInfo<unsigned int> inInfo(state, src, dim);
+  TensorInfoCl outCl(outInfo);
+  TensorInfoCl inCl(inInfo);
+
+  // a work group per line for long lines, when there are few of them, or
+  // when the group's loads along each one coalesce; otherwise a thread per
+  // line, where a thread's neighbours take the next lines over
+  bool perGroup = n >= THCL_SCAN_GROUP_MIN_LENGTH
+    && (numLines < THCL_SCAN_GROUP_MAX_LINES || (inStride == 1 && outStride == 1));
+  const char *kernelName = perGroup ? "THClScan_lineGroups" : "THClScan_lineThreads";
+  CLKernel *kernel = THClScan_getKernel(state, scanOp.operator3(), "float", 0, kernelName);
+  if(kernel == 0) { // compile-only
+    return true;
+  }
+  THClLaunch launch(state, kernel, kernelName);
+  launch.in(1, &outCl);
+  launch.inout(outInfo.wrapper);
+  launch.in(outStride);
+  launch.in(1, &inCl);
+  launch.in(inInfo.wrapper);
+  launch.in(inStride);
+  launch.in((int)n);
+  launch.in((int)numLines);
+  launch.in(init);
+
+  cl_event profileBegin = THClProfiler_begin(state);
+  if(perGroup) {
+    int groupSize = THClScan_groupSize(state, 128);
+    launch.localFloats(2 * groupSize);
+    // the groups go round the lines until they're done
+    long numGroups = numLines < 65536 ? numLines : 65536;
+    launch.run_1d(numGroups * groupSize, groupSize);
+  } else {
+    int groupSize = THClScan_groupSize(state, 256);
+    launch.run_1d(DIVUP(numLines, (long)groupSize) * groupSize, groupSize);
+  }
+  THClProfiler_end(state, profileBegin, kernelName, THClProfiler_shapeClass(inInfo.dims, totalElements),
+    totalElements * sizeof(float));
+  return true;
+}
+
+void THClScan_exclusiveSum(THClState *state, CLWrapper *in, int inOffset, const char *inType, int flags,
+    CLWrapper *out, long n, CLWrapper *total)
+{
+  // any size does for the Hillis-Steele scan within a tile
+  int tileSize = THClScan_groupSize(state, 256);
+  long numTiles = DIVUP(n, (long)tileSize);
+  THClStorage *tileSums = numTiles > 1 ? THClStorage_newWithSize(state, numTiles) : 0;
+  CLWrapper *sums = tileSums != 0 ? tileSums->wrapper : total;
+
+  CLKernel *kernel = THClScan_getKernel(state, "*out = *in1 + *in2", inType, flags, "THClScan_tiles");
+  if(kernel != 0) { // 0 in compile-only mode
+    THClLaunch launch(state, kernel, "THClScan_tiles");
+    launch.in((int)n);
+    launch.in(in);
+    launch.in(inOffset);
+    launch.out(out);
+    launch.out(sums);
+    launch.localFloats(tileSize);
+    launch.run_1d(numTiles * tileSize, tileSize);
+  }
+  if(tileSums != 0) {
+    // the tiles' totals are scanned the same way, and added back on
+    THClScan_exclusiveSum(state, tileSums->wrapper, 0, "int", 0, tileSums->wrapper, numTiles, total);
+    kernel = THClScan_getKernel(state, "*out = *in1 + *in2", "int", 0, "THClScan_addTileOffsets");
+    if(kernel != 0) {
+      THClLaunch launch(state, kernel, "THClScan_addTileOffsets");
+      launch.in((int)n);
+      launch.inout(out);
+      launch.in(tileSums->wrapper);
+      launch.run_1d(numTiles * tileSize, tileSize);
+    }
+    THClStorage_free(state, tileSums);
+  }
+}
+
+std::string getScan_template() {
+    // [[[cog
+    // import stringify
+    // stringify.write_kernel( "kernel", "THClScan.cl" )
+    // ]]]
+    // generated using cog, from THClScan.cl:
+    const char * kernelSource =  
+    "// Scan (prefix sum) kernels\n" 
+    "\n" 
+    "// expected templated values:\n" 
+    "// scan_operation: folds two values, eg \"*out = *in1 + *in2\"\n" 
+    "// MAX_CLTORCH_DIMS\n" 
+    "// InType: OpenCL type of the input to THClScan_tiles, uchar, float or int\n" 
+    "// flags: 1 if THClScan_tiles counts the nonzero elements of its input,\n" 
+    "//   rather than summing them\n" 
+    "//\n" 
+    "// the int buffers travel in float wrappers on the host side, so they're\n" 
+    "// just reinterpreted as int here\n" 
+    "\n" 
+    "// kernel argument that defines tensor layout\n" 
+    "typedef struct TensorInfoCl {\n" 
+    "  int sizes[{{MAX_CLTORCH_DIMS}}];\n" 
+    "  int strides[{{MAX_CLTORCH_DIMS}}];\n" 
+    "  int offset;\n" 
+    "  int dims;\n" 
+    "} TensorInfoCl;\n" 
+    "\n" 
+    "// where line linearId starts; the lines are the tensor with the scan\n" 
+    "// dimension's size taken as 1\n" 
+    "int IndexToOffset_999_get(int linearId, global const TensorInfoCl *info) {\n" 
+    "  int offset = info->offset;\n" 
+    "  for (int i = info->dims - 1; i >= 0; --i) {\n" 
+    "    int curDimIndex = linearId % info->sizes[i];\n" 
+    "    offset += curDimIndex * info->strides[i];\n" 
+    "    linearId /= info->sizes[i];\n" 
+    "  }\n" 
+    "  return offset;\n" 
+    "}\n" 
+    "\n" 
+    "float scanOp(float _in1, float _in2) {\n" 
+    "  float _out;\n" 
+    "  float *in1 = &_in1;\n" 
+    "  float *in2 = &_in2;\n" 
+    "  float *out = &_out;\n" 
+    "  {{scan_operation}};\n" 
+    "  return _out;\n" 
+    "}\n" 
+    "\n" 
+    "// A thread per line, each scanning its n elements in turn; neighbouring\n" 
+    "// threads take neighbouring lines, so for a scan over an outer dimension\n" 
+    "// their loads coalesce\n" 
+    "kernel void THClScan_lineThreads(global const TensorInfoCl *outInfo, global float *outData, int outStride,\n" 
+    "    global const TensorInfoCl *inInfo, global const float *inData, int inStride,\n" 
+    "    int n, int numLines, float init) {\n" 
+    "  const int line = get_global_id(0);\n" 
+    "  if(line >= numLines) {\n" 
+    "    return;\n" 
+    "  }\n" 
+    "  const int outBase = IndexToOffset_999_get(line, outInfo);\n" 
+    "  const int inBase = IndexToOffset_999_get(line, inInfo);\n" 
+    "  float value = init;\n" 
+    "  for(int i = 0; i < n; i++) {\n" 
+    "    value = scanOp(value, inData[inBase + i * inStride]);\n" 
+    "    outData[outBase + i * outStride] = value;\n" 
+    "  }\n" 
+    "}\n" 
+    "\n" 
+    "// A work group per line: tiles of twice the group size go through a\n" 
+    "// work-efficient (Blelloch) scan in local memory, and a carry takes each\n" 
+    "// tile's total on to the next.  The group size has to be a power of two\n" 
+    "kernel void THClScan_lineGroups(global const TensorInfoCl *outInfo, global float *outData, int outStride,\n" 
+    "    global const TensorInfoCl *inInfo, global const float *inData, int inStride,\n" 
+    "    int n, int numLines, float init, local float *tile) {\n" 
+    "  const int tid = get_local_id(0);\n" 
+    "  const int size = get_local_size(0);\n" 
+    "  const int tileSize = 2 * size;\n" 
+    "  for(int line = get_group_id(0); line < numLines; line += get_num_groups(0)) {\n" 
+    "    const int outBase = IndexToOffset_999_get(line, outInfo);\n" 
+    "    const int inBase = IndexToOffset_999_get(line, inInfo);\n" 
+    "    float carry = init;\n" 
+    "    for(int start = 0; start < n; start += tileSize) {\n" 
+    "      const int a = start + tid;\n" 
+    "      const int b = start + tid + size;\n" 
+    "      const float valueA = a < n ? inData[inBase + a * inStride] : init;\n" 
+    "      const float valueB = b < n ? inData[inBase + b * inStride] : init;\n" 
+    "      tile[tid] = valueA;\n" 
+    "      tile[tid + size] = valueB;\n" 
+    "\n" 
+    "      // up-sweep: each node ends up holding the fold of its subtree\n" 
+    "      for(int d = 1; d < tileSize; d <<= 1) {\n" 
+    "        barrier(CLK_LOCAL_MEM_FENCE);\n" 
+    "        const int i = (tid + 1) * 2 * d - 1;\n" 
+    "        if(i < tileSize) {\n" 
+    "          tile[i] = scanOp(tile[i - d], tile[i]);\n" 
+    "        }\n" 
+    "      }\n" 
+    "      barrier(CLK_LOCAL_MEM_FENCE);\n" 
+    "      const float total = tile[tileSize - 1];\n" 
+    "      barrier(CLK_LOCAL_MEM_FENCE);\n" 
+    "      if(tid == 0) {\n" 
+    "        tile[tileSize - 1] = init;\n" 
+    "      }\n" 
+    "      // down-sweep: each node gets the fold of everything before it\n" 
+    "      for(int d = size; d >= 1; d >>= 1) {\n" 
+    "        barrier(CLK_LOCAL_MEM_FENCE);\n" 
+    "        const int i = (tid + 1) * 2 * d - 1;\n" 
+    "        if(i < tileSize) {\n" 
+    "          const float left = tile[i - d];\n" 
+    "          tile[i - d] = tile[i];\n" 
+    "          tile[i] = scanOp(tile[i], left);\n" 
+    "        }\n" 
+    "      }\n" 
+    "      barrier(CLK_LOCAL_MEM_FENCE);\n" 
+    "      if(a < n) {\n" 
+    "        outData[outBase + a * outStride] = scanOp(carry, scanOp(tile[tid], valueA));\n" 
+    "      }\n" 
+    "      if(b < n) {\n" 
+    "        outData[outBase + b * outStride] = scanOp(carry, scanOp(tile[tid + size], valueB));\n" 
+    "      }\n" 
+    "      carry = scanOp(carry, total);\n" 
+    "      barrier(CLK_LOCAL_MEM_FENCE);\n" 
+    "    }\n" 
+    "  }\n" 
+    "}\n" 
+    "\n" 
+    "// Exclusive prefix sum of each work group's tile of in, into out, which can\n" 
+    "// be in.  The sum of the whole tile goes to tileSums[group]\n" 
+    "kernel void THClScan_tiles(int n, global const {{InType}} *in, int inOffset,\n" 
+    "    global int *out, global int *tileSums, local float *scratchSpace) {\n" 
+    "  local int *scratch = (local int *)scratchSpace;\n" 
+    "  const int tid = get_local_id(0);\n" 
+    "  const int size = get_local_size(0);\n" 
+    "  const int linearIndex = get_global_id(0);\n" 
+    "  int value = 0;\n" 
+    "  if(linearIndex < n) {\n" 
+    "    {% if flags == 1 then %}\n" 
+    "    value = in[inOffset + linearIndex] != 0 ? 1 : 0;\n" 
+    "    {% else %}\n" 
+    "    value = (int)in[inOffset + linearIndex];\n" 
+    "    {% end %}\n" 
+    "  }\n" 
+    "  scratch[tid] = value;\n" 
+    "  barrier(CLK_LOCAL_MEM_FENCE);\n" 
+    "  // Hillis-Steele: after the pass for offset, scratch[tid] sums the\n" 
+    "  // 2 * offset values up to tid\n" 
+    "  for(int offset = 1; offset < size; offset <<= 1) {\n" 
+    "    int other = tid >= offset ? scratch[tid - offset] : 0;\n" 
+    "    barrier(CLK_LOCAL_MEM_FENCE);\n" 
+    "    scratch[tid] += other;\n" 
+    "    barrier(CLK_LOCAL_MEM_FENCE);\n" 
+    "  }\n" 
+    "  if(linearIndex < n) {\n" 
+    "    out[linearIndex] = scratch[tid] - value;\n" 
+    "  }\n" 
+    "  if(tid == size - 1) {\n" 
+    "    tileSums[get_group_id(0)] = scratch[tid];\n" 
+    "  }\n" 
+    "}\n" 
+    "\n" 
+    "// Adds the scanned tile sums onto each tile of a scan\n" 
+    "kernel void THClScan_addTileOffsets(int n, global int *positions, global const int *tileOffsets) {\n" 
+    "  const int linearIndex = get_global_id(0);\n" 
+    "  if(linearIndex < n) {\n" 
+    "    positions[linearIndex] += tileOffsets[get_group_id(0)];\n" 
+    "  }\n" 
+    "}\n" 
+    "\n" 
+    "";
+    // [[[end]]]
+    return kernelSource;
+}
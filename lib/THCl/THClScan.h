@@ -0,0 +1,37 @@
+#ifndef THCL_SCAN_INC
+#define THCL_SCAN_INC
+
+//
+// Scans (prefix sums) on the device, for cumsum / cumprod, and for
+// compaction: an exclusive sum of a mask's flags gives each set element's
+// place in the compacted output.
+//
+
+#include "THClGeneral.h"
+#include "THClTensor.h"
+
+#ifdef __cplusplus
+#include "THClReduceApplyUtils.h"
+
+class CLWrapper;
+
+std::string getScan_template();
+
+// Inclusive scan of src along dim into self, which is resized to src:
+// element i of each line folds elements 0..i with scanOp's operator3, eg
+// "*out = *in1 * *in2", whose identity is init.  Either tensor can have any
+// strides, and they can be the same tensor.  Returns false if they have
+// too many dimensions for the kernels
+bool THClTensor_scanDim(THClState *state, THClTensor *self, THClTensor *src, long dim,
+  const HasOperator3 &scanOp, float init);
+
+// Exclusive prefix sum of the n elements of in from inOffset, read as
+// inType ("uchar", "float" or "int"), into the ints of out, which can be in;
+// with flags, in's nonzero elements are counted instead.  The sum of all n
+// goes to total[0].  out and total are ints in float wrappers, eg from
+// THClStorage_newWithSize
+void THClScan_exclusiveSum(THClState *state, CLWrapper *in, int inOffset, const char *inType, int flags,
+  CLWrapper *out, long n, CLWrapper *total);
+#endif // __cplusplus
+
+#endif
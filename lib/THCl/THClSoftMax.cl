@@ -0,0 +1,154 @@
+// Softmax kernels, over rows: n contiguous floats each, from an offset
+//
+// expected templated values:
+// log_softmax: 1 for logSoftmax, 0 for softmax
+//
+// The work group size has to be a power of two
+
+// value folded over the work group, by max if isMax, otherwise by sum; every
+// thread gets the result
+float groupReduce(float value, local float *smem, int isMax) {
+  const int tid = get_local_id(0);
+  smem[tid] = value;
+  for (int s = get_local_size(0) >> 1; s > 0; s >>= 1) {
+    barrier(CLK_LOCAL_MEM_FENCE);
+    if (tid < s) {
+      smem[tid] = isMax ? fmax(smem[tid], smem[tid + s]) : smem[tid] + smem[tid + s];
+    }
+  }
+  barrier(CLK_LOCAL_MEM_FENCE);
+  const float result = smem[0];
+  barrier(CLK_LOCAL_MEM_FENCE);
+  return result;
+}
+
+// Online softmax: (max, sum) is a running max of some values, and the sum of
+// their exps relative to it.  This merges (max2, sum2) into it, rescaling
+// whichever sum has the smaller max
+void onlineMerge(float max2, float sum2, float *max, float *sum) {
+  if (max2 == -INFINITY) {
+    return;
+  }
+  if (*max == -INFINITY) {
+    *max = max2;
+    *sum = sum2;
+    return;
+  }
+  const float newMax = fmax(*max, max2);
+  *sum = *sum * exp(*max - newMax) + sum2 * exp(max2 - newMax);
+  *max = newMax;
+}
+
+// A work group per row, for rows that fit in local memory: the row is read
+// from global memory once, and the max, the sum and the output come from
+// the copy in local memory
+kernel void THClSoftMax_forwardLocal(int n, int numRows, global const float *in, int inOffset,
+    global float *out, int outOffset, local float *row, local float *smem) {
+  const int tid = get_local_id(0);
+  const int size = get_local_size(0);
+  for (int r = get_group_id(0); r < numRows; r += get_num_groups(0)) {
+    global const float *inRow = in + inOffset + r * n;
+    global float *outRow = out + outOffset + r * n;
+    // each thread only touches its own elements of row, so it needs no
+    // barriers of its own
+    float max = -INFINITY;
+    for (int i = tid; i < n; i += size) {
+      const float value = inRow[i];
+      row[i] = value;
+      max = fmax(max, value);
+    }
+    max = groupReduce(max, smem, 1);
+    float sum = 0;
+    for (int i = tid; i < n; i += size) {
+      sum += exp(row[i] - max);
+    }
+    sum = groupReduce(sum, smem, 0);
+    {% if log_softmax == 1 then %}
+    const float logSum = max + log(sum);
+    for (int i = tid; i < n; i += size) {
+      outRow[i] = row[i] - logSum;
+    }
+    {% else %}
+    const float scale = 1.0f / sum;
+    for (int i = tid; i < n; i += size) {
+      outRow[i] = exp(row[i] - max) * scale;
+    }
+    {% end %}
+  }
+}
+
+// A work group per row, for longer rows: the first pass finds the max and
+// the sum together, by online softmax, and the second writes the output
+kernel void THClSoftMax_forwardOnline(int n, int numRows, global const float *in, int inOffset,
+    global float *out, int outOffset, local float *smemMax, local float *smemSum) {
+  const int tid = get_local_id(0);
+  const int size = get_local_size(0);
+  for (int r = get_group_id(0); r < numRows; r += get_num_groups(0)) {
+    global const float *inRow = in + inOffset + r * n;
+    global float *outRow = out + outOffset + r * n;
+    float max = -INFINITY;
+    float sum = 0;
+    for (int i = tid; i < n; i += size) {
+      onlineMerge(inRow[i], 1.0f, &max, &sum);
+    }
+    smemMax[tid] = max;
+    smemSum[tid] = sum;
+    for (int s = size >> 1; s > 0; s >>= 1) {
+      barrier(CLK_LOCAL_MEM_FENCE);
+      if (tid < s) {
+        float mergedMax = smemMax[tid];
+        float mergedSum = smemSum[tid];
+        onlineMerge(smemMax[tid + s], smemSum[tid + s], &mergedMax, &mergedSum);
+        smemMax[tid] = mergedMax;
+        smemSum[tid] = mergedSum;
+      }
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+    max = smemMax[0];
+    sum = smemSum[0];
+    barrier(CLK_LOCAL_MEM_FENCE);
+    {% if log_softmax == 1 then %}
+    const float logSum = max + log(sum);
+    for (int i = tid; i < n; i += size) {
+      outRow[i] = inRow[i] - logSum;
+    }
+    {% else %}
+    const float scale = 1.0f / sum;
+    for (int i = tid; i < n; i += size) {
+      outRow[i] = exp(inRow[i] - max) * scale;
+    }
+    {% end %}
+  }
+}
+
+// A work group per row: gradInput from gradOutput and the forward output.
+// For softmax, gradInput = output * (gradOutput - sum(gradOutput * output));
+// for logSoftmax, gradInput = gradOutput - exp(output) * sum(gradOutput)
+kernel void THClSoftMax_backward(int n, int numRows, global const float *gradOutput, int gradOutputOffset,
+    global const float *output, int outputOffset, global float *gradInput, int gradInputOffset,
+    local float *smem) {
+  const int tid = get_local_id(0);
+  const int size = get_local_size(0);
+  for (int r = get_group_id(0); r < numRows; r += get_num_groups(0)) {
+    global const float *gradOutputRow = gradOutput + gradOutputOffset + r * n;
+    global const float *outputRow = output + outputOffset + r * n;
+    global float *gradInputRow = gradInput + gradInputOffset + r * n;
+    float sum = 0;
+    for (int i = tid; i < n; i += size) {
+      {% if log_softmax == 1 then %}
+      sum += gradOutputRow[i];
+      {% else %}
+      sum += gradOutputRow[i] * outputRow[i];
+      {% end %}
+    }
+    sum = groupReduce(sum, smem, 0);
+    for (int i = tid; i < n; i += size) {
+      {% if log_softmax == 1 then %}
+      gradInputRow[i] = gradOutputRow[i] - exp(outputRow[i]) * sum;
+      {% else %}
+      gradInputRow[i] = outputRow[i] * (gradOutputRow[i] - sum);
+      {% end %}
+    }
+  }
+}
+
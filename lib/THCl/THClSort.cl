@@ -0,0 +1,283 @@
+// Sort, topk and kthvalue kernels
+//
+// Each kernel works on rows: n contiguous floats each, from an offset,
+// which the host side gets by moving the dimension being sorted to the end.
+// Indices are floats, counting from 1, like those of max and min
+//
+// positions comes from THClScan_exclusiveSum; it travels in a float wrapper
+// on the host side, so it's just reinterpreted as int here
+
+// Keys as uints that order the same way as the floats, or the other way
+// round if descending.  -0 goes before +0, and NaNs after +inf
+uint sortKey(float value, int descending) {
+  uint key = as_uint(value);
+  key = (key & 0x80000000u) ? ~key : (key | 0x80000000u);
+  return descending ? ~key : key;
+}
+
+float keyValue(uint key, int descending) {
+  key = descending ? ~key : key;
+  key = (key & 0x80000000u) ? (key & 0x7fffffffu) : ~key;
+  return as_float(key);
+}
+
+// whether (key1, payload1) goes after (key2, payload2): by key, then by
+// payload, so rows with their indices as payload sort stably.  The padding
+// has a negative payload, and goes after everything else
+bool sortAfter(uint key1, float payload1, uint key2, float payload2) {
+  if((payload1 < 0) != (payload2 < 0)) {
+    return payload1 < 0;
+  }
+  if(key1 != key2) {
+    return key1 > key2;
+  }
+  return payload1 > payload2;
+}
+
+// exclusive sum of value over the work group; the group's total goes to
+// *total.  Every thread of the group has to call it
+int groupExclusiveSum(int value, local int *scratch, int *total) {
+  const int tid = get_local_id(0);
+  const int size = get_local_size(0);
+  scratch[tid] = value;
+  barrier(CLK_LOCAL_MEM_FENCE);
+  for(int offset = 1; offset < size; offset <<= 1) {
+    int other = tid >= offset ? scratch[tid - offset] : 0;
+    barrier(CLK_LOCAL_MEM_FENCE);
+    scratch[tid] += other;
+    barrier(CLK_LOCAL_MEM_FENCE);
+  }
+  const int inclusive = scratch[tid];
+  *total = scratch[size - 1];
+  barrier(CLK_LOCAL_MEM_FENCE);
+  return inclusive - value;
+}
+
+// A work group per row, sorting it in local memory with a bitonic network,
+// padded out to sortSize, a power of two.  The payload goes along with the
+// keys; with initPayload, it starts as the indices
+kernel void THClSort_bitonic(int n, int numRows, int sortSize, int descending, int initPayload,
+    global float *keys, int keysOffset, global float *payload, int payloadOffset,
+    local float *keySpace, local float *payloadSpace) {
+  local uint *localKeys = (local uint *)keySpace;
+  const int tid = get_local_id(0);
+  const int size = get_local_size(0);
+  for(int row = get_group_id(0); row < numRows; row += get_num_groups(0)) {
+    global float *rowKeys = keys + keysOffset + row * n;
+    global float *rowPayload = payload + payloadOffset + row * n;
+    for(int i = tid; i < sortSize; i += size) {
+      if(i < n) {
+        localKeys[i] = sortKey(rowKeys[i], descending);
+        payloadSpace[i] = initPayload ? (float)(i + 1) : rowPayload[i];
+      } else {
+        localKeys[i] = 0xffffffffu;
+        payloadSpace[i] = -1.0f;
+      }
+    }
+    // blocks of blockSize go alternately up and down, then each merges with
+    // its neighbour into a block of twice the size
+    for(int blockSize = 2; blockSize <= sortSize; blockSize <<= 1) {
+      for(int stride = blockSize >> 1; stride > 0; stride >>= 1) {
+        barrier(CLK_LOCAL_MEM_FENCE);
+        for(int t = tid; t < (sortSize >> 1); t += size) {
+          const int lower = 2 * t - (t & (stride - 1));
+          const int upper = lower + stride;
+          const bool up = (lower & blockSize) == 0;
+          const bool after = sortAfter(localKeys[lower], payloadSpace[lower],
+            localKeys[upper], payloadSpace[upper]);
+          if(after == up) {
+            const uint key = localKeys[lower];
+            const float value = payloadSpace[lower];
+            localKeys[lower] = localKeys[upper];
+            payloadSpace[lower] = payloadSpace[upper];
+            localKeys[upper] = key;
+            payloadSpace[upper] = value;
+          }
+        }
+      }
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+    for(int i = tid; i < n; i += size) {
+      rowKeys[i] = keyValue(localKeys[i], descending);
+      rowPayload[i] = payloadSpace[i];
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+  }
+}
+
+// Radix sort, for rows too long to sort in local memory: each pass takes
+// four bits of the keys, from the least significant.  A work group per
+// tile of a row counts its digits, into counts laid out by row, then digit,
+// then tile, so that an exclusive sum over all of it gives where each
+// tile's elements of each digit go
+kernel void THClSort_radixCount(int n, int numRows, int tilesPerRow, int shift, int descending,
+    global const float *keys, int keysOffset, global float *countSpace) {
+  global int *counts = (global int *)countSpace;
+  local int hist[16];
+  const int tid = get_local_id(0);
+  const int row = get_group_id(0) / tilesPerRow;
+  const int tile = get_group_id(0) % tilesPerRow;
+  const int i = tile * get_local_size(0) + tid;
+  if(tid < 16) {
+    hist[tid] = 0;
+  }
+  barrier(CLK_LOCAL_MEM_FENCE);
+  if(row < numRows && i < n) {
+    const uint key = sortKey(keys[keysOffset + row * n + i], descending);
+    atomic_inc(&hist[(key >> shift) & 15]);
+  }
+  barrier(CLK_LOCAL_MEM_FENCE);
+  if(row < numRows && tid < 16) {
+    counts[(row * 16 + tid) * tilesPerRow + tile] = hist[tid];
+  }
+}
+
+// Moves each element of the tile to where positions says its digit starts,
+// after those of the same digit earlier in the tile, so each pass is stable
+kernel void THClSort_radixScatter(int n, int numRows, int tilesPerRow, int shift, int descending, int initPayload,
+    global const float *keysIn, int keysInOffset, global const float *payloadIn, int payloadInOffset,
+    global float *keysOut, int keysOutOffset, global float *payloadOut, int payloadOutOffset,
+    global const int *positions, local float *digitSpace) {
+  local int *digits = (local int *)digitSpace;
+  const int tid = get_local_id(0);
+  const int row = get_group_id(0) / tilesPerRow;
+  const int tile = get_group_id(0) % tilesPerRow;
+  const int i = tile * get_local_size(0) + tid;
+  const bool inRow = row < numRows && i < n;
+  float key = 0;
+  float value = 0;
+  int digit = 16;
+  if(inRow) {
+    key = keysIn[keysInOffset + row * n + i];
+    value = initPayload ? (float)(i + 1) : payloadIn[payloadInOffset + row * n + i];
+    digit = (sortKey(key, descending) >> shift) & 15;
+  }
+  digits[tid] = digit;
+  barrier(CLK_LOCAL_MEM_FENCE);
+  if(inRow) {
+    int rank = 0;
+    for(int j = 0; j < tid; j++) {
+      rank += digits[j] == digit ? 1 : 0;
+    }
+    const int dest = positions[(row * 16 + digit) * tilesPerRow + tile] + rank;
+    keysOut[keysOutOffset + dest] = key;
+    payloadOut[payloadOutOffset + dest] = value;
+  }
+}
+
+// Finds the key of the k-th element (from 1) of row in sort order, by
+// radix select: each pass narrows it down by four more bits, from the most
+// significant, with a histogram of the keys that match so far.  How many
+// of the elements with that key come within the first k goes to *kLeft.
+// Every thread of the group has to call it
+void radixSelect(global const float *row, int n, int k, int descending,
+    local int *hist, local uint *sharedKey, local int *sharedLeft, uint *selected, int *kLeft) {
+  const int tid = get_local_id(0);
+  const int size = get_local_size(0);
+  uint desired = 0;
+  uint desiredMask = 0;
+  int left = k;
+  for(int shift = 28; shift >= 0; shift -= 4) {
+    if(tid < 16) {
+      hist[tid] = 0;
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+    for(int i = tid; i < n; i += size) {
+      const uint key = sortKey(row[i], descending);
+      if((key & desiredMask) == desired) {
+        atomic_inc(&hist[(key >> shift) & 15]);
+      }
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+    if(tid == 0) {
+      int digit = 0;
+      while(hist[digit] < left) {
+        left -= hist[digit];
+        digit++;
+      }
+      *sharedKey = desired | ((uint)digit << shift);
+      *sharedLeft = left;
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+    desired = *sharedKey;
+    left = *sharedLeft;
+    desiredMask |= 15u << shift;
+  }
+  *selected = desired;
+  *kLeft = left;
+}
+
+// A work group per row, writing the first k of it in sort order, though in
+// the order they're found in the row, to k contiguous values and indices
+kernel void THClSort_topk(int n, int numRows, int k, int descending,
+    global const float *in, int inOffset, global float *values, int valuesOffset,
+    global float *indices, int indicesOffset, local float *scratchSpace) {
+  local int *scratch = (local int *)scratchSpace;
+  local int hist[16];
+  local uint sharedKey;
+  local int sharedLeft;
+  const int tid = get_local_id(0);
+  const int size = get_local_size(0);
+  for(int r = get_group_id(0); r < numRows; r += get_num_groups(0)) {
+    global const float *row = in + inOffset + r * n;
+    uint selected;
+    int kLeft;
+    radixSelect(row, n, k, descending, hist, &sharedKey, &sharedLeft, &selected, &kLeft);
+    // everything before the selected key, and the first kLeft with it
+    int written = 0;
+    int equalSeen = 0;
+    for(int base = 0; base < n && written < k; base += size) {
+      const int i = base + tid;
+      float value = 0;
+      uint key = 0;
+      if(i < n) {
+        value = row[i];
+        key = sortKey(value, descending);
+      }
+      const int equal = i < n && key == selected ? 1 : 0;
+      int equalTotal;
+      const int equalRank = groupExclusiveSum(equal, scratch, &equalTotal);
+      const int take = i < n && (key < selected || (equal && equalSeen + equalRank < kLeft)) ? 1 : 0;
+      int takeTotal;
+      const int place = groupExclusiveSum(take, scratch, &takeTotal);
+      if(take) {
+        values[valuesOffset + r * k + written + place] = value;
+        indices[indicesOffset + r * k + written + place] = (float)(i + 1);
+      }
+      written += takeTotal;
+      equalSeen += equalTotal;
+    }
+  }
+}
+
+// A work group per row, writing its k-th smallest element, and that
+// element's index; of equal elements, the one earliest in the row
+kernel void THClSort_kthvalue(int n, int numRows, int k,
+    global const float *in, int inOffset, global float *values, int valuesOffset,
+    global float *indices, int indicesOffset, local float *scratchSpace) {
+  local int *scratch = (local int *)scratchSpace;
+  local int hist[16];
+  local uint sharedKey;
+  local int sharedLeft;
+  const int size = get_local_size(0);
+  const int tid = get_local_id(0);
+  for(int r = get_group_id(0); r < numRows; r += get_num_groups(0)) {
+    global const float *row = in + inOffset + r * n;
+    uint selected;
+    int kLeft;
+    radixSelect(row, n, k, 0, hist, &sharedKey, &sharedLeft, &selected, &kLeft);
+    int equalSeen = 0;
+    for(int base = 0; base < n && equalSeen < kLeft; base += size) {
+      const int i = base + tid;
+      const int equal = i < n && sortKey(row[i], 0) == selected ? 1 : 0;
+      int equalTotal;
+      const int equalRank = groupExclusiveSum(equal, scratch, &equalTotal);
+      if(equal && equalSeen + equalRank == kLeft - 1) {
+        values[valuesOffset + r] = row[i];
+        indices[indicesOffset + r] = (float)(i + 1);
+      }
+      equalSeen += equalTotal;
+    }
+  }
+}
+
@@ -1,12 +1,91 @@
 #include "THClStorage.h"
 #include "THClGeneral.h"
+#include "THClProfiler.h"
+#include "THClMemory.h"
+#include "THClMapping.h"
 #include "THAtomic.h"
 
 #include "EasyCL.h"
 #include <stdexcept>
+#include <cstdio>
 //#include <iostream>
 using namespace std;
 
+// number of floats needed to hold size elements of dataType
+static long THClStorage_numFloats(long size, int dataType)
+{
+  long bytes = size * THClStorage_elementSize(dataType);
+  return (bytes + sizeof(float) - 1) / sizeof(float);
+}
+
+// a buffer for self->size elements on self->device, from the pool if one of
+// the right size is there.  If the device can't make one, self is left with
+// no buffer, error says why, and this returns false: callers undo their own
+// changes before THError, which mustn't longjmp out of a catch block
+static bool THClStorage_allocate(THClState *state, THClStorage *self, char *error, size_t errorSize)
+{
+  long numFloats = THClStorage_numFloats(self->size, self->dataType);
+  if(THClMemory_takeFromPool(state, self->device, numFloats, &self->data, &self->wrapper)) {
+    return true;
+  }
+  EasyCL *cl = THClState_getClForDevice(state, self->device);
+  self->data = new float[numFloats];
+  self->wrapper = cl->wrap( numFloats, self->data );
+  bool created = false;
+  try {
+    self->wrapper->createOnDevice();
+    created = true;
+  } catch(runtime_error &) {
+  }
+  if(!created) {
+    // probably out of device memory: give the pooled buffers back, and try once more
+    THClMemory_emptyPool(state);
+    try {
+      self->wrapper->createOnDevice();
+      created = true;
+    } catch(runtime_error &e) {
+      snprintf(error, errorSize, "%s", e.what());
+    }
+  }
+  if(!created) {
+    delete self->wrapper;
+    delete[] self->data;
+    self->wrapper = 0;
+    self->data = 0;
+  }
+  return created;
+}
+
+static void THClStorage_allocationFailed(const THClStorage *self, const char *error)
+{
+  THError("couldn't allocate %ld floats on the device (%s); for tensors bigger than device memory, "
+    "keep them as FloatTensors and use cltorch.streamMap2 / streamMap3 / streamAddmm",
+    THClStorage_numFloats(self->size, self->dataType), error);
+}
+
+static void THClStorage_release(THClState *state, THClStorage *self)
+{
+  if(THClMapping_isMapped(state, self)) {
+    THClMapping_release(state, self);
+    return;
+  }
+  long numFloats = THClStorage_numFloats(self->size, self->dataType);
+  if(!THClMemory_returnToPool(state, self->device, numFloats, self->data, self->wrapper)) {
+    delete self->wrapper;
+    delete[] self->data;
+  }
+  self->wrapper = 0;
+  self->data = 0;
+}
+
+int THClStorage_elementSize(int dataType)
+{
+  if( dataType == THCL_BYTE ) {
+    return 1;
+  }
+  return dataType == THCL_HALF ? 2 : 4;
+}
+
 void THClStorage_set(THClState *state, THClStorage *self, long index, float value)
 {
 //  cout << "set size=" << self->size << " index=" << index << " value=" << value << endl;
@@ -14,10 +93,10 @@ void THClStorage_set(THClState *state, THClStorage *self, long index, float valu
   if( self->wrapper->isDeviceDirty() ) { // we have to do this, since we're going to copy it all back again
                                          // although I suppose we could set via a kernel perhaps
                                          // either way, this function is pretty inefficient right now :-P
-    self->wrapper->copyToHost();
+    THClProfiler_copyToHost(state, self->wrapper);
   }
-  self->data[index] = value;
-  self->wrapper->copyToDevice();
+  THClStorage_elementFromFloat(self->dataType, self->data, index, value);
+  THClProfiler_copyToDevice(state, self->wrapper);
 }
 
 float THClStorage_get(THClState *state, const THClStorage *self, long index)
@@ -25,12 +104,17 @@ float THClStorage_get(THClState *state, const THClStorage *self, long index)
 //  printf("THClStorage_get\n");
   THArgCheck((index >= 0) && (index < self->size), 2, "index out of bounds");
   if( self->wrapper->isDeviceDirty() ) {
-    self->wrapper->copyToHost();
+    THClProfiler_copyToHost(state, self->wrapper);
   }
-  return self->data[index];
+  return THClStorage_elementToFloat(self->dataType, self->data, index);
 }
 
 THClStorage* THClStorage_new(THClState *state)
+{
+  return THClStorage_newOfType(state, THCL_FLOAT);
+}
+
+THClStorage* THClStorage_newOfType(THClState *state, int dataType)
 {
   THClStorage *storage = (THClStorage*)THAlloc(sizeof(THClStorage));
   storage->data = NULL;
@@ -38,31 +122,40 @@ THClStorage* THClStorage_new(THClState *state)
   storage->size = 0;
   storage->refcount = 1;
   storage->flag = TH_STORAGE_REFCOUNTED | TH_STORAGE_RESIZABLE | TH_STORAGE_FREEMEM;
+  storage->device = THClState_getDevice(state);
+  storage->dataType = dataType;
   return storage;
 }
 
 THClStorage* THClStorage_newWithSize(THClState *state, long size)
+{
+  return THClStorage_newWithSizeOfType(state, size, THCL_FLOAT);
+}
+
+THClStorage* THClStorage_newWithSizeOfType(THClState *state, long size, int dataType)
 {
   THArgCheck(size >= 0, 2, "invalid size");
 
   if(size > 0)
   {
     THClStorage *storage = (THClStorage*)THAlloc(sizeof(THClStorage));
-    float *data = new float[size];
-    EasyCL *cl = state->cl;
-    CLWrapper *wrapper = cl->wrap( size, data );
-    wrapper->createOnDevice();
-    storage->data = data;
-    storage->wrapper = wrapper;
-
     storage->size = size;
     storage->refcount = 1;
     storage->flag = TH_STORAGE_REFCOUNTED | TH_STORAGE_RESIZABLE | TH_STORAGE_FREEMEM;
+    storage->device = THClState_getDevice(state);
+    storage->dataType = dataType;
+    char error[256];
+    if(!THClStorage_allocate(state, storage, error, sizeof(error))) {
+      THClStorage failed = *storage;
+      THFree(storage);
+      THClStorage_allocationFailed(&failed, error);
+    }
+    THClMemory_allocated(state, storage);
     return storage;
   }
   else
   {
-    return THClStorage_new(state);
+    return THClStorage_newOfType(state, dataType);
   }
 }
 
@@ -110,8 +203,12 @@ THClStorage* THClStorage_newWithSize4(THClState *state, float data0, float data1
 
 THClStorage* THClStorage_newWithMapping(THClState *state, const char *fileName, long size, int isShared)
 {
-  THError("not available yet for THClStorage");
-  return NULL;
+  return THClMapping_newStorage(state, fileName, size, isShared, 0);
+}
+
+THClStorage* THClStorage_newWithLazyMapping(THClState *state, const char *fileName, long size, int isShared)
+{
+  return THClMapping_newStorage(state, fileName, size, isShared, 1);
 }
 
 THClStorage* THClStorage_newWithData(THClState *state, float *data, long size)
@@ -139,19 +236,26 @@ void THClStorage_free(THClState *state, THClStorage *self)
 
   if (THAtomicDecrementRef(&self->refcount))
   {
-    if(self->flag & TH_STORAGE_FREEMEM) {
-      delete self->wrapper;
-      delete self->data;
+    if((self->flag & TH_STORAGE_FREEMEM) && self->wrapper != 0) {
+      THClMemory_freed(state, self);
+      THClStorage_release(state, self);
     }
     THFree(self);
   }
 }
 void THClStorage_fill(THClState *state, THClStorage *self, float value)
 {
+  if( self->dataType != THCL_FLOAT ) {
+    for( int i = 0; i < self->size; i++ ) {
+      THClStorage_elementFromFloat(self->dataType, self->data, i, value);
+    }
+    THClProfiler_copyToDevice(state, self->wrapper);
+    return;
+  }
   for( int i = 0; i < self->size; i++ ) {
     self->data[i] = value;
   }
-  self->wrapper->copyToDevice();
+  THClProfiler_copyToDevice(state, self->wrapper);
 }
 
 void THClStorage_resize(THClState *state, THClStorage *self, long size)
@@ -159,10 +263,147 @@ void THClStorage_resize(THClState *state, THClStorage *self, long size)
   if( size <= self->size ) {
     return;
   }
-  delete self->wrapper;
-  delete[] self->data;
-  self->data = new float[size];
-  self->wrapper = state->cl->wrap( size, self->data );
+  // the new buffer is made before the old one goes, so a failure leaves
+  // self as it was
+  THClStorage grown = *self;
+  grown.size = size;
+  char error[256];
+  if(!THClStorage_allocate(state, &grown, error, sizeof(error))) {
+    THClStorage_allocationFailed(&grown, error);
+  }
+  if(self->wrapper != 0) {
+    THClMemory_freed(state, self);
+    THClStorage_release(state, self);
+  }
   self->size = size;
+  self->data = grown.data;
+  self->wrapper = grown.wrapper;
+  THClMemory_allocated(state, self);
+}
+
+
+int THClStorage_isHostUnified(THClState *state, const THClStorage *self)
+{
+  cl_bool unified = CL_FALSE;
+  EasyCL *cl = THClState_getClForDevice(state, self->device);
+  if(clGetDeviceInfo(cl->device, CL_DEVICE_HOST_UNIFIED_MEMORY, sizeof(unified), &unified, 0) != CL_SUCCESS) {
+    return 0;
+  }
+  return unified == CL_TRUE;
+}
+
+float *THClStorage_map(THClState *state, THClStorage *self, int forWrite)
+{
+  EasyCL *cl = THClState_getClForDevice(state, self->device);
+  if( !self->wrapper->isOnDevice() ) {
+    self->wrapper->createOnDevice();
+  }
+  THClMapping_touchAll(state, self->wrapper);
+  cl_int err;
+  cl_map_flags flags = forWrite ? (CL_MAP_READ | CL_MAP_WRITE) : CL_MAP_READ;
+  float *mapped = (float *)clEnqueueMapBuffer(*cl->queue, self->wrapper->getBuffer(), CL_TRUE,
+    flags, 0, THClStorage_numFloats(self->size, self->dataType) * sizeof(float), 0, 0, 0, &err);
+  if(err != CL_SUCCESS) {
+    THError("clEnqueueMapBuffer failed, OpenCL error %d", err);
+  }
+  if(forWrite) {
+    // storage->data no longer matches the device
+    self->wrapper->markDeviceDirty();
+  }
+  return mapped;
+}
+
+void THClStorage_unmap(THClState *state, THClStorage *self, float *mapped)
+{
+  EasyCL *cl = THClState_getClForDevice(state, self->device);
+  cl_int err = clEnqueueUnmapMemObject(*cl->queue, self->wrapper->getBuffer(), mapped, 0, 0, 0);
+  if(err != CL_SUCCESS) {
+    THError("clEnqueueUnmapMemObject failed, OpenCL error %d", err);
+  }
 }
 
+unsigned short THClHalf_fromFloat(float value)
+{
+  union { float f; unsigned int u; } bits;
+  bits.f = value;
+  unsigned int sign = (bits.u >> 16) & 0x8000;
+  int exponent = (int)((bits.u >> 23) & 0xff) - 127 + 15;
+  unsigned int mantissa = bits.u & 0x7fffff;
+
+  if( ((bits.u >> 23) & 0xff) == 0xff ) {
+    // inf or nan
+    return (unsigned short)(sign | 0x7c00 | (mantissa ? 0x200 : 0));
+  }
+  if( exponent >= 0x1f ) {
+    // too big: inf
+    return (unsigned short)(sign | 0x7c00);
+  }
+  if( exponent <= 0 ) {
+    // denormal, or too small: zero
+    if( exponent < -10 ) {
+      return (unsigned short)sign;
+    }
+    mantissa |= 0x800000;
+    int shift = 14 - exponent;
+    unsigned int halfMantissa = mantissa >> shift;
+    unsigned int remainder = mantissa & ((1u << shift) - 1);
+    unsigned int halfway = 1u << (shift - 1);
+    if( remainder > halfway || (remainder == halfway && (halfMantissa & 1)) ) {
+      halfMantissa++;
+    }
+    return (unsigned short)(sign | halfMantissa);
+  }
+  unsigned int half = sign | (exponent << 10) | (mantissa >> 13);
+  unsigned int remainder = mantissa & 0x1fff;
+  // round to nearest even; a carry out of the mantissa correctly bumps the exponent
+  if( remainder > 0x1000 || (remainder == 0x1000 && (half & 1)) ) {
+    half++;
+  }
+  return (unsigned short)half;
+}
+
+float THClHalf_toFloat(unsigned short value)
+{
+  union { float f; unsigned int u; } bits;
+  unsigned int sign = (value & 0x8000) << 16;
+  unsigned int exponent = (value >> 10) & 0x1f;
+  unsigned int mantissa = value & 0x3ff;
+  if( exponent == 0x1f ) {
+    bits.u = sign | 0x7f800000 | (mantissa << 13);
+  } else if( exponent != 0 ) {
+    bits.u = sign | ((exponent - 15 + 127) << 23) | (mantissa << 13);
+  } else if( mantissa == 0 ) {
+    bits.u = sign;
+  } else {
+    // denormal: normalize it
+    exponent = 127 - 15 + 1;
+    while( (mantissa & 0x400) == 0 ) {
+      mantissa <<= 1;
+      exponent--;
+    }
+    bits.u = sign | (exponent << 23) | ((mantissa & 0x3ff) << 13);
+  }
+  return bits.f;
+}
+
+float THClStorage_elementToFloat(int dataType, const void *data, long index)
+{
+  if( dataType == THCL_HALF ) {
+    return THClHalf_toFloat(((const unsigned short *)data)[index]);
+  } else if( dataType == THCL_BYTE ) {
+    return ((const unsigned char *)data)[index];
+  }
+  return ((const float *)data)[index];
+}
+
+void THClStorage_elementFromFloat(int dataType, void *data, long index, float value)
+{
+  if( dataType == THCL_HALF ) {
+    ((unsigned short *)data)[index] = THClHalf_fromFloat(value);
+  } else if( dataType == THCL_BYTE ) {
+    // as a FloatTensor's copy to a ByteTensor does
+    ((unsigned char *)data)[index] = (unsigned char)(long)value;
+  } else {
+    ((float *)data)[index] = value;
+  }
+}
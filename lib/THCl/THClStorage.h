@@ -8,6 +8,14 @@
 #define TH_STORAGE_RESIZABLE  2
 #define TH_STORAGE_FREEMEM    4
 
+/* what each element of a ClStorage holds on the device.  The host-side
+   data array mirrors the device bytes, so for half storages it holds
+   packed 16-bit values, two to each float slot, and for byte storages
+   four bytes to each */
+#define THCL_FLOAT 0
+#define THCL_HALF  1
+#define THCL_BYTE  2
+
 typedef struct THClStorage
 {
     float *data; // I know this seems a bit superfluous....
@@ -18,6 +26,8 @@ typedef struct THClStorage
     THAllocator *allocator;
     void *allocatorContext;
     struct THClStorage *view;
+    int device; // the device the wrapper's buffer lives on
+    int dataType; // THCL_FLOAT, THCL_HALF or THCL_BYTE
 } THClStorage;
 
 
@@ -30,11 +40,17 @@ THCL_API float THClStorage_get(THClState *state, const THClStorage*, long);
 
 THCL_API THClStorage* THClStorage_new(THClState *state);
 THCL_API THClStorage* THClStorage_newWithSize(THClState *state, long size);
+THCL_API THClStorage* THClStorage_newOfType(THClState *state, int dataType);
+THCL_API THClStorage* THClStorage_newWithSizeOfType(THClState *state, long size, int dataType);
+THCL_API int THClStorage_elementSize(int dataType);
 THCL_API THClStorage* THClStorage_newWithSize1(THClState *state, float);
 THCL_API THClStorage* THClStorage_newWithSize2(THClState *state, float, float);
 THCL_API THClStorage* THClStorage_newWithSize3(THClState *state, float, float, float);
 THCL_API THClStorage* THClStorage_newWithSize4(THClState *state, float, float, float, float);
 THCL_API THClStorage* THClStorage_newWithMapping(THClState *state, const char *filename, long size, int shared);
+/* as newWithMapping, but each chunk of the file goes to the device the first
+   time a kernel uses it; see THClMapping.h */
+THCL_API THClStorage* THClStorage_newWithLazyMapping(THClState *state, const char *filename, long size, int shared);
 
 /* takes ownership of data */
 THCL_API THClStorage* THClStorage_newWithData(THClState *state, float *data, long size);
@@ -53,4 +69,18 @@ THCL_API void THClStorage_free(THClState *state, THClStorage *storage);
 THCL_API void THClStorage_resize(THClState *state, THClStorage *storage, long size);
 THCL_API void THClStorage_fill(THClState *state, THClStorage *storage, float value);
 
+/* On devices where host and device share memory (integrated gpus, cpu devices)
+   the device buffer can be mapped and read or written directly, skipping the
+   copy through storage->data */
+THCL_API int THClStorage_isHostUnified(THClState *state, const THClStorage *storage);
+THCL_API float *THClStorage_map(THClState *state, THClStorage *storage, int forWrite);
+THCL_API void THClStorage_unmap(THClState *state, THClStorage *storage, float *mapped);
+
+/* host-side conversions to and from IEEE 754 half precision */
+THCL_API unsigned short THClHalf_fromFloat(float value);
+THCL_API float THClHalf_toFloat(unsigned short value);
+/* element index of host data laid out as dataType, as a float, and back */
+THCL_API float THClStorage_elementToFloat(int dataType, const void *data, long index);
+THCL_API void THClStorage_elementFromFloat(int dataType, void *data, long index, float value);
+
 #endif
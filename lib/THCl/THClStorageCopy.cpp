@@ -1,6 +1,7 @@
 #include <iostream>
 
 #include "THClStorageCopy.h"
+#include "THClProfiler.h"
 #include "THClGeneral.h"
 
 #include <stdio.h>
@@ -17,6 +18,7 @@ void THClStorage_rawCopy(THClState *state, THClStorage *self, float *src)
 void THClStorage_copy(THClState *state, THClStorage *self, THClStorage *src)
 {
   THArgCheck(self->size == src->size, 2, "size does not match");
+  THArgCheck(self->dataType == src->dataType, 2, "storage types do not match");
   if( !self->wrapper->isOnDevice() ) {
     self->wrapper->createOnDevice();
   }
@@ -34,10 +36,16 @@ void THClStorage_copyFloat(THClState *state, THClStorage *self, struct THFloatSt
 {
 //  cout << "THClStorgae_copyFloat()" << endl;
   THArgCheck(self->size == src->size, 2, "size does not match");
-  for( int i = 0; i < self->size; i++ ) {
-    self->data[i] = src->data[i];
+  if( self->dataType != THCL_FLOAT ) {
+    for( int i = 0; i < self->size; i++ ) {
+      THClStorage_elementFromFloat(self->dataType, self->data, i, src->data[i]);
+    }
+  } else {
+    for( int i = 0; i < self->size; i++ ) {
+      self->data[i] = src->data[i];
+    }
   }
-  self->wrapper->copyToDevice();
+  THClProfiler_copyToDevice(state, self->wrapper);
  // THClCheck(clMemcpy(self->data, src->data, self->size * sizeof(float), clMemcpyHostToDevice));
 }
 
@@ -64,7 +72,13 @@ void THFloatStorage_copyCl(THClState *state, THFloatStorage *self, struct THClSt
 //  cout << "THfloatStorage_copyCl" << endl;
   THArgCheck(self->size == src->size, 2, "size does not match");
   if( src->wrapper->isDeviceDirty() ) {
-    src->wrapper->copyToHost();
+    THClProfiler_copyToHost(state, src->wrapper);
+  }
+  if( src->dataType != THCL_FLOAT ) {
+    for( int i = 0; i < self->size; i++ ) {
+      self->data[i] = THClStorage_elementToFloat(src->dataType, src->data, i);
+    }
+    return;
   }
   for( int i = 0; i < self->size; i++ ) {
     self->data[i] = src->data[i];
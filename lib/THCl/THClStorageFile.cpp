@@ -0,0 +1,189 @@
+#include "THClStorageFile.h"
+#include "THClStorage.h"
+#include "THClProfiler.h"
+#include "THClMapping.h"
+
+#include <vector>
+
+using namespace std;
+
+static void THClStorageFile_check(cl_int err, const char *what)
+{
+  if(err != CL_SUCCESS) {
+    THError("%s failed, OpenCL error %d", what, err);
+  }
+}
+
+static void THClStorageFile_wait(cl_event *event)
+{
+  if(*event != 0) {
+    THClStorageFile_check(clWaitForEvents(1, event), "clWaitForEvents");
+    clReleaseEvent(*event);
+    *event = 0;
+  }
+}
+
+// the pinned chunks for device, created the first time they're needed
+static THClDeviceStaging *THClStorageFile_get(THClState *state, int device)
+{
+  if(state->fileStaging == 0) {
+    THClFileStaging *staging = new THClFileStaging();
+    staging->devices = new THClDeviceStaging[state->allocatedDevices];
+    for(int i = 0; i < state->allocatedDevices; i++) {
+      staging->devices[i].cl = 0;
+    }
+    state->fileStaging = staging;
+  }
+  THClDeviceStaging *deviceStaging = &state->fileStaging->devices[device];
+  if(deviceStaging->cl == 0) {
+    EasyCL *cl = THClState_getClForDevice(state, device);
+    size_t bytes = THCL_FILE_CHUNK * sizeof(float);
+    for(int i = 0; i < THCL_FILE_SLOTS; i++) {
+      THClFileSlot *slot = &deviceStaging->slots[i];
+      cl_int err;
+      slot->pinned = clCreateBuffer(*cl->context, CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR, bytes, 0, &err);
+      THClStorageFile_check(err, "clCreateBuffer");
+      slot->host = (float *)clEnqueueMapBuffer(*cl->queue, slot->pinned, CL_TRUE,
+        CL_MAP_READ | CL_MAP_WRITE, 0, bytes, 0, 0, 0, &err);
+      THClStorageFile_check(err, "clEnqueueMapBuffer");
+      slot->done = 0;
+    }
+    deviceStaging->cl = cl;
+  }
+  return deviceStaging;
+}
+
+// count elements from host, as floats
+static void THClStorageFile_writeChunk(THFile *file, int dataType, float *host, long count, vector<float> &widened)
+{
+  if(dataType != THCL_FLOAT) {
+    for(long i = 0; i < count; i++) {
+      widened[i] = THClStorage_elementToFloat(dataType, host, i);
+    }
+    THFile_writeFloatRaw(file, &widened[0], count);
+  } else {
+    THFile_writeFloatRaw(file, host, count);
+  }
+}
+
+// count floats from the file into host, as dataType elements
+static void THClStorageFile_readChunk(THFile *file, int dataType, float *host, long count, vector<float> &narrowed)
+{
+  if(dataType != THCL_FLOAT) {
+    THFile_readFloatRaw(file, &narrowed[0], count);
+    for(long i = 0; i < count; i++) {
+      THClStorage_elementFromFloat(dataType, host, i, narrowed[i]);
+    }
+  } else {
+    THFile_readFloatRaw(file, host, count);
+  }
+}
+
+void THClStorage_write(THClState *state, THClStorage *self, THFile *file)
+{
+  long size = self->size;
+  THFile_writeLongScalar(file, size);
+  if(size == 0) {
+    return;
+  }
+  vector<float> widened(self->dataType != THCL_FLOAT ? THCL_FILE_CHUNK : 0);
+  if(!self->wrapper->isOnDevice()) {
+    // nothing on the device yet, so storage->data is all there is
+    for(long done = 0; done < size; done += THCL_FILE_CHUNK) {
+      long count = size - done < THCL_FILE_CHUNK ? size - done : THCL_FILE_CHUNK;
+      float *host = (float *)((char *)self->data + done * THClStorage_elementSize(self->dataType));
+      THClStorageFile_writeChunk(file, self->dataType, host, count, widened);
+    }
+    return;
+  }
+
+  THClMapping_touchAll(state, self->wrapper);
+  THClDeviceStaging *staging = THClStorageFile_get(state, self->device);
+  cl_command_queue queue = *staging->cl->queue;
+  cl_mem buffer = self->wrapper->getBuffer();
+  int elementSize = THClStorage_elementSize(self->dataType);
+  long numChunks = (size + THCL_FILE_CHUNK - 1) / THCL_FILE_CHUNK;
+  cl_event profileBegin = THClProfiler_begin(state);
+  // the read of chunk c+1 is in flight while chunk c goes to the file
+  for(long c = 0; c <= numChunks; c++) {
+    if(c < numChunks) {
+      THClFileSlot *slot = &staging->slots[c % THCL_FILE_SLOTS];
+      long count = size - c * THCL_FILE_CHUNK < THCL_FILE_CHUNK ? size - c * THCL_FILE_CHUNK : THCL_FILE_CHUNK;
+      THClStorageFile_check(clEnqueueReadBuffer(queue, buffer, CL_FALSE,
+        c * THCL_FILE_CHUNK * elementSize, count * elementSize, slot->host, 0, 0, &slot->done),
+        "clEnqueueReadBuffer");
+      clFlush(queue);
+    }
+    if(c > 0) {
+      THClFileSlot *slot = &staging->slots[(c - 1) % THCL_FILE_SLOTS];
+      long count = size - (c - 1) * THCL_FILE_CHUNK < THCL_FILE_CHUNK ? size - (c - 1) * THCL_FILE_CHUNK : THCL_FILE_CHUNK;
+      THClStorageFile_wait(&slot->done);
+      THClStorageFile_writeChunk(file, self->dataType, slot->host, count, widened);
+    }
+  }
+  THClProfiler_end(state, profileBegin, "storage write", "", size * elementSize);
+}
+
+void THClStorage_read(THClState *state, THClStorage *self, THFile *file)
+{
+  long size = THFile_readLongScalar(file);
+  THClStorage_resize(state, self, size);
+  if(size == 0) {
+    return;
+  }
+  if(!self->wrapper->isOnDevice()) {
+    self->wrapper->createOnDevice();
+  }
+  // the whole buffer gets overwritten
+  THClMapping_markResident(state, self->wrapper);
+  vector<float> narrowed(self->dataType != THCL_FLOAT ? THCL_FILE_CHUNK : 0);
+  THClDeviceStaging *staging = THClStorageFile_get(state, self->device);
+  cl_command_queue queue = *staging->cl->queue;
+  cl_mem buffer = self->wrapper->getBuffer();
+  int elementSize = THClStorage_elementSize(self->dataType);
+  long numChunks = (size + THCL_FILE_CHUNK - 1) / THCL_FILE_CHUNK;
+  cl_event profileBegin = THClProfiler_begin(state);
+  // chunk c is read from the file while chunk c-1 is on its way to the device
+  for(long c = 0; c < numChunks; c++) {
+    THClFileSlot *slot = &staging->slots[c % THCL_FILE_SLOTS];
+    long count = size - c * THCL_FILE_CHUNK < THCL_FILE_CHUNK ? size - c * THCL_FILE_CHUNK : THCL_FILE_CHUNK;
+    THClStorageFile_wait(&slot->done);
+    THClStorageFile_readChunk(file, self->dataType, slot->host, count, narrowed);
+    THClStorageFile_check(clEnqueueWriteBuffer(queue, buffer, CL_FALSE,
+      c * THCL_FILE_CHUNK * elementSize, count * elementSize, slot->host, 0, 0, &slot->done),
+      "clEnqueueWriteBuffer");
+    clFlush(queue);
+  }
+  for(int i = 0; i < THCL_FILE_SLOTS; i++) {
+    THClStorageFile_wait(&staging->slots[i].done);
+  }
+  THClProfiler_end(state, profileBegin, "storage read", "", size * elementSize);
+  // storage->data is now out of date
+  self->wrapper->markDeviceDirty();
+}
+
+void THClStorageFile_free(THClState *state)
+{
+  THClFileStaging *staging = state->fileStaging;
+  if(staging == 0) {
+    return;
+  }
+  for(int d = 0; d < state->allocatedDevices; d++) {
+    THClDeviceStaging *deviceStaging = &staging->devices[d];
+    if(deviceStaging->cl == 0) {
+      continue;
+    }
+    cl_command_queue queue = *deviceStaging->cl->queue;
+    for(int i = 0; i < THCL_FILE_SLOTS; i++) {
+      THClStorageFile_wait(&deviceStaging->slots[i].done);
+      clEnqueueUnmapMemObject(queue, deviceStaging->slots[i].pinned, deviceStaging->slots[i].host, 0, 0, 0);
+    }
+    clFinish(queue);
+    for(int i = 0; i < THCL_FILE_SLOTS; i++) {
+      clReleaseMemObject(deviceStaging->slots[i].pinned);
+    }
+  }
+  delete[] staging->devices;
+  delete staging;
+  state->fileStaging = 0;
+}
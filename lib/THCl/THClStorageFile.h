@@ -0,0 +1,47 @@
+#ifndef THCL_STORAGE_FILE_INC
+#define THCL_STORAGE_FILE_INC
+
+#include "THClGeneral.h"
+#include "THFile.h"
+
+struct THClStorage;
+
+// Serialization of ClStorages, in the same format as a FloatStorage: the
+// size, then size floats.  Half and byte storages are widened to floats on the way
+// out, and narrowed on the way in.
+//
+// The device buffer is streamed through two pinned chunks, without going
+// through storage->data: while one chunk is written to the file, the next is
+// being read from the device, and the other way round when loading.  The
+// pinned chunks are kept per device and reused.
+
+// floats per pinned chunk
+#define THCL_FILE_CHUNK (1024 * 1024)
+
+THCL_API void THClStorage_write(THClState *state, struct THClStorage *storage, THFile *file);
+// resizes storage to the size in the file
+THCL_API void THClStorage_read(THClState *state, struct THClStorage *storage, THFile *file);
+THCL_API void THClStorageFile_free(THClState *state);
+
+#ifdef __cplusplus
+#include "EasyCL.h"
+
+#define THCL_FILE_SLOTS 2
+
+struct THClFileSlot {
+  cl_mem pinned;
+  float *host;
+  cl_event done; // the last transfer into or out of host
+};
+
+struct THClDeviceStaging {
+  EasyCL *cl; // 0 until the device's chunks are created
+  THClFileSlot slots[THCL_FILE_SLOTS];
+};
+
+typedef struct THClFileStaging {
+  THClDeviceStaging *devices; // one per allocated device
+} THClFileStaging;
+#endif // __cplusplus
+
+#endif
@@ -0,0 +1,283 @@
+#include "THClStream.h"
+#include "THClTensor.h"
+#include "THClTensorMath.h"
+#include "THClTensorCopy.h"
+#include "THClGraph.h"
+#include "THClProfiler.h"
+
+#include <algorithm>
+
+using namespace std;
+
+// cap on the automatic tile size, in floats
+#define THCL_STREAM_MAX_TILE (64l * 1024 * 1024)
+#define THCL_STREAM_SLOTS 2
+
+static void THClStream_check(cl_int err, const char *what)
+{
+  if(err != CL_SUCCESS) {
+    THError("%s failed, OpenCL error %d", what, err);
+  }
+}
+
+static THClStream *THClStream_get(THClState *state)
+{
+  if(state->stream == 0) {
+    THClStream *stream = new THClStream();
+    stream->tileElements = 0;
+    stream->transferQueues = new cl_command_queue[state->allocatedDevices];
+    for(int i = 0; i < state->allocatedDevices; i++) {
+      stream->transferQueues[i] = 0;
+    }
+    state->stream = stream;
+  }
+  return state->stream;
+}
+
+static cl_command_queue THClStream_transferQueue(THClState *state, int device)
+{
+  THClStream *stream = THClStream_get(state);
+  if(stream->transferQueues[device] == 0) {
+    EasyCL *cl = THClState_getClForDevice(state, device);
+    cl_int err;
+    stream->transferQueues[device] = clCreateCommandQueue(*cl->context, cl->device, 0, &err);
+    THClStream_check(err, "clCreateCommandQueue");
+  }
+  return stream->transferQueues[device];
+}
+
+// floats per operand per tile: numOperands tiles, twice over, in at most a
+// quarter of the device's memory, and each within the max allocation size
+static long THClStream_tileFloats(THClState *state, int numOperands)
+{
+  THClStream *stream = THClStream_get(state);
+  if(stream->tileElements > 0) {
+    return stream->tileElements;
+  }
+  cl_ulong maxAlloc = 0;
+  cl_ulong globalMem = 0;
+  THClStream_check(clGetDeviceInfo(state->cl->device, CL_DEVICE_MAX_MEM_ALLOC_SIZE, sizeof(maxAlloc), &maxAlloc, 0),
+    "clGetDeviceInfo");
+  THClStream_check(clGetDeviceInfo(state->cl->device, CL_DEVICE_GLOBAL_MEM_SIZE, sizeof(globalMem), &globalMem, 0),
+    "clGetDeviceInfo");
+  cl_ulong bytes = min(maxAlloc, globalMem / 4 / (THCL_STREAM_SLOTS * numOperands));
+  return min((long)(bytes / sizeof(float)), THCL_STREAM_MAX_TILE);
+}
+
+// one tensor's part in a streamed op: rows of width floats, uploaded from in
+// and downloaded to out, either of which can be 0
+struct THClStreamOperand {
+  const float *in;
+  float *out;
+  long width;
+};
+
+// tiles[i] is a rows x width view of operand i's device tile
+typedef void (*THClStreamCompute)(THClState *state, THClTensor **tiles, void *context);
+
+static void THClStream_upload(cl_command_queue transfer, int numOperands, THClStreamOperand *operands,
+    THClStorage **storages, long firstRow, long rows, cl_event *uploaded)
+{
+  for(int k = 0; k < numOperands; k++) {
+    if(operands[k].in != 0) {
+      THClStream_check(clEnqueueWriteBuffer(transfer, storages[k]->wrapper->getBuffer(), CL_FALSE,
+        0, rows * operands[k].width * sizeof(float), operands[k].in + firstRow * operands[k].width, 0, 0, 0),
+        "clEnqueueWriteBuffer");
+    }
+  }
+  THClStream_check(clEnqueueMarkerWithWaitList(transfer, 0, 0, uploaded), "clEnqueueMarkerWithWaitList");
+  clFlush(transfer);
+}
+
+static void THClStream_run(THClState *state, int numOperands, THClStreamOperand *operands, long rows,
+    THClStreamCompute compute, void *context)
+{
+  THArgCheck(!THClGraph_isCapturing(state), 1, "can't stream while capturing a graph");
+  if(rows == 0) {
+    return;
+  }
+  long maxWidth = 1;
+  for(int k = 0; k < numOperands; k++) {
+    maxWidth = max(maxWidth, operands[k].width);
+  }
+  long rowsPerTile = min(rows, THClStream_tileFloats(state, numOperands) / maxWidth);
+  THArgCheck(rowsPerTile >= 1, 2, "a single row doesn't fit in a device tile");
+  long numTiles = (rows + rowsPerTile - 1) / rowsPerTile;
+
+  int device = THClState_getDevice(state);
+  cl_command_queue transfer = THClStream_transferQueue(state, device);
+  THClStorage *storages[THCL_STREAM_SLOTS][3];
+  cl_event uploaded[THCL_STREAM_SLOTS];
+  for(int s = 0; s < THCL_STREAM_SLOTS; s++) {
+    for(int k = 0; k < numOperands; k++) {
+      storages[s][k] = THClStorage_newWithSize(state, rowsPerTile * operands[k].width);
+    }
+  }
+
+  cl_event profileBegin = THClProfiler_begin(state);
+  THClStream_upload(transfer, numOperands, operands, storages[0], 0, min(rowsPerTile, rows), &uploaded[0]);
+  for(long tile = 0; tile < numTiles; tile++) {
+    int slot = tile % THCL_STREAM_SLOTS;
+    long firstRow = tile * rowsPerTile;
+    long tileRows = min(rowsPerTile, rows - firstRow);
+    // the transfer queue is in order, so this upload comes after the
+    // download of the tile that last used the slot
+    if(tile + 1 < numTiles) {
+      int nextSlot = (tile + 1) % THCL_STREAM_SLOTS;
+      long nextFirstRow = firstRow + rowsPerTile;
+      THClStream_upload(transfer, numOperands, operands, storages[nextSlot], nextFirstRow,
+        min(rowsPerTile, rows - nextFirstRow), &uploaded[nextSlot]);
+    }
+    THClStream_check(clWaitForEvents(1, &uploaded[slot]), "clWaitForEvents");
+    clReleaseEvent(uploaded[slot]);
+
+    THClTensor *tiles[3];
+    for(int k = 0; k < numOperands; k++) {
+      tiles[k] = THClTensor_newWithStorage2d(state, storages[slot][k], 0, tileRows, operands[k].width,
+        operands[k].width, 1);
+    }
+    compute(state, tiles, context);
+    state->cl->finish();
+    for(int k = 0; k < numOperands; k++) {
+      if(operands[k].out != 0) {
+        THClStream_check(clEnqueueReadBuffer(transfer, storages[slot][k]->wrapper->getBuffer(), CL_FALSE,
+          0, tileRows * operands[k].width * sizeof(float), operands[k].out + firstRow * operands[k].width, 0, 0, 0),
+          "clEnqueueReadBuffer");
+      }
+      THClTensor_free(state, tiles[k]);
+    }
+    clFlush(transfer);
+  }
+  THClStream_check(clFinish(transfer), "clFinish");
+  THClProfiler_end(state, profileBegin, "stream", "", 0);
+
+  for(int s = 0; s < THCL_STREAM_SLOTS; s++) {
+    for(int k = 0; k < numOperands; k++) {
+      THClStorage_free(state, storages[s][k]);
+    }
+  }
+}
+
+struct THClStreamMapContext {
+  const char *operation;
+  int numScalars;
+  const float *scalars;
+  int numTensors;
+};
+
+static void THClStream_computeMap(THClState *state, THClTensor **tiles, void *context)
+{
+  THClStreamMapContext *map = (THClStreamMapContext *)context;
+  if(map->numTensors == 3) {
+    THClTensor_map3(state, tiles[0], tiles[1], tiles[2], map->operation, map->numScalars, map->scalars);
+  } else {
+    THClTensor_map2(state, tiles[0], tiles[1], map->operation, map->numScalars, map->scalars);
+  }
+}
+
+void THClStream_map(THClState *state, THFloatTensor *self, THFloatTensor *src1, THFloatTensor *src2,
+    const char *operation, int numScalars, const float *scalars)
+{
+  long numElements = THFloatTensor_nElement(self);
+  THArgCheck(THFloatTensor_isContiguous(self), 2, "tensors must be contiguous");
+  THArgCheck(THFloatTensor_isContiguous(src1) && THFloatTensor_nElement(src1) == numElements, 3,
+    "tensors must be contiguous, and the same size");
+  THArgCheck(src2 == 0 || (THFloatTensor_isContiguous(src2) && THFloatTensor_nElement(src2) == numElements), 4,
+    "tensors must be contiguous, and the same size");
+
+  // *out can be read by the operation, so self goes up as well as down
+  THClStreamOperand operands[3];
+  operands[0].in = THFloatTensor_data(self);
+  operands[0].out = THFloatTensor_data(self);
+  operands[1].in = THFloatTensor_data(src1);
+  operands[1].out = 0;
+  int numOperands = 2;
+  if(src2 != 0) {
+    operands[2].in = THFloatTensor_data(src2);
+    operands[2].out = 0;
+    numOperands = 3;
+  }
+  for(int k = 0; k < numOperands; k++) {
+    operands[k].width = 1;
+  }
+  THClStreamMapContext context;
+  context.operation = operation;
+  context.numScalars = numScalars;
+  context.scalars = scalars;
+  context.numTensors = numOperands;
+  THClStream_run(state, numOperands, operands, numElements, THClStream_computeMap, &context);
+}
+
+struct THClStreamAddmmContext {
+  float beta;
+  float alpha;
+  THClTensor *mat2;
+};
+
+static void THClStream_computeAddmm(THClState *state, THClTensor **tiles, void *context)
+{
+  THClStreamAddmmContext *addmm = (THClStreamAddmmContext *)context;
+  if(addmm->beta == 0) {
+    // the tile wasn't uploaded, and might hold anything, NaNs included
+    THClTensor_zero(state, tiles[0]);
+  }
+  THClTensor_addmm(state, tiles[0], addmm->beta, tiles[0], addmm->alpha, tiles[1], addmm->mat2);
+}
+
+void THClStream_addmm(THClState *state, THFloatTensor *self, float beta, THFloatTensor *t,
+    float alpha, THFloatTensor *mat1, THFloatTensor *mat2)
+{
+  THArgCheck(mat1->nDimension == 2 && mat2->nDimension == 2, 5, "matrices expected");
+  THArgCheck(mat1->size[1] == mat2->size[0], 5, "size mismatch");
+  THArgCheck(t->nDimension == 2 && t->size[0] == mat1->size[0] && t->size[1] == mat2->size[1], 3,
+    "size mismatch");
+  THArgCheck(THFloatTensor_isContiguous(t) && THFloatTensor_isContiguous(mat1), 5,
+    "tensors must be contiguous");
+  if(self != t) {
+    THFloatTensor_resize2d(self, t->size[0], t->size[1]);
+  }
+  THArgCheck(THFloatTensor_isContiguous(self), 1, "tensors must be contiguous");
+
+  long rows = mat1->size[0];
+  long inner = mat1->size[1];
+  long cols = mat2->size[1];
+  THClTensor *mat2Cl = THClTensor_newWithSize2d(state, inner, cols);
+  THClTensor_copyFloat(state, mat2Cl, mat2);
+
+  THClStreamOperand operands[2];
+  operands[0].in = beta != 0 ? THFloatTensor_data(t) : 0;
+  operands[0].out = THFloatTensor_data(self);
+  operands[0].width = cols;
+  operands[1].in = THFloatTensor_data(mat1);
+  operands[1].out = 0;
+  operands[1].width = inner;
+  THClStreamAddmmContext context;
+  context.beta = beta;
+  context.alpha = alpha;
+  context.mat2 = mat2Cl;
+  THClStream_run(state, 2, operands, rows, THClStream_computeAddmm, &context);
+  THClTensor_free(state, mat2Cl);
+}
+
+void THClStream_setTileElements(THClState *state, long tileElements)
+{
+  THArgCheck(tileElements >= 0, 2, "tile size can't be negative");
+  THClStream_get(state)->tileElements = tileElements;
+}
+
+void THClStream_free(THClState *state)
+{
+  THClStream *stream = state->stream;
+  if(stream == 0) {
+    return;
+  }
+  for(int i = 0; i < state->allocatedDevices; i++) {
+    if(stream->transferQueues[i] != 0) {
+      clFinish(stream->transferQueues[i]);
+      clReleaseCommandQueue(stream->transferQueues[i]);
+    }
+  }
+  delete[] stream->transferQueues;
+  delete stream;
+  state->stream = 0;
+}
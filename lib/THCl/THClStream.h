@@ -0,0 +1,34 @@
+#ifndef THCL_STREAM_INC
+#define THCL_STREAM_INC
+
+#include "THClGeneral.h"
+#include "TH.h"
+
+// Out-of-core execution: ops on host tensors too big for the device, run
+// in device-sized tiles of rows.  Each tile's inputs are uploaded on a
+// second, transfer, queue while the previous tile computes, and its result
+// is downloaded while the next one computes; two sets of device tiles
+// alternate.  The host tensors must be contiguous.
+
+// map2 / map3 (see THClTensor_map) over host tensors; src2 may be 0
+THCL_API void THClStream_map(THClState *state, THFloatTensor *self, THFloatTensor *src1, THFloatTensor *src2,
+  const char *operation, int numScalars, const float *scalars);
+// self = beta * t + alpha * mat1 * mat2, tiled over the rows of mat1; mat2
+// has to fit on the device
+THCL_API void THClStream_addmm(THClState *state, THFloatTensor *self, float beta, THFloatTensor *t,
+  float alpha, THFloatTensor *mat1, THFloatTensor *mat2);
+// floats per device tile; 0 (the default) sizes tiles from the device's
+// memory and max allocation size
+THCL_API void THClStream_setTileElements(THClState *state, long tileElements);
+THCL_API void THClStream_free(THClState *state);
+
+#ifdef __cplusplus
+#include "EasyCL.h"
+
+typedef struct THClStream {
+  long tileElements;
+  cl_command_queue *transferQueues; // per device, 0 until used
+} THClStream;
+#endif // __cplusplus
+
+#endif
@@ -191,6 +191,8 @@ THClTensor *THClTensor_newWithSize4d(THClState *state, long size0, long size1, l
 THClTensor *THClTensor_newClone(THClState *state, THClTensor *self)
 {
   THClTensor *tensor = THClTensor_new(state);
+  if(self->storage && self->storage->dataType != THCL_FLOAT)
+    tensor->storage = THClStorage_newOfType(state, self->storage->dataType);
   THClTensor_resizeAs(state, tensor, self);
   THClTensor_copy(state, tensor, self);
   return tensor;
@@ -235,6 +237,26 @@ THClTensor *THClTensor_newUnfold(THClState *state, THClTensor *tensor, int dimen
   return self;
 }
 
+THClTensor *THClTensor_newExpandAs(THClState *state, THClTensor *tensor, const THClTensor *target)
+{
+  THArgCheck(THClTensor_canExpandAs(state, tensor, target), 2, "sizes don't broadcast");
+  int nDimension = target->nDimension;
+  int skipped = nDimension - tensor->nDimension;
+  long *stride = (long*)THAlloc(sizeof(long)*nDimension);
+  for(int d = 0; d < nDimension; d++)
+  {
+    int srcDim = d - skipped;
+    if(srcDim < 0 || tensor->size[srcDim] != target->size[d])
+      stride[d] = 0;
+    else
+      stride[d] = tensor->stride[srcDim];
+  }
+  THClTensor *self = THClTensor_new(state);
+  THClTensor_rawSet(state, self, tensor->storage, tensor->storageOffset, nDimension, target->size, stride);
+  THFree(stride);
+  return self;
+}
+
 /* Resize */
 void THClTensor_resize(THClState *state, THClTensor *self, THLongStorage *size, THLongStorage *stride)
 {
@@ -558,6 +580,56 @@ int THClTensor_isSameSizeAs(THClState *state, const THClTensor *self, const THCl
   return 1;
 }
 
+int THClTensor_canExpandAs(THClState *state, const THClTensor *src, const THClTensor *target)
+{
+  int d;
+  if(src->nDimension == 0 || src->nDimension > target->nDimension)
+    return 0;
+  for(d = 1; d <= src->nDimension; d++)
+  {
+    long srcSize = src->size[src->nDimension - d];
+    if(srcSize != 1 && srcSize != target->size[target->nDimension - d])
+      return 0;
+  }
+  return 1;
+}
+
+void THClTensor_resizeBroadcast(THClState *state, THClTensor *self, THClTensor *src1, THClTensor *src2)
+{
+  if(THClTensor_nElement(state, src1) == THClTensor_nElement(state, src2))
+  {
+    if(self != src1)
+      THClTensor_resizeAs(state, self, src1);
+    return;
+  }
+  THArgCheck(src1->nDimension > 0 && src2->nDimension > 0, 3, "sizes do not match");
+  int nDimension = src1->nDimension > src2->nDimension ? src1->nDimension : src2->nDimension;
+  long *size = (long*)THAlloc(sizeof(long)*nDimension);
+  for(int d = 1; d <= nDimension; d++)
+  {
+    long size1 = d <= src1->nDimension ? src1->size[src1->nDimension - d] : 1;
+    long size2 = d <= src2->nDimension ? src2->size[src2->nDimension - d] : 1;
+    if(size1 != size2 && size1 != 1 && size2 != 1)
+    {
+      THFree(size);
+      THArgCheck(0, 3, "sizes do not match, and don't broadcast");
+    }
+    size[nDimension - d] = size1 == 1 ? size2 : size1;
+  }
+  /* self can't grow if it is also one of the sources */
+  int isSame = self->nDimension == nDimension;
+  for(int d = 0; isSame && d < nDimension; d++)
+    isSame = self->size[d] == size[d];
+  if(!isSame && (self == src1 || self == src2))
+  {
+    THFree(size);
+    THArgCheck(0, 1, "result of a broadcast can't be written in place into a smaller source");
+  }
+  if(!isSame)
+    THClTensor_rawResize(state, self, nDimension, size, NULL);
+  THFree(size);
+}
+
 long THClTensor_nElement(THClState *state, const THClTensor *self)
 {
   if(self->nDimension == 0)
@@ -795,12 +867,8 @@ float THClTensor_get4d(THClState *state, const THClTensor *tensor, long x0, long
 //}
 // from .cu
 THCL_API int THClTensor_getDevice(THClState* state, const THClTensor* thc) {
-  THError("THClTensor_getDevice Not implemented");
-  return 0;
-//  if (!thc->storage) return -1;
-//  cudaPointerAttributes attr;
-//  THClCheck(cudaPointerGetAttributes(&attr, thc->storage->data));
-//  return attr.device;
+  if (!thc->storage) return -1;
+  return thc->storage->device;
 }
 int THClTensor_checkGPU(THClState *state, unsigned int nTensors, ...)
 {
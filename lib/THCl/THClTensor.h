@@ -74,6 +74,9 @@ THCL_API THClTensor *THClTensor_newSelect(THClState *state, THClTensor *tensor,
 THCL_API THClTensor *THClTensor_newNarrow(THClState *state, THClTensor *tensor, int dimension_, long firstIndex_, long size_);
 THCL_API THClTensor *THClTensor_newTranspose(THClState *state, THClTensor *tensor, int dimension1_, int dimension2_);
 THCL_API THClTensor *THClTensor_newUnfold(THClState *state, THClTensor *tensor, int dimension_, long size_, long step_);
+/* a view of tensor at target's size, with stride 0 along the dimensions it is
+   broadcast over; see THClTensor_canExpandAs */
+THCL_API THClTensor *THClTensor_newExpandAs(THClState *state, THClTensor *tensor, const THClTensor *target);
 
 THCL_API void THClTensor_resize(THClState *state, THClTensor *tensor, THLongStorage *size, THLongStorage *stride);
 THCL_API void THClTensor_resizeAs(THClState *state, THClTensor *tensor, THClTensor *src);
@@ -110,6 +113,13 @@ THCL_API void THClTensor_squeeze1d(THClState *state, THClTensor *self, THClTenso
 
 THCL_API int THClTensor_isContiguous(THClState *state, const THClTensor *self);
 THCL_API int THClTensor_isSameSizeAs(THClState *state, const THClTensor *self, const THClTensor *src);
+/* Broadcasting, for the elementwise ops: trailing dimensions line up, and a
+   dimension of size 1, or a missing leading one, stretches to match the other
+   tensor.  canExpandAs is true if src broadcasts to exactly target's size */
+THCL_API int THClTensor_canExpandAs(THClState *state, const THClTensor *src, const THClTensor *target);
+/* resizes self for an elementwise op on src1 and src2: like src1 if they have
+   as many elements, as always, and to their broadcast size otherwise */
+THCL_API void THClTensor_resizeBroadcast(THClState *state, THClTensor *self, THClTensor *src1, THClTensor *src2);
 THCL_API long THClTensor_nElement(THClState *state, const THClTensor *self);
 
 THCL_API void THClTensor_retain(THClState *state, THClTensor *self);
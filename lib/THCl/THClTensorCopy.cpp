@@ -1,14 +1,22 @@
 #include <stdexcept>
+#include <string.h>
 
 #include "THClApply.h"
 #include "THClTensorCopy.h"
+#include "THClProfiler.h"
+#include "THClPrecompile.h"
 #include "THClGeneral.h"
 #include "THClTensor.h"
+#include "THClDeviceCopy.h"
+#include "THClMapping.h"
 
 #include "EasyCL.h"
+#include "templates/TemplatedKernel.h"
 
 using namespace std;
 
+static std::string getTypeConvert_template();
+
 // ============ from .c:
 
 /* specific methods */
@@ -21,42 +29,194 @@ void THClTensor_copyFloat(THClState *state, THClTensor *self, struct THFloatTens
     src = THFloatTensor_newContiguous(src);
   
     int numElements = THFloatTensor_nElement(src);
-    float *dest_segment = selfc->storage->data + selfc->storageOffset;
     float *src_segment = src->storage->data + src->storageOffset;
-    for( int i = 0; i < numElements; i++ ) {
-      dest_segment[i] = src_segment[i];
+    if( selfc->storage->dataType != THCL_FLOAT ) {
+      // the rest of the storage goes back up too, so it has to be current
+      if( selfc->storage->wrapper->isDeviceDirty() ) {
+        THClProfiler_copyToHost(state, selfc->storage->wrapper);
+      }
+      for( int i = 0; i < numElements; i++ ) {
+        THClStorage_elementFromFloat(selfc->storage->dataType, selfc->storage->data,
+          selfc->storageOffset + i, src_segment[i]);
+      }
+      THClProfiler_copyToDevice(state, selfc->storage->wrapper);
+    } else if( THClStorage_isHostUnified(state, selfc->storage) ) {
+      // write straight into the buffer, rather than via storage->data
+      float *mapped = THClStorage_map(state, selfc->storage, 1);
+      memcpy(mapped + selfc->storageOffset, src_segment, numElements * sizeof(float));
+      THClStorage_unmap(state, selfc->storage, mapped);
+    } else {
+      float *dest_segment = selfc->storage->data + selfc->storageOffset;
+      for( int i = 0; i < numElements; i++ ) {
+        dest_segment[i] = src_segment[i];
+      }
+      THClProfiler_copyToDevice(state, selfc->storage->wrapper);
     }
-    selfc->storage->wrapper->copyToDevice();
 
     THFloatTensor_free(src);
     THClTensor_freeCopyTo(state, selfc, self);
   }
 }
 
-/* everything comes down to copy to a tensor of floats */
-#define IMPLEMENT_TH_CL_TENSOR_COPY(TYPEC)                            \
-void THClTensor_copy##TYPEC(THClState *state, THClTensor *self, struct TH##TYPEC##Tensor *src) \
+// Integer types are uploaded as-is, and converted to float on the device:
+// a ByteTensor only moves a quarter of the bytes a FloatTensor would.
+// The raw data travels in a float wrapper; if its length isn't a whole
+// number of floats, it gets packed into a padded array first.
+static CLKernel *THClTensor_getConvertKernel(THClState *state, const char *clType, const char *kernelName)
+{
+  TemplatedKernel kernelBuilder( state->cl );
+  kernelBuilder.set("SrcType", clType);
+  std::string uniqueName = std::string(kernelName) + "_" + clType;
+  return THClKernel_build( state, kernelBuilder, uniqueName, "THClTypeConvert.cl", getTypeConvert_template(), kernelName );
+}
+
+static void THClTensor_convertToFloat(THClState *state, THClTensor *self, void *raw, long numElements,
+    int elementSize, const char *clType, float scale, float shift)
+{
+  THArgCheck(numElements < ( 1l << 31 ), 2, "tensor too large");
+  if( numElements == 0 ) {
+    return;
+  }
+  if( self->storage->dataType != THCL_FLOAT ) {
+    // convert into a float tensor first, then let THClTensor_copy narrow it
+    THClTensor *selff = THClTensor_new(state);
+    THClTensor_resizeAs(state, selff, self);
+    THClTensor_convertToFloat(state, selff, raw, numElements, elementSize, clType, scale, shift);
+    THClTensor_copy(state, self, selff);
+    THClTensor_free(state, selff);
+    return;
+  }
+  THClTensor *selfc = THClTensor_newContiguous(state, self);
+  long numBytes = numElements * elementSize;
+  long numFloats = DIVUP(numBytes, (long)sizeof(float));
+  float *packed = 0;
+  if( numBytes % sizeof(float) == 0 ) {
+    packed = (float *)raw;
+  } else {
+    packed = new float[numFloats];
+    memcpy(packed, raw, numBytes);
+  }
+  CLWrapper *rawWrapper = state->cl->wrap( numFloats, packed );
+  THClProfiler_copyToDevice(state, rawWrapper);
+
+  CLKernel *kernel = THClTensor_getConvertKernel(state, clType, "THClTensor_convertToFloat");
+  if( kernel != 0 ) { // 0 in compile-only mode
+    // these launch on the raw kernel, so lazy mappings are touched by hand
+    if( THClMapping_any(state) ) {
+      THClMapping_touch(state, selfc->storage->wrapper, selfc->storageOffset, numElements);
+    }
+    kernel->in( (int)numElements );
+    kernel->in( rawWrapper );
+    kernel->inout( selfc->storage->wrapper );
+    kernel->in( (int)selfc->storageOffset );
+    kernel->in( scale );
+    kernel->in( shift );
+    int workgroupSize = 64;
+    kernel->run_1d( DIVUP(numElements, workgroupSize) * workgroupSize, workgroupSize );
+    state->cl->finish();
+  }
+
+  delete rawWrapper;
+  if( packed != raw ) {
+    delete[] packed;
+  }
+  THClTensor_freeCopyTo(state, selfc, self);
+}
+
+static void THClTensor_convertFromFloat(THClState *state, void *raw, THClTensor *src, long numElements,
+    int elementSize, const char *clType)
+{
+  THArgCheck(numElements < ( 1l << 31 ), 2, "tensor too large");
+  if( numElements == 0 ) {
+    return;
+  }
+  if( src->storage->dataType != THCL_FLOAT ) {
+    THClTensor *srcf = THClTensor_new(state);
+    THClTensor_resizeAs(state, srcf, src);
+    THClTensor_copy(state, srcf, src);
+    THClTensor_convertFromFloat(state, raw, srcf, numElements, elementSize, clType);
+    THClTensor_free(state, srcf);
+    return;
+  }
+  src = THClTensor_newContiguous(state, src);
+  long numBytes = numElements * elementSize;
+  long numFloats = DIVUP(numBytes, (long)sizeof(float));
+  float *packed = 0;
+  if( numBytes % sizeof(float) == 0 ) {
+    packed = (float *)raw;
+  } else {
+    packed = new float[numFloats];
+  }
+  CLWrapper *rawWrapper = state->cl->wrap( numFloats, packed );
+  rawWrapper->createOnDevice();
+
+  CLKernel *kernel = THClTensor_getConvertKernel(state, clType, "THClTensor_convertFromFloat");
+  if( kernel != 0 ) { // 0 in compile-only mode
+    if( THClMapping_any(state) ) {
+      THClMapping_touch(state, src->storage->wrapper, src->storageOffset, numElements);
+    }
+    kernel->in( (int)numElements );
+    kernel->in( src->storage->wrapper );
+    kernel->in( (int)src->storageOffset );
+    kernel->out( rawWrapper );
+    int workgroupSize = 64;
+    kernel->run_1d( DIVUP(numElements, workgroupSize) * workgroupSize, workgroupSize );
+    state->cl->finish();
+  }
+  THClProfiler_copyToHost(state, rawWrapper);
+
+  delete rawWrapper;
+  if( packed != raw ) {
+    memcpy(raw, packed, numBytes);
+    delete[] packed;
+  }
+  THClTensor_free(state, src);
+}
+
+// OpenCL's long is always 64 bits, but the host's is only 64 bits on LP64
+// platforms; on LLP64 (Windows) it matches OpenCL's int
+#define THCL_HOST_LONG_CLTYPE (sizeof(long) == 8 ? "long" : "int")
+
+#define IMPLEMENT_TH_CL_TENSOR_COPY(TYPEC, TYPE, CLTYPE)                 \
+void THClTensor_copy##TYPEC##Scaled(THClState *state, THClTensor *self, struct TH##TYPEC##Tensor *src, \
+    float scale, float shift)                                           \
 {                                                                       \
   THArgCheck(THClTensor_nElement(state, self) == TH##TYPEC##Tensor_nElement(src), 2, "sizes do not match"); \
                                                                         \
   {                                                                     \
-    THLongStorage *size = TH##TYPEC##Tensor_newSizeOf(src);             \
-    THFloatTensor *srcf = THFloatTensor_newWithSize(size, NULL);        \
-                                                                        \
-    THFloatTensor_copy##TYPEC(srcf, src);                               \
-    THClTensor_copyFloat(state, self, srcf);                                 \
-                                                                        \
-    THLongStorage_free(size);                                           \
-    THFloatTensor_free(srcf);                                           \
+    src = TH##TYPEC##Tensor_newContiguous(src);                         \
+    THClTensor_convertToFloat(state, self, TH##TYPEC##Tensor_data(src), \
+      TH##TYPEC##Tensor_nElement(src), sizeof(TYPE), CLTYPE, scale, shift); \
+    TH##TYPEC##Tensor_free(src);                                        \
   }                                                                     \
+}                                                                       \
+void THClTensor_copy##TYPEC(THClState *state, THClTensor *self, struct TH##TYPEC##Tensor *src) \
+{                                                                       \
+  THClTensor_copy##TYPEC##Scaled(state, self, src, 1.0f, 0.0f);         \
 }
 
-IMPLEMENT_TH_CL_TENSOR_COPY(Byte)
-IMPLEMENT_TH_CL_TENSOR_COPY(Char)
-IMPLEMENT_TH_CL_TENSOR_COPY(Short)
-IMPLEMENT_TH_CL_TENSOR_COPY(Int)
-IMPLEMENT_TH_CL_TENSOR_COPY(Long)
-IMPLEMENT_TH_CL_TENSOR_COPY(Double)
+IMPLEMENT_TH_CL_TENSOR_COPY(Byte, unsigned char, "uchar")
+IMPLEMENT_TH_CL_TENSOR_COPY(Char, char, "char")
+IMPLEMENT_TH_CL_TENSOR_COPY(Short, short, "short")
+IMPLEMENT_TH_CL_TENSOR_COPY(Int, int, "int")
+IMPLEMENT_TH_CL_TENSOR_COPY(Long, long, THCL_HOST_LONG_CLTYPE)
+
+/* doubles are converted on the host, since the device might not do fp64 */
+void THClTensor_copyDouble(THClState *state, THClTensor *self, struct THDoubleTensor *src)
+{
+  THArgCheck(THClTensor_nElement(state, self) == THDoubleTensor_nElement(src), 2, "sizes do not match");
+
+  {
+    THLongStorage *size = THDoubleTensor_newSizeOf(src);
+    THFloatTensor *srcf = THFloatTensor_newWithSize(size, NULL);
+
+    THFloatTensor_copyDouble(srcf, src);
+    THClTensor_copyFloat(state, self, srcf);
+
+    THLongStorage_free(size);
+    THFloatTensor_free(srcf);
+  }
+}
 
 /* copyCl */
 
@@ -69,13 +229,27 @@ void THFloatTensor_copyCl(THClState *state, THFloatTensor *self, struct THClTens
     src = THClTensor_newContiguous(state, src);
 
     int numElements = THClTensor_nElement(state, src);
-    if( src->storage->wrapper->isDeviceDirty() ) {
-        src->storage->wrapper->copyToHost();
-    }
     float *dest_segment = selfc->storage->data + selfc->storageOffset;
-    float *src_segment =  src->storage->data + src->storageOffset;
-    for( int i = 0; i < numElements; i++ ) {
-        dest_segment[i] = src_segment[i];
+    if( src->storage->dataType != THCL_FLOAT ) {
+      if( src->storage->wrapper->isDeviceDirty() ) {
+          THClProfiler_copyToHost(state, src->storage->wrapper);
+      }
+      for( int i = 0; i < numElements; i++ ) {
+          dest_segment[i] = THClStorage_elementToFloat(src->storage->dataType, src->storage->data,
+            src->storageOffset + i);
+      }
+    } else if( THClStorage_isHostUnified(state, src->storage) && src->storage->wrapper->isOnDevice() ) {
+      float *mapped = THClStorage_map(state, src->storage, 0);
+      memcpy(dest_segment, mapped + src->storageOffset, numElements * sizeof(float));
+      THClStorage_unmap(state, src->storage, mapped);
+    } else {
+      if( src->storage->wrapper->isDeviceDirty() ) {
+          THClProfiler_copyToHost(state, src->storage->wrapper);
+      }
+      float *src_segment =  src->storage->data + src->storageOffset;
+      for( int i = 0; i < numElements; i++ ) {
+          dest_segment[i] = src_segment[i];
+      }
     }
 
     THClTensor_free(state, src);
@@ -83,29 +257,40 @@ void THFloatTensor_copyCl(THClState *state, THFloatTensor *self, struct THClTens
   }
 }
 
-#define IMPLEMENT_TH_CL_TENSOR_COPY_TO(TYPEC)                                                          \
+#define IMPLEMENT_TH_CL_TENSOR_COPY_TO(TYPEC, TYPE, CLTYPE)                                          \
   void TH##TYPEC##Tensor_copyCl(THClState *state, TH##TYPEC##Tensor *self, struct THClTensor *src) \
   {                                                                                                      \
     THArgCheck(TH##TYPEC##Tensor_nElement(self) == THClTensor_nElement(state, src), 2, "sizes do not match"); \
                                                                                                          \
     {                                                                                                    \
-      THLongStorage *size = THClTensor_newSizeOf(state, src);                                          \
-      THFloatTensor *srcf = THFloatTensor_newWithSize(size, NULL);                                       \
-                                                                                                         \
-      THFloatTensor_copyCl(state, srcf, src);                                                          \
-      TH##TYPEC##Tensor_copyFloat(self, srcf);                                                           \
-                                                                                                         \
-      THLongStorage_free(size);                                                                          \
-      THFloatTensor_free(srcf);                                                                          \
+      TH##TYPEC##Tensor *selfc = TH##TYPEC##Tensor_newContiguous(self);                                  \
+      THClTensor_convertFromFloat(state, TH##TYPEC##Tensor_data(selfc), src,                             \
+        THClTensor_nElement(state, src), sizeof(TYPE), CLTYPE);                                          \
+      TH##TYPEC##Tensor_freeCopyTo(selfc, self);                                                         \
     }                                                                                                    \
   }
 
-IMPLEMENT_TH_CL_TENSOR_COPY_TO(Byte)
-IMPLEMENT_TH_CL_TENSOR_COPY_TO(Char)
-IMPLEMENT_TH_CL_TENSOR_COPY_TO(Short)
-IMPLEMENT_TH_CL_TENSOR_COPY_TO(Int)
-IMPLEMENT_TH_CL_TENSOR_COPY_TO(Long)
-IMPLEMENT_TH_CL_TENSOR_COPY_TO(Double)
+IMPLEMENT_TH_CL_TENSOR_COPY_TO(Byte, unsigned char, "uchar")
+IMPLEMENT_TH_CL_TENSOR_COPY_TO(Char, char, "char")
+IMPLEMENT_TH_CL_TENSOR_COPY_TO(Short, short, "short")
+IMPLEMENT_TH_CL_TENSOR_COPY_TO(Int, int, "int")
+IMPLEMENT_TH_CL_TENSOR_COPY_TO(Long, long, THCL_HOST_LONG_CLTYPE)
+
+void THDoubleTensor_copyCl(THClState *state, THDoubleTensor *self, struct THClTensor *src)
+{
+  THArgCheck(THDoubleTensor_nElement(self) == THClTensor_nElement(state, src), 2, "sizes do not match");
+
+  {
+    THLongStorage *size = THClTensor_newSizeOf(state, src);
+    THFloatTensor *srcf = THFloatTensor_newWithSize(size, NULL);
+
+    THFloatTensor_copyCl(state, srcf, src);
+    THDoubleTensor_copyFloat(self, srcf);
+
+    THLongStorage_free(size);
+    THFloatTensor_free(srcf);
+  }
+}
 
 void THClTensor_copyCl(THClState *state, THClTensor *self, THClTensor *src)
 {
@@ -114,6 +299,44 @@ void THClTensor_copyCl(THClState *state, THClTensor *self, THClTensor *src)
 
 // ============ from cu:
 
+// src and dst live on different devices: make each side contiguous on its own
+// device, then stream the bytes across
+static void THClTensor_copyAcrossDevices(THClState *state, THClTensor *dst, THClTensor *src) {
+  int oldDev = THClState_getDevice(state);
+  int srcDev = THClTensor_getDevice(state, src);
+  int dstDev = THClTensor_getDevice(state, dst);
+
+  // the staging ring moves floats, so half and byte tensors are widened either side
+  THClState_setDevice(state, srcDev);
+  THClTensor *srcc = src;
+  if(src->storage->dataType == THCL_FLOAT) {
+    srcc = THClTensor_newContiguous(state, src);
+  } else {
+    srcc = THClTensor_new(state);
+    THClTensor_resizeAs(state, srcc, src);
+    THClTensor_copy(state, srcc, src);
+  }
+
+  THClState_setDevice(state, dstDev);
+  THClTensor *dstc = dst;
+  if(THClTensor_isContiguous(state, dst) && dst->storage->dataType == THCL_FLOAT) {
+    THClTensor_retain(state, dst);
+  } else {
+    dstc = THClTensor_new(state);
+    THClTensor_resizeAs(state, dstc, dst);
+  }
+
+  THClDeviceCopy_copy(state,
+    dstDev, dstc->storage->wrapper, dstc->storageOffset,
+    srcDev, srcc->storage->wrapper, srcc->storageOffset,
+    THClTensor_nElement(state, src));
+
+  THClTensor_freeCopyTo(state, dstc, dst);
+  THClState_setDevice(state, srcDev);
+  THClTensor_free(state, srcc);
+  THClState_setDevice(state, oldDev);
+}
+
 //static inline int curGPU() {
 //  int curDev;
 //  THClCheck(cudaGetDevice(&curDev));
@@ -138,9 +361,17 @@ THClTensor_copy(THClState* state, THClTensor* dst, THClTensor* src) {
   // -FIXME: if both tensors have matching size and stride arrays, and no
   // holes within (in other words, there is some permutation that can be applied
   // to the size/strides such that the resulting tensor is contiguous).
+  int srcDev = THClTensor_getDevice(state, src);
+  int dstDev = THClTensor_getDevice(state, dst);
+  if (srcDev != dstDev) {
+    THClTensor_copyAcrossDevices(state, dst, src);
+    return;
+  }
+
   bool srcContig = THClTensor_isContiguous(state, src);
   bool dstContig = THClTensor_isContiguous(state, dst);
-  bool memcpyEligible = (srcContig && dstContig) || (totalElements == 1);
+  bool memcpyEligible = ((srcContig && dstContig) || (totalElements == 1))
+    && src->storage->dataType == dst->storage->dataType;
 
   if (memcpyEligible) {
     if( !dst->storage->wrapper->isOnDevice() ) {
@@ -199,7 +430,45 @@ THClTensor_copy(THClState* state, THClTensor* dst, THClTensor* src) {
 //    if (curGPU() != oldDev) {
 //      THClCheck(cudaSetDevice(oldDev));
 //    }
-    throw runtime_error("not implemented");
-    THError("Not implemented");
+    // this also converts between float and half
+    bool succ =
+      THClTensor_pointwiseApply2(state, dst, src, CopyOp());
+    THArgCheck(succ, 2, CLTORCH_DIM_WARNING);
   }
 }
+
+static std::string getTypeConvert_template() {
+    // [[[cog
+    // import stringify
+    // stringify.write_kernel( "kernel", "THClTypeConvert.cl" )
+    // ]]]
+    // generated using cog, from THClTypeConvert.cl:
+    const char * kernelSource =  
+    "// OpenCL kernels....\n" 
+    "\n" 
+    "// expected templated values:\n" 
+    "// SrcType: OpenCL type of the raw buffer, eg uchar, short, int, long\n" 
+    "//\n" 
+    "// the raw buffer travels in a float wrapper on the host side, so it's\n" 
+    "// just reinterpreted as SrcType here\n" 
+    "\n" 
+    "kernel void THClTensor_convertToFloat(int n, global const {{SrcType}} *src,\n" 
+    "    global float *dst, int dstOffset, float scale, float shift) {\n" 
+    "  int linearIndex = get_global_id(0);\n" 
+    "  if(linearIndex < n) {\n" 
+    "    dst[dstOffset + linearIndex] = (float)src[linearIndex] * scale + shift;\n" 
+    "  }\n" 
+    "}\n" 
+    "\n" 
+    "kernel void THClTensor_convertFromFloat(int n, global const float *src, int srcOffset,\n" 
+    "    global {{SrcType}} *dst) {\n" 
+    "  int linearIndex = get_global_id(0);\n" 
+    "  if(linearIndex < n) {\n" 
+    "    dst[linearIndex] = ({{SrcType}})src[srcOffset + linearIndex];\n" 
+    "  }\n" 
+    "}\n" 
+    "\n" 
+    "";
+    // [[[end]]]
+    return kernelSource;
+}
@@ -13,6 +13,13 @@ THCL_API void THClTensor_copyLong(THClState *state, THClTensor *self, THLongTens
 THCL_API void THClTensor_copyFloat(THClState *state, THClTensor *self, THFloatTensor *src);
 THCL_API void THClTensor_copyDouble(THClState *state, THClTensor *self, THDoubleTensor *src);
 
+/* self = src * scale + shift, with the conversion done on the device */
+THCL_API void THClTensor_copyByteScaled(THClState *state, THClTensor *self, THByteTensor *src, float scale, float shift);
+THCL_API void THClTensor_copyCharScaled(THClState *state, THClTensor *self, THCharTensor *src, float scale, float shift);
+THCL_API void THClTensor_copyShortScaled(THClState *state, THClTensor *self, THShortTensor *src, float scale, float shift);
+THCL_API void THClTensor_copyIntScaled(THClState *state, THClTensor *self, THIntTensor *src, float scale, float shift);
+THCL_API void THClTensor_copyLongScaled(THClState *state, THClTensor *self, THLongTensor *src, float scale, float shift);
+
 THCL_API void THByteTensor_copyCl(THClState *state, THByteTensor *self, THClTensor *src);
 THCL_API void THCharTensor_copyCl(THClState *state, THCharTensor *self, THClTensor *src);
 THCL_API void THShortTensor_copyCl(THClState *state, THShortTensor *self, THClTensor *src);
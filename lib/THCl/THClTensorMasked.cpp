@@ -0,0 +1,266 @@
+#include <string>
+#include "THClTensorMath.h"
+#include "THClGeneral.h"
+#include "THClTensorCopy.h"
+#include "THClByte.h"
+#include "THClApply.h"
+#include "THClGraph.h"
+#include "THClProfiler.h"
+#include "THClScan.h"
+#include "EasyCL.h"
+#include "templates/TemplatedKernel.h"
+
+using namespace std;
+
+#ifndef DIVUP
+#define DIVUP(x, y) (((x) + (y) - 1) / (y))
+#endif
+
+static std::string getMasked_template();
+
+class TensorMaskedFillOp : public HasOperator2, public HasScalars {
+public:
+  int getNumScalars() const { return 1; }
+  float getScalar(int index) const { return val; }
+  TensorMaskedFillOp(float v) : val(v) {}
+  string operator2() const {
+    return "if (*in1 != 0) *out = val1";
+  }
+  const float val;
+};
+
+void THClTensor_maskedFill(THClState* state, THClTensor *tensor, THClTensor *mask, float value)
+{
+  THAssert(THClTensor_checkGPU(state, 2, tensor, mask));
+  THArgCheck(THClTensor_nElement(state, tensor) == THClTensor_nElement(state, mask), 2,
+    "sizes do not match");
+  if (!THClTensor_pointwiseApply2(state, tensor, mask, TensorMaskedFillOp(value))) {
+    THArgCheck(false, 2, CLTORCH_DIM_WARNING);
+  }
+}
+
+// maskedCopy and maskedSelect find where each set element of the mask goes
+// with THClScan_exclusiveSum over the mask.  Only the count of set elements,
+// when it's needed to size or check a tensor, comes back to the host.
+
+static CLKernel *THClMasked_getKernel(THClState *state, const char *maskType, const char *kernelName)
+{
+  TemplatedKernel kernelBuilder(state->cl);
+  kernelBuilder.set("MaskType", maskType);
+  string uniqueName = string(kernelName) + "_" + maskType;
+  return THClKernel_build(state, kernelBuilder, uniqueName, "THClMasked.cl", getMasked_template(), kernelName);
+}
+
+// contiguous, and something the kernels can read: a float or byte mask as it
+// is, a half one widened
+static THClTensor *THClMasked_newContiguousMask(THClState *state, THClTensor *mask)
+{
+  if(mask->storage->dataType != THCL_HALF) {
+    return THClTensor_newContiguous(state, mask);
+  }
+  THClTensor *maskf = THClTensor_new(state);
+  THClTensor_resizeAs(state, maskf, mask);
+  THClTensor_copy(state, maskf, mask);
+  return maskf;
+}
+
+static THClTensor *THClMasked_newContiguousFloat(THClState *state, THClTensor *self)
+{
+  if(self->storage == 0 || self->storage->dataType == THCL_FLOAT) {
+    return THClTensor_newContiguous(state, self);
+  }
+  THClTensor *selff = THClTensor_new(state);
+  THClTensor_resizeAs(state, selff, self);
+  THClTensor_copy(state, selff, self);
+  return selff;
+}
+
+static const char *THClMasked_maskType(THClTensor *mask)
+{
+  return mask->storage->dataType == THCL_BYTE ? "uchar" : "float";
+}
+
+// where each set element of maskc goes, as ints; the number set goes to
+// *numSet, if it's given, which waits for the scan
+static THClStorage *THClMasked_newPositions(THClState *state, THClTensor *maskc, long *numSet)
+{
+  long n = THClTensor_nElement(state, maskc);
+  THClStorage *positions = THClStorage_newWithSize(state, n);
+  THClStorage *total = THClStorage_newWithSize(state, 1);
+  THClScan_exclusiveSum(state, maskc->storage->wrapper, (int)maskc->storageOffset, THClMasked_maskType(maskc), 1,
+    positions->wrapper, n, total->wrapper);
+  if(numSet != 0) {
+    THClProfiler_copyToHost(state, total->wrapper);
+    *numSet = ((int *)total->data)[0];
+  }
+  THClStorage_free(state, total);
+  return positions;
+}
+
+// THClMasked_compact or THClMasked_expand over the elements of maskc
+static void THClMasked_move(THClState *state, const char *kernelName, THClTensor *maskc,
+    THClStorage *positions, THClTensor *srcc, THClTensor *dstc)
+{
+  long n = THClTensor_nElement(state, maskc);
+  CLKernel *kernel = THClMasked_getKernel(state, THClMasked_maskType(maskc), kernelName);
+  if(kernel == 0) {
+    return;
+  }
+  int maxWorkgroupSize = (int)state->cl->getMaxWorkgroupSize();
+  int workgroupSize = 256 < maxWorkgroupSize ? 256 : maxWorkgroupSize;
+  THClLaunch launch(state, kernel, kernelName);
+  launch.in((int)n);
+  launch.in(maskc->storage->wrapper);
+  launch.in((int)maskc->storageOffset);
+  launch.in(positions->wrapper);
+  launch.in(srcc->storage->wrapper);
+  launch.in((int)srcc->storageOffset);
+  launch.inout(dstc->storage->wrapper);
+  launch.in((int)dstc->storageOffset);
+  cl_event profileBegin = THClProfiler_begin(state);
+  launch.run_1d(DIVUP(n, (long)workgroupSize) * workgroupSize, workgroupSize);
+  THClProfiler_end(state, profileBegin, kernelName, "", n * sizeof(float));
+}
+
+void THClTensor_maskedCopy(THClState* state, THClTensor *tensor, THClTensor *mask, THClTensor *src)
+{
+  THAssert(THClTensor_checkGPU(state, 3, tensor, src, mask));
+  long n = THClTensor_nElement(state, tensor);
+  THArgCheck(THClTensor_nElement(state, mask) == n, 2, "sizes do not match");
+  THArgCheck(n < (1l << 31), 2, "tensor too large");
+  THArgCheck(!THClGraph_isCapturing(state), 1, "maskedCopy can't be captured in a graph");
+  if(n == 0) {
+    return;
+  }
+  THClTensor *maskc = THClMasked_newContiguousMask(state, mask);
+  THClTensor *srcc = THClMasked_newContiguousFloat(state, src);
+  // src only has to be checked against the count when it could fall short
+  long srcElements = THClTensor_nElement(state, srcc);
+  long numSet = 0;
+  THClStorage *positions = THClMasked_newPositions(state, maskc, srcElements < n ? &numSet : 0);
+  if(numSet > srcElements) {
+    THClStorage_free(state, positions);
+    THClTensor_free(state, maskc);
+    THClTensor_free(state, srcc);
+    THArgCheck(false, 4, "mask has more set elements than src has elements");
+  }
+  if(srcElements == 0) { // so nothing's set either
+    THClStorage_free(state, positions);
+    THClTensor_free(state, maskc);
+    THClTensor_free(state, srcc);
+    return;
+  }
+  THClTensor *tensorc = THClMasked_newContiguousFloat(state, tensor);
+  THClMasked_move(state, "THClMasked_expand", maskc, positions, srcc, tensorc);
+  THClStorage_free(state, positions);
+  THClTensor_free(state, maskc);
+  THClTensor_free(state, srcc);
+  THClTensor_freeCopyTo(state, tensorc, tensor);
+}
+
+void THClTensor_maskedSelect(THClState* state, THClTensor *tensor, THClTensor *src, THClTensor *mask)
+{
+  THAssert(THClTensor_checkGPU(state, 3, tensor, src, mask));
+  long n = THClTensor_nElement(state, src);
+  THArgCheck(THClTensor_nElement(state, mask) == n, 2, "sizes do not match");
+  THArgCheck(n < (1l << 31), 2, "tensor too large");
+  THArgCheck(!THClGraph_isCapturing(state), 1, "maskedSelect can't be captured in a graph");
+  if(n == 0) {
+    THClTensor_resize1d(state, tensor, 0);
+    return;
+  }
+  THClTensor *maskc = THClMasked_newContiguousMask(state, mask);
+  THClTensor *srcc = THClMasked_newContiguousFloat(state, src);
+  long numSet = 0;
+  THClStorage *positions = THClMasked_newPositions(state, maskc, &numSet);
+  // tensor can take the result directly, unless resizing it could touch src
+  bool direct = tensor->storage != 0 && tensor->storage->dataType == THCL_FLOAT
+    && tensor->storage != srcc->storage && tensor->storage != maskc->storage;
+  THClTensor *result = direct ? tensor : THClTensor_new(state);
+  THClTensor_resize1d(state, result, numSet);
+  if(numSet > 0) {
+    THClMasked_move(state, "THClMasked_compact", maskc, positions, srcc, result);
+  }
+  THClStorage_free(state, positions);
+  THClTensor_free(state, maskc);
+  THClTensor_free(state, srcc);
+  if(result != tensor) {
+    THClTensor_resize1d(state, tensor, numSet);
+    THClTensor_freeCopyTo(state, result, tensor);
+  }
+}
+
+// the host mask goes up as a ClByteTensor, a quarter of the bytes of a float one
+static THClTensor *THClMasked_newFromByte(THClState *state, THByteTensor *mask)
+{
+  THClTensor *maskCl = THClByteTensor_new(state);
+  THLongStorage *size = THByteTensor_newSizeOf(mask);
+  THClTensor_resize(state, maskCl, size, NULL);
+  THLongStorage_free(size);
+  THClTensor_copyByte(state, maskCl, mask);
+  return maskCl;
+}
+
+void THClTensor_maskedFillByte(THClState* state, THClTensor *tensor, THByteTensor *mask, float value)
+{
+  THAssert(THClTensor_checkGPU(state, 1, tensor));
+  THClTensor *maskCl = THClMasked_newFromByte(state, mask);
+  THClTensor_maskedFill(state, tensor, maskCl, value);
+  THClTensor_free(state, maskCl);
+}
+
+void THClTensor_maskedCopyByte(THClState* state, THClTensor *tensor, THByteTensor *mask, THClTensor *src)
+{
+  THAssert(THClTensor_checkGPU(state, 2, tensor, src));
+  THClTensor *maskCl = THClMasked_newFromByte(state, mask);
+  THClTensor_maskedCopy(state, tensor, maskCl, src);
+  THClTensor_free(state, maskCl);
+}
+
+void THClTensor_maskedSelectByte(THClState* state, THClTensor *tensor, THClTensor *src, THByteTensor *mask)
+{
+  THAssert(THClTensor_checkGPU(state, 2, tensor, src));
+  THClTensor *maskCl = THClMasked_newFromByte(state, mask);
+  THClTensor_maskedSelect(state, tensor, src, maskCl);
+  THClTensor_free(state, maskCl);
+}
+
+static std::string getMasked_template() {
+    // [[[cog
+    // import stringify
+    // stringify.write_kernel( "kernel", "THClMasked.cl" )
+    // ]]]
+    // generated using cog, from THClMasked.cl:
+    const char * kernelSource =  
+    "// OpenCL kernels....\n" 
+    "\n" 
+    "// expected templated values:\n" 
+    "// MaskType: OpenCL type of the mask, uchar or float\n" 
+    "//\n" 
+    "// positions comes from THClScan_exclusiveSum over the mask; it travels in\n" 
+    "// a float wrapper on the host side, so it's just reinterpreted as int here\n" 
+    "\n" 
+    "// dst[positions[i]] = src[i], where mask[i] is set\n" 
+    "kernel void THClMasked_compact(int n, global const {{MaskType}} *mask, int maskOffset,\n" 
+    "    global const int *positions, global const float *src, int srcOffset,\n" 
+    "    global float *dst, int dstOffset) {\n" 
+    "  const int linearIndex = get_global_id(0);\n" 
+    "  if(linearIndex < n && mask[maskOffset + linearIndex] != 0) {\n" 
+    "    dst[dstOffset + positions[linearIndex]] = src[srcOffset + linearIndex];\n" 
+    "  }\n" 
+    "}\n" 
+    "\n" 
+    "// dst[i] = src[positions[i]], where mask[i] is set\n" 
+    "kernel void THClMasked_expand(int n, global const {{MaskType}} *mask, int maskOffset,\n" 
+    "    global const int *positions, global const float *src, int srcOffset,\n" 
+    "    global float *dst, int dstOffset) {\n" 
+    "  const int linearIndex = get_global_id(0);\n" 
+    "  if(linearIndex < n && mask[maskOffset + linearIndex] != 0) {\n" 
+    "    dst[dstOffset + linearIndex] = src[srcOffset + positions[linearIndex]];\n" 
+    "  }\n" 
+    "}\n" 
+    "\n" 
+    "";
+    // [[[end]]]
+    return kernelSource;
+}
@@ -6,6 +6,7 @@
 //#include "THClTensorRandom.h"
 #include "THClApply.h"
 #include "THClReduce.h"
+#include "THClScan.h"
 
 using namespace std;
 
@@ -91,8 +92,7 @@ public:
 void THClTensor_cpow(THClState *state, THClTensor *self_, THClTensor *src1, THClTensor *src2)
 {
   THAssert(THClTensor_checkGPU(state, 3, self_, src1, src2));
-  THArgCheck(THClTensor_nElement(state, src1) ==
-             THClTensor_nElement(state, src2), 3, "sizes do not match");
+  THClTensor_resizeBroadcast(state, self_, src1, src2);
 
   if (self_ == src1) {
     // self = pow(self, src2)
@@ -100,8 +100,6 @@ void THClTensor_cpow(THClState *state, THClTensor *self_, THClTensor *src1, THCl
       THArgCheck(false, 2, CLTORCH_DIM_WARNING);
     }
   } else {
-    THClTensor_resizeAs(state, self_, src1);
-
     // self = pow(src1, src2)
     if (!THClTensor_pointwiseApply3(state, self_, src1, src2, TensorCPowOp())) {
       THArgCheck(false, 2, CLTORCH_DIM_WARNING);
@@ -122,8 +120,7 @@ public:
 void THClTensor_cdiv(THClState* state, THClTensor *self_, THClTensor *src1, THClTensor *src2)
 {
   THAssert(THClTensor_checkGPU(state, 3, self_, src1, src2));
-  THArgCheck(THClTensor_nElement(state, src1) ==
-             THClTensor_nElement(state, src2), 3, "sizes do not match");
+  THClTensor_resizeBroadcast(state, self_, src1, src2);
 
   if (self_ == src1) {
     // self *= src2
@@ -131,8 +128,6 @@ void THClTensor_cdiv(THClState* state, THClTensor *self_, THClTensor *src1, THCl
       THArgCheck(false, 2, CLTORCH_DIM_WARNING);
     }
   } else {
-    THClTensor_resizeAs(state, self_, src1);
-
     // self = src1 * src2
     if (!THClTensor_pointwiseApply3(state, self_, src1, src2, TensorDivOp())) {
       THArgCheck(false, 2, CLTORCH_DIM_WARNING);
@@ -206,133 +201,131 @@ void THClTensor_addcdiv(THClState *state, THClTensor *self_, THClTensor *t, floa
 
 float THClTensor_minall(THClState *state, THClTensor *self)
 {
-//  THAssert(THClTensor_checkGPU(state, 1, self));
-//  self = THClTensor_newContiguous(state, self);
-//  thrust::device_ptr<float> self_data(THClTensor_data(state, self));
-
-//  float result = thrust::reduce(self_data, self_data+THClTensor_nElement(state, self), (float)(THInf), thrust::minimum<float>());
-
-//  THClTensor_free(state, self);
-//  return result;
-    THError("Not implemented");
-    return 0;
+  THAssert(THClTensor_checkGPU(state, 1, self));
+  float result;
+  if (!THClTensor_reduceAll(state, self, CopyOp(), TensorMinReduceOp(), THInf, &result)) {
+    THArgCheck(false, 1, CLTORCH_DIM_WARNING);
+  }
+  return result;
 }
 
 float THClTensor_maxall(THClState *state, THClTensor *self)
 {
-//  THAssert(THClTensor_checkGPU(state, 1, self));
-//  self = THClTensor_newContiguous(state, self);
-//  thrust::device_ptr<float> self_data(THClTensor_data(state, self));
-
-//  float result = thrust::reduce(self_data, self_data+THClTensor_nElement(state, self), (float)(-THInf), thrust::maximum<float>());
-
-//  THClTensor_free(state, self);
-//  return result;
-    THError("Not implemented");
-    return 0;
+  THAssert(THClTensor_checkGPU(state, 1, self));
+  float result;
+  if (!THClTensor_reduceAll(state, self, CopyOp(), TensorMaxReduceOp(), -THInf, &result)) {
+    THArgCheck(false, 1, CLTORCH_DIM_WARNING);
+  }
+  return result;
 }
 
 float THClTensor_sumall(THClState *state, THClTensor *self)
 {
   THAssert(THClTensor_checkGPU(state, 1, self));
-  self = THClTensor_newContiguous(state, self);
-//  thrust::device_ptr<float> self_data(THClTensor_data(state, self));
-
-//  float result = thrust::reduce(self_data, self_data+THClTensor_nElement(state, self), (float)(0), thrust::plus<float>());
-
-//  THClTensor_free(state, self);
-//  return result;
-
-    THError("Not implemented");
-    return 0;
+  float result;
+  if (!THClTensor_reduceAll(state, self, CopyOp(), TensorAddReduceOp(), 0.0f, &result)) {
+    THArgCheck(false, 1, CLTORCH_DIM_WARNING);
+  }
+  return result;
 }
 
 float THClTensor_prodall(THClState *state, THClTensor *self)
 {
-//  THAssert(THClTensor_checkGPU(state, 1, self));
-//  self = THClTensor_newContiguous(state, self);
-//  thrust::device_ptr<float> self_data(THClTensor_data(state, self));
-
-//  float result = thrust::reduce(self_data, self_data+THClTensor_nElement(state, self), (float)(1), thrust::multiplies<float>());
-
-//  THClTensor_free(state, self);
-//  return result;
-    THError("Not implemented");
-    return 0;
+  THAssert(THClTensor_checkGPU(state, 1, self));
+  float result;
+  if (!THClTensor_reduceAll(state, self, CopyOp(), TensorMulReduceOp(), 1.0f, &result)) {
+    THArgCheck(false, 1, CLTORCH_DIM_WARNING);
+  }
+  return result;
 }
 
-//struct dim4 {
-//    unsigned arr[4];
-
-//    __host__ dim4(unsigned init=0) {
-//        for(unsigned i=0; i<4; i++) { arr[i] = init; }
-//    }
-
-//    __host__ __device__ unsigned& operator[](const unsigned& idx) { return arr[idx]; }
-//};
-
 void THClTensor_sum(THClState* state, THClTensor *self, THClTensor *src, long dimension)
 {
-//  THAssert(THClTensor_checkGPU(state, 2, self, src));
-//  THClTensor_reduceDim(
-//    state, self, src,
-//    thrust::identity<float>(), thrust::plus<float>(), 0.0f, dimension);
-
-//  THClCheck(cudaGetLastError());
-    THError("Not implemented");
-//    return 0;
+  THAssert(THClTensor_checkGPU(state, 2, self, src));
+  if (!THClTensor_reduceDim(state, self, src, CopyOp(), TensorAddReduceOp(), 0.0f, dimension)) {
+    THArgCheck(false, 2, CLTORCH_DIM_WARNING);
+  }
 }
 
 void THClTensor_prod(THClState* state, THClTensor *self, THClTensor *src, long dimension)
 {
-//  THAssert(THClTensor_checkGPU(state, 2, self, src));
-//  THClTensor_reduceDim(
-//    state, self, src,
-//    thrust::identity<float>(), thrust::multiplies<float>(), 1.0f, dimension);
-
-//  THClCheck(cudaGetLastError());
-    THError("Not implemented");
-//    return 0;
+  THAssert(THClTensor_checkGPU(state, 2, self, src));
+  if (!THClTensor_reduceDim(state, self, src, CopyOp(), TensorMulReduceOp(), 1.0f, dimension)) {
+    THArgCheck(false, 2, CLTORCH_DIM_WARNING);
+  }
 }
 
-//struct logicalall_functor
-//{
-//  __host__ __device__ float operator()(const float& x, const float& y) const
-//  {
-//    return x && y;
-//  }
-//};
+// the indices are floats, so they go through a float temporary if the
+// tensor given for them isn't one
+static void THClTensor_reduceDimIndexOrError(THClState *state, THClTensor *values, THClTensor *indices,
+    THClTensor *src, const HasOperator3 &compareOp, long dimension)
+{
+  THArgCheck(dimension >= 0 && dimension < THClTensor_nDimension(state, src), 4, "dimension out of range");
+  THArgCheck(THClTensor_size(state, src, dimension) <= (1l << 24), 3, "dimension too large to index");
+  bool direct = indices->storage == 0 || indices->storage->dataType == THCL_FLOAT;
+  THClTensor *indicesf = direct ? indices : THClTensor_new(state);
+  bool ok = THClTensor_reduceDimIndex(state, values, indicesf, src, CopyOp(), compareOp, dimension);
+  if (!direct) {
+    if (ok) {
+      THClTensor_resizeAs(state, indices, indicesf);
+      THClTensor_copy(state, indices, indicesf);
+    }
+    THClTensor_free(state, indicesf);
+  }
+  if (!ok) {
+    THArgCheck(false, 2, CLTORCH_DIM_WARNING);
+  }
+}
 
-//struct logicalany_functor
-//{
-//  __host__ __device__ float operator()(const float& x, const float& y) const
-//  {
-//    return x || y;
-//  }
-//};
+void THClTensor_min(THClState *state, THClTensor *values, THClTensor *indices, THClTensor *src, long dimension)
+{
+  THAssert(THClTensor_checkGPU(state, 3, values, indices, src));
+  THClTensor_reduceDimIndexOrError(state, values, indices, src, TensorMinIndexOp(), dimension);
+}
 
-int THClTensor_logicalall(THClState *state, THClTensor *self) {
-//  THAssert(THClTensor_checkGPU(state, 1, self));
-//  self = THClTensor_newContiguous(state, self);
-//  thrust::device_ptr<float> self_data(THClTensor_data(state, self));
+void THClTensor_max(THClState *state, THClTensor *values, THClTensor *indices, THClTensor *src, long dimension)
+{
+  THAssert(THClTensor_checkGPU(state, 3, values, indices, src));
+  THClTensor_reduceDimIndexOrError(state, values, indices, src, TensorMaxIndexOp(), dimension);
+}
 
-//  int result = thrust::reduce(self_data, self_data+THClTensor_nElement(state, self), (float)(1), logicalall_functor());
+void THClTensor_cumsum(THClState *state, THClTensor *self, THClTensor *src, long dimension)
+{
+  THAssert(THClTensor_checkGPU(state, 2, self, src));
+  if (!THClTensor_scanDim(state, self, src, dimension, TensorAddReduceOp(), 0.0f)) {
+    THArgCheck(false, 2, CLTORCH_DIM_WARNING);
+  }
+}
 
-//  THClTensor_free(state, self);
-//  return result;
-    THError("Not implemented");
-    return 0;
+void THClTensor_cumprod(THClState *state, THClTensor *self, THClTensor *src, long dimension)
+{
+  THAssert(THClTensor_checkGPU(state, 2, self, src));
+  if (!THClTensor_scanDim(state, self, src, dimension, TensorMulReduceOp(), 1.0f)) {
+    THArgCheck(false, 2, CLTORCH_DIM_WARNING);
+  }
 }
 
-int THClTensor_logicalany(THClState *state, THClTensor *self) {
-//  THAssert(THClTensor_checkGPU(state, 1, self));
-//  self = THClTensor_newContiguous(state, self);
-//  thrust::device_ptr<float> self_data(THClTensor_data(state, self));
+class TensorNonZeroOp : public HasOperator2 {
+public:
+  string operator2() const {
+    return "*out = *in1 != 0";
+  }
+};
 
-//  int result = thrust::reduce(self_data, self_data+THClTensor_nElement(state, self), (float)(0), logicalany_functor());
+int THClTensor_logicalall(THClState *state, THClTensor *self) {
+  THAssert(THClTensor_checkGPU(state, 1, self));
+  float result;
+  if (!THClTensor_reduceAll(state, self, TensorNonZeroOp(), TensorMinReduceOp(), 1.0f, &result)) {
+    THArgCheck(false, 1, CLTORCH_DIM_WARNING);
+  }
+  return result != 0;
+}
 
-//  THClTensor_free(state, self);
-//  return result;
-    THError("Not implemented");
-    return 0;
+int THClTensor_logicalany(THClState *state, THClTensor *self) {
+  THAssert(THClTensor_checkGPU(state, 1, self));
+  float result;
+  if (!THClTensor_reduceAll(state, self, TensorNonZeroOp(), TensorMaxReduceOp(), 0.0f, &result)) {
+    THArgCheck(false, 1, CLTORCH_DIM_WARNING);
+  }
+  return result != 0;
 }
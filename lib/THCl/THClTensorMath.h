@@ -15,8 +15,20 @@ THCL_API long THClTensor_numel(THClState *state, THClTensor *t);
 THCL_API void THClTensor_add(THClState *state, THClTensor *self, THClTensor *src, float value);
 THCL_API void THClTensor_mul(THClState *state, THClTensor *self, THClTensor *src, float value);
 THCL_API void THClTensor_div(THClState *state, THClTensor *self, THClTensor *src, float value);
+// self = value - src
+THCL_API void THClTensor_rsub(THClState *state, THClTensor *self, THClTensor *src, float value);
 
 
+// Pointwise ops given as OpenCL C, eg "*out = *in1 > 0 ? *in1 : val1 * *in1".
+// self is *out, src1 and src2 are *in1 and *in2, and scalars are val1,
+// val2, ...  Kernels are built once per operation and tensor layout.
+THCL_API void THClTensor_map(THClState *state, THClTensor *self, const char *operation,
+  int numScalars, const float *scalars);
+THCL_API void THClTensor_map2(THClState *state, THClTensor *self, THClTensor *src, const char *operation,
+  int numScalars, const float *scalars);
+THCL_API void THClTensor_map3(THClState *state, THClTensor *self, THClTensor *src1, THClTensor *src2,
+  const char *operation, int numScalars, const float *scalars);
+
 THCL_API void THClTensor_cadd(THClState *state, THClTensor *self, THClTensor *src1, float value, THClTensor *src2);
 THCL_API void THClTensor_cmul(THClState *state, THClTensor *self, THClTensor *src1, THClTensor *src2);
 THCL_API void THClTensor_cpow(THClState *state, THClTensor *self, THClTensor *src1, THClTensor *src2);
@@ -92,6 +104,11 @@ THCL_API void  THClTensor_norm(THClState *state, THClTensor* self, THClTensor* s
 THCL_API void  THClTensor_renorm(THClState *state, THClTensor* self, THClTensor* src, float value, long dimension, float max_norm);
 THCL_API float THClTensor_dist(THClState *state, THClTensor *self, THClTensor *src, float value);
 
+THCL_API void THClTensor_softmax(THClState *state, THClTensor *output, THClTensor *input);
+THCL_API void THClTensor_logSoftmax(THClState *state, THClTensor *output, THClTensor *input);
+THCL_API void THClTensor_softmaxBackward(THClState *state, THClTensor *gradInput, THClTensor *gradOutput, THClTensor *output);
+THCL_API void THClTensor_logSoftmaxBackward(THClState *state, THClTensor *gradInput, THClTensor *gradOutput, THClTensor *output);
+
 THCL_API void THClTensor_rand(THClState *state, THClTensor *r_, THLongStorage *size);
 THCL_API void THClTensor_randn(THClState *state, THClTensor *r_, THLongStorage *size);
 
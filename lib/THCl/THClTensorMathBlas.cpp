@@ -113,6 +113,25 @@ void THClTensor_addmv(THClState *state, THClTensor *r_, float beta, THClTensor *
 //  THError("Not implemented");
 }
 
+static bool THClTensor_isNarrow(THClTensor *self)
+{
+  return self->storage != NULL && self->storage->dataType != THCL_FLOAT;
+}
+
+// clBLAS only does float, so half and byte operands are widened into float
+// temporaries on the device first
+static THClTensor *THClTensor_newFloat(THClState *state, THClTensor *self)
+{
+  if(!THClTensor_isNarrow(self)) {
+    THClTensor_retain(state, self);
+    return self;
+  }
+  THClTensor *selff = THClTensor_new(state);
+  THClTensor_resizeAs(state, selff, self);
+  THClTensor_copy(state, selff, self);
+  return selff;
+}
+
 void THClTensor_addmm(THClState *state, THClTensor *r_, float beta, THClTensor *t, float alpha, THClTensor *m1, THClTensor *m2)
 {
 //  throw runtime_error("foo");
@@ -120,6 +139,30 @@ void THClTensor_addmm(THClState *state, THClTensor *r_, float beta, THClTensor *
   char transpose_r, transpose_m1, transpose_m2;
   THClTensor *r__, *m1_, *m2_;
 
+  if(THClTensor_isNarrow(r_) || THClTensor_isNarrow(t) || THClTensor_isNarrow(m1) || THClTensor_isNarrow(m2))
+  {
+    THClTensor *tf = THClTensor_newFloat(state, t);
+    THClTensor *m1f = THClTensor_newFloat(state, m1);
+    THClTensor *m2f = THClTensor_newFloat(state, m2);
+    THClTensor *rf = r_;
+    if(r_ == t)
+      rf = tf;
+    else if(THClTensor_isNarrow(r_))
+      rf = THClTensor_new(state);
+    THClTensor_addmm(state, rf, beta, tf, alpha, m1f, m2f);
+    if(rf != r_)
+    {
+      THClTensor_resizeAs(state, r_, rf);
+      THClTensor_copy(state, r_, rf);
+      if(rf != tf)
+        THClTensor_free(state, rf);
+    }
+    THClTensor_free(state, tf);
+    THClTensor_free(state, m1f);
+    THClTensor_free(state, m2f);
+    return;
+  }
+
   if( (m1->nDimension != 2) || (m2->nDimension != 2) )
     THError("matrix and matrix expected");
 
@@ -17,8 +17,7 @@ using namespace std;
 template<class Op>
 void THClTensor_logicalTensor(THClState *state, THClTensor *self_, THClTensor *src1, THClTensor *src2, Op op)
 {
-  THClTensor_resizeAs(state, self_, src1);
-  THArgCheck(THClTensor_nElement(state, src1) == THClTensor_nElement(state, src2), 3, "sizes do not match");
+  THClTensor_resizeBroadcast(state, self_, src1, src2);
 
   if (!THClTensor_pointwiseApply3(state, self_, src1, src2, op)) {
     THArgCheck(false, 2, CLTORCH_DIM_WARNING);
@@ -77,6 +77,35 @@ void THClTensor_mul(THClState *state, THClTensor *self_, THClTensor *src_, float
 //  THClCheck(cudaGetLastError());
 }
 
+class TensorRSubConstantOp : public HasOperator2, public HasOperator1, public HasScalars {
+public:
+  int getNumScalars() const { return 1; }
+  float getScalar( int index ) const { return val; }
+  TensorRSubConstantOp(float v) : val(v) {}
+  string operator2() const {
+    return "*out = val1 - *in1";
+  }
+  string operator1() const {
+    return "*out = val1 - *out";
+  }
+  const float val;
+};
+void THClTensor_rsub(THClState *state, THClTensor *self_, THClTensor *src_, float value)
+{
+  THAssert(THClTensor_checkGPU(state, 2, self_, src_));
+  if (self_ == src_) {
+    if (!THClTensor_pointwiseApply1(state, self_, TensorRSubConstantOp(value))) {
+      THArgCheck(false, 2, CLTORCH_DIM_WARNING);
+    }
+  } else {
+    THClTensor_resizeAs(state, self_, src_);
+
+    if (!THClTensor_pointwiseApply2(state, self_, src_, TensorRSubConstantOp(value))) {
+      THArgCheck(false, 2, CLTORCH_DIM_WARNING);
+    }
+  }
+}
+
 void THClTensor_div(THClState* state, THClTensor *self_, THClTensor *src_, float value)
 {
   THAssert(THClTensor_checkGPU(state, 2, self_, src_));
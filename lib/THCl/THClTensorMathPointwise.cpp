@@ -81,7 +81,7 @@ public:
         return "*out += val1 * *in1";
     }
     std::string operator3() const {
-        return "*out += *in1 + val1 * *in2";
+        return "*out = *in1 + val1 * *in2";
     }
   float val;
 };
@@ -89,8 +89,7 @@ public:
 void THClTensor_cadd(THClState *state, THClTensor *self_, THClTensor* src1, float value, THClTensor *src2)
 {
   THAssert(THClTensor_checkGPU(state, 3, self_, src1, src2));
-  THArgCheck(THClTensor_nElement(state, src1) ==
-             THClTensor_nElement(state, src2), 3, "sizes do not match");
+  THClTensor_resizeBroadcast(state, self_, src1, src2);
 
   if (self_ == src1) {
     if (value == 1.0f) {
@@ -105,8 +104,6 @@ void THClTensor_cadd(THClState *state, THClTensor *self_, THClTensor* src1, floa
       }
     }
   } else {
-    THClTensor_resizeAs(state, self_, src1);
-
     if (value == 1.0f) {
       // self = src1 + src2
       if (!THClTensor_pointwiseApply3(state, self_, src1, src2, TensorAddOp())) {
@@ -134,8 +131,7 @@ public:
 void THClTensor_cmul(THClState *state, THClTensor *self_, THClTensor *src1, THClTensor *src2)
 {
   THAssert(THClTensor_checkGPU(state, 3, self_, src1, src2));
-  THArgCheck(THClTensor_nElement(state, src1) ==
-             THClTensor_nElement(state, src2), 3, "sizes do not match");
+  THClTensor_resizeBroadcast(state, self_, src1, src2);
 
   if (self_ == src1) {
     // self *= src2
@@ -143,8 +139,6 @@ void THClTensor_cmul(THClState *state, THClTensor *self_, THClTensor *src1, THCl
       THArgCheck(false, 2, CLTORCH_DIM_WARNING);
     }
   } else {
-    THClTensor_resizeAs(state, self_, src1);
-
     // self = src1 * src2
     if (!THClTensor_pointwiseApply3(state, self_, src1, src2, TensorMulOp())) {
       THArgCheck(false, 2, CLTORCH_DIM_WARNING);
@@ -152,3 +146,52 @@ void THClTensor_cmul(THClState *state, THClTensor *self_, THClTensor *src1, THCl
   }
 }
 
+class TensorMapOp : public HasOperator1, public HasOperator2, public HasOperator3, public HasScalars {
+public:
+  TensorMapOp(const char *operation, int numScalars, const float *scalars) :
+    operation(operation), scalars(scalars, scalars + numScalars) {}
+  int getNumScalars() const { return (int)scalars.size(); }
+  float getScalar(int index) const { return scalars[index]; }
+  std::string operator1() const {
+    return operation;
+  }
+  std::string operator2() const {
+    return operation;
+  }
+  std::string operator3() const {
+    return operation;
+  }
+  std::string operation;
+  std::vector<float> scalars;
+};
+
+void THClTensor_map(THClState *state, THClTensor *self_, const char *operation, int numScalars, const float *scalars)
+{
+  THAssert(THClTensor_checkGPU(state, 1, self_));
+  THArgCheck(numScalars >= 0, 3, "invalid number of scalars");
+  if (!THClTensor_pointwiseApply1(state, self_, TensorMapOp(operation, numScalars, scalars))) {
+    THArgCheck(false, 2, CLTORCH_DIM_WARNING);
+  }
+}
+
+void THClTensor_map2(THClState *state, THClTensor *self_, THClTensor *src, const char *operation, int numScalars, const float *scalars)
+{
+  THAssert(THClTensor_checkGPU(state, 2, self_, src));
+  THArgCheck(THClTensor_nElement(state, self_) == THClTensor_nElement(state, src) ||
+             THClTensor_canExpandAs(state, src, self_), 3, "sizes do not match");
+  if (!THClTensor_pointwiseApply2(state, self_, src, TensorMapOp(operation, numScalars, scalars))) {
+    THArgCheck(false, 2, CLTORCH_DIM_WARNING);
+  }
+}
+
+void THClTensor_map3(THClState *state, THClTensor *self_, THClTensor *src1, THClTensor *src2, const char *operation, int numScalars, const float *scalars)
+{
+  THAssert(THClTensor_checkGPU(state, 3, self_, src1, src2));
+  THArgCheck(THClTensor_nElement(state, self_) == THClTensor_nElement(state, src1) ||
+             THClTensor_canExpandAs(state, src1, self_), 3, "sizes do not match");
+  THArgCheck(THClTensor_nElement(state, self_) == THClTensor_nElement(state, src2) ||
+             THClTensor_canExpandAs(state, src2, self_), 4, "sizes do not match");
+  if (!THClTensor_pointwiseApply3(state, self_, src1, src2, TensorMapOp(operation, numScalars, scalars))) {
+    THArgCheck(false, 2, CLTORCH_DIM_WARNING);
+  }
+}
@@ -0,0 +1,391 @@
+#include <string>
+#include <cmath>
+#include <cstdio>
+#include "THClTensorMath.h"
+#include "THClGeneral.h"
+#include "THClTensorCopy.h"
+#include "THClApply.h"
+#include "THClReduce.h"
+#include "THClGraph.h"
+#include "THClProfiler.h"
+#include "THClPrecompile.h"
+#include "EasyCL.h"
+#include "templates/TemplatedKernel.h"
+
+using namespace std;
+
+#ifndef DIVUP
+#define DIVUP(x, y) (((x) + (y) - 1) / (y))
+#endif
+
+// number of work groups in the first pass of dist
+#define THCL_NORM_DIST_GROUPS 64
+// groups go round the slices until they're done, beyond this many
+#define THCL_NORM_MAX_GROUPS 65536
+
+static std::string getNorm_template();
+
+// p = 0, 1, 2 and inf get their own cases, without pow: see THClNorm.cl
+enum { THCL_NORM_NONZERO = 0, THCL_NORM_L1 = 1, THCL_NORM_L2 = 2, THCL_NORM_INF = 3, THCL_NORM_P = 4 };
+
+static int THClNorm_pCase(float p)
+{
+  if (p == 0) {
+    return THCL_NORM_NONZERO;
+  } else if (p == 1) {
+    return THCL_NORM_L1;
+  } else if (p == 2) {
+    return THCL_NORM_L2;
+  } else if (std::isinf(p) && p > 0) {
+    return THCL_NORM_INF;
+  }
+  return THCL_NORM_P;
+}
+
+// p as an OpenCL float literal, eg "2.5f"
+static string THClNorm_literal(float p)
+{
+  char buffer[32];
+  snprintf(buffer, sizeof(buffer), "%.9g", p);
+  string literal(buffer);
+  if (literal.find_first_of(".e") == string::npos) {
+    literal += ".0";
+  }
+  return literal + "f";
+}
+
+// the term each element adds to the norm, as the reduce engine's modifyOp
+class TensorNormTermOp : public HasOperator2 {
+public:
+  TensorNormTermOp(float p) : p(p), pCase(THClNorm_pCase(p)) {}
+  string operator2() const {
+    switch (pCase) {
+      case THCL_NORM_NONZERO: return "*out = *in1 != 0";
+      case THCL_NORM_L2: return "*out = *in1 * *in1";
+      case THCL_NORM_P: return "*out = pow(fabs(*in1), " + THClNorm_literal(p) + ")";
+      default: return "*out = fabs(*in1)";
+    }
+  }
+  const float p;
+  const int pCase;
+};
+
+// takes the folded terms to the norm
+class TensorNormRootOp : public HasOperator1, public HasScalars {
+public:
+  int getNumScalars() const { return 1; }
+  float getScalar(int index) const { return 1 / p; }
+  TensorNormRootOp(float p) : p(p) {}
+  string operator1() const {
+    return p == 2 ? "*out = sqrt(*out)" : "*out = pow(*out, val1)";
+  }
+  const float p;
+};
+
+static float THClNorm_root(float acc, float p)
+{
+  switch (THClNorm_pCase(p)) {
+    case THCL_NORM_L2: return sqrt(acc);
+    case THCL_NORM_P: return pow(acc, 1 / p);
+    default: return acc;
+  }
+}
+
+static bool THClNorm_needsRoot(float p)
+{
+  int pCase = THClNorm_pCase(p);
+  return pCase == THCL_NORM_L2 || pCase == THCL_NORM_P;
+}
+
+float THClTensor_normall(THClState *state, THClTensor *self, float value)
+{
+  THAssert(THClTensor_checkGPU(state, 1, self));
+  TensorAddReduceOp addOp;
+  TensorMaxReduceOp maxOp;
+  const HasOperator3 &reduceOp = THClNorm_pCase(value) == THCL_NORM_INF ?
+    (const HasOperator3 &)maxOp : (const HasOperator3 &)addOp;
+  float result;
+  if (!THClTensor_reduceAll(state, self, TensorNormTermOp(value), reduceOp, 0.0f, &result)) {
+    THArgCheck(false, 1, CLTORCH_DIM_WARNING);
+  }
+  return THClNorm_root(result, value);
+}
+
+void THClTensor_norm(THClState *state, THClTensor* self, THClTensor* src, float value, long dimension)
+{
+  THAssert(THClTensor_checkGPU(state, 2, self, src));
+  THArgCheck(dimension >= 0 && dimension < THClTensor_nDimension(state, src), 4, "dimension out of range");
+  TensorAddReduceOp addOp;
+  TensorMaxReduceOp maxOp;
+  const HasOperator3 &reduceOp = THClNorm_pCase(value) == THCL_NORM_INF ?
+    (const HasOperator3 &)maxOp : (const HasOperator3 &)addOp;
+  if (!THClTensor_reduceDim(state, self, src, TensorNormTermOp(value), reduceOp, 0.0f, dimension)) {
+    THArgCheck(false, 2, CLTORCH_DIM_WARNING);
+  }
+  // the root only touches the reduced tensor
+  if (THClNorm_needsRoot(value) && !THClTensor_pointwiseApply1(state, self, TensorNormRootOp(value))) {
+    THArgCheck(false, 2, CLTORCH_DIM_WARNING);
+  }
+}
+
+static CLKernel *THClNorm_getKernel(THClState *state, const char *kernelName)
+{
+  TemplatedKernel kernelBuilder(state->cl);
+  kernelBuilder.set("MAX_CLTORCH_DIMS", MAX_CLTORCH_DIMS);
+  return THClKernel_build(state, kernelBuilder, kernelName, "THClNorm.cl", getNorm_template(), kernelName);
+}
+
+// the largest power of two up to 256 that the device takes as a work group
+static int THClNorm_groupSize(THClState *state)
+{
+  int maxWorkgroupSize = (int)state->cl->getMaxWorkgroupSize();
+  int groupSize = 256;
+  while (groupSize > maxWorkgroupSize) {
+    groupSize >>= 1;
+  }
+  return groupSize;
+}
+
+// the kernels work in float, so other types go through a float copy
+static THClTensor *THClNorm_newFloat(THClState *state, THClTensor *self)
+{
+  if (self->storage == 0 || self->storage->dataType == THCL_FLOAT) {
+    THClTensor_retain(state, self);
+    return self;
+  }
+  THClTensor *selff = THClTensor_new(state);
+  THClTensor_resizeAs(state, selff, self);
+  THClTensor_copy(state, selff, self);
+  return selff;
+}
+
+static bool THClNorm_fitsKernels(THClState *state, THClTensor *t)
+{
+  return THClTensor_nDimension(state, t) <= MAX_CLTORCH_DIMS && THCL_canUse32BitIndexMath(state, t);
+}
+
+void THClTensor_renorm(THClState *state, THClTensor* self, THClTensor* src, float value, long dimension, float maxnorm)
+{
+  THAssert(THClTensor_checkGPU(state, 2, self, src));
+  THArgCheck(dimension >= 0 && dimension < THClTensor_nDimension(state, src), 3, "invalid dimension");
+  THArgCheck(value > 0, 2, "non-positive-norm not supported");
+  THArgCheck(THClTensor_nDimension(state, src) > 1, 1, "need at least 2 dimensions");
+  THArgCheck(THClNorm_fitsKernels(state, src), 1, CLTORCH_DIM_WARNING);
+
+  if (self != src) {
+    THClTensor_resizeAs(state, self, src);
+    THClTensor_copy(state, self, src);
+  }
+  THClTensor *data = THClNorm_newFloat(state, self);
+  CLKernel *kernel = THClNorm_getKernel(state, "THClNorm_renorm");
+  if (kernel != 0) { // 0 in compile-only mode
+    long numSlices = THClTensor_size(state, data, dimension);
+    long sliceSize = THClTensor_nElement(state, data) / numSlices;
+    // the elements of slice 0; the others are the same, further on
+    TensorInfo<unsigned int> info(state, data, dimension);
+    TensorInfoCl infoCl(info);
+    int groupSize = THClNorm_groupSize(state);
+
+    THClLaunch launch(state, kernel, "THClNorm_renorm");
+    launch.in(1, &infoCl);
+    launch.inout(info.wrapper);
+    launch.in((int)THClTensor_stride(state, data, dimension));
+    launch.in((int)sliceSize);
+    launch.in((int)numSlices);
+    launch.in(value);
+    launch.in(THClNorm_pCase(value));
+    launch.in(maxnorm);
+    launch.localFloats(groupSize);
+    long numGroups = numSlices < THCL_NORM_MAX_GROUPS ? numSlices : THCL_NORM_MAX_GROUPS;
+    cl_event profileBegin = THClProfiler_begin(state);
+    launch.run_1d(numGroups * groupSize, groupSize);
+    THClProfiler_end(state, profileBegin, "THClNorm_renorm",
+      THClProfiler_shapeClass(info.dims, numSlices * sliceSize), numSlices * sliceSize * 2 * sizeof(float));
+  }
+  if (data != self) {
+    THClTensor_copy(state, self, data);
+  }
+  THClTensor_free(state, data);
+}
+
+float THClTensor_dist(THClState *state, THClTensor *self, THClTensor *src, float value)
+{
+  THAssert(THClTensor_checkGPU(state, 2, self, src));
+  long n = THClTensor_nElement(state, self);
+  THArgCheck(THClTensor_nElement(state, src) == n, 2, "sizes do not match");
+  THArgCheck(THClNorm_fitsKernels(state, self), 1, CLTORCH_DIM_WARNING);
+  THArgCheck(THClNorm_fitsKernels(state, src), 2, CLTORCH_DIM_WARNING);
+  if (n == 0) {
+    return 0;
+  }
+  CLKernel *kernel = THClNorm_getKernel(state, "THClNorm_distPartials");
+  if (kernel == 0) { // compile-only
+    return 0;
+  }
+
+  // the difference is taken as the elements are read, so there's no
+  // temporary for it
+  THClTensor *a = THClNorm_newFloat(state, self);
+  THClTensor *b = THClNorm_newFloat(state, src);
+  TensorInfo<unsigned int> aInfo(state, a);
+  TensorInfo<unsigned int> bInfo(state, b);
+  TensorInfoCl aCl(aInfo);
+  TensorInfoCl bCl(bInfo);
+  int groupSize = THClNorm_groupSize(state);
+  long numGroups = DIVUP(n, (long)groupSize);
+  if (numGroups > THCL_NORM_DIST_GROUPS) {
+    numGroups = THCL_NORM_DIST_GROUPS;
+  }
+  THClTensor *partials = THClTensor_newWithSize1d(state, numGroups);
+
+  THClLaunch launch(state, kernel, "THClNorm_distPartials");
+  launch.in(1, &aCl);
+  launch.in(aInfo.wrapper);
+  launch.in(1, &bCl);
+  launch.in(bInfo.wrapper);
+  launch.in((int)n);
+  launch.in(value);
+  launch.in(THClNorm_pCase(value));
+  launch.out(THClTensor_wrapper(state, partials));
+  launch.localFloats(groupSize);
+  cl_event profileBegin = THClProfiler_begin(state);
+  launch.run_1d(numGroups * groupSize, groupSize);
+  THClProfiler_end(state, profileBegin, "THClNorm_distPartials",
+    THClProfiler_shapeClass(aInfo.dims, n), n * 2 * sizeof(float));
+
+  TensorAddReduceOp addOp;
+  TensorMaxReduceOp maxOp;
+  const HasOperator3 &reduceOp = THClNorm_pCase(value) == THCL_NORM_INF ?
+    (const HasOperator3 &)maxOp : (const HasOperator3 &)addOp;
+  float result = 0;
+  bool ok = THClTensor_reduceAll(state, partials, CopyOp(), reduceOp, 0.0f, &result);
+  THClTensor_free(state, partials);
+  THClTensor_free(state, a);
+  THClTensor_free(state, b);
+  THArgCheck(ok, 1, CLTORCH_DIM_WARNING);
+  return THClNorm_root(result, value);
+}
+
+static std::string getNorm_template() {
+    // [[[cog
+    // import stringify
+    // stringify.write_kernel( "kernel", "THClNorm.cl" )
+    // ]]]
+    // generated using cog, from THClNorm.cl:
+    const char * kernelSource =  
+    "// Norm kernels, for renorm and dist\n" 
+    "\n" 
+    "// expected templated values:\n" 
+    "// MAX_CLTORCH_DIMS\n" 
+    "//\n" 
+    "// pCase picks the norm: 0 counts the nonzero elements, 1 sums |x|, 2 sums\n" 
+    "// x^2, 3 takes the largest |x|, and 4 sums |x|^p\n" 
+    "\n" 
+    "// kernel argument that defines tensor layout\n" 
+    "typedef struct TensorInfoCl {\n" 
+    "  int sizes[{{MAX_CLTORCH_DIMS}}];\n" 
+    "  int strides[{{MAX_CLTORCH_DIMS}}];\n" 
+    "  int offset;\n" 
+    "  int dims;\n" 
+    "} TensorInfoCl;\n" 
+    "\n" 
+    "// where element linearId is, from the start of the storage\n" 
+    "int IndexToOffset_999_get(int linearId, global const TensorInfoCl *info) {\n" 
+    "  int offset = info->offset;\n" 
+    "  for (int i = info->dims - 1; i >= 0; --i) {\n" 
+    "    int curDimIndex = linearId % info->sizes[i];\n" 
+    "    offset += curDimIndex * info->strides[i];\n" 
+    "    linearId /= info->sizes[i];\n" 
+    "  }\n" 
+    "  return offset;\n" 
+    "}\n" 
+    "\n" 
+    "// fmax, except that NaNs win, as in TensorMaxReduceOp\n" 
+    "float normMax(float a, float b) {\n" 
+    "  return isnan(a) ? a : (isnan(b) ? b : fmax(a, b));\n" 
+    "}\n" 
+    "\n" 
+    "float normAccumulate(float acc, float x, float p, int pCase) {\n" 
+    "  switch(pCase) {\n" 
+    "    case 0: return acc + (x != 0 ? 1 : 0);\n" 
+    "    case 1: return acc + fabs(x);\n" 
+    "    case 2: return acc + x * x;\n" 
+    "    case 3: return normMax(acc, fabs(x));\n" 
+    "    default: return acc + pow(fabs(x), p);\n" 
+    "  }\n" 
+    "}\n" 
+    "\n" 
+    "float normCombine(float acc1, float acc2, int pCase) {\n" 
+    "  return pCase == 3 ? normMax(acc1, acc2) : acc1 + acc2;\n" 
+    "}\n" 
+    "\n" 
+    "float normFinish(float acc, float p, int pCase) {\n" 
+    "  switch(pCase) {\n" 
+    "    case 2: return sqrt(acc);\n" 
+    "    case 4: return pow(acc, 1 / p);\n" 
+    "    default: return acc;\n" 
+    "  }\n" 
+    "}\n" 
+    "\n" 
+    "// Folds smem[0..get_local_size(0)) into smem[0]\n" 
+    "void normReduceLocal(local float *smem, int pCase) {\n" 
+    "  const int tid = get_local_id(0);\n" 
+    "  const int size = get_local_size(0);\n" 
+    "  barrier(CLK_LOCAL_MEM_FENCE);\n" 
+    "  for (int s = 1; s < size; s <<= 1) {\n" 
+    "    if ((tid % (s << 1)) == 0 && tid + s < size) {\n" 
+    "      smem[tid] = normCombine(smem[tid], smem[tid + s], pCase);\n" 
+    "    }\n" 
+    "    barrier(CLK_LOCAL_MEM_FENCE);\n" 
+    "  }\n" 
+    "}\n" 
+    "\n" 
+    "// A work group per slice: it finds the slice's norm, and if that's over\n" 
+    "// maxnorm, scales the slice down to it, as the CPU does.  info lays out the\n" 
+    "// elements of slice 0; slice i is sliceStride * i further on\n" 
+    "kernel void THClNorm_renorm(global const TensorInfoCl *info, global float *data,\n" 
+    "    int sliceStride, int sliceSize, int numSlices,\n" 
+    "    float p, int pCase, float maxnorm, local float *smem) {\n" 
+    "  const int tid = get_local_id(0);\n" 
+    "  const int size = get_local_size(0);\n" 
+    "  for (int slice = get_group_id(0); slice < numSlices; slice += get_num_groups(0)) {\n" 
+    "    const int base = slice * sliceStride;\n" 
+    "    float acc = 0;\n" 
+    "    for (int j = tid; j < sliceSize; j += size) {\n" 
+    "      acc = normAccumulate(acc, data[base + IndexToOffset_999_get(j, info)], p, pCase);\n" 
+    "    }\n" 
+    "    smem[tid] = acc;\n" 
+    "    normReduceLocal(smem, pCase);\n" 
+    "    const float norm = normFinish(smem[0], p, pCase);\n" 
+    "    if (norm > maxnorm) {\n" 
+    "      const float scale = maxnorm / (norm + 1e-7f);\n" 
+    "      for (int j = tid; j < sliceSize; j += size) {\n" 
+    "        data[base + IndexToOffset_999_get(j, info)] *= scale;\n" 
+    "      }\n" 
+    "    }\n" 
+    "    barrier(CLK_LOCAL_MEM_FENCE);\n" 
+    "  }\n" 
+    "}\n" 
+    "\n" 
+    "// Each block folds the norm terms of a - b, over a strided share of their\n" 
+    "// elements, into partials[block]; they're folded together on the host side\n" 
+    "// with THClTensor_reduceAll\n" 
+    "kernel void THClNorm_distPartials(global const TensorInfoCl *aInfo, global const float *aData,\n" 
+    "    global const TensorInfoCl *bInfo, global const float *bData,\n" 
+    "    int totalElements, float p, int pCase, global float *partials, local float *smem) {\n" 
+    "  float acc = 0;\n" 
+    "  for (int i = get_global_id(0); i < totalElements; i += get_global_size(0)) {\n" 
+    "    const float diff = aData[IndexToOffset_999_get(i, aInfo)] - bData[IndexToOffset_999_get(i, bInfo)];\n" 
+    "    acc = normAccumulate(acc, diff, p, pCase);\n" 
+    "  }\n" 
+    "  smem[get_local_id(0)] = acc;\n" 
+    "  normReduceLocal(smem, pCase);\n" 
+    "  if (get_local_id(0) == 0) {\n" 
+    "    partials[get_group_id(0)] = smem[0];\n" 
+    "  }\n" 
+    "}\n" 
+    "\n" 
+    "";
+    // [[[end]]]
+    return kernelSource;
+}
@@ -0,0 +1,343 @@
+#include <string>
+#include "THClTensorMath.h"
+#include "THClGeneral.h"
+#include "THClTensorCopy.h"
+#include "THClApply.h"
+#include "THClGraph.h"
+#include "THClProfiler.h"
+#include "THClPrecompile.h"
+#include "EasyCL.h"
+#include "templates/TemplatedKernel.h"
+
+using namespace std;
+
+// groups go round the rows until they're done, beyond this many
+#define THCL_SOFTMAX_MAX_GROUPS 65536
+
+static std::string getSoftMax_template();
+
+// Softmax and logSoftmax over the last dimension, and their backward passes,
+// are each one kernel, with a work group per row.  Rows that fit in local
+// memory are read from global memory once; longer ones take two reads, the
+// first finding the max and the sum together by online softmax.
+
+static CLKernel *THClSoftMax_getKernel(THClState *state, int logSoftmax, const char *kernelName)
+{
+  TemplatedKernel kernelBuilder(state->cl);
+  kernelBuilder.set("log_softmax", logSoftmax);
+  string uniqueName = string(kernelName) + "_" + easycl::toString(logSoftmax);
+  return THClKernel_build(state, kernelBuilder, uniqueName, "THClSoftMax.cl", getSoftMax_template(), kernelName);
+}
+
+// a power of two up to 256, and the device's maximum, and not much more
+// than n, so short rows don't leave most of the group idle
+static int THClSoftMax_groupSize(THClState *state, long n)
+{
+  int maxWorkgroupSize = (int)state->cl->getMaxWorkgroupSize();
+  int groupSize = 1;
+  while (groupSize < n && groupSize < 256 && groupSize * 2 <= maxWorkgroupSize) {
+    groupSize <<= 1;
+  }
+  return groupSize;
+}
+
+// contiguous and float, for the kernels
+static THClTensor *THClSoftMax_newContiguousFloat(THClState *state, THClTensor *self)
+{
+  if (self->storage->dataType == THCL_FLOAT) {
+    return THClTensor_newContiguous(state, self);
+  }
+  THClTensor *selff = THClTensor_new(state);
+  THClTensor_resizeAs(state, selff, self);
+  THClTensor_copy(state, selff, self);
+  return selff;
+}
+
+// self, if the kernels can write to it directly, otherwise a contiguous
+// float tensor of its size, for THClSoftMax_freeResult to copy back
+static THClTensor *THClSoftMax_newResult(THClState *state, THClTensor *self)
+{
+  if (self->storage != 0 && self->storage->dataType == THCL_FLOAT && THClTensor_isContiguous(state, self)) {
+    THClTensor_retain(state, self);
+    return self;
+  }
+  THClTensor *result = THClTensor_new(state);
+  THClTensor_resizeAs(state, result, self);
+  return result;
+}
+
+static void THClSoftMax_freeResult(THClState *state, THClTensor *result, THClTensor *self)
+{
+  if (result != self) {
+    THClTensor_copy(state, self, result);
+  }
+  THClTensor_free(state, result);
+}
+
+static void THClSoftMax_checkInput(THClState *state, THClTensor *input, int argNumber)
+{
+  THArgCheck(THClTensor_nDimension(state, input) > 0, argNumber, "empty tensor");
+  THArgCheck(THClTensor_nElement(state, input) < (1l << 31), argNumber, "tensor too large");
+}
+
+static void THClSoftMax_forward(THClState *state, THClTensor *output, THClTensor *input, int logSoftmax)
+{
+  THAssert(THClTensor_checkGPU(state, 2, output, input));
+  THClSoftMax_checkInput(state, input, 2);
+  long n = THClTensor_size(state, input, THClTensor_nDimension(state, input) - 1);
+  long numRows = THClTensor_nElement(state, input) / n;
+
+  THClTensor *inputc = THClSoftMax_newContiguousFloat(state, input);
+  THClTensor_resizeAs(state, output, input);
+  THClTensor *outputc = THClSoftMax_newResult(state, output);
+
+  int groupSize = THClSoftMax_groupSize(state, n);
+  // the row takes up to half of local memory, with the group's scratch
+  long maxLocalRow = (long)state->cl->getLocalMemorySize() / 2 / (long)sizeof(float) - groupSize;
+  bool local = n <= maxLocalRow;
+  const char *kernelName = local ? "THClSoftMax_forwardLocal" : "THClSoftMax_forwardOnline";
+  CLKernel *kernel = THClSoftMax_getKernel(state, logSoftmax, kernelName);
+  if (kernel != 0) { // 0 in compile-only mode
+    THClLaunch launch(state, kernel, kernelName);
+    launch.in((int)n);
+    launch.in((int)numRows);
+    launch.in(inputc->storage->wrapper);
+    launch.in((int)inputc->storageOffset);
+    launch.out(outputc->storage->wrapper);
+    launch.in((int)outputc->storageOffset);
+    launch.localFloats(local ? (int)n : groupSize);
+    launch.localFloats(groupSize);
+    long numGroups = numRows < THCL_SOFTMAX_MAX_GROUPS ? numRows : THCL_SOFTMAX_MAX_GROUPS;
+    cl_event profileBegin = THClProfiler_begin(state);
+    launch.run_1d(numGroups * groupSize, groupSize);
+    THClProfiler_end(state, profileBegin, kernelName, THClProfiler_shapeClass(2, n * numRows),
+      n * numRows * (local ? 2 : 3) * sizeof(float));
+  }
+  THClTensor_free(state, inputc);
+  THClSoftMax_freeResult(state, outputc, output);
+}
+
+static void THClSoftMax_backward(THClState *state, THClTensor *gradInput, THClTensor *gradOutput,
+    THClTensor *output, int logSoftmax)
+{
+  THAssert(THClTensor_checkGPU(state, 3, gradInput, gradOutput, output));
+  THClSoftMax_checkInput(state, output, 3);
+  THArgCheck(THClTensor_nElement(state, gradOutput) == THClTensor_nElement(state, output), 2,
+    "sizes do not match");
+  long n = THClTensor_size(state, output, THClTensor_nDimension(state, output) - 1);
+  long numRows = THClTensor_nElement(state, output) / n;
+
+  THClTensor *gradOutputc = THClSoftMax_newContiguousFloat(state, gradOutput);
+  THClTensor *outputc = THClSoftMax_newContiguousFloat(state, output);
+  THClTensor_resizeAs(state, gradInput, output);
+  THClTensor *gradInputc = THClSoftMax_newResult(state, gradInput);
+
+  CLKernel *kernel = THClSoftMax_getKernel(state, logSoftmax, "THClSoftMax_backward");
+  if (kernel != 0) {
+    int groupSize = THClSoftMax_groupSize(state, n);
+    THClLaunch launch(state, kernel, "THClSoftMax_backward");
+    launch.in((int)n);
+    launch.in((int)numRows);
+    launch.in(gradOutputc->storage->wrapper);
+    launch.in((int)gradOutputc->storageOffset);
+    launch.in(outputc->storage->wrapper);
+    launch.in((int)outputc->storageOffset);
+    launch.out(gradInputc->storage->wrapper);
+    launch.in((int)gradInputc->storageOffset);
+    launch.localFloats(groupSize);
+    long numGroups = numRows < THCL_SOFTMAX_MAX_GROUPS ? numRows : THCL_SOFTMAX_MAX_GROUPS;
+    cl_event profileBegin = THClProfiler_begin(state);
+    launch.run_1d(numGroups * groupSize, groupSize);
+    THClProfiler_end(state, profileBegin, "THClSoftMax_backward", THClProfiler_shapeClass(2, n * numRows),
+      n * numRows * 5 * sizeof(float));
+  }
+  THClTensor_free(state, gradOutputc);
+  THClTensor_free(state, outputc);
+  THClSoftMax_freeResult(state, gradInputc, gradInput);
+}
+
+void THClTensor_softmax(THClState *state, THClTensor *output, THClTensor *input)
+{
+  THClSoftMax_forward(state, output, input, 0);
+}
+
+void THClTensor_logSoftmax(THClState *state, THClTensor *output, THClTensor *input)
+{
+  THClSoftMax_forward(state, output, input, 1);
+}
+
+void THClTensor_softmaxBackward(THClState *state, THClTensor *gradInput, THClTensor *gradOutput, THClTensor *output)
+{
+  THClSoftMax_backward(state, gradInput, gradOutput, output, 0);
+}
+
+void THClTensor_logSoftmaxBackward(THClState *state, THClTensor *gradInput, THClTensor *gradOutput, THClTensor *output)
+{
+  THClSoftMax_backward(state, gradInput, gradOutput, output, 1);
+}
+
+static std::string getSoftMax_template() {
+    // [[[cog
+    // import stringify
+    // stringify.write_kernel( "kernel", "THClSoftMax.cl" )
+    // ]]]
+    // generated using cog, from THClSoftMax.cl:
+    const char * kernelSource =  
+    "// Softmax kernels, over rows: n contiguous floats each, from an offset\n" 
+    "//\n" 
+    "// expected templated values:\n" 
+    "// log_softmax: 1 for logSoftmax, 0 for softmax\n" 
+    "//\n" 
+    "// The work group size has to be a power of two\n" 
+    "\n" 
+    "// value folded over the work group, by max if isMax, otherwise by sum; every\n" 
+    "// thread gets the result\n" 
+    "float groupReduce(float value, local float *smem, int isMax) {\n" 
+    "  const int tid = get_local_id(0);\n" 
+    "  smem[tid] = value;\n" 
+    "  for (int s = get_local_size(0) >> 1; s > 0; s >>= 1) {\n" 
+    "    barrier(CLK_LOCAL_MEM_FENCE);\n" 
+    "    if (tid < s) {\n" 
+    "      smem[tid] = isMax ? fmax(smem[tid], smem[tid + s]) : smem[tid] + smem[tid + s];\n" 
+    "    }\n" 
+    "  }\n" 
+    "  barrier(CLK_LOCAL_MEM_FENCE);\n" 
+    "  const float result = smem[0];\n" 
+    "  barrier(CLK_LOCAL_MEM_FENCE);\n" 
+    "  return result;\n" 
+    "}\n" 
+    "\n" 
+    "// Online softmax: (max, sum) is a running max of some values, and the sum of\n" 
+    "// their exps relative to it.  This merges (max2, sum2) into it, rescaling\n" 
+    "// whichever sum has the smaller max\n" 
+    "void onlineMerge(float max2, float sum2, float *max, float *sum) {\n" 
+    "  if (max2 == -INFINITY) {\n" 
+    "    return;\n" 
+    "  }\n" 
+    "  if (*max == -INFINITY) {\n" 
+    "    *max = max2;\n" 
+    "    *sum = sum2;\n" 
+    "    return;\n" 
+    "  }\n" 
+    "  const float newMax = fmax(*max, max2);\n" 
+    "  *sum = *sum * exp(*max - newMax) + sum2 * exp(max2 - newMax);\n" 
+    "  *max = newMax;\n" 
+    "}\n" 
+    "\n" 
+    "// A work group per row, for rows that fit in local memory: the row is read\n" 
+    "// from global memory once, and the max, the sum and the output come from\n" 
+    "// the copy in local memory\n" 
+    "kernel void THClSoftMax_forwardLocal(int n, int numRows, global const float *in, int inOffset,\n" 
+    "    global float *out, int outOffset, local float *row, local float *smem) {\n" 
+    "  const int tid = get_local_id(0);\n" 
+    "  const int size = get_local_size(0);\n" 
+    "  for (int r = get_group_id(0); r < numRows; r += get_num_groups(0)) {\n" 
+    "    global const float *inRow = in + inOffset + r * n;\n" 
+    "    global float *outRow = out + outOffset + r * n;\n" 
+    "    // each thread only touches its own elements of row, so it needs no\n" 
+    "    // barriers of its own\n" 
+    "    float max = -INFINITY;\n" 
+    "    for (int i = tid; i < n; i += size) {\n" 
+    "      const float value = inRow[i];\n" 
+    "      row[i] = value;\n" 
+    "      max = fmax(max, value);\n" 
+    "    }\n" 
+    "    max = groupReduce(max, smem, 1);\n" 
+    "    float sum = 0;\n" 
+    "    for (int i = tid; i < n; i += size) {\n" 
+    "      sum += exp(row[i] - max);\n" 
+    "    }\n" 
+    "    sum = groupReduce(sum, smem, 0);\n" 
+    "    {% if log_softmax == 1 then %}\n" 
+    "    const float logSum = max + log(sum);\n" 
+    "    for (int i = tid; i < n; i += size) {\n" 
+    "      outRow[i] = row[i] - logSum;\n" 
+    "    }\n" 
+    "    {% else %}\n" 
+    "    const float scale = 1.0f / sum;\n" 
+    "    for (int i = tid; i < n; i += size) {\n" 
+    "      outRow[i] = exp(row[i] - max) * scale;\n" 
+    "    }\n" 
+    "    {% end %}\n" 
+    "  }\n" 
+    "}\n" 
+    "\n" 
+    "// A work group per row, for longer rows: the first pass finds the max and\n" 
+    "// the sum together, by online softmax, and the second writes the output\n" 
+    "kernel void THClSoftMax_forwardOnline(int n, int numRows, global const float *in, int inOffset,\n" 
+    "    global float *out, int outOffset, local float *smemMax, local float *smemSum) {\n" 
+    "  const int tid = get_local_id(0);\n" 
+    "  const int size = get_local_size(0);\n" 
+    "  for (int r = get_group_id(0); r < numRows; r += get_num_groups(0)) {\n" 
+    "    global const float *inRow = in + inOffset + r * n;\n" 
+    "    global float *outRow = out + outOffset + r * n;\n" 
+    "    float max = -INFINITY;\n" 
+    "    float sum = 0;\n" 
+    "    for (int i = tid; i < n; i += size) {\n" 
+    "      onlineMerge(inRow[i], 1.0f, &max, &sum);\n" 
+    "    }\n" 
+    "    smemMax[tid] = max;\n" 
+    "    smemSum[tid] = sum;\n" 
+    "    for (int s = size >> 1; s > 0; s >>= 1) {\n" 
+    "      barrier(CLK_LOCAL_MEM_FENCE);\n" 
+    "      if (tid < s) {\n" 
+    "        float mergedMax = smemMax[tid];\n" 
+    "        float mergedSum = smemSum[tid];\n" 
+    "        onlineMerge(smemMax[tid + s], smemSum[tid + s], &mergedMax, &mergedSum);\n" 
+    "        smemMax[tid] = mergedMax;\n" 
+    "        smemSum[tid] = mergedSum;\n" 
+    "      }\n" 
+    "    }\n" 
+    "    barrier(CLK_LOCAL_MEM_FENCE);\n" 
+    "    max = smemMax[0];\n" 
+    "    sum = smemSum[0];\n" 
+    "    barrier(CLK_LOCAL_MEM_FENCE);\n" 
+    "    {% if log_softmax == 1 then %}\n" 
+    "    const float logSum = max + log(sum);\n" 
+    "    for (int i = tid; i < n; i += size) {\n" 
+    "      outRow[i] = inRow[i] - logSum;\n" 
+    "    }\n" 
+    "    {% else %}\n" 
+    "    const float scale = 1.0f / sum;\n" 
+    "    for (int i = tid; i < n; i += size) {\n" 
+    "      outRow[i] = exp(inRow[i] - max) * scale;\n" 
+    "    }\n" 
+    "    {% end %}\n" 
+    "  }\n" 
+    "}\n" 
+    "\n" 
+    "// A work group per row: gradInput from gradOutput and the forward output.\n" 
+    "// For softmax, gradInput = output * (gradOutput - sum(gradOutput * output));\n" 
+    "// for logSoftmax, gradInput = gradOutput - exp(output) * sum(gradOutput)\n" 
+    "kernel void THClSoftMax_backward(int n, int numRows, global const float *gradOutput, int gradOutputOffset,\n" 
+    "    global const float *output, int outputOffset, global float *gradInput, int gradInputOffset,\n" 
+    "    local float *smem) {\n" 
+    "  const int tid = get_local_id(0);\n" 
+    "  const int size = get_local_size(0);\n" 
+    "  for (int r = get_group_id(0); r < numRows; r += get_num_groups(0)) {\n" 
+    "    global const float *gradOutputRow = gradOutput + gradOutputOffset + r * n;\n" 
+    "    global const float *outputRow = output + outputOffset + r * n;\n" 
+    "    global float *gradInputRow = gradInput + gradInputOffset + r * n;\n" 
+    "    float sum = 0;\n" 
+    "    for (int i = tid; i < n; i += size) {\n" 
+    "      {% if log_softmax == 1 then %}\n" 
+    "      sum += gradOutputRow[i];\n" 
+    "      {% else %}\n" 
+    "      sum += gradOutputRow[i] * outputRow[i];\n" 
+    "      {% end %}\n" 
+    "    }\n" 
+    "    sum = groupReduce(sum, smem, 0);\n" 
+    "    for (int i = tid; i < n; i += size) {\n" 
+    "      {% if log_softmax == 1 then %}\n" 
+    "      gradInputRow[i] = gradOutputRow[i] - exp(outputRow[i]) * sum;\n" 
+    "      {% else %}\n" 
+    "      gradInputRow[i] = outputRow[i] * (gradOutputRow[i] - sum);\n" 
+    "      {% end %}\n" 
+    "    }\n" 
+    "  }\n" 
+    "}\n" 
+    "\n" 
+    "";
+    // [[[end]]]
+    return kernelSource;
+}
@@ -0,0 +1,612 @@
+#include <string>
+#include "THClTensorSort.h"
+#include "THClTensorMath.h"
+#include "THClTensorCopy.h"
+#include "THClGeneral.h"
+#include "THClGraph.h"
+#include "THClProfiler.h"
+#include "THClPrecompile.h"
+#include "THClScan.h"
+#include "EasyCL.h"
+#include "templates/TemplatedKernel.h"
+
+using namespace std;
+
+#ifndef DIVUP
+#define DIVUP(x, y) (((x) + (y) - 1) / (y))
+#endif
+
+// rows longer than this never go through the bitonic sort, whatever local
+// memory the device has
+#define THCL_SORT_BITONIC_MAX 2048
+// groups go round the rows until they're done, beyond this many
+#define THCL_SORT_MAX_GROUPS 65536
+
+static std::string getSort_template();
+
+// All of it works on rows: the input with the dimension being sorted moved
+// to the end, copied so it's contiguous.  Rows that fit in local memory go
+// through a bitonic sort, a work group each; longer ones go through a radix
+// sort, all the rows together.  topk and kthvalue don't sort the rows, but
+// find the k-th element of each by radix select.  Nothing comes back to the
+// host, so all of them can be captured in a graph.
+
+static CLKernel *THClSort_getKernel(THClState *state, const char *kernelName)
+{
+  TemplatedKernel kernelBuilder(state->cl);
+  return THClKernel_build(state, kernelBuilder, kernelName, "THClSort.cl", getSort_template(), kernelName);
+}
+
+// the largest power of two up to max that the device takes as a work group
+static int THClSort_groupSize(THClState *state, int max)
+{
+  int maxWorkgroupSize = (int)state->cl->getMaxWorkgroupSize();
+  int groupSize = max;
+  while(groupSize > maxWorkgroupSize) {
+    groupSize >>= 1;
+  }
+  return groupSize;
+}
+
+// the longest row the bitonic sort takes: its keys and payloads have to fit
+// in local memory, with half of it to spare
+static long THClSort_bitonicMax(THClState *state)
+{
+  long localMemory = state->cl->getLocalMemorySize();
+  long max = THCL_SORT_BITONIC_MAX;
+  while(max > 1 && max * 2 * (long)sizeof(float) > localMemory / 2) {
+    max >>= 1;
+  }
+  return max;
+}
+
+// input with dim moved to the end, as a new contiguous float tensor
+static THClTensor *THClSort_newRows(THClState *state, THClTensor *input, int dim)
+{
+  THClTensor *transposed = THClTensor_newTranspose(state, input, dim, THClTensor_nDimension(state, input) - 1);
+  THClTensor *rows = THClTensor_new(state);
+  THClTensor_resizeAs(state, rows, transposed);
+  THClTensor_copy(state, rows, transposed);
+  THClTensor_free(state, transposed);
+  return rows;
+}
+
+// a new float tensor the shape of rows, but with rows of length k
+static THClTensor *THClSort_newRowsOfLength(THClState *state, THClTensor *rows, long k)
+{
+  THLongStorage *size = THClTensor_newSizeOf(state, rows);
+  size->data[size->size - 1] = k;
+  THClTensor *result = THClTensor_new(state);
+  THClTensor_resize(state, result, size, NULL);
+  THLongStorage_free(size);
+  return result;
+}
+
+// resizes result to input, with dim of size k, and copies rows into it
+static void THClSort_copyFromRows(THClState *state, THClTensor *result, THClTensor *input, int dim, long k,
+    THClTensor *rows)
+{
+  THLongStorage *size = THClTensor_newSizeOf(state, input);
+  size->data[dim] = k;
+  THClTensor_resize(state, result, size, NULL);
+  THLongStorage_free(size);
+  THClTensor *transposed = THClTensor_newTranspose(state, result, dim, THClTensor_nDimension(state, result) - 1);
+  THClTensor_copy(state, transposed, rows);
+  THClTensor_free(state, transposed);
+}
+
+static void THClSort_bitonic(THClState *state, THClTensor *keys, THClTensor *payload, long n, long numRows,
+    int descending, int initPayload)
+{
+  CLKernel *kernel = THClSort_getKernel(state, "THClSort_bitonic");
+  if(kernel == 0) { // compile-only
+    return;
+  }
+  int sortSize = 2;
+  while(sortSize < n) {
+    sortSize <<= 1;
+  }
+  // a thread per pair compared
+  int groupSize = THClSort_groupSize(state, sortSize / 2 < 256 ? sortSize / 2 : 256);
+  THClLaunch launch(state, kernel, "THClSort_bitonic");
+  launch.in((int)n);
+  launch.in((int)numRows);
+  launch.in(sortSize);
+  launch.in(descending);
+  launch.in(initPayload);
+  launch.inout(keys->storage->wrapper);
+  launch.in((int)keys->storageOffset);
+  launch.inout(payload->storage->wrapper);
+  launch.in((int)payload->storageOffset);
+  launch.localFloats(sortSize);
+  launch.localFloats(sortSize);
+  long numGroups = numRows < THCL_SORT_MAX_GROUPS ? numRows : THCL_SORT_MAX_GROUPS;
+  cl_event profileBegin = THClProfiler_begin(state);
+  launch.run_1d(numGroups * groupSize, groupSize);
+  THClProfiler_end(state, profileBegin, "THClSort_bitonic", THClProfiler_shapeClass(2, n * numRows),
+    n * numRows * 2 * sizeof(float));
+}
+
+static void THClSort_radix(THClState *state, THClTensor *keys, THClTensor *payload, long n, long numRows,
+    int descending, int initPayload)
+{
+  CLKernel *countKernel = THClSort_getKernel(state, "THClSort_radixCount");
+  CLKernel *scatterKernel = THClSort_getKernel(state, "THClSort_radixScatter");
+  if(countKernel == 0 || scatterKernel == 0) {
+    return;
+  }
+  int tileSize = THClSort_groupSize(state, 256);
+  long tilesPerRow = DIVUP(n, (long)tileSize);
+  long numTiles = tilesPerRow * numRows;
+  THArgCheck(numTiles * tileSize < (1l << 31), 2, "tensor too large");
+  long numCounts = numTiles * 16;
+  THClStorage *counts = THClStorage_newWithSize(state, numCounts);
+  THClStorage *total = THClStorage_newWithSize(state, 1);
+  THClStorage *keysSpare = THClStorage_newWithSize(state, n * numRows);
+  THClStorage *payloadSpare = THClStorage_newWithSize(state, n * numRows);
+
+  cl_event profileBegin = THClProfiler_begin(state);
+  // an even number of passes, so the rows end up back where they started
+  for(int pass = 0; pass < 8; pass++) {
+    CLWrapper *keysIn = pass % 2 == 0 ? keys->storage->wrapper : keysSpare->wrapper;
+    CLWrapper *payloadIn = pass % 2 == 0 ? payload->storage->wrapper : payloadSpare->wrapper;
+    CLWrapper *keysOut = pass % 2 == 0 ? keysSpare->wrapper : keys->storage->wrapper;
+    CLWrapper *payloadOut = pass % 2 == 0 ? payloadSpare->wrapper : payload->storage->wrapper;
+    int keysInOffset = pass % 2 == 0 ? (int)keys->storageOffset : 0;
+    int payloadInOffset = pass % 2 == 0 ? (int)payload->storageOffset : 0;
+    int keysOutOffset = pass % 2 == 0 ? 0 : (int)keys->storageOffset;
+    int payloadOutOffset = pass % 2 == 0 ? 0 : (int)payload->storageOffset;
+    int shift = pass * 4;
+
+    THClLaunch count(state, countKernel, "THClSort_radixCount");
+    count.in((int)n);
+    count.in((int)numRows);
+    count.in((int)tilesPerRow);
+    count.in(shift);
+    count.in(descending);
+    count.in(keysIn);
+    count.in(keysInOffset);
+    count.out(counts->wrapper);
+    count.run_1d(numTiles * tileSize, tileSize);
+
+    THClScan_exclusiveSum(state, counts->wrapper, 0, "int", 0, counts->wrapper, numCounts, total->wrapper);
+
+    THClLaunch scatter(state, scatterKernel, "THClSort_radixScatter");
+    scatter.in((int)n);
+    scatter.in((int)numRows);
+    scatter.in((int)tilesPerRow);
+    scatter.in(shift);
+    scatter.in(descending);
+    scatter.in(pass == 0 ? initPayload : 0);
+    scatter.in(keysIn);
+    scatter.in(keysInOffset);
+    scatter.in(payloadIn);
+    scatter.in(payloadInOffset);
+    scatter.out(keysOut);
+    scatter.in(keysOutOffset);
+    scatter.out(payloadOut);
+    scatter.in(payloadOutOffset);
+    scatter.in(counts->wrapper);
+    scatter.localFloats(tileSize);
+    scatter.run_1d(numTiles * tileSize, tileSize);
+  }
+  THClProfiler_end(state, profileBegin, "THClSort_radix", THClProfiler_shapeClass(2, n * numRows),
+    n * numRows * 2 * sizeof(float) * 8 * 2);
+
+  THClStorage_free(state, counts);
+  THClStorage_free(state, total);
+  THClStorage_free(state, keysSpare);
+  THClStorage_free(state, payloadSpare);
+}
+
+// sorts each of the numRows rows of n in keys, contiguous floats, in place,
+// moving payload's along with them; with initPayload, payload's rows start
+// out as the indices
+static void THClSort_rows(THClState *state, THClTensor *keys, THClTensor *payload, long n, long numRows,
+    int descending, int initPayload)
+{
+  if(n * numRows == 0) {
+    return;
+  }
+  if(n <= THClSort_bitonicMax(state)) {
+    THClSort_bitonic(state, keys, payload, n, numRows, descending, initPayload);
+  } else {
+    THClSort_radix(state, keys, payload, n, numRows, descending, initPayload);
+  }
+}
+
+// topk or kthvalue, over each row of rows, into the rows of values and indices
+static void THClSort_select(THClState *state, const char *kernelName, THClTensor *rows, long n, long numRows,
+    long k, int descending, THClTensor *values, THClTensor *indices)
+{
+  bool topk = string(kernelName) == "THClSort_topk";
+  CLKernel *kernel = THClSort_getKernel(state, kernelName);
+  if(kernel == 0) {
+    return;
+  }
+  int groupSize = THClSort_groupSize(state, 256);
+  THClLaunch launch(state, kernel, kernelName);
+  launch.in((int)n);
+  launch.in((int)numRows);
+  launch.in((int)k);
+  if(topk) {
+    launch.in(descending);
+  }
+  launch.in(rows->storage->wrapper);
+  launch.in((int)rows->storageOffset);
+  launch.out(values->storage->wrapper);
+  launch.in((int)values->storageOffset);
+  launch.out(indices->storage->wrapper);
+  launch.in((int)indices->storageOffset);
+  launch.localFloats(groupSize);
+  long numGroups = numRows < THCL_SORT_MAX_GROUPS ? numRows : THCL_SORT_MAX_GROUPS;
+  cl_event profileBegin = THClProfiler_begin(state);
+  launch.run_1d(numGroups * groupSize, groupSize);
+  THClProfiler_end(state, profileBegin, kernelName, THClProfiler_shapeClass(2, n * numRows),
+    n * numRows * sizeof(float) * 9);
+}
+
+static void THClSort_checkInput(THClState *state, THClTensor *input, int dim)
+{
+  THArgCheck(dim >= 0 && dim < THClTensor_nDimension(state, input), 4, "dimension out of range");
+  THArgCheck(THClTensor_nElement(state, input) < (1l << 31), 3, "tensor too large");
+  // so that floats hold every index exactly
+  THArgCheck(THClTensor_size(state, input, dim) <= (1l << 24), 3, "dimension too large to index");
+}
+
+void THClTensor_sort(THClState *state, THClTensor *sorted, THClTensor *indices, THClTensor *input,
+    int dim, int order)
+{
+  THAssert(THClTensor_checkGPU(state, 3, sorted, indices, input));
+  THClSort_checkInput(state, input, dim);
+  long n = THClTensor_size(state, input, dim);
+  long numRows = THClTensor_nElement(state, input) / n;
+
+  THClTensor *rows = THClSort_newRows(state, input, dim);
+  THClTensor *rowIndices = THClSort_newRowsOfLength(state, rows, n);
+  THClSort_rows(state, rows, rowIndices, n, numRows, order, 1);
+  THClSort_copyFromRows(state, sorted, input, dim, n, rows);
+  THClSort_copyFromRows(state, indices, input, dim, n, rowIndices);
+  THClTensor_free(state, rows);
+  THClTensor_free(state, rowIndices);
+}
+
+void THClTensor_topk(THClState *state, THClTensor *topK, THClTensor *indices, THClTensor *input,
+    long k, int dim, int dir, int sorted)
+{
+  THAssert(THClTensor_checkGPU(state, 3, topK, indices, input));
+  THClSort_checkInput(state, input, dim);
+  long n = THClTensor_size(state, input, dim);
+  long numRows = THClTensor_nElement(state, input) / n;
+  THArgCheck(k >= 0 && k <= n, 4, "k not in range for dimension");
+
+  THClTensor *rows = THClSort_newRows(state, input, dim);
+  THClTensor *rowValues = THClSort_newRowsOfLength(state, rows, k);
+  THClTensor *rowIndices = THClSort_newRowsOfLength(state, rows, k);
+  if(k > 0) {
+    THClSort_select(state, "THClSort_topk", rows, n, numRows, k, dir, rowValues, rowIndices);
+    if(sorted && k > 1) {
+      THClSort_rows(state, rowValues, rowIndices, k, numRows, dir, 0);
+    }
+  }
+  THClSort_copyFromRows(state, topK, input, dim, k, rowValues);
+  THClSort_copyFromRows(state, indices, input, dim, k, rowIndices);
+  THClTensor_free(state, rows);
+  THClTensor_free(state, rowValues);
+  THClTensor_free(state, rowIndices);
+}
+
+void THClTensor_kthvalue(THClState *state, THClTensor *values, THClTensor *indices, THClTensor *input,
+    long k, int dim)
+{
+  THAssert(THClTensor_checkGPU(state, 3, values, indices, input));
+  THClSort_checkInput(state, input, dim);
+  long n = THClTensor_size(state, input, dim);
+  long numRows = THClTensor_nElement(state, input) / n;
+  THArgCheck(k >= 1 && k <= n, 4, "k not in range for dimension");
+
+  THClTensor *rows = THClSort_newRows(state, input, dim);
+  THClTensor *rowValues = THClSort_newRowsOfLength(state, rows, 1);
+  THClTensor *rowIndices = THClSort_newRowsOfLength(state, rows, 1);
+  THClSort_select(state, "THClSort_kthvalue", rows, n, numRows, k, 0, rowValues, rowIndices);
+  THClSort_copyFromRows(state, values, input, dim, 1, rowValues);
+  THClSort_copyFromRows(state, indices, input, dim, 1, rowIndices);
+  THClTensor_free(state, rows);
+  THClTensor_free(state, rowValues);
+  THClTensor_free(state, rowIndices);
+}
+
+static std::string getSort_template() {
+    // [[[cog
+    // import stringify
+    // stringify.write_kernel( "kernel", "THClSort.cl" )
+    // ]]]
+    // generated using cog, from THClSort.cl:
+    const char * kernelSource =  
+    "// Sort, topk and kthvalue kernels\n" 
+    "//\n" 
+    "// Each kernel works on rows: n contiguous floats each, from an offset,\n" 
+    "// which the host side gets by moving the dimension being sorted to the end.\n" 
+    "// Indices are floats, counting from 1, like those of max and min\n" 
+    "//\n" 
+    "// positions comes from THClScan_exclusiveSum; it travels in a float wrapper\n" 
+    "// on the host side, so it's just reinterpreted as int here\n" 
+    "\n" 
+    "// Keys as uints that order the same way as the floats, or the other way\n" 
+    "// round if descending.  -0 goes before +0, and NaNs after +inf\n" 
+    "uint sortKey(float value, int descending) {\n" 
+    "  uint key = as_uint(value);\n" 
+    "  key = (key & 0x80000000u) ? ~key : (key | 0x80000000u);\n" 
+    "  return descending ? ~key : key;\n" 
+    "}\n" 
+    "\n" 
+    "float keyValue(uint key, int descending) {\n" 
+    "  key = descending ? ~key : key;\n" 
+    "  key = (key & 0x80000000u) ? (key & 0x7fffffffu) : ~key;\n" 
+    "  return as_float(key);\n" 
+    "}\n" 
+    "\n" 
+    "// whether (key1, payload1) goes after (key2, payload2): by key, then by\n" 
+    "// payload, so rows with their indices as payload sort stably.  The padding\n" 
+    "// has a negative payload, and goes after everything else\n" 
+    "bool sortAfter(uint key1, float payload1, uint key2, float payload2) {\n" 
+    "  if((payload1 < 0) != (payload2 < 0)) {\n" 
+    "    return payload1 < 0;\n" 
+    "  }\n" 
+    "  if(key1 != key2) {\n" 
+    "    return key1 > key2;\n" 
+    "  }\n" 
+    "  return payload1 > payload2;\n" 
+    "}\n" 
+    "\n" 
+    "// exclusive sum of value over the work group; the group's total goes to\n" 
+    "// *total.  Every thread of the group has to call it\n" 
+    "int groupExclusiveSum(int value, local int *scratch, int *total) {\n" 
+    "  const int tid = get_local_id(0);\n" 
+    "  const int size = get_local_size(0);\n" 
+    "  scratch[tid] = value;\n" 
+    "  barrier(CLK_LOCAL_MEM_FENCE);\n" 
+    "  for(int offset = 1; offset < size; offset <<= 1) {\n" 
+    "    int other = tid >= offset ? scratch[tid - offset] : 0;\n" 
+    "    barrier(CLK_LOCAL_MEM_FENCE);\n" 
+    "    scratch[tid] += other;\n" 
+    "    barrier(CLK_LOCAL_MEM_FENCE);\n" 
+    "  }\n" 
+    "  const int inclusive = scratch[tid];\n" 
+    "  *total = scratch[size - 1];\n" 
+    "  barrier(CLK_LOCAL_MEM_FENCE);\n" 
+    "  return inclusive - value;\n" 
+    "}\n" 
+    "\n" 
+    "// A work group per row, sorting it in local memory with a bitonic network,\n" 
+    "// padded out to sortSize, a power of two.  The payload goes along with the\n" 
+    "// keys; with initPayload, it starts as the indices\n" 
+    "kernel void THClSort_bitonic(int n, int numRows, int sortSize, int descending, int initPayload,\n" 
+    "    global float *keys, int keysOffset, global float *payload, int payloadOffset,\n" 
+    "    local float *keySpace, local float *payloadSpace) {\n" 
+    "  local uint *localKeys = (local uint *)keySpace;\n" 
+    "  const int tid = get_local_id(0);\n" 
+    "  const int size = get_local_size(0);\n" 
+    "  for(int row = get_group_id(0); row < numRows; row += get_num_groups(0)) {\n" 
+    "    global float *rowKeys = keys + keysOffset + row * n;\n" 
+    "    global float *rowPayload = payload + payloadOffset + row * n;\n" 
+    "    for(int i = tid; i < sortSize; i += size) {\n" 
+    "      if(i < n) {\n" 
+    "        localKeys[i] = sortKey(rowKeys[i], descending);\n" 
+    "        payloadSpace[i] = initPayload ? (float)(i + 1) : rowPayload[i];\n" 
+    "      } else {\n" 
+    "        localKeys[i] = 0xffffffffu;\n" 
+    "        payloadSpace[i] = -1.0f;\n" 
+    "      }\n" 
+    "    }\n" 
+    "    // blocks of blockSize go alternately up and down, then each merges with\n" 
+    "    // its neighbour into a block of twice the size\n" 
+    "    for(int blockSize = 2; blockSize <= sortSize; blockSize <<= 1) {\n" 
+    "      for(int stride = blockSize >> 1; stride > 0; stride >>= 1) {\n" 
+    "        barrier(CLK_LOCAL_MEM_FENCE);\n" 
+    "        for(int t = tid; t < (sortSize >> 1); t += size) {\n" 
+    "          const int lower = 2 * t - (t & (stride - 1));\n" 
+    "          const int upper = lower + stride;\n" 
+    "          const bool up = (lower & blockSize) == 0;\n" 
+    "          const bool after = sortAfter(localKeys[lower], payloadSpace[lower],\n" 
+    "            localKeys[upper], payloadSpace[upper]);\n" 
+    "          if(after == up) {\n" 
+    "            const uint key = localKeys[lower];\n" 
+    "            const float value = payloadSpace[lower];\n" 
+    "            localKeys[lower] = localKeys[upper];\n" 
+    "            payloadSpace[lower] = payloadSpace[upper];\n" 
+    "            localKeys[upper] = key;\n" 
+    "            payloadSpace[upper] = value;\n" 
+    "          }\n" 
+    "        }\n" 
+    "      }\n" 
+    "    }\n" 
+    "    barrier(CLK_LOCAL_MEM_FENCE);\n" 
+    "    for(int i = tid; i < n; i += size) {\n" 
+    "      rowKeys[i] = keyValue(localKeys[i], descending);\n" 
+    "      rowPayload[i] = payloadSpace[i];\n" 
+    "    }\n" 
+    "    barrier(CLK_LOCAL_MEM_FENCE);\n" 
+    "  }\n" 
+    "}\n" 
+    "\n" 
+    "// Radix sort, for rows too long to sort in local memory: each pass takes\n" 
+    "// four bits of the keys, from the least significant.  A work group per\n" 
+    "// tile of a row counts its digits, into counts laid out by row, then digit,\n" 
+    "// then tile, so that an exclusive sum over all of it gives where each\n" 
+    "// tile's elements of each digit go\n" 
+    "kernel void THClSort_radixCount(int n, int numRows, int tilesPerRow, int shift, int descending,\n" 
+    "    global const float *keys, int keysOffset, global float *countSpace) {\n" 
+    "  global int *counts = (global int *)countSpace;\n" 
+    "  local int hist[16];\n" 
+    "  const int tid = get_local_id(0);\n" 
+    "  const int row = get_group_id(0) / tilesPerRow;\n" 
+    "  const int tile = get_group_id(0) % tilesPerRow;\n" 
+    "  const int i = tile * get_local_size(0) + tid;\n" 
+    "  if(tid < 16) {\n" 
+    "    hist[tid] = 0;\n" 
+    "  }\n" 
+    "  barrier(CLK_LOCAL_MEM_FENCE);\n" 
+    "  if(row < numRows && i < n) {\n" 
+    "    const uint key = sortKey(keys[keysOffset + row * n + i], descending);\n" 
+    "    atomic_inc(&hist[(key >> shift) & 15]);\n" 
+    "  }\n" 
+    "  barrier(CLK_LOCAL_MEM_FENCE);\n" 
+    "  if(row < numRows && tid < 16) {\n" 
+    "    counts[(row * 16 + tid) * tilesPerRow + tile] = hist[tid];\n" 
+    "  }\n" 
+    "}\n" 
+    "\n" 
+    "// Moves each element of the tile to where positions says its digit starts,\n" 
+    "// after those of the same digit earlier in the tile, so each pass is stable\n" 
+    "kernel void THClSort_radixScatter(int n, int numRows, int tilesPerRow, int shift, int descending, int initPayload,\n" 
+    "    global const float *keysIn, int keysInOffset, global const float *payloadIn, int payloadInOffset,\n" 
+    "    global float *keysOut, int keysOutOffset, global float *payloadOut, int payloadOutOffset,\n" 
+    "    global const int *positions, local float *digitSpace) {\n" 
+    "  local int *digits = (local int *)digitSpace;\n" 
+    "  const int tid = get_local_id(0);\n" 
+    "  const int row = get_group_id(0) / tilesPerRow;\n" 
+    "  const int tile = get_group_id(0) % tilesPerRow;\n" 
+    "  const int i = tile * get_local_size(0) + tid;\n" 
+    "  const bool inRow = row < numRows && i < n;\n" 
+    "  float key = 0;\n" 
+    "  float value = 0;\n" 
+    "  int digit = 16;\n" 
+    "  if(inRow) {\n" 
+    "    key = keysIn[keysInOffset + row * n + i];\n" 
+    "    value = initPayload ? (float)(i + 1) : payloadIn[payloadInOffset + row * n + i];\n" 
+    "    digit = (sortKey(key, descending) >> shift) & 15;\n" 
+    "  }\n" 
+    "  digits[tid] = digit;\n" 
+    "  barrier(CLK_LOCAL_MEM_FENCE);\n" 
+    "  if(inRow) {\n" 
+    "    int rank = 0;\n" 
+    "    for(int j = 0; j < tid; j++) {\n" 
+    "      rank += digits[j] == digit ? 1 : 0;\n" 
+    "    }\n" 
+    "    const int dest = positions[(row * 16 + digit) * tilesPerRow + tile] + rank;\n" 
+    "    keysOut[keysOutOffset + dest] = key;\n" 
+    "    payloadOut[payloadOutOffset + dest] = value;\n" 
+    "  }\n" 
+    "}\n" 
+    "\n" 
+    "// Finds the key of the k-th element (from 1) of row in sort order, by\n" 
+    "// radix select: each pass narrows it down by four more bits, from the most\n" 
+    "// significant, with a histogram of the keys that match so far.  How many\n" 
+    "// of the elements with that key come within the first k goes to *kLeft.\n" 
+    "// Every thread of the group has to call it\n" 
+    "void radixSelect(global const float *row, int n, int k, int descending,\n" 
+    "    local int *hist, local uint *sharedKey, local int *sharedLeft, uint *selected, int *kLeft) {\n" 
+    "  const int tid = get_local_id(0);\n" 
+    "  const int size = get_local_size(0);\n" 
+    "  uint desired = 0;\n" 
+    "  uint desiredMask = 0;\n" 
+    "  int left = k;\n" 
+    "  for(int shift = 28; shift >= 0; shift -= 4) {\n" 
+    "    if(tid < 16) {\n" 
+    "      hist[tid] = 0;\n" 
+    "    }\n" 
+    "    barrier(CLK_LOCAL_MEM_FENCE);\n" 
+    "    for(int i = tid; i < n; i += size) {\n" 
+    "      const uint key = sortKey(row[i], descending);\n" 
+    "      if((key & desiredMask) == desired) {\n" 
+    "        atomic_inc(&hist[(key >> shift) & 15]);\n" 
+    "      }\n" 
+    "    }\n" 
+    "    barrier(CLK_LOCAL_MEM_FENCE);\n" 
+    "    if(tid == 0) {\n" 
+    "      int digit = 0;\n" 
+    "      while(hist[digit] < left) {\n" 
+    "        left -= hist[digit];\n" 
+    "        digit++;\n" 
+    "      }\n" 
+    "      *sharedKey = desired | ((uint)digit << shift);\n" 
+    "      *sharedLeft = left;\n" 
+    "    }\n" 
+    "    barrier(CLK_LOCAL_MEM_FENCE);\n" 
+    "    desired = *sharedKey;\n" 
+    "    left = *sharedLeft;\n" 
+    "    desiredMask |= 15u << shift;\n" 
+    "  }\n" 
+    "  *selected = desired;\n" 
+    "  *kLeft = left;\n" 
+    "}\n" 
+    "\n" 
+    "// A work group per row, writing the first k of it in sort order, though in\n" 
+    "// the order they're found in the row, to k contiguous values and indices\n" 
+    "kernel void THClSort_topk(int n, int numRows, int k, int descending,\n" 
+    "    global const float *in, int inOffset, global float *values, int valuesOffset,\n" 
+    "    global float *indices, int indicesOffset, local float *scratchSpace) {\n" 
+    "  local int *scratch = (local int *)scratchSpace;\n" 
+    "  local int hist[16];\n" 
+    "  local uint sharedKey;\n" 
+    "  local int sharedLeft;\n" 
+    "  const int tid = get_local_id(0);\n" 
+    "  const int size = get_local_size(0);\n" 
+    "  for(int r = get_group_id(0); r < numRows; r += get_num_groups(0)) {\n" 
+    "    global const float *row = in + inOffset + r * n;\n" 
+    "    uint selected;\n" 
+    "    int kLeft;\n" 
+    "    radixSelect(row, n, k, descending, hist, &sharedKey, &sharedLeft, &selected, &kLeft);\n" 
+    "    // everything before the selected key, and the first kLeft with it\n" 
+    "    int written = 0;\n" 
+    "    int equalSeen = 0;\n" 
+    "    for(int base = 0; base < n && written < k; base += size) {\n" 
+    "      const int i = base + tid;\n" 
+    "      float value = 0;\n" 
+    "      uint key = 0;\n" 
+    "      if(i < n) {\n" 
+    "        value = row[i];\n" 
+    "        key = sortKey(value, descending);\n" 
+    "      }\n" 
+    "      const int equal = i < n && key == selected ? 1 : 0;\n" 
+    "      int equalTotal;\n" 
+    "      const int equalRank = groupExclusiveSum(equal, scratch, &equalTotal);\n" 
+    "      const int take = i < n && (key < selected || (equal && equalSeen + equalRank < kLeft)) ? 1 : 0;\n" 
+    "      int takeTotal;\n" 
+    "      const int place = groupExclusiveSum(take, scratch, &takeTotal);\n" 
+    "      if(take) {\n" 
+    "        values[valuesOffset + r * k + written + place] = value;\n" 
+    "        indices[indicesOffset + r * k + written + place] = (float)(i + 1);\n" 
+    "      }\n" 
+    "      written += takeTotal;\n" 
+    "      equalSeen += equalTotal;\n" 
+    "    }\n" 
+    "  }\n" 
+    "}\n" 
+    "\n" 
+    "// A work group per row, writing its k-th smallest element, and that\n" 
+    "// element's index; of equal elements, the one earliest in the row\n" 
+    "kernel void THClSort_kthvalue(int n, int numRows, int k,\n" 
+    "    global const float *in, int inOffset, global float *values, int valuesOffset,\n" 
+    "    global float *indices, int indicesOffset, local float *scratchSpace) {\n" 
+    "  local int *scratch = (local int *)scratchSpace;\n" 
+    "  local int hist[16];\n" 
+    "  local uint sharedKey;\n" 
+    "  local int sharedLeft;\n" 
+    "  const int size = get_local_size(0);\n" 
+    "  const int tid = get_local_id(0);\n" 
+    "  for(int r = get_group_id(0); r < numRows; r += get_num_groups(0)) {\n" 
+    "    global const float *row = in + inOffset + r * n;\n" 
+    "    uint selected;\n" 
+    "    int kLeft;\n" 
+    "    radixSelect(row, n, k, 0, hist, &sharedKey, &sharedLeft, &selected, &kLeft);\n" 
+    "    int equalSeen = 0;\n" 
+    "    for(int base = 0; base < n && equalSeen < kLeft; base += size) {\n" 
+    "      const int i = base + tid;\n" 
+    "      const int equal = i < n && sortKey(row[i], 0) == selected ? 1 : 0;\n" 
+    "      int equalTotal;\n" 
+    "      const int equalRank = groupExclusiveSum(equal, scratch, &equalTotal);\n" 
+    "      if(equal && equalSeen + equalRank == kLeft - 1) {\n" 
+    "        values[valuesOffset + r] = row[i];\n" 
+    "        indices[indicesOffset + r] = (float)(i + 1);\n" 
+    "      }\n" 
+    "      equalSeen += equalTotal;\n" 
+    "    }\n" 
+    "  }\n" 
+    "}\n" 
+    "\n" 
+    "";
+    // [[[end]]]
+    return kernelSource;
+}
@@ -0,0 +1,20 @@
+#ifndef TH_CL_TENSOR_SORT_INC
+#define TH_CL_TENSOR_SORT_INC
+
+#include "THClTensor.h"
+#include "THClGeneral.h"
+
+// The indices are ClTensors of floats, counting from 1, as for max and min
+
+// sorts input along dim, ascending, or descending if order is set
+THCL_API void THClTensor_sort(THClState *state, THClTensor *sorted, THClTensor *indices, THClTensor *input,
+  int dim, int order);
+// the k smallest along dim, or the k largest if dir is set; in order if
+// sorted is set, otherwise in the order they're found along dim
+THCL_API void THClTensor_topk(THClState *state, THClTensor *topK, THClTensor *indices, THClTensor *input,
+  long k, int dim, int dir, int sorted);
+// the k-th smallest along dim, which is kept, with size 1
+THCL_API void THClTensor_kthvalue(THClState *state, THClTensor *values, THClTensor *indices, THClTensor *input,
+  long k, int dim);
+
+#endif
@@ -0,0 +1,24 @@
+// OpenCL kernels....
+
+// expected templated values:
+// SrcType: OpenCL type of the raw buffer, eg uchar, short, int, long
+//
+// the raw buffer travels in a float wrapper on the host side, so it's
+// just reinterpreted as SrcType here
+
+kernel void THClTensor_convertToFloat(int n, global const {{SrcType}} *src,
+    global float *dst, int dstOffset, float scale, float shift) {
+  int linearIndex = get_global_id(0);
+  if(linearIndex < n) {
+    dst[dstOffset + linearIndex] = (float)src[linearIndex] * scale + shift;
+  }
+}
+
+kernel void THClTensor_convertFromFloat(int n, global const float *src, int srcOffset,
+    global {{SrcType}} *dst) {
+  int linearIndex = get_global_id(0);
+  if(linearIndex < n) {
+    dst[linearIndex] = ({{SrcType}})src[srcOffset + linearIndex];
+  }
+}
+
@@ -0,0 +1,164 @@
+// Sweeps tensor sizes and layouts through the apply, copy, reduce and gemm
+// paths, and writes achieved bandwidth, GFLOP/s and host launch overhead as
+// JSON, so runs can be diffed.
+//
+// usage: THClBenchmark [--out results.json] [--repeats 20] [--quick]
+//
+// Each case is run once to build its kernel, then timed over `repeats`
+// calls.  Wall time is measured on the host; device time comes from a
+// second run with the profiler on.  Launch overhead is the wall time per
+// call that the device wasn't busy for.
+
+#include <iostream>
+
+#include "THClBenchmarkUtils.h"
+#include "THClApply.h"
+#include "THClBlas.h"
+
+using namespace std;
+
+class BenchmarkScaleOp : public HasOperator1 {
+public:
+  string operator1() const {
+    return "*out = *out * 1.0001f";
+  }
+};
+
+class BenchmarkScaleCopyOp : public HasOperator2 {
+public:
+  string operator2() const {
+    return "*out = *in1 * 1.0001f";
+  }
+};
+
+class BenchmarkAddOp : public HasOperator3 {
+public:
+  string operator3() const {
+    return "*out = *in1 + *in2";
+  }
+};
+
+static int repeats = 20;
+static vector<BenchmarkRecord> results;
+
+// times `repeats` calls of fn, after one warm-up call
+template< typename Fn >
+static void runCase(THClState *state, string op, string layout, long elements,
+    double bytesPerCall, double flopsPerCall, Fn fn) {
+  fn();
+
+  cl_ulong start = THClProfiler_hostNow();
+  for(int i = 0; i < repeats; i++) {
+    fn();
+  }
+  state->cl->finish();
+  double wallUs = (THClProfiler_hostNow() - start) / 1000.0 / repeats;
+
+  THClProfiler_start(state);
+  for(int i = 0; i < repeats; i++) {
+    fn();
+  }
+  THClProfiler_stop(state);
+  vector<THClProfileSummary> summaries = THClProfiler_summarize(state);
+  double deviceMs = 0;
+  for(size_t i = 0; i < summaries.size(); i++) {
+    deviceMs += summaries[i].milliseconds;
+  }
+  double deviceUs = deviceMs * 1000.0 / repeats;
+  double launchOverheadUs = wallUs > deviceUs ? wallUs - deviceUs : 0;
+
+  BenchmarkRecord record;
+  record.set("op", op).set("layout", layout).set("elements", elements)
+    .set("wallUs", wallUs).set("deviceUs", deviceUs).set("launchOverheadUs", launchOverheadUs)
+    .set("gbPerSecond", bytesPerCall / (wallUs * 1000.0));
+  if(flopsPerCall > 0) {
+    record.set("gflops", flopsPerCall / (wallUs * 1000.0));
+  }
+  results.push_back(record);
+  cerr << op << " " << layout << " " << elements << ": " << wallUs << "us wall, "
+    << deviceUs << "us device" << endl;
+}
+
+static void benchmarkLayout(THClState *state, string layout, long elements) {
+  THClTensor *a = newBenchmarkTensor(state, layout, elements, 1.0f);
+  THClTensor *b = newBenchmarkTensor(state, layout, elements, 2.0f);
+  THClTensor *c = newBenchmarkTensor(state, layout, elements, 3.0f);
+  THClTensor *dst = THClTensor_newWithSize1d(state, elements);
+  THClTensor *out = THClTensor_new(state);
+  double floatBytes = (double)elements * sizeof(float);
+  int nDimension = THClTensor_nDimension(state, a);
+
+  runCase(state, "pointwiseApply1", layout, elements, 2 * floatBytes, elements, [&]() {
+    THClTensor_pointwiseApply1(state, a, BenchmarkScaleOp());
+  });
+  runCase(state, "pointwiseApply2", layout, elements, 2 * floatBytes, elements, [&]() {
+    THClTensor_pointwiseApply2(state, a, b, BenchmarkScaleCopyOp());
+  });
+  runCase(state, "pointwiseApply3", layout, elements, 3 * floatBytes, elements, [&]() {
+    THClTensor_pointwiseApply3(state, a, b, c, BenchmarkAddOp());
+  });
+  // copy out of the layout into a contiguous tensor of the same size
+  THClTensor_resizeAs(state, dst, a);
+  runCase(state, "copy", layout, elements, 2 * floatBytes, 0, [&]() {
+    THClTensor_copy(state, dst, a);
+  });
+  runCase(state, "sumall", layout, elements, floatBytes, elements, [&]() {
+    THClTensor_sumall(state, a);
+  });
+  runCase(state, "sum_lastdim", layout, elements, floatBytes, elements, [&]() {
+    THClTensor_sum(state, out, a, nDimension - 1);
+  });
+  if(nDimension > 1) {
+    runCase(state, "sum_firstdim", layout, elements, floatBytes, elements, [&]() {
+      THClTensor_sum(state, out, a, 0);
+    });
+  }
+
+  THClTensor_free(state, a);
+  THClTensor_free(state, b);
+  THClTensor_free(state, c);
+  THClTensor_free(state, dst);
+  THClTensor_free(state, out);
+}
+
+static void benchmarkGemm(THClState *state, long n) {
+  THClTensor *a = newBenchmarkTensor(state, "contiguous1d", n * n, 1.0f);
+  THClTensor *b = newBenchmarkTensor(state, "contiguous1d", n * n, 2.0f);
+  THClTensor *c = newBenchmarkTensor(state, "contiguous1d", n * n, 0.0f);
+  double bytes = 4.0 * n * n * sizeof(float);
+  double flops = 2.0 * n * n * n;
+  runCase(state, "gemm", "square", n * n, bytes, flops, [&]() {
+    THClBlas_gemm(state, 'n', 'n', n, n, n, 1.0f,
+      THClTensor_wrapper(state, a), 0, n,
+      THClTensor_wrapper(state, b), 0, n, 0.0f,
+      THClTensor_wrapper(state, c), 0, n);
+  });
+  THClTensor_free(state, a);
+  THClTensor_free(state, b);
+  THClTensor_free(state, c);
+}
+
+int main(int argc, char *argv[]) {
+  BenchmarkArgs args(argc, argv);
+  repeats = args.getInt("repeats", 20);
+  bool quick = args.has("quick");
+
+  THClState state;
+  THClInit(&state);
+
+  const vector<string> &layouts = getBenchmarkLayouts();
+  long maxElements = quick ? (1l << 16) : (1l << 22);
+  for(long elements = 1l << 12; elements <= maxElements; elements <<= 2) {
+    for(size_t i = 0; i < layouts.size(); i++) {
+      benchmarkLayout(&state, layouts[i], elements);
+    }
+  }
+  long maxGemm = quick ? 256 : 1024;
+  for(long n = 64; n <= maxGemm; n *= 4) {
+    benchmarkGemm(&state, n);
+  }
+
+  writeBenchmarkJson(args.get("out", ""), "THClBenchmark", getBenchmarkDeviceName(&state), results);
+  THClShutdown(&state);
+  return 0;
+}
@@ -0,0 +1,155 @@
+#ifndef THCL_BENCHMARK_UTILS_INC
+#define THCL_BENCHMARK_UTILS_INC
+
+// Bits shared by the THCl benchmark executables: command line parsing,
+// tensor layouts, and writing results out as JSON.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <map>
+
+#include "THCl.h"
+#include "THClProfiler.h"
+#include "EasyCL.h"
+#include "util/easycl_stringhelper.h"
+
+// one JSON object, kept as ordered key/value pairs, values already encoded
+class BenchmarkRecord {
+public:
+  BenchmarkRecord &set(std::string key, std::string value) {
+    std::string quoted = "\"";
+    for(size_t i = 0; i < value.size(); i++) {
+      if(value[i] == '"' || value[i] == '\\') {
+        quoted += '\\';
+      }
+      quoted += value[i];
+    }
+    fields.push_back(std::make_pair(key, quoted + "\""));
+    return *this;
+  }
+  BenchmarkRecord &set(std::string key, double value) {
+    char buffer[64];
+    sprintf(buffer, "%.6g", value);
+    fields.push_back(std::make_pair(key, std::string(buffer)));
+    return *this;
+  }
+  std::string toJson() const {
+    std::string json = "{";
+    for(size_t i = 0; i < fields.size(); i++) {
+      json += (i == 0 ? "" : ", ") + ("\"" + fields[i].first + "\": ") + fields[i].second;
+    }
+    return json + "}";
+  }
+private:
+  std::vector<std::pair<std::string, std::string> > fields;
+};
+
+// {"benchmark": ..., "device": ..., "results": [...]}, to filename, or stdout
+// when filename is empty
+inline void writeBenchmarkJson(std::string filename, std::string benchmark, std::string device,
+    const std::vector<BenchmarkRecord> &results) {
+  FILE *out = filename == "" ? stdout : fopen(filename.c_str(), "w");
+  if(out == 0) {
+    fprintf(stderr, "couldn't open %s for writing\n", filename.c_str());
+    exit(1);
+  }
+  BenchmarkRecord header;
+  header.set("benchmark", benchmark).set("device", device);
+  std::string headerJson = header.toJson();
+  fprintf(out, "%s, \"results\": [\n", headerJson.substr(0, headerJson.size() - 1).c_str());
+  for(size_t i = 0; i < results.size(); i++) {
+    fprintf(out, "  %s%s\n", results[i].toJson().c_str(), i + 1 < results.size() ? "," : "");
+  }
+  fprintf(out, "]}\n");
+  if(out != stdout) {
+    fclose(out);
+  }
+}
+
+// --name value pairs, and bare --flags
+class BenchmarkArgs {
+public:
+  BenchmarkArgs(int argc, char *argv[]) {
+    for(int i = 1; i < argc; i++) {
+      std::string arg = argv[i];
+      if(arg.substr(0, 2) != "--") {
+        fprintf(stderr, "unexpected argument %s\n", argv[i]);
+        exit(1);
+      }
+      arg = arg.substr(2);
+      if(i + 1 < argc && strncmp(argv[i + 1], "--", 2) != 0) {
+        values[arg] = argv[++i];
+      } else {
+        values[arg] = "1";
+      }
+    }
+  }
+  bool has(std::string name) const {
+    return values.find(name) != values.end();
+  }
+  std::string get(std::string name, std::string defaultValue) const {
+    return has(name) ? values.find(name)->second : defaultValue;
+  }
+  int getInt(std::string name, int defaultValue) const {
+    return has(name) ? atoi(values.find(name)->second.c_str()) : defaultValue;
+  }
+private:
+  std::map<std::string, std::string> values;
+};
+
+inline std::string getBenchmarkDeviceName(THClState *state) {
+  return easycl::DevicesInfo::getDeviceInfo(THClState_getDevice(state)).deviceName;
+}
+
+// A tensor with `elements` elements laid out as `layout`, filled with value:
+//   contiguous1d .. contiguous4d
+//   transposed2d: the transpose of a contiguous matrix
+//   narrowed2d: the left half of a contiguous matrix twice as wide
+// elements should be a multiple of 4096
+inline THClTensor *newBenchmarkTensor(THClState *state, std::string layout, long elements, float value) {
+  THClTensor *base = 0;
+  THClTensor *result = 0;
+  if(layout == "contiguous1d") {
+    result = THClTensor_newWithSize1d(state, elements);
+  } else if(layout == "contiguous2d") {
+    result = THClTensor_newWithSize2d(state, elements / 256, 256);
+  } else if(layout == "contiguous3d") {
+    result = THClTensor_newWithSize3d(state, elements / 1024, 64, 16);
+  } else if(layout == "contiguous4d") {
+    result = THClTensor_newWithSize4d(state, elements / 4096, 16, 16, 16);
+  } else if(layout == "transposed2d") {
+    base = THClTensor_newWithSize2d(state, elements / 256, 256);
+    result = THClTensor_newTranspose(state, base, 0, 1);
+  } else if(layout == "narrowed2d") {
+    base = THClTensor_newWithSize2d(state, elements / 256, 512);
+    result = THClTensor_newNarrow(state, base, 1, 0, 256);
+  } else {
+    fprintf(stderr, "unknown layout %s\n", layout.c_str());
+    exit(1);
+  }
+  if(base != 0) {
+    THClTensor_fill(state, base, value);
+    THClTensor_free(state, base);
+  } else {
+    THClTensor_fill(state, result, value);
+  }
+  return result;
+}
+
+inline const std::vector<std::string> &getBenchmarkLayouts() {
+  static std::vector<std::string> layouts;
+  if(layouts.size() == 0) {
+    layouts.push_back("contiguous1d");
+    layouts.push_back("contiguous2d");
+    layouts.push_back("contiguous3d");
+    layouts.push_back("contiguous4d");
+    layouts.push_back("transposed2d");
+    layouts.push_back("narrowed2d");
+  }
+  return layouts;
+}
+
+#endif
@@ -0,0 +1,171 @@
+// Measures the host cost of launching small pointwise ops, where latency
+// is dominated by the path through THClTensor_pointwiseApplyN, TensorInfo,
+// TemplatedKernel and kernelLaunch rather than by the device.
+//
+// usage: THClLaunchOverhead [--out results.json] [--iterations 2000]
+//                           [--thresholds launch_overhead_thresholds.txt]
+//
+// Every op runs `iterations` times on tensors of 1 to 1024 elements, and
+// each call is timed separately, giving p50 and p99.  A second run with the
+// profiler on breaks each call down into the profiler's host spans:
+// tensorInfo, buildKernel, setArgs, enqueue and finish.
+//
+// Each line of the thresholds file is "op size phase percentile maxUs",
+// with "*" matching any op or size, and # starting a comment.  Any
+// measurement over its threshold is reported, and the exit code is 1.
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+
+#include "THClBenchmarkUtils.h"
+
+using namespace std;
+
+struct Threshold {
+  string op;
+  string size;
+  string phase;
+  string percentile;
+  double maxUs;
+};
+
+static vector<Threshold> readThresholds(string filename) {
+  vector<Threshold> thresholds;
+  ifstream in(filename.c_str());
+  if(!in) {
+    cerr << "couldn't open " << filename << endl;
+    exit(1);
+  }
+  string line;
+  while(getline(in, line)) {
+    if(line.find('#') != string::npos) {
+      line = line.substr(0, line.find('#'));
+    }
+    istringstream fields(line);
+    Threshold threshold;
+    if(fields >> threshold.op >> threshold.size >> threshold.phase >> threshold.percentile >> threshold.maxUs) {
+      thresholds.push_back(threshold);
+    }
+  }
+  return thresholds;
+}
+
+static double percentile(vector<double> samples, double fraction) {
+  if(samples.size() == 0) {
+    return 0;
+  }
+  sort(samples.begin(), samples.end());
+  size_t index = (size_t)(fraction * (samples.size() - 1) + 0.5);
+  return samples[index];
+}
+
+struct PhaseStats {
+  string op;
+  long size;
+  string phase;
+  double p50;
+  double p99;
+};
+
+template< typename Fn >
+static void measure(THClState *state, string op, long size, int iterations, vector<PhaseStats> &stats, Fn fn) {
+  // the first call builds the kernel; that's not what we're measuring
+  fn();
+
+  vector<double> totals;
+  for(int i = 0; i < iterations; i++) {
+    cl_ulong start = THClProfiler_hostNow();
+    fn();
+    totals.push_back((THClProfiler_hostNow() - start) / 1000.0);
+  }
+  PhaseStats total = { op, size, "total", percentile(totals, 0.5), percentile(totals, 0.99) };
+  stats.push_back(total);
+
+  THClProfiler_start(state);
+  for(int i = 0; i < iterations; i++) {
+    fn();
+  }
+  THClProfiler_stop(state);
+  map<string, vector<double> > phases;
+  vector<THClHostSpanRecord> &spans = state->profiler->hostSpans;
+  for(size_t i = 0; i < spans.size(); i++) {
+    phases[spans[i].name].push_back((spans[i].finish - spans[i].start) / 1000.0);
+  }
+  for(map<string, vector<double> >::iterator it = phases.begin(); it != phases.end(); it++) {
+    PhaseStats phase = { op, size, it->first, percentile(it->second, 0.5), percentile(it->second, 0.99) };
+    stats.push_back(phase);
+  }
+  cerr << op << " size=" << size << ": p50=" << total.p50 << "us p99=" << total.p99 << "us" << endl;
+}
+
+static bool matches(const string &pattern, const string &value) {
+  return pattern == "*" || pattern == value;
+}
+
+int main(int argc, char *argv[]) {
+  BenchmarkArgs args(argc, argv);
+  int iterations = args.getInt("iterations", 2000);
+
+  THClState state;
+  THClInit(&state);
+
+  vector<PhaseStats> stats;
+  for(long size = 1; size <= 1024; size *= 4) {
+    THClTensor *a = THClTensor_newWithSize1d(&state, size);
+    THClTensor *b = THClTensor_newWithSize1d(&state, size);
+    THClTensor *c = THClTensor_newWithSize1d(&state, size);
+    THClTensor_fill(&state, b, 2.0f);
+    THClTensor_fill(&state, c, 3.0f);
+    measure(&state, "fill", size, iterations, stats, [&]() {
+      THClTensor_fill(&state, a, 1.0f);
+    });
+    measure(&state, "add", size, iterations, stats, [&]() {
+      THClTensor_add(&state, a, b, 1.0f);
+    });
+    measure(&state, "cmul", size, iterations, stats, [&]() {
+      THClTensor_cmul(&state, a, b, c);
+    });
+    measure(&state, "cadd", size, iterations, stats, [&]() {
+      THClTensor_cadd(&state, a, b, 0.5f, c);
+    });
+    THClTensor_free(&state, a);
+    THClTensor_free(&state, b);
+    THClTensor_free(&state, c);
+  }
+
+  vector<BenchmarkRecord> results;
+  for(size_t i = 0; i < stats.size(); i++) {
+    BenchmarkRecord record;
+    record.set("op", stats[i].op).set("size", stats[i].size).set("phase", stats[i].phase)
+      .set("p50Us", stats[i].p50).set("p99Us", stats[i].p99);
+    results.push_back(record);
+  }
+  writeBenchmarkJson(args.get("out", ""), "THClLaunchOverhead", getBenchmarkDeviceName(&state), results);
+
+  int failures = 0;
+  if(args.has("thresholds")) {
+    vector<Threshold> thresholds = readThresholds(args.get("thresholds", ""));
+    for(size_t t = 0; t < thresholds.size(); t++) {
+      Threshold &threshold = thresholds[t];
+      for(size_t i = 0; i < stats.size(); i++) {
+        PhaseStats &stat = stats[i];
+        if(!matches(threshold.op, stat.op) || !matches(threshold.size, easycl::toString(stat.size))
+            || !matches(threshold.phase, stat.phase)) {
+          continue;
+        }
+        double value = threshold.percentile == "p99" ? stat.p99 : stat.p50;
+        if(value > threshold.maxUs) {
+          cerr << "FAIL " << stat.op << " size=" << stat.size << " " << stat.phase << " "
+            << threshold.percentile << "=" << value << "us, threshold " << threshold.maxUs << "us" << endl;
+          failures++;
+        }
+      }
+    }
+    cerr << (failures == 0 ? "all launch overhead thresholds met" : "launch overhead thresholds exceeded") << endl;
+  }
+
+  THClShutdown(&state);
+  return failures == 0 ? 0 : 1;
+}
@@ -40,6 +40,509 @@ function test_basic()
   print('c6\n', c)
 end
 
+function test_allReduce()
+  local numDevices = cltorch.getDeviceCount()
+  if numDevices < 2 then
+    print('test_allReduce: needs at least 2 devices, skipping')
+    return
+  end
+  local oldDevice = cltorch.getDevice()
+  local expected = torch.FloatTensor(1000, 3):zero()
+  local tensors = {}
+  for device=1,numDevices do
+    cltorch.setDevice(device)
+    local a = torch.FloatTensor(1000, 3):uniform()
+    expected:add(a)
+    tensors[device] = a:cl()
+  end
+  cltorch.allReduce(tensors)
+  for device=1,numDevices do
+    luaunit.assertTrue((tensors[device]:float() - expected):abs():max() < 0.0001)
+  end
+  cltorch.setDevice(oldDevice)
+end
+
+function test_reductions()
+  local a = torch.FloatTensor(60, 37):uniform() + 0.5
+  local c = a:cl()
+  luaunit.assertTrue(math.abs(c:sum() - a:sum()) < 0.01)
+  luaunit.assertTrue(math.abs(c:min() - a:min()) < 0.0001)
+  luaunit.assertTrue(math.abs(c:max() - a:max()) < 0.0001)
+  local small = a:narrow(1, 1, 3):narrow(2, 1, 4)
+  luaunit.assertTrue(math.abs(small:cl():prod() - small:prod()) < 0.0001)
+  for dim=1,2 do
+    luaunit.assertTrue((c:sum(dim):float() - a:sum(dim)):abs():max() < 0.001)
+    luaunit.assertTrue((c:t():sum(dim):float() - a:t():sum(dim)):abs():max() < 0.001)
+    luaunit.assertTrue((small:cl():prod(dim):float() - small:prod(dim)):abs():max() < 0.0001)
+  end
+  -- NaNs win, as they do along a dimension
+  local withNan = a:clone()
+  withNan[7][5] = 0/0
+  local nanCl = withNan:cl()
+  luaunit.assertTrue(nanCl:min() ~= nanCl:min())
+  luaunit.assertTrue(nanCl:max() ~= nanCl:max())
+  luaunit.assertTrue(nanCl:norm(math.huge) ~= nanCl:norm(math.huge))
+  local maxs = nanCl:max(1)
+  luaunit.assertTrue(maxs[1][5] ~= maxs[1][5])
+end
+
+function test_profiler()
+  local a = torch.FloatTensor(100, 20):uniform():cl()
+  cltorch.profiler.start()
+  a:add(1)
+  a:add(1)
+  local b = a:float()
+  cltorch.profiler.stop()
+  local report = cltorch.profiler.report()
+  local kernelCalls = 0
+  local copies = 0
+  for i, op in ipairs(report) do
+    if op.name:find('^applyDv2_') then
+      kernelCalls = kernelCalls + op.calls
+    end
+    if op.name == 'copyToHost' then
+      copies = copies + op.calls
+    end
+    luaunit.assertTrue(op.milliseconds >= 0)
+  end
+  luaunit.assertEquals(kernelCalls, 2)
+  luaunit.assertTrue(copies >= 1)
+
+  local filename = os.tmpname()
+  cltorch.profiler.writeTrace(filename)
+  local f = io.open(filename, 'r')
+  local trace = f:read('*all')
+  f:close()
+  os.remove(filename)
+  luaunit.assertEquals(trace:sub(1, 15), '{"traceEvents":')
+  luaunit.assertTrue(trace:find('"cat":"host"') ~= nil)
+  luaunit.assertTrue(trace:find('"cat":"device"') ~= nil)
+
+  -- more calls than are kept pending: the early ones resolve along the way,
+  -- and still count
+  cltorch.profiler.start()
+  for i=1,3000 do
+    a:add(1)
+  end
+  cltorch.profiler.stop()
+  kernelCalls = 0
+  for i, op in ipairs(cltorch.profiler.report()) do
+    if op.name:find('^applyDv2_') then
+      kernelCalls = kernelCalls + op.calls
+    end
+  end
+  luaunit.assertEquals(kernelCalls, 3000)
+end
+
+function test_memoryusage()
+  collectgarbage()
+  local before = cltorch.getMemoryUsage()
+  cltorch.setMemoryTracking(true)
+  local a = torch.ClTensor(1000, 100)
+  local during = cltorch.getMemoryUsage()
+  luaunit.assertEquals(during.storages, before.storages + 1)
+  luaunit.assertEquals(during.deviceBytes, before.deviceBytes + 400000)
+  luaunit.assertEquals(during.hostBytes, before.hostBytes + 400000)
+  luaunit.assertTrue(during.peakDeviceBytes >= during.deviceBytes)
+
+  local filename = os.tmpname()
+  cltorch.dumpMemory(filename)
+  local f = io.open(filename, 'r')
+  local dump = f:read('*all')
+  f:close()
+  os.remove(filename)
+  luaunit.assertTrue(dump:find('400000 bytes in 1 storages') ~= nil)
+  luaunit.assertTrue(dump:find('test_memoryusage') ~= nil)
+  cltorch.setMemoryTracking(false)
+
+  a = nil
+  collectgarbage()
+  local after = cltorch.getMemoryUsage()
+  luaunit.assertEquals(after.deviceBytes, before.deviceBytes)
+  luaunit.assertEquals(after.frees, during.frees + 1)
+end
+
+function test_operators()
+  local a = torch.FloatTensor(30, 40):uniform()
+  local b = torch.FloatTensor(40, 30):uniform():t()
+  local acl = a:cl()
+  local bcl = b:cl()
+  luaunit.assertTrue(((acl + bcl):float() - (a + b)):abs():max() < 0.0001)
+  luaunit.assertTrue(((acl + 3):float() - (a + 3)):abs():max() < 0.0001)
+  luaunit.assertTrue(((3 + acl):float() - (3 + a)):abs():max() < 0.0001)
+  luaunit.assertTrue(((acl - bcl):float() - (a - b)):abs():max() < 0.0001)
+  luaunit.assertTrue(((acl - 3):float() - (a - 3)):abs():max() < 0.0001)
+  luaunit.assertTrue(((3 - bcl):float() - (3 - b)):abs():max() < 0.0001)
+  luaunit.assertTrue(((-bcl):float() - (-b)):abs():max() < 0.0001)
+  luaunit.assertTrue(((bcl * 3):float() - (b * 3)):abs():max() < 0.0001)
+  luaunit.assertTrue(((3 * acl):float() - (3 * a)):abs():max() < 0.0001)
+  luaunit.assertTrue(((bcl / 4):float() - (b / 4)):abs():max() < 0.0001)
+
+  -- results of the same size reuse the freed buffers
+  collectgarbage()
+  local before = cltorch.getMemoryUsage()
+  for i=1,5 do
+    local c = acl + bcl
+    c = nil
+    collectgarbage()
+  end
+  local after = cltorch.getMemoryUsage()
+  luaunit.assertTrue(after.poolHits >= before.poolHits + 4)
+  luaunit.assertEquals(after.deviceBytes, before.deviceBytes)
+  cltorch.emptyStoragePool()
+  luaunit.assertEquals(cltorch.getMemoryUsage().pooledBytes, 0)
+end
+
+function test_map()
+  local a = torch.FloatTensor(30, 40):uniform() - 0.5
+  local b = torch.FloatTensor(40, 30):uniform():t()
+  local acl = a:cl()
+  local bcl = b:cl()
+
+  local res = acl:clone():map('*out = *out * *out')
+  luaunit.assertTrue((res:float() - torch.cmul(a, a)):abs():max() < 0.0001)
+
+  res = torch.ClTensor(30, 40):map2(acl, '*out = *in1 > 0 ? *in1 : val1 * *in1', 0.1)
+  local expected = a:clone()
+  expected:map(a, function(_, x) return x > 0 and x or 0.1 * x end)
+  luaunit.assertTrue((res:float() - expected):abs():max() < 0.0001)
+
+  res = torch.ClTensor(30, 40):map3(acl, bcl, '*out = *in1 * val1 + *in2 * val2', 2, 3)
+  luaunit.assertTrue((res:float() - (a * 2 + b * 3)):abs():max() < 0.0001)
+
+  -- the narrower types go through the same kernels
+  local bytes = torch.FloatTensor(30, 40):random(10)
+  res = acl:clone():map2(bytes:clbyte(), '*out = *out + *in1 * val1', 2)
+  luaunit.assertTrue((res:float() - (a + bytes * 2)):abs():max() < 0.0001)
+  local ok = pcall(function() acl:clone():map3(nil, bcl, '*out = *in2') end)
+  luaunit.assertFalse(ok)
+end
+
+function test_saveload()
+  local a = torch.FloatTensor(1500, 1000):uniform()
+  local filename = os.tmpname()
+  torch.save(filename, a:cl())
+  local b = torch.load(filename)
+  luaunit.assertEquals(torch.type(b), 'torch.ClTensor')
+  luaunit.assertTrue((b:float() - a):abs():max() == 0)
+
+  -- the storage is written as a FloatStorage would be
+  local function storageBytes(storage)
+    local f = torch.DiskFile(filename, 'w'):binary()
+    storage:write(f)
+    f:close()
+    f = io.open(filename, 'rb')
+    local bytes = f:read('*all')
+    f:close()
+    return bytes
+  end
+  luaunit.assertTrue(storageBytes(a:cl():storage()) == storageBytes(a:storage()))
+
+  local half = a:clhalf()
+  torch.save(filename, half)
+  local halfLoaded = torch.load(filename)
+  luaunit.assertEquals(torch.type(halfLoaded), 'torch.ClHalfTensor')
+  luaunit.assertTrue((halfLoaded:float() - half:float()):abs():max() == 0)
+  os.remove(filename)
+end
+
+function test_mapping()
+  local a = torch.FloatTensor(3 * 1024 * 1024):uniform()
+  local filename = os.tmpname()
+  local f = torch.DiskFile(filename, 'w'):binary()
+  f:writeFloat(a:storage())
+  f:close()
+
+  local eager = torch.ClTensor(torch.ClStorage(filename, false))
+  luaunit.assertTrue((eager:float() - a):abs():max() == 0)
+
+  local storage = cltorch.newLazyStorage(filename)
+  local resident, numChunks = cltorch.getMappingResidency(storage)
+  luaunit.assertEquals(resident, 0)
+  luaunit.assertEquals(numChunks, 3)
+  -- only the second chunk is used
+  local lazy = torch.ClTensor(storage, 1024 * 1024 + 1, torch.LongStorage{100})
+  luaunit.assertTrue(math.abs(lazy:sum() - a:narrow(1, 1024 * 1024 + 1, 100):sum()) < 0.001)
+  resident, numChunks = cltorch.getMappingResidency(storage)
+  luaunit.assertEquals(resident, 1)
+  -- a kernel over the whole storage brings in the rest
+  local doubled = torch.ClTensor(storage) * 2
+  luaunit.assertTrue((doubled:float() - a * 2):abs():max() == 0)
+  resident, numChunks = cltorch.getMappingResidency(storage)
+  luaunit.assertEquals(resident, 3)
+  os.remove(filename)
+
+  -- Long copies go through their own conversion kernels, in both directions
+  local ints = torch.FloatTensor(3 * 1024 * 1024):random(1000)
+  filename = os.tmpname()
+  f = torch.DiskFile(filename, 'w'):binary()
+  f:writeFloat(ints:storage())
+  f:close()
+  local lazyInts = torch.ClTensor(cltorch.newLazyStorage(filename))
+  luaunit.assertTrue((lazyInts:long() - ints:long()):abs():max() == 0)
+  storage = cltorch.newLazyStorage(filename)
+  local src = torch.LongTensor(100):random(1000)
+  torch.ClTensor(storage, 1024 * 1024 + 1, torch.LongStorage{100}):copy(src)
+  -- the whole storage, after the copy: the file mustn't be uploaded over it
+  local expected = ints:long()
+  expected:narrow(1, 1024 * 1024 + 1, 100):copy(src)
+  luaunit.assertTrue((torch.ClTensor(storage):long() - expected):abs():max() == 0)
+  os.remove(filename)
+end
+
+function test_precompile()
+  cltorch.precompile({{op='tanh', ntensors=2, dims=3}})
+  cltorch.finishPrecompile()
+  local a = torch.FloatTensor(3, 4, 5):uniform()
+  local res = a:cl():transpose(1, 3)
+  res:tanh(a:cl():transpose(1, 3))
+  luaunit.assertTrue((res:float() - torch.tanh(a:transpose(1, 3))):abs():max() < 0.0001)
+
+  local filename = os.tmpname()
+  cltorch.saveKernelTrace(filename)
+  local f = io.open(filename, 'r')
+  local header = f:read('*line')
+  f:close()
+  luaunit.assertEquals(header, 'cltorch-kernel-trace 1')
+  -- everything in the trace is built already
+  cltorch.precompile(filename)
+  luaunit.assertEquals(cltorch.finishPrecompile(), 0)
+  os.remove(filename)
+end
+
+function test_broadcast()
+  local m = torch.FloatTensor(5, 7):uniform()
+  local row = torch.FloatTensor(1, 7):uniform()
+  local col = torch.FloatTensor(5, 1):uniform():add(0.5)
+  local res = m:cl() + row:cl()
+  luaunit.assertEquals(res:size(), torch.LongStorage({5, 7}))
+  luaunit.assertTrue((res:float() - (m + row:expand(5, 7))):abs():max() < 0.0001)
+
+  local mcl = m:cl()
+  mcl:cmul(col:cl())
+  luaunit.assertTrue((mcl:float() - torch.cmul(m, col:expand(5, 7))):abs():max() < 0.0001)
+
+  -- a 1d tensor lines up with the last dimension
+  res = torch.ClTensor():cdiv(m:cl(), torch.FloatTensor(7):fill(2):cl())
+  luaunit.assertTrue((res:float() - m / 2):abs():max() < 0.0001)
+  res = torch.lt(m:cl(), row:cl())
+  luaunit.assertEquals(res:float():sum(), torch.lt(m, row:expand(5, 7)):float():sum())
+
+  luaunit.assertError(function() torch.ClTensor(3):fill(1):cadd(torch.ClTensor(4):fill(1)) end)
+  -- an in-place op can't grow its tensor
+  luaunit.assertError(function() row:cl():cadd(m:cl()) end)
+end
+
+function test_masks()
+  -- enough elements for the scan to take several tiles
+  local a = torch.FloatTensor(1000):uniform()
+  local amask = torch.gt(a, 0.5)
+  local mask = torch.gt(a:cl(), 0.5)
+  luaunit.assertEquals(torch.type(mask), 'torch.ClByteTensor')
+  luaunit.assertEquals((mask:float() - amask:float()):abs():max(), 0)
+  luaunit.assertEquals(mask:sum(), amask:sum())
+  luaunit.assertTrue(mask:any())
+  luaunit.assertFalse(mask:all())
+  -- a ClTensor result can still be passed in
+  local res = torch.ClTensor()
+  torch.gt(res, a:cl(), 0.5)
+  luaunit.assertEquals((res:float() - amask:float()):abs():max(), 0)
+
+  local expected = a:clone():maskedFill(amask, 0)
+  luaunit.assertEquals((a:cl():maskedFill(mask, 0):float() - expected):abs():max(), 0)
+  luaunit.assertEquals((a:cl():maskedFill(amask, 0):float() - expected):abs():max(), 0)
+
+  expected = a:maskedSelect(amask)
+  luaunit.assertEquals((a:cl():maskedSelect(mask):float() - expected):abs():max(), 0)
+  luaunit.assertEquals((a:cl()[mask]:float() - expected):abs():max(), 0)
+
+  local src = torch.FloatTensor(1000):uniform()
+  expected = a:clone():maskedCopy(amask, src)
+  luaunit.assertEquals((a:cl():maskedCopy(mask, src:cl()):float() - expected):abs():max(), 0)
+  luaunit.assertError(function() a:cl():maskedCopy(mask, torch.ClTensor(3):fill(1)) end)
+end
+
+function test_scan()
+  -- long rows take a work group each, short ones and columns a thread each
+  for _,size in ipairs({{3, 1000}, {1000, 5}, {40, 300}}) do
+    local a = torch.FloatTensor(size[1], size[2]):uniform()
+    for dim=1,2 do
+      local res = torch.cumsum(a:cl(), dim):float()
+      luaunit.assertTrue((res - torch.cumsum(a, dim)):abs():max() < 0.001 * size[dim])
+    end
+  end
+  -- a transposed view, in place
+  local a = torch.FloatTensor(50, 7):uniform(0.9, 1.1)
+  local acl = a:cl():t()
+  acl:cumprod(acl, 2)
+  luaunit.assertTrue((acl:float() - torch.cumprod(a:t(), 2)):abs():max() < 0.001)
+end
+
+function test_maxmin_indices()
+  -- integer values, so there are plenty of ties
+  local a = torch.FloatTensor(30, 600):random(1, 5)
+  for _,name in ipairs({'max', 'min'}) do
+    -- rows are contiguous, columns and a transposed view's rows strided
+    for _,t in ipairs({a:cl(), a:cl():t()}) do
+      for dim=1,2 do
+        local values, indices = t[name](t, dim)
+        local expectedValues, expectedIndices = t:float()[name](t:float(), dim)
+        luaunit.assertEquals((values:float() - expectedValues):abs():max(), 0)
+        luaunit.assertEquals((indices:float() - expectedIndices:float()):abs():max(), 0)
+      end
+    end
+  end
+end
+
+function test_moments()
+  -- a large mean, that a sum of squares would lose the variance to
+  local a = torch.FloatTensor(40, 700):uniform():add(1000)
+  local acl = a:cl()
+  luaunit.assertTrue(math.abs(acl:mean() - a:mean()) < 0.01)
+  luaunit.assertTrue(math.abs(acl:var() - a:var()) < 0.001)
+  luaunit.assertTrue(math.abs(acl:std() - a:std()) < 0.001)
+  -- rows are contiguous, columns strided
+  for dim=1,2 do
+    luaunit.assertTrue((acl:mean(dim):float() - a:mean(dim)):abs():max() < 0.01)
+    for _,flag in ipairs({false, true}) do
+      luaunit.assertTrue((acl:var(dim, flag):float() - a:var(dim, flag)):abs():max() < 0.001)
+      luaunit.assertTrue((acl:std(dim, flag):float() - a:std(dim, flag)):abs():max() < 0.001)
+    end
+  end
+end
+
+function test_norms()
+  local a = torch.FloatTensor(30, 200):uniform(-1, 1)
+  local b = torch.FloatTensor(30, 200):uniform(-1, 1)
+  local acl = a:cl()
+  for _,p in ipairs({0, 1, 2, 3, math.huge}) do
+    if p ~= math.huge then
+      luaunit.assertTrue(math.abs(acl:norm(p) - a:norm(p)) < 0.001 * a:norm(p))
+      if p ~= 0 then
+        luaunit.assertTrue(math.abs(acl:dist(b:cl(), p) - a:dist(b, p)) < 0.001 * a:dist(b, p))
+      end
+      for dim=1,2 do
+        luaunit.assertTrue((acl:norm(p, dim):float() - a:norm(p, dim)):abs():max() < 0.001 * a:norm(p))
+      end
+    else
+      luaunit.assertTrue(math.abs(acl:norm(p) - a:clone():abs():max()) < 0.0001)
+      luaunit.assertTrue(math.abs(acl:dist(b:cl(), p) - (a - b):abs():max()) < 0.0001)
+    end
+  end
+  -- on a transposed view, so the slices are strided
+  for _,p in ipairs({1, 2, 2.5}) do
+    local expected = torch.renorm(a:t(), p, 2, 3)
+    local res = torch.renorm(acl:t(), p, 2, 3)
+    luaunit.assertTrue((res:float() - expected):abs():max() < 0.0001)
+  end
+  local withNan = a:clone()
+  withNan[3][7] = 0/0
+  local nanDist = withNan:cl():dist(b:cl(), math.huge)
+  luaunit.assertTrue(nanDist ~= nanDist)
+end
+
+function test_softmax()
+  -- 100 fits in local memory; 50000 takes the online path
+  for _,n in ipairs({100, 50000}) do
+    local a = torch.FloatTensor(7, n):uniform(-5, 5)
+    local expSum = a:clone():exp():sum(2):expand(7, n)
+    local expected = torch.exp(a):cdiv(expSum)
+    local acl = a:cl()
+    luaunit.assertTrue((acl:softmax():float() - expected):abs():max() < 0.0001)
+    local expectedLog = a - torch.log(expSum)
+    luaunit.assertTrue((acl:logSoftmax():float() - expectedLog):abs():max() < 0.001)
+
+    local gradOutput = torch.FloatTensor(7, n):uniform(-1, 1)
+    local dot = torch.cmul(gradOutput, expected):sum(2):expand(7, n)
+    local expectedGrad = torch.cmul(expected, gradOutput - dot)
+    local grad = torch.ClTensor():softmaxBackward(gradOutput:cl(), expected:cl())
+    luaunit.assertTrue((grad:float() - expectedGrad):abs():max() < 0.0001)
+    local gradSum = gradOutput:sum(2):expand(7, n)
+    expectedGrad = gradOutput - torch.cmul(expected, gradSum)
+    grad = torch.ClTensor():logSoftmaxBackward(gradOutput:cl(), expectedLog:cl())
+    luaunit.assertTrue((grad:float() - expectedGrad):abs():max() < 0.001)
+  end
+end
+
+function test_sort()
+  -- short rows go through the bitonic sort, long ones through the radix sort
+  for _,size in ipairs({{20, 100}, {3, 5000}}) do
+    local a = torch.FloatTensor(size[1], size[2]):uniform()
+    for _,descending in ipairs({false, true}) do
+      local values, indices = a:cl():sort(2, descending)
+      local expected = torch.sort(a, 2, descending)
+      luaunit.assertEquals((values:float() - expected):abs():max(), 0)
+      luaunit.assertEquals((a:gather(2, indices:long()) - expected):abs():max(), 0)
+    end
+    local values = a:cl():sort(1)
+    luaunit.assertEquals((values:float() - torch.sort(a, 1)):abs():max(), 0)
+  end
+  -- ties keep their order
+  local _, indices = torch.ClTensor({2, 1, 2, 1}):sort()
+  luaunit.assertEquals(indices:float():totable(), {2, 4, 1, 3})
+
+  local a = torch.FloatTensor(1000, 50):uniform()
+  local values, indices = a:cl():topk(5, 2, true, true)
+  local expected = torch.sort(a, 2, true):narrow(2, 1, 5)
+  luaunit.assertEquals((values:float() - expected):abs():max(), 0)
+  luaunit.assertEquals((a:gather(2, indices:long()) - expected):abs():max(), 0)
+  values = a:cl():topk(3, 1)
+  luaunit.assertEquals((values:float():sort(1) - torch.sort(a, 1):narrow(1, 1, 3)):abs():max(), 0)
+
+  values, indices = a:cl():kthvalue(7, 2)
+  local kth, kthIndices = torch.kthvalue(a, 7, 2)
+  luaunit.assertEquals((values:float() - kth):abs():max(), 0)
+  luaunit.assertEquals((indices:float() - kthIndices:float()):abs():max(), 0)
+end
+
+function test_stream()
+  -- small tiles, so each op takes several, with a short last one
+  cltorch.setStreamTileSize(1000)
+  local a = torch.FloatTensor(4500):uniform()
+  local b = torch.FloatTensor(4500):uniform()
+  local res = torch.FloatTensor(4500):fill(1)
+  cltorch.streamMap3(res, a, b, '*out = *out + *in1 * *in2 + val1', 3)
+  luaunit.assertTrue((res - (torch.cmul(a, b) + 4)):abs():max() < 0.0001)
+
+  local m1 = torch.FloatTensor(70, 30):uniform()
+  local m2 = torch.FloatTensor(30, 40):uniform()
+  local t = torch.FloatTensor(70, 40):uniform()
+  local r = torch.FloatTensor()
+  cltorch.streamAddmm(r, 0.5, t, 2, m1, m2)
+  luaunit.assertTrue((r - torch.addmm(0.5, t, 2, m1, m2)):abs():max() < 0.001)
+  cltorch.streamAddmm(r, 0, t, 1, m1, m2)
+  luaunit.assertTrue((r - m1 * m2):abs():max() < 0.001)
+  cltorch.setStreamTileSize(0)
+end
+
+function test_graph()
+  local a = torch.ClTensor(10, 3):fill(1)
+  local b = torch.ClTensor(10, 3):fill(2)
+  local c = torch.ClTensor(10, 3)
+  cltorch.beginGraphCapture()
+  a:add(1)
+  c:cmul(a, b)
+  local graph = cltorch.endGraphCapture()
+  luaunit.assertEquals(graph:numNodes(), 2)
+  luaunit.assertEquals(graph:numScalars(), 1)
+  luaunit.assertEquals(c:float():min(), 4)
+
+  graph:replay()
+  luaunit.assertEquals(a:float():min(), 3)
+  luaunit.assertEquals(c:float():max(), 6)
+
+  graph:setScalar(1, 10)
+  graph:replay()
+  luaunit.assertEquals(a:float():min(), 13)
+  luaunit.assertEquals(c:float():max(), 26)
+
+  local b2 = torch.ClTensor(10, 3):fill(-1)
+  graph:updateTensor(b, b2)
+  graph:replay()
+  luaunit.assertEquals(c:float():max(), -23)
+  graph:free()
+end
+
 os.exit( luaunit.LuaUnit.run() )
 
 
@@ -756,7 +756,7 @@ static int torch_Tensor_(__newindex__)(lua_State *L)
       luaL_error(L,"number or tensor expected");
     }
   }
-  else if((maskCl = luaT_toudata(L, 2, "torch.ClTensor")))
+  else if((maskCl = luaT_toudata(L, 2, "torch.ClTensor")) || (maskCl = luaT_toudata(L, 2, "torch.ClByteTensor")))
   {
     THTensor *vals;
     if (lua_isnumber(L, 3))
@@ -899,7 +899,7 @@ static int torch_Tensor_(__index__)(lua_State *L)
     lua_pushboolean(L, 1);
     return 2;
   }
-  else if((maskCl = luaT_toudata(L, 2, "torch.ClTensor")))
+  else if((maskCl = luaT_toudata(L, 2, "torch.ClTensor")) || (maskCl = luaT_toudata(L, 2, "torch.ClByteTensor")))
   {
     THTensor *vals = THTensor_(new)(state);
     THTensor_(maskedSelect)(state, vals, tensor, maskCl);